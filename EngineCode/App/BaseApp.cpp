@@ -1,5 +1,6 @@
 #include "BaseApp.hpp"
 #include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
 #include "EngineCode/Renderer/BaseRenderer.hpp"
 #include "EngineCode/Window/BaseWindow.hpp"
 
@@ -25,7 +26,10 @@ BaseApp::~BaseApp()
 //---------------------------------------------------------------------------------------------------
 void BaseApp::Run()
 {
-	Initialize();
+	{
+		PROFILE_ZONE("App::Initialize");
+		Initialize();
+	}
 	MainLoop();
 }
 
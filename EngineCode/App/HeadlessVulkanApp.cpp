@@ -0,0 +1,117 @@
+#include "HeadlessVulkanApp.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include "EngineCode/Renderer/VulkanRenderer.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+
+//---------------------------------------------------------------------------------------------------
+HeadlessVulkanApp::HeadlessVulkanApp(uint32_t width, uint32_t height, uint32_t frameCount, const std::string& outputPath, float frameBudgetMilliseconds)
+	: BaseApp()
+	, m_width(width)
+	, m_height(height)
+	, m_frameCount(frameCount)
+	, m_outputPath(outputPath)
+	, m_frameBudgetMilliseconds(frameBudgetMilliseconds)
+	, m_framesReceived(0)
+{
+	m_vulkanRenderer	= new VulkanRenderer(this);
+	m_renderer			= m_vulkanRenderer;
+}
+
+//---------------------------------------------------------------------------------------------------
+HeadlessVulkanApp::~HeadlessVulkanApp()
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+void HeadlessVulkanApp::Initialize()
+{
+	m_vulkanRenderer->SetHeadless(m_width, m_height);
+	if (m_frameBudgetMilliseconds > 0.0f)
+	{
+		DynamicResolutionSettings settings;
+		settings.frameBudgetMilliseconds = m_frameBudgetMilliseconds;
+		m_vulkanRenderer->SetDynamicResolution(true, settings);
+	}
+	m_vulkanRenderer->SetFrameReadyCallback([this](const uint8_t* pixels, uint32_t width, uint32_t height, uint64_t frameNumber)
+	{
+		OnFrameReady(pixels, width, height, frameNumber);
+	});
+	m_renderer->Initialize(nullptr);
+	s_isRunning = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void HeadlessVulkanApp::MainLoop()
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < m_frameCount && s_isRunning; ++i)
+	{
+		PROFILE_FRAME_MARK();
+		m_renderer->Update();
+		m_renderer->Draw();
+	}
+	m_vulkanRenderer->FlushReadbacks();
+
+	auto endTime	= std::chrono::high_resolution_clock::now();
+	double totalMs	= std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	std::cout << "headless: " << m_framesReceived << " frames at " << m_width << "x" << m_height << " in " << totalMs << " ms";
+	if (m_framesReceived > 0)
+	{
+		std::cout << " (" << totalMs / m_framesReceived << " ms/frame)";
+	}
+	std::cout << std::endl;
+	if (m_vulkanRenderer->IsDynamicResolution())
+	{
+		std::cout << "headless: finished at a render scale of " << m_vulkanRenderer->GetRenderScale() << std::endl;
+	}
+	m_vulkanRenderer->GetGpuProfiler().PrintStats();
+
+	WriteLastFrame();
+	s_isRunning = false;
+}
+
+//---------------------------------------------------------------------------------------------------
+void HeadlessVulkanApp::OnFrameReady(const uint8_t* pixels, uint32_t width, uint32_t height, uint64_t frameNumber)
+{
+	PROFILE_FUNCTION();
+	UNUSED(frameNumber);
+	++m_framesReceived;
+
+	// Only the final image is kept, copying every frame would turn a GPU benchmark into a memcpy one
+	if (m_framesReceived == m_frameCount && !m_outputPath.empty())
+	{
+		m_width		= width;
+		m_height	= height;
+		m_lastFrame.assign(pixels, pixels + (size_t)width * height * 4);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void HeadlessVulkanApp::WriteLastFrame() const
+{
+	if (m_lastFrame.empty())
+	{
+		return;
+	}
+
+	std::ofstream file(m_outputPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "headless: failed to open " << m_outputPath << " for writing" << std::endl;
+		return;
+	}
+
+	// PPM has no alpha channel, RGBA8 is written out as RGB8
+	file << "P6\n" << m_width << " " << m_height << "\n255\n";
+	for (size_t i = 0; i < m_lastFrame.size(); i += 4)
+	{
+		file.write(reinterpret_cast<const char*>(&m_lastFrame[i]), 3);
+	}
+	std::cout << "headless: wrote " << m_outputPath << std::endl;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef _APP_HEADLESS_VULKAN_H_
+#define _APP_HEADLESS_VULKAN_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "BaseApp.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class VulkanRenderer;
+
+//---------------------------------------------------------------------------------------------------
+// Renders a fixed number of frames without a window, for CI, render farms and benchmarks. The last
+// frame read back is written to outputPath as a binary PPM, nothing is written for an empty path.
+// A frame budget above zero turns on dynamic resolution with that many milliseconds of GPU time a frame.
+class HeadlessVulkanApp : public BaseApp
+{
+public:
+	HeadlessVulkanApp(uint32_t width, uint32_t height, uint32_t frameCount, const std::string& outputPath, float frameBudgetMilliseconds = 0.0f);
+	virtual ~HeadlessVulkanApp();
+
+protected:
+	virtual void Initialize();
+	virtual void MainLoop();
+
+private:
+	void					OnFrameReady(const uint8_t* pixels, uint32_t width, uint32_t height, uint64_t frameNumber);
+	void					WriteLastFrame() const;
+
+public:
+	static const uint32_t	DEFAULT_FRAME_COUNT	= 100;
+
+private:
+	VulkanRenderer*			m_vulkanRenderer;
+	uint32_t				m_width;
+	uint32_t				m_height;
+	uint32_t				m_frameCount;
+	std::string				m_outputPath;
+	float					m_frameBudgetMilliseconds;
+	std::vector<uint8_t>	m_lastFrame;
+	uint64_t				m_framesReceived;
+};
+#endif // !_APP_HEADLESS_VULKAN_H_
@@ -1,15 +1,18 @@
 #include "Win32VulkanApp.hpp"
 #include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
 #include "EngineCode/Window/GlfwWindow.hpp"
 #include "EngineCode/Renderer/VulkanRenderer.hpp"
 
 
 //---------------------------------------------------------------------------------------------------
-Win32VulkanApp::Win32VulkanApp()
+Win32VulkanApp::Win32VulkanApp(float frameBudgetMilliseconds)
 	: BaseApp()
+	, m_frameBudgetMilliseconds(frameBudgetMilliseconds)
 {
-	m_window	= new GlfwWindow(this);
-	m_renderer	= new VulkanRenderer(this);
+	m_window			= new GlfwWindow(this);
+	m_vulkanRenderer	= new VulkanRenderer(this);
+	m_renderer			= m_vulkanRenderer;
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -22,6 +25,12 @@ Win32VulkanApp::~Win32VulkanApp()
 void Win32VulkanApp::Initialize()
 {
 	m_window->Initialize();
+	if (m_frameBudgetMilliseconds > 0.0f)
+	{
+		DynamicResolutionSettings settings;
+		settings.frameBudgetMilliseconds = m_frameBudgetMilliseconds;
+		m_vulkanRenderer->SetDynamicResolution(true, settings);
+	}
 	m_renderer->Initialize(m_window);
 }
 
@@ -30,7 +39,11 @@ void Win32VulkanApp::MainLoop()
 {
 	while (s_isRunning)
 	{
-		m_window->Update();
+		PROFILE_FRAME_MARK();
+		{
+			PROFILE_ZONE("PollWindowEvents");
+			m_window->Update();
+		}
 		m_renderer->Update();
 		m_renderer->Draw();
 	}
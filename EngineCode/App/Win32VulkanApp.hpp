@@ -6,11 +6,14 @@
 //---------------------------------------------------------------------------------------------------
 #include "BaseApp.hpp"
 
+class VulkanRenderer;
+
 //---------------------------------------------------------------------------------------------------
+// A frame budget above zero turns on dynamic resolution with that many milliseconds of GPU time a frame
 class Win32VulkanApp : public BaseApp
 {
 public:
-	Win32VulkanApp();
+	Win32VulkanApp(float frameBudgetMilliseconds = 0.0f);
 	virtual ~Win32VulkanApp();
 
 protected:
@@ -19,5 +22,9 @@ protected:
 
 public:
 	void NotifyWindowResize(int width, int height) override;
+
+private:
+	VulkanRenderer*	m_vulkanRenderer;
+	float			m_frameBudgetMilliseconds;
 };
 #endif // !_APP_WIN32_VULKAN_H_
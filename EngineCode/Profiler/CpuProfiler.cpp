@@ -0,0 +1,287 @@
+#include "CpuProfiler.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+
+#if DEEPSRI_PROFILER_ENABLED
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+namespace
+{
+	enum EventType : uint32_t
+	{
+		EVENT_ZONE,
+		EVENT_FRAME_MARK,
+	};
+
+	struct Event
+	{
+		const char*		name;
+		uint64_t		startTicks;
+		uint64_t		endTicks;	// Frame number for EVENT_FRAME_MARK
+		EventType		type;
+	};
+
+	const uint32_t		EVENTS_PER_CHUNK	= 16 * 1024;
+	const uint32_t		MAX_CHUNKS			= 256;	// 4M events, ~128 MiB per thread at most
+
+	struct EventChunk
+	{
+		Event			events[EVENTS_PER_CHUNK];
+	};
+
+	// Written by its own thread only. The event count is published with release semantics after the
+	// event itself, so the exporter never reads a half written event
+	struct ThreadBuffer
+	{
+		std::atomic<EventChunk*>	chunks[MAX_CHUNKS]	= {};
+		std::atomic<uint32_t>		eventCount			{ 0 };
+		std::atomic<uint64_t>		droppedCount		{ 0 };
+		uint32_t					generation			= 0;
+		uint32_t					threadId			= 0;
+		std::string					threadName;
+
+		~ThreadBuffer()
+		{
+			for (auto& chunk : chunks)
+			{
+				delete chunk.load();
+			}
+		}
+	};
+
+	// Where the owning thread writes its next event, kept next to the thread's other TLS so that recording
+	// an event with room left in the chunk touches nothing else. next == end whenever the slow path has to
+	// look at the buffer: no chunk yet, a full one, or a capture that started since
+	struct ThreadCursor
+	{
+		Event*			next		= nullptr;
+		Event*			end			= nullptr;
+		uint32_t		eventCount	= 0;
+		uint32_t		generation	= 0;
+	};
+
+	// Buffers are never freed while the program runs, a thread that exited still has events to export
+	std::mutex									s_registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>>	s_threadBuffers;
+	std::atomic<uint32_t>						s_generation		{ 0 };
+	std::atomic<uint64_t>						s_frameNumber		{ 0 };
+	uint64_t									s_captureStartTicks	= 0;
+	std::chrono::steady_clock::time_point		s_captureStartTime;
+	thread_local ThreadBuffer*					t_threadBuffer		= nullptr;
+	thread_local ThreadCursor					t_cursor;
+
+	//-----------------------------------------------------------------------------------------------
+	ThreadBuffer* GetThreadBuffer()
+	{
+		if (!t_threadBuffer)
+		{
+			std::lock_guard<std::mutex> lock(s_registryMutex);
+			s_threadBuffers.emplace_back(new ThreadBuffer());
+			t_threadBuffer				= s_threadBuffers.back().get();
+			t_threadBuffer->threadId	= (uint32_t)s_threadBuffers.size();
+			t_threadBuffer->generation	= s_generation.load();
+			t_threadBuffer->threadName	= "Thread " + std::to_string(t_threadBuffer->threadId);
+		}
+		return t_threadBuffer;
+	}
+
+	//-----------------------------------------------------------------------------------------------
+	// Once per chunk, capture and thread: finds or allocates the chunk the next event goes to and points
+	// the cursor at its free part. Returns false if the thread ran out of chunks
+	bool AdvanceCursor(ThreadCursor& cursor)
+	{
+		ThreadBuffer* buffer = GetThreadBuffer();
+
+		// A new capture started since this thread last recorded, it clears its own buffer lazily
+		uint32_t generation = s_generation.load(std::memory_order_relaxed);
+		if (buffer->generation != generation)
+		{
+			buffer->generation = generation;
+			buffer->eventCount.store(0, std::memory_order_relaxed);
+			buffer->droppedCount.store(0, std::memory_order_relaxed);
+		}
+		cursor.generation = generation;
+		cursor.eventCount = buffer->eventCount.load(std::memory_order_relaxed);
+
+		uint32_t chunkIndex = cursor.eventCount / EVENTS_PER_CHUNK;
+		if (chunkIndex >= MAX_CHUNKS)
+		{
+			cursor.next = cursor.end = nullptr;
+			buffer->droppedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		EventChunk* chunk = buffer->chunks[chunkIndex].load(std::memory_order_relaxed);
+		if (!chunk)
+		{
+			// Left uninitialized on purpose, zeroing 512 KiB here would be a hitch of its own
+			chunk = new EventChunk;
+			buffer->chunks[chunkIndex].store(chunk, std::memory_order_release);
+		}
+
+		cursor.next	= chunk->events + cursor.eventCount % EVENTS_PER_CHUNK;
+		cursor.end	= chunk->events + EVENTS_PER_CHUNK;
+		return true;
+	}
+
+	//-----------------------------------------------------------------------------------------------
+	// The common case is a generation compare, a 32 byte store and publishing the count
+	void PushEvent(const Event& event)
+	{
+		ThreadCursor& cursor = t_cursor;
+		if ((cursor.next == cursor.end || cursor.generation != s_generation.load(std::memory_order_relaxed)) && !AdvanceCursor(cursor))
+		{
+			return;
+		}
+
+		*cursor.next++ = event;
+		t_threadBuffer->eventCount.store(++cursor.eventCount, std::memory_order_release);
+	}
+
+	//-----------------------------------------------------------------------------------------------
+	void WriteJsonString(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				fputc('\\', file);
+			}
+			fputc((unsigned char)*c < 0x20 ? ' ' : *c, file);
+		}
+		fputc('"', file);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+std::atomic<bool> CpuProfiler::s_isCapturing(false);
+
+//---------------------------------------------------------------------------------------------------
+void CpuProfiler::BeginCapture()
+{
+	s_captureStartTime	= std::chrono::steady_clock::now();
+	s_captureStartTicks	= Now();
+	s_frameNumber.store(0);
+	s_generation.fetch_add(1);
+	s_isCapturing.store(true);
+}
+
+//---------------------------------------------------------------------------------------------------
+void CpuProfiler::EndCapture()
+{
+	s_isCapturing.store(false);
+}
+
+//---------------------------------------------------------------------------------------------------
+void CpuProfiler::SetThreadName(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(s_registryMutex);
+	buffer->threadName = name;
+}
+
+//---------------------------------------------------------------------------------------------------
+void CpuProfiler::MarkFrame()
+{
+	if (!IsCapturing())
+	{
+		return;
+	}
+
+	Event event			= {};
+	event.name			= "Frame";
+	event.startTicks	= Now();
+	event.endTicks		= s_frameNumber.fetch_add(1, std::memory_order_relaxed);
+	event.type			= EVENT_FRAME_MARK;
+	PushEvent(event);
+}
+
+//---------------------------------------------------------------------------------------------------
+void CpuProfiler::RecordZone(const char* name, uint64_t startTicks, uint64_t endTicks)
+{
+	Event event			= {};
+	event.name			= name;
+	event.startTicks	= startTicks;
+	event.endTicks		= endTicks;
+	event.type			= EVENT_ZONE;
+	PushEvent(event);
+}
+
+//---------------------------------------------------------------------------------------------------
+bool CpuProfiler::WriteChromeTrace(const std::string& filePath)
+{
+	// Plain stdio, a long capture is millions of events and iostream formatting dominates otherwise
+	FILE* file = fopen(filePath.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "CPU profiler: failed to open " << filePath << " for writing" << std::endl;
+		return false;
+	}
+
+	// Calibrated over the whole capture, so the error of the two clock reads is spread over its length
+	uint64_t elapsedTicks	= std::max<uint64_t>(1, Now() - s_captureStartTicks);
+	double elapsedNs		= (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_captureStartTime).count();
+	double usPerTick		= elapsedNs / elapsedTicks / 1000.0;
+
+	std::lock_guard<std::mutex> lock(s_registryMutex);
+	uint32_t generation	= s_generation.load();
+	uint64_t eventCount	= 0;
+	uint64_t dropped	= 0;
+	bool isFirst		= true;
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+	for (const auto& buffer : s_threadBuffers)
+	{
+		if (!isFirst)
+		{
+			fputs(",\n", file);
+		}
+		isFirst = false;
+		fprintf(file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->threadId);
+		WriteJsonString(file, buffer->threadName.c_str());
+		fputs("}}", file);
+
+		if (buffer->generation != generation)
+		{
+			continue;
+		}
+
+		uint32_t count = buffer->eventCount.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const Event& event = buffer->chunks[i / EVENTS_PER_CHUNK].load(std::memory_order_acquire)->events[i % EVENTS_PER_CHUNK];
+
+			// Trace timestamps are microseconds, three decimals keep the full nanosecond resolution
+			double timestampUs = (int64_t)(event.startTicks - s_captureStartTicks) * usPerTick;
+			if (event.type == EVENT_FRAME_MARK)
+			{
+				fprintf(file, ",\n{\"ph\":\"i\",\"s\":\"g\",\"name\":\"Frame\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"frame\":%llu}}", buffer->threadId, timestampUs, (unsigned long long)event.endTicks);
+			}
+			else
+			{
+				fputs(",\n{\"ph\":\"X\",\"name\":", file);
+				WriteJsonString(file, event.name);
+				fprintf(file, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->threadId, timestampUs, (event.endTicks - event.startTicks) * usPerTick);
+			}
+		}
+		eventCount	+= count;
+		dropped		+= buffer->droppedCount.load(std::memory_order_relaxed);
+	}
+	fputs("\n]}\n", file);
+	fclose(file);
+
+	std::cout << "CPU profiler: wrote " << eventCount << " events to " << filePath;
+	if (dropped > 0)
+	{
+		std::cout << ", " << dropped << " dropped for lack of buffer space";
+	}
+	std::cout << std::endl;
+	return true;
+}
+#endif // DEEPSRI_PROFILER_ENABLED
@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef _CPU_PROFILER_H_
+#define _CPU_PROFILER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "Main/PrecompiledDefinitions.hpp"
+
+#if DEEPSRI_PROFILER_ENABLED
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEEPSRI_PROFILER_USE_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+//---------------------------------------------------------------------------------------------------
+// Scoped-zone CPU profiler. Every thread appends to its own chunked event buffer, so recording a zone
+// takes no lock and touches no shared cache line: two TSC reads and one 32 byte store. Ticks are
+// converted to nanoseconds against steady_clock over the length of the capture, which assumes an
+// invariant TSC as every x86 CPU of the last decade has. Nothing is recorded outside
+// BeginCapture/EndCapture. The capture is exported as Chrome trace JSON, which both chrome://tracing
+// and ui.perfetto.dev open directly.
+//
+// Zone names are stored by pointer and must outlive the capture, string literals and __FUNCTION__ only.
+class CpuProfiler
+{
+public:
+	// Starts a new capture, dropping whatever the previous one recorded
+	static void					BeginCapture();
+	static void					EndCapture();
+	static bool					IsCapturing()	{ return s_isCapturing.load(std::memory_order_relaxed); }
+
+	// Only call once the capture has ended, threads still recording would race with the export
+	static bool					WriteChromeTrace(const std::string& filePath);
+
+	static void					SetThreadName(const char* name);
+	static void					MarkFrame();
+	static void					RecordZone(const char* name, uint64_t startTicks, uint64_t endTicks);
+
+	// Raw ticks, never 0. steady_clock costs 20 to 40 ns a call on common setups, which alone would
+	// blow the per-zone budget twice over
+	static uint64_t				Now()
+	{
+#if DEEPSRI_PROFILER_USE_TSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+private:
+	static std::atomic<bool>	s_isCapturing;
+};
+
+//---------------------------------------------------------------------------------------------------
+class CpuProfileZone
+{
+public:
+	explicit CpuProfileZone(const char* name)
+		: m_name(name)
+		, m_startTicks(CpuProfiler::IsCapturing() ? CpuProfiler::Now() : 0)
+	{
+
+	}
+
+	~CpuProfileZone()
+	{
+		if (m_startTicks != 0)
+		{
+			CpuProfiler::RecordZone(m_name, m_startTicks, CpuProfiler::Now());
+		}
+	}
+
+	CpuProfileZone(const CpuProfileZone&) = delete;
+	CpuProfileZone& operator=(const CpuProfileZone&) = delete;
+
+private:
+	const char*					m_name;
+	uint64_t					m_startTicks;
+};
+
+//---------------------------------------------------------------------------------------------------
+#define PROFILE_CONCAT_INNER(a, b)	a##b
+#define PROFILE_CONCAT(a, b)		PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name)			CpuProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION()			PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_FRAME_MARK()		CpuProfiler::MarkFrame()
+#define PROFILE_THREAD_NAME(name)	CpuProfiler::SetThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME_MARK()
+#define PROFILE_THREAD_NAME(name)
+
+#endif // DEEPSRI_PROFILER_ENABLED
+#endif // !_CPU_PROFILER_H_
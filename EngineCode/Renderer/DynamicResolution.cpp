@@ -0,0 +1,104 @@
+#include "DynamicResolution.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <cmath>
+
+//---------------------------------------------------------------------------------------------------
+DynamicResolution::DynamicResolution()
+	: m_scale(1.0f)
+	, m_smoothedMilliseconds(0.0)
+	, m_sampleCount(0)
+	, m_overBudgetFrames(0)
+	, m_underBudgetFrames(0)
+	, m_framesToIgnore(0)
+{
+	Reset();
+}
+
+//---------------------------------------------------------------------------------------------------
+void DynamicResolution::SetSettings(const DynamicResolutionSettings& settings)
+{
+	m_settings			= settings;
+	m_settings.minScale	= std::max(SCALE_STEP, std::min(m_settings.minScale, 1.0f));
+	m_settings.maxScale	= std::max(m_settings.minScale, std::min(m_settings.maxScale, 1.0f));
+	m_scale				= ClampScale(m_scale);
+}
+
+//---------------------------------------------------------------------------------------------------
+void DynamicResolution::Reset()
+{
+	m_scale					= ClampScale(m_settings.maxScale);
+	m_smoothedMilliseconds	= 0.0;
+	m_sampleCount			= 0;
+	m_overBudgetFrames		= 0;
+	m_underBudgetFrames		= 0;
+	m_framesToIgnore		= 0;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool DynamicResolution::AddFrameTime(double milliseconds)
+{
+	if (m_framesToIgnore > 0)
+	{
+		--m_framesToIgnore;
+		return false;
+	}
+
+	m_smoothedMilliseconds = m_sampleCount++ == 0 ? milliseconds : m_smoothedMilliseconds + (milliseconds - m_smoothedMilliseconds) * SMOOTHING;
+
+	double budget = m_settings.frameBudgetMilliseconds;
+	if (m_smoothedMilliseconds > budget * m_settings.upperThreshold)
+	{
+		++m_overBudgetFrames;
+		m_underBudgetFrames = 0;
+	}
+	else if (m_smoothedMilliseconds < budget * m_settings.lowerThreshold)
+	{
+		++m_underBudgetFrames;
+		m_overBudgetFrames = 0;
+	}
+	else
+	{
+		m_overBudgetFrames	= 0;
+		m_underBudgetFrames	= 0;
+	}
+
+	bool isShrinking	= m_overBudgetFrames >= std::max(1u, m_settings.shrinkFrames);
+	bool isGrowing		= m_underBudgetFrames >= std::max(1u, m_settings.growFrames);
+	if (!isShrinking && !isGrowing)
+	{
+		return false;
+	}
+	m_overBudgetFrames	= 0;
+	m_underBudgetFrames	= 0;
+
+	// Pixel count goes with the square of the scale
+	double target	= budget * 0.5 * (m_settings.lowerThreshold + m_settings.upperThreshold);
+	double ratio	= std::sqrt(target / std::max(m_smoothedMilliseconds, 0.001));
+	float scale		= (float)(m_scale * ratio);
+	scale			= std::max(m_scale - m_settings.maxStep, std::min(scale, m_scale + m_settings.maxStep));
+	scale			= ClampScale(scale);
+	if (scale == m_scale)
+	{
+		return false;
+	}
+
+	// The average was measured at the old scale, start over once the new one reaches the measurements
+	m_scale					= scale;
+	m_sampleCount			= 0;
+	m_framesToIgnore		= m_settings.latencyFrames;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t DynamicResolution::ScaleSize(uint32_t size) const
+{
+	return std::max(1u, (uint32_t)std::lround(size * m_scale));
+}
+
+//---------------------------------------------------------------------------------------------------
+float DynamicResolution::ClampScale(float scale) const
+{
+	scale = std::round(scale / SCALE_STEP) * SCALE_STEP;
+	return std::max(m_settings.minScale, std::min(scale, m_settings.maxScale));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef _DYNAMIC_RESOLUTION_H_
+#define _DYNAMIC_RESOLUTION_H_
+
+//---------------------------------------------------------------------------------------------------
+#include <cstdint>
+
+//---------------------------------------------------------------------------------------------------
+struct DynamicResolutionSettings
+{
+	float			frameBudgetMilliseconds	= 16.0f;	// GPU time a frame may take
+	float			minScale				= 0.5f;		// Of the output size, per axis
+	float			maxScale				= 1.0f;
+	float			lowerThreshold			= 0.8f;		// Fraction of the budget below which the scale grows
+	float			upperThreshold			= 0.95f;	// Fraction of the budget above which it shrinks
+	uint32_t		shrinkFrames			= 2;		// Consecutive frames over the upper threshold before shrinking
+	uint32_t		growFrames				= 30;		// Consecutive frames under the lower threshold before growing
+	uint32_t		latencyFrames			= 2;		// Frames a new scale takes to show up in the measurements
+	float			maxStep					= 0.15f;	// Largest change of scale in one adjustment
+};
+
+//---------------------------------------------------------------------------------------------------
+// Picks a render scale that keeps measured GPU frame time within a budget. Cost is taken to follow the
+// pixel count, so the scale moves by the square root of the budget over the smoothed frame time, aimed
+// at the middle of the band between the two thresholds. Inside the band nothing changes, and a change
+// has to be asked for by several frames in a row, so noise never makes the resolution oscillate.
+// Shrinking reacts within a couple of frames to avoid a dropped one, growing back waits much longer.
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+
+	void				SetSettings(const DynamicResolutionSettings& settings);
+	const DynamicResolutionSettings&	GetSettings() const	{ return m_settings; }
+
+	// Back to the largest scale with no history
+	void				Reset();
+
+	// One measured GPU frame. Returns true when the scale changed
+	bool				AddFrameTime(double milliseconds);
+
+	float				GetScale() const					{ return m_scale; }
+	double				GetSmoothedFrameTime() const		{ return m_smoothedMilliseconds; }
+
+	// A full size scaled down, never below one
+	uint32_t			ScaleSize(uint32_t size) const;
+
+public:
+	static constexpr float	SCALE_STEP			= 1.0f / 64.0f;	// Scales are snapped to this
+	static constexpr double	SMOOTHING			= 0.25;			// Weight of a new sample in the average
+
+private:
+	float				ClampScale(float scale) const;
+
+private:
+	DynamicResolutionSettings	m_settings;
+	float				m_scale;
+	double				m_smoothedMilliseconds;
+	uint32_t			m_sampleCount;
+	uint32_t			m_overBudgetFrames;
+	uint32_t			m_underBudgetFrames;
+	uint32_t			m_framesToIgnore;	// Still measured at the previous scale
+};
+#endif // !_DYNAMIC_RESOLUTION_H_
@@ -1,8 +1,14 @@
 #include "EngineCode/Renderer/Mesh.hpp"
 #include "Main/PrecompiledDefinitions.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
 //---------------------------------------------------------------------------------------------------
 Mesh::Mesh()
+	: m_vertexBufferId(0)
+	, m_indexBufferId(0)
 {
 
 }
@@ -16,7 +22,101 @@ Mesh::~Mesh()
 //---------------------------------------------------------------------------------------------------
 void Mesh::LoadMesh(const std::string& meshPath)
 {
+	std::ifstream file(meshPath);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open mesh " + meshPath + "!");
+	}
 
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texCoords;
+	std::vector<glm::vec3> normals;
+	std::unordered_map<std::string, uint32_t> cornerVertices;
+	m_vertices.clear();
+	m_indices.clear();
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string keyword;
+		stream >> keyword;
+		if (keyword == "v")
+		{
+			glm::vec3 position;
+			stream >> position.x >> position.y >> position.z;
+			positions.push_back(position);
+		}
+		else if (keyword == "vt")
+		{
+			// OBJ puts the origin at the bottom left, Vulkan samples from the top left
+			glm::vec2 texCoord;
+			stream >> texCoord.x >> texCoord.y;
+			texCoords.push_back(glm::vec2(texCoord.x, 1.0f - texCoord.y));
+		}
+		else if (keyword == "vn")
+		{
+			glm::vec3 normal;
+			stream >> normal.x >> normal.y >> normal.z;
+			normals.push_back(normal);
+		}
+		else if (keyword == "f")
+		{
+			std::vector<uint32_t> polygon;
+			std::string corner;
+			while (stream >> corner)
+			{
+				auto found = cornerVertices.find(corner);
+				if (found != cornerVertices.end())
+				{
+					polygon.push_back(found->second);
+					continue;
+				}
+
+				// position/texCoord/normal, the last two optional, negative indices counting from the end
+				int32_t references[3] = { 0, 0, 0 };
+				std::istringstream cornerStream(corner);
+				std::string reference;
+				for (uint32_t i = 0; i < 3 && std::getline(cornerStream, reference, '/'); ++i)
+				{
+					references[i] = reference.empty() ? 0 : std::stoi(reference);
+				}
+				size_t counts[3] = { positions.size(), texCoords.size(), normals.size() };
+				size_t resolved[3];
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					resolved[i] = references[i] < 0 ? counts[i] + references[i] : (size_t)references[i] - 1;
+					if (references[i] != 0 && resolved[i] >= counts[i])
+					{
+						throw std::runtime_error("failed to load mesh " + meshPath + ", a face refers past the end!");
+					}
+				}
+				if (references[0] == 0)
+				{
+					throw std::runtime_error("failed to load mesh " + meshPath + ", a face corner has no position!");
+				}
+
+				Vertex vertex;
+				vertex.pos			= positions[resolved[0]];
+				vertex.color		= glm::vec3(1.0f);
+				vertex.texCoords	= references[1] != 0 ? texCoords[resolved[1]] : glm::vec2(0.0f);
+				vertex.normal		= references[2] != 0 ? normals[resolved[2]] : glm::vec3(0.0f);
+				vertex.tangent		= glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+				uint32_t index = (uint32_t)m_vertices.size();
+				m_vertices.push_back(vertex);
+				cornerVertices.emplace(corner, index);
+				polygon.push_back(index);
+			}
+
+			for (size_t i = 2; i < polygon.size(); ++i)
+			{
+				m_indices.push_back(polygon[0]);
+				m_indices.push_back(polygon[i - 1]);
+				m_indices.push_back(polygon[i]);
+			}
+		}
+	}
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -24,3 +124,32 @@ void Mesh::InitializeMesh()
 {
 
 }
+
+//---------------------------------------------------------------------------------------------------
+void Mesh::Optimize(float overdrawThreshold)
+{
+	// Levels index the vertices as they were, they have to be built again afterwards
+	m_indices.resize(GetFullIndexCount());
+	m_lods.clear();
+	MeshOptimizer::Optimize(m_vertices, m_indices, overdrawThreshold);
+}
+
+//---------------------------------------------------------------------------------------------------
+MeshCacheStats Mesh::Analyze(uint32_t cacheSize) const
+{
+	return MeshOptimizer::Analyze(m_indices.data(), GetFullIndexCount(), (uint32_t)m_vertices.size(), sizeof(Vertex), cacheSize);
+}
+
+//---------------------------------------------------------------------------------------------------
+void Mesh::BuildLods(float reduction, float maxError)
+{
+	// Levels already built are replaced rather than simplified along with the full mesh
+	m_indices.resize(GetFullIndexCount());
+	m_lods = MeshSimplifier::BuildLodChain(m_vertices.data(), (uint32_t)m_vertices.size(), m_indices, 0, (uint32_t)m_indices.size(), reduction, maxError);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t Mesh::GetFullIndexCount() const
+{
+	return m_lods.empty() ? (uint32_t)m_indices.size() : m_lods[0].indexCount;
+}
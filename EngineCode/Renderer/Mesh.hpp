@@ -5,6 +5,9 @@
 
 //---------------------------------------------------------------------------------------------------
 #include "VertexData.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include <string>
 #include <vector>
 
 //---------------------------------------------------------------------------------------------------
@@ -14,14 +17,29 @@ public:
 	Mesh();
 	~Mesh();
 
+	// Wavefront OBJ: positions, texture coordinates and normals, polygons fanned into triangles.
+	// Every distinct corner becomes one vertex. Throws when the file cannot be read
 	void LoadMesh(const std::string& meshPath);
 	void InitializeMesh();
 
+	// Reorders for the vertex cache, overdraw and vertex fetch, see MeshOptimizer. Drops any levels of detail
+	void Optimize(float overdrawThreshold = MeshOptimizer::DEFAULT_OVERDRAW_THRESHOLD);
+	MeshCacheStats Analyze(uint32_t cacheSize = MeshOptimizer::DEFAULT_CACHE_SIZE) const;	// Of level 0
+
+	// Appends simplified levels to the indices, see MeshSimplifier. Level 0 stays the whole mesh
+	void BuildLods(float reduction = MeshSimplifier::DEFAULT_LOD_REDUCTION, float maxError = MeshSimplifier::DEFAULT_MAX_ERROR);
+
+	const std::vector<Vertex>&		GetVertices() const	{ return m_vertices; }
+	const std::vector<uint32_t>&	GetIndices() const	{ return m_indices; }
+	const std::vector<MeshLod>&		GetLods() const		{ return m_lods; }
+
 private:
+	uint32_t GetFullIndexCount() const;
+
 	std::vector<Vertex>		m_vertices;
 	std::vector<uint32_t>	m_indices;
+	std::vector<MeshLod>	m_lods;			// Empty until BuildLods
 	uint16_t				m_vertexBufferId;
 	uint16_t				m_indexBufferId;
 };
 #endif // !_MESH_H_
-
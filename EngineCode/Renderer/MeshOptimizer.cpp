@@ -0,0 +1,375 @@
+#include "MeshOptimizer.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+//---------------------------------------------------------------------------------------------------
+// One step of a FIFO cache simulated with timestamps: a vertex is cached while fewer than cacheSize
+// misses happened since its own. Returns the misses of the triangle
+static uint32_t SimulateTriangle(const uint32_t* triangle, uint32_t cacheSize, std::vector<uint32_t>& cacheTimestamps, uint32_t& timestamp)
+{
+	uint32_t misses = 0;
+	for (uint32_t corner = 0; corner < 3; ++corner)
+	{
+		uint32_t vertex = triangle[corner];
+		if (timestamp - cacheTimestamps[vertex] > cacheSize)
+		{
+			cacheTimestamps[vertex] = timestamp++;
+			++misses;
+		}
+	}
+	return misses;
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float overdrawThreshold)
+{
+	if (indices.empty())
+	{
+		return;
+	}
+	OptimizeVertexCache(indices.data(), (uint32_t)indices.size(), (uint32_t)vertices.size());
+	OptimizeOverdraw(indices.data(), (uint32_t)indices.size(), vertices.data(), (uint32_t)vertices.size(), overdrawThreshold);
+	OptimizeVertexFetch(vertices, indices.data(), (uint32_t)indices.size());
+}
+
+//---------------------------------------------------------------------------------------------------
+float MeshOptimizer::ScoreVertex(int32_t cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	// The last triangle's vertices score a little lower, so the next one does not strip along a single edge
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		score = cachePosition < 3 ? 0.75f : std::pow(1.0f - (cachePosition - 3) / (float)(SCORE_CACHE_SIZE - 3), 1.5f);
+	}
+
+	// Vertices with few triangles left are finished first, rather than leaving them stranded
+	return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// The triangles of every vertex, packed. A vertex's first remaining[vertex] entries are the ones not yet emitted
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+	{
+		++remaining[indices[i]];
+	}
+	std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		firstTriangle[vertex + 1] = firstTriangle[vertex] + remaining[vertex];
+	}
+	std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+	std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+	{
+		vertexTriangles[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int32_t> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		vertexScores[vertex] = ScoreVertex(-1, remaining[vertex]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		const uint32_t* corners		= indices + triangle * 3;
+		triangleScores[triangle]	= vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+	}
+
+	// Restarts look at the vertices of recently emitted triangles first, then go on from wherever the
+	// last restart in input order left off. Both only ever move forwards, which keeps restarts linear
+	std::vector<bool> isEmitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;
+	deadEnds.reserve(triangleCount * 3);
+	uint32_t inputCursor = 0;
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> nextCache;
+	cache.reserve(SCORE_CACHE_SIZE + 3);
+	nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+	uint32_t bestTriangle = (uint32_t)(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+	for (uint32_t emitted = 0; emitted < triangleCount; ++emitted)
+	{
+		// Nothing in the cache has triangles left, start over from the best triangle of the latest vertex
+		// that still has some, or failing that the next one not emitted yet in input order
+		while (bestTriangle == ~0u && !deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+
+			float bestScore				= -std::numeric_limits<float>::max();
+			const uint32_t* triangles	= &vertexTriangles[firstTriangle[vertex]];
+			for (uint32_t i = 0; i < remaining[vertex]; ++i)
+			{
+				if (triangleScores[triangles[i]] > bestScore)
+				{
+					bestScore		= triangleScores[triangles[i]];
+					bestTriangle	= triangles[i];
+				}
+			}
+		}
+		if (bestTriangle == ~0u)
+		{
+			while (isEmitted[inputCursor])
+			{
+				++inputCursor;
+			}
+			bestTriangle = inputCursor;
+		}
+
+		const uint32_t* corners = indices + bestTriangle * 3;
+		output.insert(output.end(), corners, corners + 3);
+		isEmitted[bestTriangle] = true;
+
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			uint32_t vertex		= corners[corner];
+			uint32_t* triangles	= &vertexTriangles[firstTriangle[vertex]];
+			uint32_t* found		= std::find(triangles, triangles + remaining[vertex], bestTriangle);
+			std::swap(*found, triangles[--remaining[vertex]]);
+			if (remaining[vertex] > 0)
+			{
+				deadEnds.push_back(vertex);
+			}
+		}
+
+		// The triangle's vertices go to the front, whatever falls past the end is evicted
+		nextCache.assign(corners, corners + 3);
+		for (uint32_t vertex : cache)
+		{
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+			{
+				nextCache.push_back(vertex);
+			}
+		}
+		std::swap(cache, nextCache);
+
+		bestTriangle		= ~0u;
+		float bestScore		= -std::numeric_limits<float>::max();
+		for (uint32_t position = 0; position < cache.size(); ++position)
+		{
+			uint32_t vertex					= cache[position];
+			int32_t cachePosition			= position < SCORE_CACHE_SIZE ? (int32_t)position : -1;
+			cachePositions[vertex]			= cachePosition;
+			float score						= ScoreVertex(cachePosition, remaining[vertex]);
+			float scoreChange				= score - vertexScores[vertex];
+			vertexScores[vertex]			= score;
+
+			const uint32_t* triangles = &vertexTriangles[firstTriangle[vertex]];
+			for (uint32_t i = 0; i < remaining[vertex]; ++i)
+			{
+				triangleScores[triangles[i]] += scoreChange;
+				if (triangleScores[triangles[i]] > bestScore)
+				{
+					bestScore		= triangleScores[triangles[i]];
+					bestTriangle	= triangles[i];
+				}
+			}
+		}
+		cache.resize(std::min<size_t>(cache.size(), SCORE_CACHE_SIZE));
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount, float threshold)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	uint32_t timestamp = DEFAULT_CACHE_SIZE + 1;
+
+	// Where every vertex of a triangle misses, the cache order starts on a new patch anyway, so cutting
+	// there costs nothing
+	std::vector<uint32_t> misses(triangleCount);
+	std::vector<uint32_t> hardBoundaries;
+	for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		misses[triangle] = SimulateTriangle(indices + triangle * 3, DEFAULT_CACHE_SIZE, cacheTimestamps, timestamp);
+		if (triangle == 0 || misses[triangle] == 3)
+		{
+			hardBoundaries.push_back(triangle);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Within a patch, cut wherever the part since the last cut is no worse than threshold times the
+	// patch's own ACMR, with the cache starting cold at every cut as it would after reordering
+	std::vector<uint32_t> clusters;
+	for (uint32_t patch = 0; patch + 1 < hardBoundaries.size(); ++patch)
+	{
+		uint32_t begin		= hardBoundaries[patch];
+		uint32_t end		= hardBoundaries[patch + 1];
+		uint32_t patchMisses	= 0;
+		for (uint32_t triangle = begin; triangle < end; ++triangle)
+		{
+			patchMisses += misses[triangle];
+		}
+		float patchThreshold = threshold * patchMisses / (float)(end - begin);
+
+		clusters.push_back(begin);
+		timestamp += DEFAULT_CACHE_SIZE + 1;
+		uint32_t clusterMisses		= 0;
+		uint32_t clusterTriangles	= 0;
+		for (uint32_t triangle = begin; triangle < end; ++triangle)
+		{
+			clusterMisses += SimulateTriangle(indices + triangle * 3, DEFAULT_CACHE_SIZE, cacheTimestamps, timestamp);
+			++clusterTriangles;
+			if (triangle + 1 < end && clusterMisses <= patchThreshold * clusterTriangles)
+			{
+				clusters.push_back(triangle + 1);
+				timestamp			+= DEFAULT_CACHE_SIZE + 1;
+				clusterMisses		= 0;
+				clusterTriangles	= 0;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// A cluster facing away from the middle of the mesh is likely to be in front of whatever else covers
+	// the same pixels, from any view it is seen at all
+	glm::vec3 meshCenter(0.0f);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		meshCenter += vertices[vertex].pos;
+	}
+	meshCenter /= (float)std::max(1u, vertexCount);
+
+	uint32_t clusterCount = (uint32_t)clusters.size() - 1;
+	std::vector<float> sortKeys(clusterCount);
+	for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; ++triangle)
+		{
+			const glm::vec3& a			= vertices[indices[triangle * 3 + 0]].pos;
+			const glm::vec3& b			= vertices[indices[triangle * 3 + 1]].pos;
+			const glm::vec3& c			= vertices[indices[triangle * 3 + 2]].pos;
+			glm::vec3 triangleNormal	= glm::cross(b - a, c - a);
+			float triangleArea			= glm::length(triangleNormal);
+			centroid					+= (a + b + c) * (triangleArea / 3.0f);
+			normal						+= triangleNormal;
+			area						+= triangleArea;
+		}
+		float normalLength	= glm::length(normal);
+		centroid			= area > 0.0f ? centroid / area : centroid;
+		normal				= normalLength > 0.0f ? normal / normalLength : normal;
+		sortKeys[cluster]	= glm::dot(centroid - meshCenter, normal);
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b)
+	{
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	for (uint32_t cluster : order)
+	{
+		output.insert(output.end(), indices + clusters[cluster] * 3, indices + clusters[cluster + 1] * 3);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, uint32_t indexCount)
+{
+	std::vector<uint32_t> remap(vertices.size(), ~0u);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t& newIndex = remap[indices[i]];
+		if (newIndex == ~0u)
+		{
+			newIndex = (uint32_t)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = newIndex;
+	}
+	vertices.swap(reordered);
+	return (uint32_t)vertices.size();
+}
+
+//---------------------------------------------------------------------------------------------------
+MeshCacheStats MeshOptimizer::Analyze(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t vertexStride, uint32_t cacheSize)
+{
+	static const uint32_t LINE_SIZE			= 64;
+	static const uint32_t LINE_CACHE_SIZE	= 64;	// 4 KB, roughly what a vertex fetch unit keeps close
+
+	MeshCacheStats stats;
+	stats.triangleCount = indexCount / 3;
+
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<bool> isReferenced(vertexCount, false);
+	uint32_t timestamp = cacheSize + 1;
+
+	// Lines are keyed by their index in the vertex buffer, simulated the same way as the vertex cache
+	uint32_t lineCount = (uint32_t)(((uint64_t)vertexCount * vertexStride + LINE_SIZE - 1) / LINE_SIZE);
+	std::vector<uint32_t> lineTimestamps(lineCount, 0);
+	uint32_t lineTimestamp = LINE_CACHE_SIZE + 1;
+	uint32_t fetchedLines = 0;
+
+	for (uint32_t i = 0; i < stats.triangleCount * 3; ++i)
+	{
+		uint32_t vertex = indices[i];
+		if (!isReferenced[vertex])
+		{
+			isReferenced[vertex] = true;
+			++stats.vertexCount;
+		}
+		if (timestamp - cacheTimestamps[vertex] <= cacheSize)
+		{
+			continue;
+		}
+		cacheTimestamps[vertex] = timestamp++;
+		++stats.transformedCount;
+
+		uint64_t firstByte = (uint64_t)vertex * vertexStride;
+		for (uint64_t line = firstByte / LINE_SIZE; line <= (firstByte + vertexStride - 1) / LINE_SIZE; ++line)
+		{
+			if (lineTimestamp - lineTimestamps[line] > LINE_CACHE_SIZE)
+			{
+				lineTimestamps[line] = lineTimestamp++;
+				++fetchedLines;
+			}
+		}
+	}
+
+	if (stats.triangleCount > 0)
+	{
+		stats.acmr		= stats.transformedCount / (float)stats.triangleCount;
+		stats.atvr		= stats.transformedCount / (float)stats.vertexCount;
+		stats.overfetch	= fetchedLines * LINE_SIZE / (float)((uint64_t)stats.vertexCount * vertexStride);
+	}
+	return stats;
+}
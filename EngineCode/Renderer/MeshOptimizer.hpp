@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "VertexData.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// What the post-transform cache and vertex fetch of a triangle list cost, see MeshOptimizer::Analyze
+struct MeshCacheStats
+{
+	uint32_t				triangleCount		= 0;
+	uint32_t				vertexCount			= 0;	// Referenced by the indices
+	uint32_t				transformedCount	= 0;	// Vertex shader invocations, i.e. cache misses
+	float					acmr				= 0.0f;	// Average cache miss ratio, transformed per triangle. 0.5 at best, 3 at worst
+	float					atvr				= 0.0f;	// Average transformed vertex ratio, transformed per vertex. 1 at best
+	float					overfetch			= 0.0f;	// Bytes fetched from memory per vertex byte. 1 at best
+};
+
+//---------------------------------------------------------------------------------------------------
+// Reorders imported meshes for the GPU, in three passes run in this order by Optimize:
+//  - vertex cache: triangles reordered after Forsyth's linear-speed optimization, so consecutive
+//    triangles share vertices still in the post-transform cache,
+//  - overdraw: the cache-ordered list cut into clusters where that costs little cache efficiency, the
+//    clusters then drawn front-most first as seen from outside the mesh from any direction (Sander et
+//    al., view-independent occlusion sort), so later triangles fail the depth test more often,
+//  - vertex fetch: vertices renumbered in the order the indices first use them, so fetches walk memory
+//    forwards.
+// Indices are 32-bit and local to the mesh, vertexCount being one past the highest.
+class MeshOptimizer
+{
+public:
+	static const uint32_t	DEFAULT_CACHE_SIZE			= 16;	// FIFO entries simulated by Analyze and the overdraw pass
+	static const uint32_t	SCORE_CACHE_SIZE			= 32;	// LRU entries Forsyth's scoring models
+	static constexpr float	DEFAULT_OVERDRAW_THRESHOLD	= 1.05f;	// ACMR the overdraw pass may give up, as a factor
+
+	// All three passes, in place
+	static void				Optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float overdrawThreshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+	static void				OptimizeVertexCache(uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+	static void				OptimizeOverdraw(uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount, float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+	// Unreferenced vertices are dropped, returns how many are left
+	static uint32_t			OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, uint32_t indexCount);
+
+	// Simulates a FIFO post-transform cache of cacheSize entries and 64-byte memory lines for vertices of vertexStride bytes
+	static MeshCacheStats	Analyze(const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount, uint32_t vertexStride = sizeof(Vertex), uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+private:
+	static float			ScoreVertex(int32_t cachePosition, uint32_t remainingTriangles);
+};
+#endif // !_MESH_OPTIMIZER_H_
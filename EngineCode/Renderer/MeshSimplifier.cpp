@@ -0,0 +1,472 @@
+#include "MeshSimplifier.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "MeshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+//---------------------------------------------------------------------------------------------------
+// Planes through open edges upright on their triangle count this much more than the triangles' own,
+// per area, so borders and seams hold their outline while the surface around them collapses
+static const float BORDER_PLANE_WEIGHT = 10.0f;
+
+//---------------------------------------------------------------------------------------------------
+std::vector<MeshLod> MeshSimplifier::BuildLodChain(const Vertex* vertices, uint32_t vertexCount, std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, float reduction, float maxError)
+{
+	std::vector<MeshLod> lods(1);
+	lods[0].firstIndex	= firstIndex;
+	lods[0].indexCount	= indexCount;
+	if (indexCount == 0)
+	{
+		return lods;
+	}
+
+	// Errors are object space distances, the limit scales with what the range covers
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for (uint32_t index = firstIndex; index < firstIndex + indexCount; ++index)
+	{
+		boundsMin = glm::min(boundsMin, vertices[indices[index]].pos);
+		boundsMax = glm::max(boundsMax, vertices[indices[index]].pos);
+	}
+	float errorLimit = maxError * glm::length(boundsMax - boundsMin);
+
+	std::vector<uint32_t> source(indices.begin() + firstIndex, indices.begin() + firstIndex + indexCount);
+	std::vector<uint32_t> simplified;
+	while (lods.size() < MAX_LOD_COUNT && lods.back().error < errorLimit)
+	{
+		uint32_t targetIndexCount	= (uint32_t)(source.size() / 3 * reduction) * 3;
+		float levelError			= 0.0f;
+		simplified.resize(source.size());
+		uint32_t count = Simplify(simplified.data(), source.data(), (uint32_t)source.size(), vertices, vertexCount, targetIndexCount, errorLimit - lods.back().error, &levelError);
+		if (count == 0 || count > source.size() * MIN_LOD_REDUCTION)
+		{
+			break;
+		}
+
+		// Collapses leave triangles in the full mesh's order, which no longer suits the cache
+		MeshOptimizer::OptimizeVertexCache(simplified.data(), count, vertexCount);
+
+		// Each level is measured against the one it was made from, so errors add up along the chain
+		MeshLod lod;
+		lod.firstIndex	= (uint32_t)indices.size();
+		lod.indexCount	= count;
+		lod.error		= lods.back().error + levelError;
+		lods.push_back(lod);
+
+		simplified.resize(count);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		source.swap(simplified);
+	}
+	return lods;
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t MeshSimplifier::Simplify(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount, uint32_t targetIndexCount, float targetError, float* error)
+{
+	std::vector<uint32_t> result(indices, indices + indexCount);
+	uint32_t resultCount	= indexCount - indexCount % 3;
+	float maxError			= 0.0f;
+
+	// Vertices at the same position: remap points at the first of them, wedge links them into a ring
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint32_t> wedge(vertexCount);
+	std::vector<uint32_t> order(vertexCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [vertices](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& lhs = vertices[a].pos;
+		const glm::vec3& rhs = vertices[b].pos;
+		return lhs.x != rhs.x ? lhs.x < rhs.x : (lhs.y != rhs.y ? lhs.y < rhs.y : lhs.z < rhs.z);
+	});
+	for (uint32_t first = 0; first < vertexCount;)
+	{
+		uint32_t last = first + 1;
+		while (last < vertexCount && vertices[order[last]].pos == vertices[order[first]].pos)
+		{
+			++last;
+		}
+		for (uint32_t i = first; i < last; ++i)
+		{
+			remap[order[i]] = order[first];
+			wedge[order[i]] = order[i + 1 < last ? i + 1 : first];
+		}
+		first = last;
+	}
+
+	EdgeAdjacency adjacency;
+	BuildAdjacency(adjacency, result.data(), resultCount, vertexCount);
+
+	// An open edge has no twin running the other way. At a border not even between other vertices at the
+	// same positions, otherwise it runs along a seam
+	std::vector<uint32_t> openOut(vertexCount, 0);
+	std::vector<uint32_t> openIn(vertexCount, 0);
+	std::vector<uint32_t> borderEdges(vertexCount, 0);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		for (uint32_t edge = adjacency.offsets[vertex]; edge < adjacency.offsets[vertex + 1]; ++edge)
+		{
+			uint32_t target = adjacency.targets[edge];
+			if (!HasEdge(adjacency, target, vertex))
+			{
+				++openOut[vertex];
+				++openIn[target];
+				if (!HasPositionEdge(adjacency, remap, wedge, target, vertex))
+				{
+					++borderEdges[vertex];
+					++borderEdges[target];
+				}
+			}
+		}
+	}
+
+	std::vector<uint8_t> kinds(vertexCount, VERTEX_KIND_LOCKED);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		uint32_t other		= wedge[vertex];
+		bool isChain		= openOut[vertex] == 1 && openIn[vertex] == 1;
+		if (other == vertex && openOut[vertex] == 0 && openIn[vertex] == 0)
+		{
+			kinds[vertex] = VERTEX_KIND_MANIFOLD;
+		}
+		else if (other == vertex && isChain && borderEdges[vertex] == 2)
+		{
+			kinds[vertex] = VERTEX_KIND_BORDER;
+		}
+		else if (other != vertex && wedge[other] == vertex && isChain && openOut[other] == 1 && openIn[other] == 1 && borderEdges[vertex] == 0 && borderEdges[other] == 0)
+		{
+			kinds[vertex] = VERTEX_KIND_SEAM;
+		}
+	}
+
+	// One quadric per position, shared by every vertex there
+	std::vector<Quadric> quadrics(vertexCount);
+	memset(quadrics.data(), 0, sizeof(Quadric) * quadrics.size());
+	for (uint32_t triangle = 0; triangle < resultCount; triangle += 3)
+	{
+		const uint32_t* corners	= &result[triangle];
+		glm::vec3 normal		= glm::cross(vertices[corners[1]].pos - vertices[corners[0]].pos, vertices[corners[2]].pos - vertices[corners[0]].pos);
+		float length			= glm::length(normal);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+		normal /= length;
+
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			AddPlane(quadrics[remap[corners[corner]]], normal, -glm::dot(normal, vertices[corners[0]].pos), length * 0.5f);
+
+			uint32_t from	= corners[corner];
+			uint32_t to		= corners[(corner + 1) % 3];
+			if (HasEdge(adjacency, to, from))
+			{
+				continue;
+			}
+
+			glm::vec3 edge			= vertices[to].pos - vertices[from].pos;
+			glm::vec3 edgeNormal	= glm::cross(edge, normal);
+			float edgeNormalLength	= glm::length(edgeNormal);
+			if (edgeNormalLength > 0.0f)
+			{
+				edgeNormal /= edgeNormalLength;
+				float distance = -glm::dot(edgeNormal, vertices[from].pos);
+				AddPlane(quadrics[remap[from]], edgeNormal, distance, glm::dot(edge, edge) * BORDER_PLANE_WEIGHT);
+				AddPlane(quadrics[remap[to]], edgeNormal, distance, glm::dot(edge, edge) * BORDER_PLANE_WEIGHT);
+			}
+		}
+	}
+
+	// Whether from may collapse onto to given the current triangles, and where from's wedge goes then
+	auto canCollapse = [&](uint32_t from, uint32_t to, uint32_t& wedgeTo)
+	{
+		wedgeTo = to;
+		if (remap[from] == remap[to])
+		{
+			return false;
+		}
+
+		switch (kinds[from])
+		{
+		case VERTEX_KIND_MANIFOLD:
+			return true;
+
+		case VERTEX_KIND_BORDER:
+			return (kinds[to] == VERTEX_KIND_BORDER || kinds[to] == VERTEX_KIND_LOCKED)
+				&& ((HasEdge(adjacency, from, to) && !HasPositionEdge(adjacency, remap, wedge, to, from)) || (HasEdge(adjacency, to, from) && !HasPositionEdge(adjacency, remap, wedge, from, to)));
+
+		case VERTEX_KIND_SEAM:
+		{
+			bool isSeamEdge = (HasEdge(adjacency, from, to) && !HasEdge(adjacency, to, from) && HasPositionEdge(adjacency, remap, wedge, to, from))
+				|| (HasEdge(adjacency, to, from) && !HasEdge(adjacency, from, to) && HasPositionEdge(adjacency, remap, wedge, from, to));
+			if ((kinds[to] != VERTEX_KIND_SEAM && kinds[to] != VERTEX_KIND_LOCKED) || !isSeamEdge)
+			{
+				return false;
+			}
+
+			// The other side of the seam has to run between the same two positions
+			uint32_t other = wedge[from];
+			for (uint32_t candidate = wedge[to]; candidate != to; candidate = wedge[candidate])
+			{
+				if (HasEdge(adjacency, other, candidate) || HasEdge(adjacency, candidate, other))
+				{
+					wedgeTo = candidate;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		default:
+			return false;
+		}
+	};
+
+	// Cheapest collapses first, each position moving or being moved onto at most once per pass so the
+	// costs computed at the start of the pass hold
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<uint8_t> isTouched(vertexCount);
+	float errorLimit = targetError * targetError;
+	while (resultCount > targetIndexCount)
+	{
+		collapses.clear();
+		for (uint32_t triangle = 0; triangle < resultCount; triangle += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				uint32_t ends[2] = { result[triangle + corner], result[triangle + (corner + 1) % 3] };
+				for (uint32_t direction = 0; direction < 2; ++direction)
+				{
+					Collapse collapse;
+					collapse.from	= ends[direction];
+					collapse.to		= ends[1 - direction];
+					if (canCollapse(collapse.from, collapse.to, collapse.wedgeTo))
+					{
+						Quadric quadric = quadrics[remap[collapse.from]];
+						AddQuadric(quadric, quadrics[remap[collapse.to]]);
+						collapse.error = GetError(quadric, vertices[collapse.to].pos);
+						collapses.push_back(collapse);
+					}
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		std::iota(collapseRemap.begin(), collapseRemap.end(), 0);
+		std::fill(isTouched.begin(), isTouched.end(), (uint8_t)0);
+		uint32_t triangleCount	= resultCount / 3;
+		uint32_t collapseCount	= 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (triangleCount <= targetIndexCount / 3 || collapse.error > errorLimit)
+			{
+				break;
+			}
+
+			uint32_t from	= collapse.from;
+			uint32_t to		= collapse.to;
+			bool isSeam		= kinds[from] == VERTEX_KIND_SEAM;
+			if (isTouched[remap[from]] || isTouched[remap[to]])
+			{
+				continue;
+			}
+			if (HasFlip(adjacency, result.data(), remap, collapseRemap, vertices, from, to) || (isSeam && HasFlip(adjacency, result.data(), remap, collapseRemap, vertices, wedge[from], collapse.wedgeTo)))
+			{
+				continue;
+			}
+
+			collapseRemap[from] = to;
+			if (isSeam)
+			{
+				collapseRemap[wedge[from]] = collapse.wedgeTo;
+			}
+			isTouched[remap[from]]	= 1;
+			isTouched[remap[to]]	= 1;
+			AddQuadric(quadrics[remap[to]], quadrics[remap[from]]);
+
+			// An interior edge or a seam takes a triangle on either side with it, a border edge only one
+			maxError		= std::max(maxError, collapse.error);
+			triangleCount	-= std::min(triangleCount, kinds[from] == VERTEX_KIND_BORDER ? 1u : 2u);
+			++collapseCount;
+		}
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Triangles that lost an edge are gone, whichever vertices at those positions they used
+		uint32_t writeCount = 0;
+		for (uint32_t triangle = 0; triangle < resultCount; triangle += 3)
+		{
+			uint32_t a = collapseRemap[result[triangle + 0]];
+			uint32_t b = collapseRemap[result[triangle + 1]];
+			uint32_t c = collapseRemap[result[triangle + 2]];
+			if (remap[a] != remap[b] && remap[b] != remap[c] && remap[c] != remap[a])
+			{
+				result[writeCount + 0] = a;
+				result[writeCount + 1] = b;
+				result[writeCount + 2] = c;
+				writeCount += 3;
+			}
+		}
+		resultCount = writeCount;
+		BuildAdjacency(adjacency, result.data(), resultCount, vertexCount);
+	}
+
+	std::copy(result.begin(), result.begin() + resultCount, destination);
+	if (error)
+	{
+		*error = std::sqrt(maxError);
+	}
+	return resultCount;
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshSimplifier::AddPlane(Quadric& quadric, const glm::vec3& normal, float distance, float weight)
+{
+	double x = normal.x;
+	double y = normal.y;
+	double z = normal.z;
+	double d = distance;
+	double w = weight;
+
+	quadric.a00		+= w * x * x;
+	quadric.a01		+= w * x * y;
+	quadric.a02		+= w * x * z;
+	quadric.a11		+= w * y * y;
+	quadric.a12		+= w * y * z;
+	quadric.a22		+= w * z * z;
+	quadric.b0		+= w * x * d;
+	quadric.b1		+= w * y * d;
+	quadric.b2		+= w * z * d;
+	quadric.c		+= w * d * d;
+	quadric.weight	+= w;
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshSimplifier::AddQuadric(Quadric& quadric, const Quadric& other)
+{
+	quadric.a00		+= other.a00;
+	quadric.a01		+= other.a01;
+	quadric.a02		+= other.a02;
+	quadric.a11		+= other.a11;
+	quadric.a12		+= other.a12;
+	quadric.a22		+= other.a22;
+	quadric.b0		+= other.b0;
+	quadric.b1		+= other.b1;
+	quadric.b2		+= other.b2;
+	quadric.c		+= other.c;
+	quadric.weight	+= other.weight;
+}
+
+//---------------------------------------------------------------------------------------------------
+float MeshSimplifier::GetError(const Quadric& quadric, const glm::vec3& position)
+{
+	if (quadric.weight <= 0.0)
+	{
+		return 0.0f;
+	}
+
+	double x = position.x;
+	double y = position.y;
+	double z = position.z;
+	double error = quadric.a00 * x * x + quadric.a11 * y * y + quadric.a22 * z * z
+		+ 2.0 * (quadric.a01 * x * y + quadric.a02 * x * z + quadric.a12 * y * z)
+		+ 2.0 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z)
+		+ quadric.c;
+
+	// Rounding can take a point on every plane slightly below zero
+	return (float)(std::max(error, 0.0) / quadric.weight);
+}
+
+//---------------------------------------------------------------------------------------------------
+void MeshSimplifier::BuildAdjacency(EdgeAdjacency& adjacency, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		++adjacency.offsets[indices[i] + 1];
+	}
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		adjacency.offsets[vertex + 1] += adjacency.offsets[vertex];
+	}
+
+	adjacency.targets.resize(indexCount);
+	adjacency.triangles.resize(indexCount);
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for (uint32_t triangle = 0; triangle < indexCount / 3; ++triangle)
+	{
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			uint32_t slot					= fill[indices[triangle * 3 + corner]]++;
+			adjacency.targets[slot]			= indices[triangle * 3 + (corner + 1) % 3];
+			adjacency.triangles[slot]		= triangle;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+bool MeshSimplifier::HasEdge(const EdgeAdjacency& adjacency, uint32_t from, uint32_t to)
+{
+	for (uint32_t edge = adjacency.offsets[from]; edge < adjacency.offsets[from + 1]; ++edge)
+	{
+		if (adjacency.targets[edge] == to)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool MeshSimplifier::HasPositionEdge(const EdgeAdjacency& adjacency, const std::vector<uint32_t>& remap, const std::vector<uint32_t>& wedge, uint32_t from, uint32_t to)
+{
+	uint32_t vertex = from;
+	do
+	{
+		for (uint32_t edge = adjacency.offsets[vertex]; edge < adjacency.offsets[vertex + 1]; ++edge)
+		{
+			if (remap[adjacency.targets[edge]] == remap[to])
+			{
+				return true;
+			}
+		}
+		vertex = wedge[vertex];
+	} while (vertex != from);
+	return false;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool MeshSimplifier::HasFlip(const EdgeAdjacency& adjacency, const uint32_t* indices, const std::vector<uint32_t>& remap, const std::vector<uint32_t>& collapseRemap, const Vertex* vertices, uint32_t from, uint32_t to)
+{
+	// Triangles as this pass's earlier collapses left them, those spanning the edge disappear
+	for (uint32_t edge = adjacency.offsets[from]; edge < adjacency.offsets[from + 1]; ++edge)
+	{
+		const uint32_t* triangle	= &indices[adjacency.triangles[edge] * 3];
+		uint32_t corners[3]			= { collapseRemap[triangle[0]], collapseRemap[triangle[1]], collapseRemap[triangle[2]] };
+		if (remap[corners[0]] == remap[to] || remap[corners[1]] == remap[to] || remap[corners[2]] == remap[to])
+		{
+			continue;
+		}
+
+		glm::vec3 before[3];
+		glm::vec3 after[3];
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			before[corner]	= vertices[corners[corner]].pos;
+			after[corner]	= remap[corners[corner]] == remap[from] ? vertices[to].pos : before[corner];
+		}
+
+		glm::vec3 normalBefore	= glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter	= glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "VertexData.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// One level of detail, a range of the same index buffer as the full mesh over the same vertices
+struct MeshLod
+{
+	uint32_t				firstIndex			= 0;
+	uint32_t				indexCount			= 0;
+	float					error				= 0.0f;	// Object space distance the level may stray from the full mesh
+};
+
+//---------------------------------------------------------------------------------------------------
+// Simplifies imported meshes into chains of levels of detail by quadric error metric edge collapse
+// (Garland and Heckbert). Every vertex carries the sum of the planes of its triangles, a collapse moves
+// one vertex onto a neighbour and costs the distance its planes end up from there, and the cheapest
+// collapses are made first. Vertices only ever move onto other vertices, so levels need no new ones
+// and index the full mesh's vertex range.
+//
+// Vertices sharing a position but not the rest of their attributes form a seam. Borders, edges of a
+// single triangle, may only collapse along themselves, seams the same and only with the vertices on
+// both sides moving together, so neither opens cracks nor smears texture coordinates across. Where
+// either meets another, or more than two vertices share a position, vertices stay where they are.
+class MeshSimplifier
+{
+public:
+	static const uint32_t	MAX_LOD_COUNT			= 8;	// Including the full mesh
+	static constexpr float	DEFAULT_LOD_REDUCTION	= 0.5f;	// Indices each level aims to keep of the one before
+	static constexpr float	MIN_LOD_REDUCTION		= 0.85f;	// A level keeping more than this is not worth its indices
+	static constexpr float	DEFAULT_MAX_ERROR		= 0.05f;	// Of the mesh's extent, for the whole chain
+
+	// Level 0 is the range itself, the simplified levels are appended to indices after each other, each
+	// made from the one before and reordered for the vertex cache. The chain ends at MAX_LOD_COUNT levels,
+	// when a level stops shrinking or when the error summed over the chain would exceed maxError of the extent
+	static std::vector<MeshLod>	BuildLodChain(const Vertex* vertices, uint32_t vertexCount, std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, float reduction = DEFAULT_LOD_REDUCTION, float maxError = DEFAULT_MAX_ERROR);
+
+	// Collapses edges until at most targetIndexCount indices are left or the next collapse would cost
+	// more than targetError, an object space distance. destination may be indices, returns how many
+	// indices it received. error, when given, receives the cost of the most expensive collapse made
+	static uint32_t			Simplify(uint32_t* destination, const uint32_t* indices, uint32_t indexCount, const Vertex* vertices, uint32_t vertexCount, uint32_t targetIndexCount, float targetError, float* error = nullptr);
+
+private:
+	enum VertexKind
+	{
+		VERTEX_KIND_MANIFOLD,	// May collapse onto any neighbour
+		VERTEX_KIND_BORDER,		// Along its border only
+		VERTEX_KIND_SEAM,		// Along its seam only, together with the vertex on the other side
+		VERTEX_KIND_LOCKED,		// Never, other vertices may still collapse onto it
+	};
+
+	// Symmetric 4x4 of summed squared plane distances, weighted, see GetError
+	struct Quadric
+	{
+		double				a00, a01, a02, a11, a12, a22;
+		double				b0, b1, b2;
+		double				c;
+		double				weight;
+	};
+
+	// Outgoing edges of every vertex, one per triangle corner, and the triangle each belongs to
+	struct EdgeAdjacency
+	{
+		std::vector<uint32_t>	offsets;	// vertexCount + 1
+		std::vector<uint32_t>	targets;
+		std::vector<uint32_t>	triangles;
+	};
+
+	struct Collapse
+	{
+		uint32_t			from;
+		uint32_t			to;
+		uint32_t			wedgeTo;	// Where the vertex across a seam goes
+		float				error;
+	};
+
+	static void				AddPlane(Quadric& quadric, const glm::vec3& normal, float distance, float weight);
+	static void				AddQuadric(Quadric& quadric, const Quadric& other);
+	static float			GetError(const Quadric& quadric, const glm::vec3& position);	// Weighted mean squared distance
+
+	static void				BuildAdjacency(EdgeAdjacency& adjacency, const uint32_t* indices, uint32_t indexCount, uint32_t vertexCount);
+	static bool				HasEdge(const EdgeAdjacency& adjacency, uint32_t from, uint32_t to);
+
+	// From any vertex at from's position to any at to's, remap and wedge as Simplify builds them
+	static bool				HasPositionEdge(const EdgeAdjacency& adjacency, const std::vector<uint32_t>& remap, const std::vector<uint32_t>& wedge, uint32_t from, uint32_t to);
+
+	// Whether moving from onto to turns any of from's remaining triangles over
+	static bool				HasFlip(const EdgeAdjacency& adjacency, const uint32_t* indices, const std::vector<uint32_t>& remap, const std::vector<uint32_t>& collapseRemap, const Vertex* vertices, uint32_t from, uint32_t to);
+};
+#endif // !_MESH_SIMPLIFIER_H_
@@ -1,2 +1,4 @@
-@for %%i IN (*.vert; *.tesc; *.tese; *.geom; *.frag; *.comp) DO (%VULKAN_SDK%/Bin32/glslangValidator.exe -V "%%i" -o "%%~ni%%~xi.spv")
+@pushd "%~dp0"
+@for %%i IN (*.vert; *.tesc; *.tese; *.geom; *.frag; *.comp) DO (%VULKAN_SDK%/Bin/glslangValidator.exe -V "%%i" -o "%%~ni%%~xi.spv" || (popd & pause & exit /b 1))
+@popd
 pause
\ No newline at end of file
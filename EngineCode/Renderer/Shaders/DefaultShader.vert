@@ -5,8 +5,13 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
+// Per instance, see InstanceData
+layout(location = 3) in mat4 inInstanceTransform;
+layout(location = 7) in vec4 inInstanceParameters;
+
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 3) out vec4 fragTint;
 
 layout(binding = 0) uniform UniformBufferObject 
 {
@@ -22,7 +27,8 @@ out gl_PerVertex
 
 void main() 
 {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+	gl_Position = ubo.proj * ubo.view * ubo.model * inInstanceTransform * vec4(inPosition, 1.0);
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
+	fragTint = inInstanceParameters;
 }
\ No newline at end of file
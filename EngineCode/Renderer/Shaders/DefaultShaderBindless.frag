@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every texture and storage buffer the renderer knows of, see VulkanBindlessTable
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(set = 1, binding = 1) readonly buffer StorageBuffer
+{
+	uint words[];
+} buffers[];
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterialIndex;
+layout(location = 3) in vec4 fragTint;
+
+layout(location = 0) out vec4 outColor;
+
+void main() 
+{
+    outColor = texture(textures[fragMaterialIndex], fragTexCoord) * fragTint;
+}
\ No newline at end of file
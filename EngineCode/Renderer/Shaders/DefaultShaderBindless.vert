@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+// Per instance, see InstanceData
+layout(location = 3) in mat4 inInstanceTransform;
+layout(location = 7) in vec4 inInstanceParameters;
+layout(location = 8) in uint inInstanceMaterial;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterialIndex;
+layout(location = 3) out vec4 fragTint;
+
+layout(binding = 0) uniform UniformBufferObject 
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+out gl_PerVertex 
+{
+	vec4 gl_Position;
+};
+
+void main() 
+{
+	gl_Position = ubo.proj * ubo.view * ubo.model * inInstanceTransform * vec4(inPosition, 1.0);
+	fragColor = inColor;
+	fragTexCoord = inTexCoord;
+	fragTint = inInstanceParameters;
+	fragMaterialIndex = inInstanceMaterial;
+}
\ No newline at end of file
@@ -0,0 +1,566 @@
+#include "TextureCompressor.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <utility>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DEEPSRI_COMPRESSOR_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//---------------------------------------------------------------------------------------------------
+// Per channel minimum and maximum over the 16 texels of a block
+static void GetBlockBounds(const uint8_t* texels, uint8_t minColor[4], uint8_t maxColor[4])
+{
+#if DEEPSRI_COMPRESSOR_USE_SSE2
+	// A row of the block is one register, four RGBA texels
+	__m128i row0		= _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 0));
+	__m128i row1		= _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 16));
+	__m128i row2		= _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 32));
+	__m128i row3		= _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 48));
+	__m128i minimum		= _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	__m128i maximum		= _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+
+	// Fold the four texels of the register onto the first
+	minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(3, 2, 3, 2)));
+	minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(1, 1, 1, 1)));
+	maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(3, 2, 3, 2)));
+	maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(1, 1, 1, 1)));
+
+	uint32_t packedMin = (uint32_t)_mm_cvtsi128_si32(minimum);
+	uint32_t packedMax = (uint32_t)_mm_cvtsi128_si32(maximum);
+	memcpy(minColor, &packedMin, 4);
+	memcpy(maxColor, &packedMax, 4);
+#else
+	for (uint32_t channel = 0; channel < 4; ++channel)
+	{
+		minColor[channel] = 255;
+		maxColor[channel] = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			minColor[channel] = std::min(minColor[channel], texels[i * 4 + channel]);
+			maxColor[channel] = std::max(maxColor[channel], texels[i * 4 + channel]);
+		}
+	}
+#endif // DEEPSRI_COMPRESSOR_USE_SSE2
+}
+
+//---------------------------------------------------------------------------------------------------
+static uint16_t PackRGB565(const uint8_t* color)
+{
+	uint32_t r = (color[0] * 31 + 127) / 255;
+	uint32_t g = (color[1] * 63 + 127) / 255;
+	uint32_t b = (color[2] * 31 + 127) / 255;
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+//---------------------------------------------------------------------------------------------------
+static void UnpackRGB565(uint16_t packed, uint8_t* color)
+{
+	uint32_t r = (packed >> 11) & 31;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	color[0] = (uint8_t)((r << 3) | (r >> 2));
+	color[1] = (uint8_t)((g << 2) | (g >> 4));
+	color[2] = (uint8_t)((b << 3) | (b >> 2));
+}
+
+//---------------------------------------------------------------------------------------------------
+// Little endian bit stream, the order BC7 fields are laid out in
+struct BlockBitWriter
+{
+	uint8_t*	block;
+	uint32_t	bit;
+
+	void Write(uint32_t value, uint32_t bitCount)
+	{
+		for (uint32_t i = 0; i < bitCount; ++i, ++bit)
+		{
+			block[bit >> 3] |= (uint8_t)(((value >> i) & 1) << (bit & 7));
+		}
+	}
+};
+
+//---------------------------------------------------------------------------------------------------
+std::vector<TextureCompression> TextureCompressor::GetCandidates(TextureContent content)
+{
+	switch (content)
+	{
+	case TEXTURE_CONTENT_COLOR:
+		return { TEXTURE_COMPRESSION_BC7, TEXTURE_COMPRESSION_BC1, TEXTURE_COMPRESSION_NONE };
+	case TEXTURE_CONTENT_COLOR_ALPHA:
+		return { TEXTURE_COMPRESSION_BC7, TEXTURE_COMPRESSION_BC3, TEXTURE_COMPRESSION_NONE };
+	case TEXTURE_CONTENT_NORMAL:
+		return { TEXTURE_COMPRESSION_BC5, TEXTURE_COMPRESSION_NONE };
+	}
+	return { TEXTURE_COMPRESSION_NONE };
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t TextureCompressor::GetBlockSize(TextureCompression compression)
+{
+	switch (compression)
+	{
+	case TEXTURE_COMPRESSION_BC1:
+		return 8;
+	case TEXTURE_COMPRESSION_BC3:
+	case TEXTURE_COMPRESSION_BC5:
+	case TEXTURE_COMPRESSION_BC7:
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t TextureCompressor::GetLevelSize(TextureCompression compression, uint32_t width, uint32_t height)
+{
+	if (compression == TEXTURE_COMPRESSION_NONE)
+	{
+		return width * height * 4;
+	}
+	return ((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(compression);
+}
+
+//---------------------------------------------------------------------------------------------------
+const char* TextureCompressor::GetName(TextureCompression compression)
+{
+	switch (compression)
+	{
+	case TEXTURE_COMPRESSION_BC1:	return "bc1";
+	case TEXTURE_COMPRESSION_BC3:	return "bc3";
+	case TEXTURE_COMPRESSION_BC5:	return "bc5";
+	case TEXTURE_COMPRESSION_BC7:	return "bc7";
+	default:						return "rgba8";
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::BuildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<TextureLevel>& levels)
+{
+	levels.clear();
+	levels.emplace_back();
+	levels[0].width		= width;
+	levels[0].height	= height;
+	levels[0].data.assign(pixels, pixels + (size_t)width * height * 4);
+
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		const TextureLevel& source = levels.back();
+
+		TextureLevel level;
+		level.width		= std::max(1u, source.width / 2);
+		level.height	= std::max(1u, source.height / 2);
+		level.data.resize((size_t)level.width * level.height * 4);
+
+		// 2x2 box filter, the last row or column repeated where the source is odd
+		for (uint32_t y = 0; y < level.height; ++y)
+		{
+			uint32_t y0 = std::min(y * 2, source.height - 1);
+			uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+			for (uint32_t x = 0; x < level.width; ++x)
+			{
+				uint32_t x0 = std::min(x * 2, source.width - 1);
+				uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+				for (uint32_t channel = 0; channel < 4; ++channel)
+				{
+					uint32_t sum =	source.data[(y0 * source.width + x0) * 4 + channel] + source.data[(y0 * source.width + x1) * 4 + channel] +
+									source.data[(y1 * source.width + x0) * 4 + channel] + source.data[(y1 * source.width + x1) * 4 + channel];
+					level.data[(y * level.width + x) * 4 + channel] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+CompressedTexture TextureCompressor::Compress(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCompression compression, uint32_t threadCount)
+{
+	PROFILE_FUNCTION();
+
+	CompressedTexture texture;
+	texture.compression = compression;
+
+	std::vector<TextureLevel> sourceLevels;
+	BuildMipChain(pixels, width, height, sourceLevels);
+	if (compression == TEXTURE_COMPRESSION_NONE)
+	{
+		texture.levels = std::move(sourceLevels);
+		return texture;
+	}
+
+	// One job per block row of every level, so the small levels do not leave threads idle at the end
+	std::vector<std::pair<uint32_t, uint32_t>> jobs;
+	texture.levels.resize(sourceLevels.size());
+	for (uint32_t level = 0; level < sourceLevels.size(); ++level)
+	{
+		texture.levels[level].width		= sourceLevels[level].width;
+		texture.levels[level].height	= sourceLevels[level].height;
+		texture.levels[level].data.resize(GetLevelSize(compression, sourceLevels[level].width, sourceLevels[level].height));
+
+		for (uint32_t blockRow = 0; blockRow < (sourceLevels[level].height + 3) / 4; ++blockRow)
+		{
+			jobs.push_back(std::make_pair(level, blockRow));
+		}
+	}
+
+	std::atomic<uint32_t> nextJob(0);
+	auto worker = [&]()
+	{
+		for (uint32_t job = nextJob++; job < jobs.size(); job = nextJob++)
+		{
+			CompressBlockRow(sourceLevels[jobs[job].first], compression, jobs[job].second, texture.levels[jobs[job].first]);
+		}
+	};
+
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threadCount = std::min(threadCount, (uint32_t)jobs.size());
+
+	// The calling thread is one of the workers
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	return texture;
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::CompressBlockRow(const TextureLevel& source, TextureCompression compression, uint32_t blockRow, TextureLevel& destination)
+{
+	uint32_t blocksWide	= (source.width + 3) / 4;
+	uint32_t blockSize	= GetBlockSize(compression);
+
+	for (uint32_t blockColumn = 0; blockColumn < blocksWide; ++blockColumn)
+	{
+		// Blocks hanging over the edge of the level repeat its last texels
+		uint8_t texels[64];
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			uint32_t sourceY = std::min(blockRow * 4 + y, source.height - 1);
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				uint32_t sourceX = std::min(blockColumn * 4 + x, source.width - 1);
+				memcpy(&texels[(y * 4 + x) * 4], &source.data[(sourceY * source.width + sourceX) * 4], 4);
+			}
+		}
+
+		uint8_t* block = &destination.data[(blockRow * blocksWide + blockColumn) * blockSize];
+		switch (compression)
+		{
+		case TEXTURE_COMPRESSION_BC1:
+			EncodeBC1Block(texels, block);
+			break;
+		case TEXTURE_COMPRESSION_BC3:
+			EncodeBC3Block(texels, block);
+			break;
+		case TEXTURE_COMPRESSION_BC5:
+			EncodeBC5Block(texels, block);
+			break;
+		case TEXTURE_COMPRESSION_BC7:
+			EncodeBC7Block(texels, block);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::EncodeBC1Block(const uint8_t* texels, uint8_t* block)
+{
+	uint8_t minColor[4], maxColor[4];
+	GetBlockBounds(texels, minColor, maxColor);
+
+	// Inset by a sixteenth of the range, the extremes are rarely worth spending an endpoint on
+	for (uint32_t channel = 0; channel < 3; ++channel)
+	{
+		uint8_t inset		= (uint8_t)((maxColor[channel] - minColor[channel]) >> 4);
+		minColor[channel]	+= inset;
+		maxColor[channel]	-= inset;
+	}
+
+	// Channel wise max >= min keeps color0 >= color1, the four colour mode unless they are equal
+	uint16_t color0		= PackRGB565(maxColor);
+	uint16_t color1		= PackRGB565(minColor);
+	uint32_t indices	= 0;
+
+	if (color0 != color1)
+	{
+		uint8_t palette[4][3];
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+		for (uint32_t channel = 0; channel < 3; ++channel)
+		{
+			palette[2][channel] = (uint8_t)((2 * palette[0][channel] + palette[1][channel]) / 3);
+			palette[3][channel] = (uint8_t)((palette[0][channel] + 2 * palette[1][channel]) / 3);
+		}
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint32_t bestIndex		= 0;
+			uint32_t bestDistance	= ~0u;
+			for (uint32_t entry = 0; entry < 4; ++entry)
+			{
+				uint32_t distance = 0;
+				for (uint32_t channel = 0; channel < 3; ++channel)
+				{
+					int32_t delta	= (int32_t)texels[i * 4 + channel] - (int32_t)palette[entry][channel];
+					distance		+= (uint32_t)(delta * delta);
+				}
+				if (distance < bestDistance)
+				{
+					bestDistance	= distance;
+					bestIndex		= entry;
+				}
+			}
+			indices |= bestIndex << (i * 2);
+		}
+	}
+
+	block[0] = (uint8_t)(color0 & 0xff);
+	block[1] = (uint8_t)(color0 >> 8);
+	block[2] = (uint8_t)(color1 & 0xff);
+	block[3] = (uint8_t)(color1 >> 8);
+	memcpy(block + 4, &indices, 4);
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::EncodeBC3Block(const uint8_t* texels, uint8_t* block)
+{
+	EncodeBC4Block(texels, 3, block);
+	EncodeBC1Block(texels, block + 8);
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::EncodeBC4Block(const uint8_t* texels, uint32_t channel, uint8_t* block)
+{
+	uint8_t minColor[4], maxColor[4];
+	GetBlockBounds(texels, minColor, maxColor);
+
+	// value0 > value1 selects eight interpolated values instead of six and the two constants
+	uint8_t value0		= maxColor[channel];
+	uint8_t value1		= minColor[channel];
+	uint64_t indices	= 0;
+
+	if (value0 > value1)
+	{
+		uint8_t palette[8];
+		palette[0] = value0;
+		palette[1] = value1;
+		for (uint32_t i = 1; i < 7; ++i)
+		{
+			palette[i + 1] = (uint8_t)(((7 - i) * value0 + i * value1) / 7);
+		}
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint32_t bestIndex		= 0;
+			int32_t bestDistance	= 256;
+			for (uint32_t entry = 0; entry < 8; ++entry)
+			{
+				int32_t distance = std::abs((int32_t)texels[i * 4 + channel] - (int32_t)palette[entry]);
+				if (distance < bestDistance)
+				{
+					bestDistance	= distance;
+					bestIndex		= entry;
+				}
+			}
+			indices |= (uint64_t)bestIndex << (i * 3);
+		}
+	}
+
+	block[0] = value0;
+	block[1] = value1;
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		block[2 + i] = (uint8_t)(indices >> (i * 8));
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::EncodeBC5Block(const uint8_t* texels, uint8_t* block)
+{
+	EncodeBC4Block(texels, 0, block);
+	EncodeBC4Block(texels, 1, block + 8);
+}
+
+//---------------------------------------------------------------------------------------------------
+void TextureCompressor::EncodeBC7Block(const uint8_t* texels, uint8_t* block)
+{
+	static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Principal axis of the texels by power iteration, starting from the diagonal of their bounds
+	float mean[4] = {};
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		for (uint32_t channel = 0; channel < 4; ++channel)
+		{
+			mean[channel] += texels[i * 4 + channel] / 16.0f;
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			for (uint32_t column = 0; column < 4; ++column)
+			{
+				covariance[row][column] += (texels[i * 4 + row] - mean[row]) * (texels[i * 4 + column] - mean[column]);
+			}
+		}
+	}
+
+	uint8_t minColor[4], maxColor[4];
+	GetBlockBounds(texels, minColor, maxColor);
+
+	float axis[4];
+	for (uint32_t channel = 0; channel < 4; ++channel)
+	{
+		axis[channel] = (float)(maxColor[channel] - minColor[channel]);
+	}
+	for (uint32_t iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4]	= {};
+		float largest	= 0.0f;
+		for (uint32_t row = 0; row < 4; ++row)
+		{
+			for (uint32_t column = 0; column < 4; ++column)
+			{
+				next[row] += covariance[row][column] * axis[column];
+			}
+			largest = std::max(largest, std::fabs(next[row]));
+		}
+		if (largest <= 0.0f)
+		{
+			break;
+		}
+		for (uint32_t channel = 0; channel < 4; ++channel)
+		{
+			axis[channel] = next[channel] / largest;
+		}
+	}
+
+	float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+	for (uint32_t channel = 0; channel < 4; ++channel)
+	{
+		axis[channel] = length > 0.0f ? axis[channel] / length : 0.0f;
+	}
+
+	float minProjection = 0.0f;
+	float maxProjection = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		float projection = 0.0f;
+		for (uint32_t channel = 0; channel < 4; ++channel)
+		{
+			projection += (texels[i * 4 + channel] - mean[channel]) * axis[channel];
+		}
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	// Endpoints are 7 bits a channel plus a p-bit shared by the endpoint's channels, pick the p-bit
+	// that lands closer
+	uint32_t quantized[2][4];
+	uint32_t pBits[2];
+	uint32_t endpoints[2][4];
+	for (uint32_t endpoint = 0; endpoint < 2; ++endpoint)
+	{
+		float projection	= endpoint == 0 ? minProjection : maxProjection;
+		float bestError		= -1.0f;
+		for (uint32_t pBit = 0; pBit < 2; ++pBit)
+		{
+			uint32_t candidate[4];
+			float error = 0.0f;
+			for (uint32_t channel = 0; channel < 4; ++channel)
+			{
+				float value			= std::min(255.0f, std::max(0.0f, mean[channel] + projection * axis[channel]));
+				candidate[channel]	= (uint32_t)std::min(127.0f, std::max(0.0f, std::floor((value - pBit) / 2.0f + 0.5f)));
+				float delta			= (float)((candidate[channel] << 1) | pBit) - value;
+				error				+= delta * delta;
+			}
+			if (bestError < 0.0f || error < bestError)
+			{
+				bestError		= error;
+				pBits[endpoint]	= pBit;
+				memcpy(quantized[endpoint], candidate, sizeof(candidate));
+			}
+		}
+		for (uint32_t channel = 0; channel < 4; ++channel)
+		{
+			endpoints[endpoint][channel] = (quantized[endpoint][channel] << 1) | pBits[endpoint];
+		}
+	}
+
+	uint32_t palette[16][4];
+	for (uint32_t entry = 0; entry < 16; ++entry)
+	{
+		for (uint32_t channel = 0; channel < 4; ++channel)
+		{
+			palette[entry][channel] = ((64 - weights[entry]) * endpoints[0][channel] + weights[entry] * endpoints[1][channel] + 32) >> 6;
+		}
+	}
+
+	uint32_t indices[16];
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		uint32_t bestDistance = ~0u;
+		for (uint32_t entry = 0; entry < 16; ++entry)
+		{
+			uint32_t distance = 0;
+			for (uint32_t channel = 0; channel < 4; ++channel)
+			{
+				int32_t delta	= (int32_t)texels[i * 4 + channel] - (int32_t)palette[entry][channel];
+				distance		+= (uint32_t)(delta * delta);
+			}
+			if (distance < bestDistance)
+			{
+				bestDistance	= distance;
+				indices[i]		= entry;
+			}
+		}
+	}
+
+	// The first index is stored without its top bit, so it has to be in the lower half
+	if (indices[0] & 8)
+	{
+		std::swap(quantized[0], quantized[1]);
+		std::swap(pBits[0], pBits[1]);
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(block, 0, 16);
+	BlockBitWriter writer = { block, 0 };
+	writer.Write(1 << 6, 7);	// Mode 6
+	for (uint32_t channel = 0; channel < 4; ++channel)
+	{
+		writer.Write(quantized[0][channel], 7);
+		writer.Write(quantized[1][channel], 7);
+	}
+	writer.Write(pBits[0], 1);
+	writer.Write(pBits[1], 1);
+	writer.Write(indices[0], 3);
+	for (uint32_t i = 1; i < 16; ++i)
+	{
+		writer.Write(indices[i], 4);
+	}
+}
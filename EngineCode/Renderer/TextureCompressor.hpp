@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef _TEXTURE_COMPRESSOR_H_
+#define _TEXTURE_COMPRESSOR_H_
+
+//---------------------------------------------------------------------------------------------------
+#include <cstdint>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+enum TextureCompression
+{
+	TEXTURE_COMPRESSION_NONE,	// RGBA8, 4 bytes a texel
+	TEXTURE_COMPRESSION_BC1,	// Opaque RGB, 8 bytes a 4x4 block
+	TEXTURE_COMPRESSION_BC3,	// RGB with interpolated alpha, 16 bytes a block
+	TEXTURE_COMPRESSION_BC5,	// Two independent channels, normal map XY, 16 bytes a block
+	TEXTURE_COMPRESSION_BC7,	// RGBA at close to RGBA8 quality, 16 bytes a block
+};
+
+//---------------------------------------------------------------------------------------------------
+// What a texture holds, which decides the compressions worth trying for it
+enum TextureContent
+{
+	TEXTURE_CONTENT_COLOR,
+	TEXTURE_CONTENT_COLOR_ALPHA,
+	TEXTURE_CONTENT_NORMAL,
+};
+
+//---------------------------------------------------------------------------------------------------
+struct TextureLevel
+{
+	uint32_t				width	= 0;
+	uint32_t				height	= 0;
+	std::vector<uint8_t>	data;
+};
+
+//---------------------------------------------------------------------------------------------------
+struct CompressedTexture
+{
+	TextureCompression			compression	= TEXTURE_COMPRESSION_NONE;
+	std::vector<TextureLevel>	levels;		// Level 0 first, down to 1x1
+};
+
+//---------------------------------------------------------------------------------------------------
+// CPU block compressor for baking textures. The mip chain is box filtered from RGBA8 and every level
+// compressed into 4x4 blocks, block rows of all levels shared out across the hardware threads. Endpoint
+// bounds are found with SSE2 where available:
+//  - BC1 and the colour half of BC3 take the inset bounding box of the block as endpoints,
+//  - BC3 alpha and both BC5 channels are BC4 blocks over the channel's range,
+//  - BC7 uses mode 6 only, endpoints along the principal axis of the block with the best p-bits.
+// Good enough for shipping content through a 4-8x smaller footprint, not a replacement for a
+// reference quality encoder.
+class TextureCompressor
+{
+public:
+	// Preferred first, always ending with TEXTURE_COMPRESSION_NONE
+	static std::vector<TextureCompression>	GetCandidates(TextureContent content);
+
+	static uint32_t			GetBlockSize(TextureCompression compression);	// Bytes a block, a texel uncompressed
+	static uint32_t			GetLevelSize(TextureCompression compression, uint32_t width, uint32_t height);
+	static const char*		GetName(TextureCompression compression);
+
+	// A full chain of RGBA8 pixels, level 0 the pixels as given
+	static void				BuildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<TextureLevel>& levels);
+
+	// threadCount 0 uses every hardware thread
+	static CompressedTexture	Compress(const uint8_t* pixels, uint32_t width, uint32_t height, TextureCompression compression, uint32_t threadCount = 0);
+
+	// One 4x4 block of RGBA8 texels, row by row
+	static void				EncodeBC1Block(const uint8_t* texels, uint8_t* block);
+	static void				EncodeBC3Block(const uint8_t* texels, uint8_t* block);
+	static void				EncodeBC4Block(const uint8_t* texels, uint32_t channel, uint8_t* block);
+	static void				EncodeBC5Block(const uint8_t* texels, uint8_t* block);
+	static void				EncodeBC7Block(const uint8_t* texels, uint8_t* block);
+
+private:
+	static void				CompressBlockRow(const TextureLevel& source, TextureCompression compression, uint32_t blockRow, TextureLevel& destination);
+};
+#endif // !_TEXTURE_COMPRESSOR_H_
@@ -0,0 +1,265 @@
+#include "TextureContainer.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "ExtLibs/stb/stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//---------------------------------------------------------------------------------------------------
+static const uint32_t DDS_MAGIC						= 0x20534444;	// "DDS "
+static const uint32_t DDS_FOURCC_DX10				= 0x30315844;	// "DX10"
+static const uint32_t DDS_FLAGS						= 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;	// Caps, height, width, pixel format, mip count, linear size
+static const uint32_t DDS_PIXEL_FORMAT_FOURCC		= 0x4;
+static const uint32_t DDS_CAPS_TEXTURE				= 0x1000;
+static const uint32_t DDS_CAPS_MIPMAP				= 0x400000 | 0x8;	// Mipmap, complex
+static const uint32_t DDS_DIMENSION_TEXTURE2D		= 3;
+static const uint32_t DDS_SOURCE_HASH_TAG			= 0x49525344;	// "DSRI", marks reserved1[1..2] as the source hash
+
+static const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM	= 28;
+static const uint32_t DXGI_FORMAT_BC1_UNORM			= 71;
+static const uint32_t DXGI_FORMAT_BC3_UNORM			= 77;
+static const uint32_t DXGI_FORMAT_BC5_UNORM			= 83;
+static const uint32_t DXGI_FORMAT_BC7_UNORM			= 98;
+
+//---------------------------------------------------------------------------------------------------
+struct DdsPixelFormat
+{
+	uint32_t	size;
+	uint32_t	flags;
+	uint32_t	fourCC;
+	uint32_t	rgbBitCount;
+	uint32_t	bitMasks[4];
+};
+
+//---------------------------------------------------------------------------------------------------
+struct DdsHeader
+{
+	uint32_t		size;
+	uint32_t		flags;
+	uint32_t		height;
+	uint32_t		width;
+	uint32_t		linearSize;
+	uint32_t		depth;
+	uint32_t		mipMapCount;
+	uint32_t		reserved1[11];
+	DdsPixelFormat	pixelFormat;
+	uint32_t		caps[4];
+	uint32_t		reserved2;
+};
+
+//---------------------------------------------------------------------------------------------------
+struct DdsHeaderDx10
+{
+	uint32_t	dxgiFormat;
+	uint32_t	resourceDimension;
+	uint32_t	miscFlag;
+	uint32_t	arraySize;
+	uint32_t	miscFlags2;
+};
+
+//---------------------------------------------------------------------------------------------------
+static uint32_t GetDxgiFormat(TextureCompression compression)
+{
+	switch (compression)
+	{
+	case TEXTURE_COMPRESSION_BC1:	return DXGI_FORMAT_BC1_UNORM;
+	case TEXTURE_COMPRESSION_BC3:	return DXGI_FORMAT_BC3_UNORM;
+	case TEXTURE_COMPRESSION_BC5:	return DXGI_FORMAT_BC5_UNORM;
+	case TEXTURE_COMPRESSION_BC7:	return DXGI_FORMAT_BC7_UNORM;
+	default:						return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+static bool GetCompression(uint32_t dxgiFormat, TextureCompression& compression)
+{
+	switch (dxgiFormat)
+	{
+	case DXGI_FORMAT_BC1_UNORM:			compression = TEXTURE_COMPRESSION_BC1;	return true;
+	case DXGI_FORMAT_BC3_UNORM:			compression = TEXTURE_COMPRESSION_BC3;	return true;
+	case DXGI_FORMAT_BC5_UNORM:			compression = TEXTURE_COMPRESSION_BC5;	return true;
+	case DXGI_FORMAT_BC7_UNORM:			compression = TEXTURE_COMPRESSION_BC7;	return true;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:	compression = TEXTURE_COMPRESSION_NONE;	return true;
+	default:							return false;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+std::string TextureContainer::GetBakedPath(const std::string& sourcePath, TextureCompression compression)
+{
+	size_t extension	= sourcePath.find_last_of('.');
+	size_t separator	= sourcePath.find_last_of("/\\");
+	std::string stem	= (extension != std::string::npos && (separator == std::string::npos || extension > separator)) ? sourcePath.substr(0, extension) : sourcePath;
+	return stem + "." + TextureCompressor::GetName(compression) + ".dds";
+}
+
+//---------------------------------------------------------------------------------------------------
+bool TextureContainer::HashSource(const std::string& sourcePath, uint64_t& sourceHash)
+{
+	std::ifstream file(sourcePath, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	sourceHash = 14695981039346656037ull;
+	char buffer[64 * 1024];
+	while (file)
+	{
+		file.read(buffer, sizeof(buffer));
+		for (std::streamsize i = 0; i < file.gcount(); ++i)
+		{
+			sourceHash = (sourceHash ^ (uint8_t)buffer[i]) * 1099511628211ull;
+		}
+	}
+	return file.eof();
+}
+
+//---------------------------------------------------------------------------------------------------
+bool TextureContainer::Write(const std::string& path, const CompressedTexture& texture, uint64_t sourceHash)
+{
+	if (texture.levels.empty())
+	{
+		return false;
+	}
+
+	DdsHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size						= sizeof(DdsHeader);
+	header.flags					= DDS_FLAGS;
+	header.width					= texture.levels[0].width;
+	header.height					= texture.levels[0].height;
+	header.linearSize				= (uint32_t)texture.levels[0].data.size();
+	header.depth					= 1;
+	header.mipMapCount				= (uint32_t)texture.levels.size();
+	header.pixelFormat.size			= sizeof(DdsPixelFormat);
+	header.pixelFormat.flags		= DDS_PIXEL_FORMAT_FOURCC;
+	header.pixelFormat.fourCC		= DDS_FOURCC_DX10;
+	header.caps[0]					= DDS_CAPS_TEXTURE | (texture.levels.size() > 1 ? DDS_CAPS_MIPMAP : 0);
+	if (sourceHash != 0)
+	{
+		header.reserved1[0]			= DDS_SOURCE_HASH_TAG;
+		header.reserved1[1]			= (uint32_t)sourceHash;
+		header.reserved1[2]			= (uint32_t)(sourceHash >> 32);
+	}
+
+	DdsHeaderDx10 headerDx10;
+	memset(&headerDx10, 0, sizeof(headerDx10));
+	headerDx10.dxgiFormat			= GetDxgiFormat(texture.compression);
+	headerDx10.resourceDimension	= DDS_DIMENSION_TEXTURE2D;
+	headerDx10.arraySize			= 1;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "texture container: failed to open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&headerDx10), sizeof(headerDx10));
+	for (const TextureLevel& level : texture.levels)
+	{
+		file.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+	}
+	return file.good();
+}
+
+//---------------------------------------------------------------------------------------------------
+bool TextureContainer::Read(const std::string& path, CompressedTexture& texture, uint64_t* sourceHash)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	uint32_t magic = 0;
+	DdsHeader header;
+	DdsHeaderDx10 headerDx10;
+	file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || magic != DDS_MAGIC || header.size != sizeof(DdsHeader) || header.pixelFormat.fourCC != DDS_FOURCC_DX10)
+	{
+		std::cerr << "texture container: " << path << " is not a DX10 DDS file" << std::endl;
+		return false;
+	}
+
+	file.read(reinterpret_cast<char*>(&headerDx10), sizeof(headerDx10));
+	if (!file || headerDx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || headerDx10.arraySize != 1 || !GetCompression(headerDx10.dxgiFormat, texture.compression))
+	{
+		std::cerr << "texture container: " << path << " holds a texture type or format that is not supported" << std::endl;
+		return false;
+	}
+
+	if (sourceHash)
+	{
+		*sourceHash = header.reserved1[0] == DDS_SOURCE_HASH_TAG ? ((uint64_t)header.reserved1[2] << 32) | header.reserved1[1] : 0;
+	}
+
+	// A full chain halves the larger side down to 1, so it has floor(log2(max(width, height))) + 1 levels
+	uint32_t maxLevelCount = 0;
+	for (uint32_t size = std::max(header.width, header.height); size > 0; size >>= 1)
+	{
+		++maxLevelCount;
+	}
+	if (header.width == 0 || header.height == 0 || header.mipMapCount > maxLevelCount)
+	{
+		std::cerr << "texture container: " << path << " has an invalid size or mip chain" << std::endl;
+		return false;
+	}
+
+	uint32_t levelCount = std::max(1u, header.mipMapCount);
+	texture.levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		TextureLevel& level	= texture.levels[i];
+		level.width			= std::max(1u, header.width >> i);
+		level.height		= std::max(1u, header.height >> i);
+		level.data.resize(TextureCompressor::GetLevelSize(texture.compression, level.width, level.height));
+		file.read(reinterpret_cast<char*>(level.data.data()), level.data.size());
+	}
+
+	if (!file)
+	{
+		std::cerr << "texture container: " << path << " is truncated" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool TextureContainer::Bake(const std::string& sourcePath, TextureCompression compression, CompressedTexture& texture, bool* isWritten)
+{
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		std::cerr << "texture container: failed to load " << sourcePath << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	texture = TextureCompressor::Compress(pixels, (uint32_t)width, (uint32_t)height, compression);
+	stbi_image_free(pixels);
+	auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::string bakedPath = GetBakedPath(sourcePath, compression);
+	std::cout << "texture container: baked " << texture.levels.size() << " levels of " << sourcePath << " as " << TextureCompressor::GetName(compression) << " in " << milliseconds << " ms" << std::endl;
+
+	// The texture is good either way, a failed write only means the next run bakes it again
+	uint64_t sourceHash	= 0;
+	bool written		= HashSource(sourcePath, sourceHash) && Write(bakedPath, texture, sourceHash);
+	if (!written)
+	{
+		std::cerr << "texture container: failed to write " << bakedPath << std::endl;
+	}
+	if (isWritten)
+	{
+		*isWritten = written;
+	}
+	return true;
+}
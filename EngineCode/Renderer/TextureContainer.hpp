@@ -0,0 +1,32 @@
+#pragma once
+
+#ifndef _TEXTURE_CONTAINER_H_
+#define _TEXTURE_CONTAINER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "TextureCompressor.hpp"
+#include <string>
+
+//---------------------------------------------------------------------------------------------------
+// Baked textures on disk as DDS with the DX10 header extension: the whole mip chain of one 2D texture,
+// level 0 first, each level's blocks exactly as the GPU consumes them. Any DDS viewer opens the files.
+// Only the formats TextureCompressor produces are read back. A hash of the source file's contents goes
+// into reserved header fields, so a bake can be told apart from one of an older version of its source.
+class TextureContainer
+{
+public:
+	// Where the baked version of a source texture lives, e.g. Texture.jpg -> Texture.bc7.dds
+	static std::string		GetBakedPath(const std::string& sourcePath, TextureCompression compression);
+
+	// 64-bit FNV-1a of the whole file, false if it cannot be read
+	static bool				HashSource(const std::string& sourcePath, uint64_t& sourceHash);
+
+	// A source hash of 0 stands for unknown, which is also what files from other tools read back as
+	static bool				Write(const std::string& path, const CompressedTexture& texture, uint64_t sourceHash = 0);
+	static bool				Read(const std::string& path, CompressedTexture& texture, uint64_t* sourceHash = nullptr);
+
+	// Loads any image stb_image reads, compresses its whole chain and writes it to the baked path. Returns
+	// whether the texture was compressed, isWritten tells whether it also made it to disk
+	static bool				Bake(const std::string& sourcePath, TextureCompression compression, CompressedTexture& texture, bool* isWritten = nullptr);
+};
+#endif // !_TEXTURE_CONTAINER_H_
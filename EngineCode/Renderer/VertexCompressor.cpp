@@ -0,0 +1,123 @@
+#include "VertexCompressor.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "ExtLibs/GLM/glm/gtc/packing.hpp"
+#include <algorithm>
+#include <limits>
+
+//---------------------------------------------------------------------------------------------------
+glm::mat4 VertexQuantization::GetDequantizeMatrix() const
+{
+	glm::mat4 dequantize(1.0f);
+	dequantize[0][0]	= scale.x;
+	dequantize[1][1]	= scale.y;
+	dequantize[2][2]	= scale.z;
+	dequantize[3]		= glm::vec4(offset, 1.0f);
+	return dequantize;
+}
+
+//---------------------------------------------------------------------------------------------------
+VertexQuantization VertexCompressor::ComputeQuantization(const Vertex* vertices, uint32_t count)
+{
+	VertexQuantization quantization;
+	if (count == 0)
+	{
+		return quantization;
+	}
+
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i].pos);
+		boundsMax = glm::max(boundsMax, vertices[i].pos);
+	}
+
+	// A flat mesh still needs an invertible scale along its flat axis
+	quantization.offset	= boundsMin;
+	quantization.scale	= glm::max(boundsMax - boundsMin, glm::vec3(std::numeric_limits<float>::min()));
+	return quantization;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VertexCompressor::Compress(const Vertex* vertices, uint32_t count, const VertexQuantization& quantization, CompressedVertex* compressed)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		compressed[i] = CompressVertex(vertices[i], quantization);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+CompressedVertex VertexCompressor::CompressVertex(const Vertex& vertex, const VertexQuantization& quantization)
+{
+	CompressedVertex compressed;
+
+	glm::vec3 position = (vertex.pos - quantization.offset) / quantization.scale;
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		compressed.pos[axis] = glm::packUnorm1x16(position[axis]);
+	}
+	compressed.pos[3] = vertex.tangent.w < 0.0f ? 0 : 0xFFFF;
+
+	EncodeOctahedral(glm::vec3(vertex.normal), compressed.normal);
+	EncodeOctahedral(glm::vec3(vertex.tangent), compressed.tangent);
+
+	for (uint32_t channel = 0; channel < 3; ++channel)
+	{
+		compressed.color[channel] = glm::packUnorm1x8(vertex.color[channel]);
+	}
+	compressed.color[3] = 0xFF;
+
+	compressed.texCoords[0] = glm::packHalf1x16(vertex.texCoords.x);
+	compressed.texCoords[1] = glm::packHalf1x16(vertex.texCoords.y);
+	return compressed;
+}
+
+//---------------------------------------------------------------------------------------------------
+Vertex VertexCompressor::DecompressVertex(const CompressedVertex& compressed, const VertexQuantization& quantization)
+{
+	Vertex vertex;
+
+	glm::vec3 position(glm::unpackUnorm1x16(compressed.pos[0]), glm::unpackUnorm1x16(compressed.pos[1]), glm::unpackUnorm1x16(compressed.pos[2]));
+	vertex.pos			= quantization.offset + position * quantization.scale;
+	vertex.color		= glm::vec3(glm::unpackUnorm1x8(compressed.color[0]), glm::unpackUnorm1x8(compressed.color[1]), glm::unpackUnorm1x8(compressed.color[2]));
+	vertex.texCoords	= glm::vec2(glm::unpackHalf1x16(compressed.texCoords[0]), glm::unpackHalf1x16(compressed.texCoords[1]));
+	vertex.normal		= DecodeOctahedral(compressed.normal);
+	vertex.tangent		= glm::vec4(DecodeOctahedral(compressed.tangent), compressed.pos[3] == 0 ? -1.0f : 1.0f);
+	return vertex;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VertexCompressor::EncodeOctahedral(const glm::vec3& direction, int16_t* encoded)
+{
+	// Zero length vectors, e.g. a mesh without tangents, come out as +Z
+	float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+	glm::vec2 octahedral(0.0f);
+	if (length > 0.0f)
+	{
+		octahedral = glm::vec2(direction) / length;
+	}
+
+	// The lower half folds over the diagonals onto the corners of the square
+	if (length > 0.0f && direction.z < 0.0f)
+	{
+		glm::vec2 folded	= glm::vec2(1.0f) - glm::abs(glm::vec2(octahedral.y, octahedral.x));
+		octahedral.x		= octahedral.x >= 0.0f ? folded.x : -folded.x;
+		octahedral.y		= octahedral.y >= 0.0f ? folded.y : -folded.y;
+	}
+
+	encoded[0] = (int16_t)glm::packSnorm1x16(octahedral.x);
+	encoded[1] = (int16_t)glm::packSnorm1x16(octahedral.y);
+}
+
+//---------------------------------------------------------------------------------------------------
+glm::vec3 VertexCompressor::DecodeOctahedral(const int16_t* encoded)
+{
+	glm::vec2 octahedral(glm::unpackSnorm1x16((uint16_t)encoded[0]), glm::unpackSnorm1x16((uint16_t)encoded[1]));
+
+	glm::vec3 direction(octahedral, 1.0f - std::abs(octahedral.x) - std::abs(octahedral.y));
+	float fold	= std::max(-direction.z, 0.0f);
+	direction.x	+= direction.x >= 0.0f ? -fold : fold;
+	direction.y	+= direction.y >= 0.0f ? -fold : fold;
+	return glm::normalize(direction);
+}
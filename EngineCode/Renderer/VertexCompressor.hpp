@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef _VERTEX_COMPRESSOR_H_
+#define _VERTEX_COMPRESSOR_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "VertexData.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Maps a mesh's bounding box onto the unit cube its packed positions are stored in
+struct VertexQuantization
+{
+	glm::vec3				offset	= glm::vec3(0.0f);	// Minimum corner of the bounds
+	glm::vec3				scale	= glm::vec3(1.0f);	// Size of the bounds, never zero
+
+	// Takes packed positions, read as unorm, back to object space
+	glm::mat4				GetDequantizeMatrix() const;
+};
+
+//---------------------------------------------------------------------------------------------------
+// Packs imported vertices into CompressedVertex, see there for the layout. Position error is half a
+// 16-bit step of the mesh's bounds per axis, normals and tangents are within about 0.05 degrees.
+class VertexCompressor
+{
+public:
+	// Bounds of count vertices
+	static VertexQuantization	ComputeQuantization(const Vertex* vertices, uint32_t count);
+
+	static void				Compress(const Vertex* vertices, uint32_t count, const VertexQuantization& quantization, CompressedVertex* compressed);
+	static CompressedVertex	CompressVertex(const Vertex& vertex, const VertexQuantization& quantization);
+	static Vertex			DecompressVertex(const CompressedVertex& compressed, const VertexQuantization& quantization);
+
+	// A unit vector onto the octahedron, unfolded into a square of two snorm values
+	static void				EncodeOctahedral(const glm::vec3& direction, int16_t* encoded);
+	static glm::vec3		DecodeOctahedral(const int16_t* encoded);
+};
+#endif // !_VERTEX_COMPRESSOR_H_
@@ -0,0 +1,197 @@
+#pragma once
+
+#ifndef _VERTEX_LAYOUT_H_
+#define _VERTEX_LAYOUT_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <array>
+#include <cstring>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Vertex data goes to the GPU split into streams, so passes that only need positions, depth and
+// shadow passes, fetch nothing else
+enum VertexStream
+{
+	VERTEX_STREAM_POSITION,
+	VERTEX_STREAM_ATTRIBUTES,
+	VERTEX_STREAM_COUNT,
+};
+
+//---------------------------------------------------------------------------------------------------
+enum VertexStreamMask
+{
+	VERTEX_STREAM_MASK_POSITION	= 1 << VERTEX_STREAM_POSITION,
+	VERTEX_STREAM_MASK_ALL		= (1 << VERTEX_STREAM_COUNT) - 1,
+};
+
+//---------------------------------------------------------------------------------------------------
+// Binding 1 carries InstanceData, the streams go around it
+static const uint32_t VERTEX_STREAM_BINDINGS[VERTEX_STREAM_COUNT] = { 0, 2 };
+
+// Where each stream starts in a vertex buffer, see VertexLayout::Pack
+static const VkDeviceSize VERTEX_STREAM_ALIGNMENT = 16;
+
+//---------------------------------------------------------------------------------------------------
+// One member of an interleaved vertex struct: the shader location and format it is read with and the
+// stream it is fetched from
+struct VertexAttributeDesc
+{
+	uint32_t		location;
+	VkFormat		format;
+	VertexStream	stream;
+	uint32_t		sourceOffset;	// offsetof the member in the vertex struct
+};
+
+//---------------------------------------------------------------------------------------------------
+// Bytes an attribute of the format takes, zero for formats no vertex layout uses
+constexpr uint32_t GetVertexFormatSize(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R16G16_SNORM:
+	case VK_FORMAT_R32_SFLOAT:
+	case VK_FORMAT_R32_UINT:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_UNORM:
+	case VK_FORMAT_R32G32_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32_SFLOAT:
+		return 12;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+// A vertex struct described as a table of its members, from which binding and attribute descriptions
+// and the packed streams are all derived. Within a stream attributes follow each other in table order,
+// so a stream's stride is the sum of their sizes. IsComplete checks at compile time that the table
+// covers every byte of the struct exactly once, a member added to the struct and not to the table
+// fails the build instead of being dropped.
+template<typename SourceVertex, size_t AttributeCount>
+class VertexLayout
+{
+public:
+	constexpr VertexLayout(const std::array<VertexAttributeDesc, AttributeCount>& attributes)
+		: m_attributes(attributes)
+	{
+	}
+
+	constexpr uint32_t		GetStride(VertexStream stream) const
+	{
+		uint32_t stride = 0;
+		for (size_t i = 0; i < AttributeCount; ++i)
+		{
+			stride += m_attributes[i].stream == stream ? GetVertexFormatSize(m_attributes[i].format) : 0;
+		}
+		return stride;
+	}
+
+	// Of the attribute within its stream
+	constexpr uint32_t		GetOffset(size_t attribute) const
+	{
+		uint32_t offset = 0;
+		for (size_t i = 0; i < attribute; ++i)
+		{
+			offset += m_attributes[i].stream == m_attributes[attribute].stream ? GetVertexFormatSize(m_attributes[i].format) : 0;
+		}
+		return offset;
+	}
+
+	constexpr bool			IsComplete() const
+	{
+		uint32_t coveredSize = 0;
+		for (size_t i = 0; i < AttributeCount; ++i)
+		{
+			uint32_t size = GetVertexFormatSize(m_attributes[i].format);
+			if (size == 0 || m_attributes[i].stream >= VERTEX_STREAM_COUNT || m_attributes[i].sourceOffset + size > sizeof(SourceVertex))
+			{
+				return false;
+			}
+			for (size_t j = 0; j < i; ++j)
+			{
+				bool overlaps = m_attributes[i].sourceOffset < m_attributes[j].sourceOffset + GetVertexFormatSize(m_attributes[j].format)
+					&& m_attributes[j].sourceOffset < m_attributes[i].sourceOffset + size;
+				if (overlaps || m_attributes[i].location == m_attributes[j].location)
+				{
+					return false;
+				}
+			}
+			coveredSize += size;
+		}
+		return coveredSize == sizeof(SourceVertex) && GetStride(VERTEX_STREAM_POSITION) > 0;
+	}
+
+	// One binding per stream in the mask, at VERTEX_STREAM_BINDINGS
+	std::vector<VkVertexInputBindingDescription>	GetBindingDescriptions(uint32_t streamMask = VERTEX_STREAM_MASK_ALL) const
+	{
+		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+		for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; ++stream)
+		{
+			uint32_t stride = GetStride((VertexStream)stream);
+			if ((streamMask & (1 << stream)) && stride > 0)
+			{
+				VkVertexInputBindingDescription bindingDescription = {};
+				bindingDescription.binding		= VERTEX_STREAM_BINDINGS[stream];
+				bindingDescription.stride		= stride;
+				bindingDescription.inputRate	= VK_VERTEX_INPUT_RATE_VERTEX;
+				bindingDescriptions.push_back(bindingDescription);
+			}
+		}
+		return bindingDescriptions;
+	}
+
+	std::vector<VkVertexInputAttributeDescription>	GetAttributeDescriptions(uint32_t streamMask = VERTEX_STREAM_MASK_ALL) const
+	{
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+		for (size_t i = 0; i < AttributeCount; ++i)
+		{
+			if (streamMask & (1 << m_attributes[i].stream))
+			{
+				VkVertexInputAttributeDescription attributeDescription = {};
+				attributeDescription.binding	= VERTEX_STREAM_BINDINGS[m_attributes[i].stream];
+				attributeDescription.location	= m_attributes[i].location;
+				attributeDescription.format		= m_attributes[i].format;
+				attributeDescription.offset		= GetOffset(i);
+				attributeDescriptions.push_back(attributeDescription);
+			}
+		}
+		return attributeDescriptions;
+	}
+
+	// Splits interleaved vertices into the streams, one after the other in data, each starting at a
+	// multiple of VERTEX_STREAM_ALIGNMENT. streamOffsets receives where each one starts
+	void					Pack(const SourceVertex* vertices, uint32_t count, std::vector<uint8_t>& data, VkDeviceSize* streamOffsets) const
+	{
+		VkDeviceSize size = 0;
+		for (uint32_t stream = 0; stream < VERTEX_STREAM_COUNT; ++stream)
+		{
+			streamOffsets[stream]	= size;
+			size					= (size + (VkDeviceSize)GetStride((VertexStream)stream) * count + VERTEX_STREAM_ALIGNMENT - 1) & ~(VERTEX_STREAM_ALIGNMENT - 1);
+		}
+		data.assign((size_t)size, 0);
+
+		for (size_t i = 0; i < AttributeCount; ++i)
+		{
+			const VertexAttributeDesc& attribute	= m_attributes[i];
+			uint32_t attributeSize					= GetVertexFormatSize(attribute.format);
+			uint32_t stride							= GetStride(attribute.stream);
+			uint8_t* destination					= data.data() + streamOffsets[attribute.stream] + GetOffset(i);
+			const uint8_t* source					= reinterpret_cast<const uint8_t*>(vertices) + attribute.sourceOffset;
+			for (uint32_t vertex = 0; vertex < count; ++vertex)
+			{
+				memcpy(destination + (size_t)vertex * stride, source + vertex * sizeof(SourceVertex), attributeSize);
+			}
+		}
+	}
+
+private:
+	std::array<VertexAttributeDesc, AttributeCount>	m_attributes;
+};
+#endif // !_VERTEX_LAYOUT_H_
@@ -0,0 +1,290 @@
+#include "VulkanBindlessTable.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+const std::vector<const char*>& VulkanBindlessTable::GetDeviceExtensions()
+{
+	static const std::vector<const char*> extensions = { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, VK_KHR_MAINTENANCE3_EXTENSION_NAME };
+	return extensions;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanBindlessSupport VulkanBindlessTable::QuerySupport(const VkInstance& instance, const VkPhysicalDevice& physicalDevice)
+{
+	VulkanBindlessSupport support;
+
+	auto getFeatures2	= (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+	auto getProperties2	= (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+	if (!getFeatures2 || !getProperties2)
+	{
+		return support;
+	}
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const char* required : GetDeviceExtensions())
+	{
+		auto found = std::find_if(availableExtensions.begin(), availableExtensions.end(), [required](const VkExtensionProperties& extension)
+		{
+			return strcmp(extension.extensionName, required) == 0;
+		});
+		if (found == availableExtensions.end())
+		{
+			return support;
+		}
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures	= {};
+	indexingFeatures.sType											= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2KHR features							= {};
+	features.sType													= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext													= &indexingFeatures;
+	getFeatures2(physicalDevice, &features);
+
+	// Update-unused-while-pending is what lets new resources be registered while earlier frames still run
+	if (!indexingFeatures.runtimeDescriptorArray || !indexingFeatures.descriptorBindingPartiallyBound || !indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+		|| !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind || !indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind)
+	{
+		return support;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties	= {};
+	indexingProperties.sType											= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2KHR properties							= {};
+	properties.sType													= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+	properties.pNext													= &indexingProperties;
+	getProperties2(physicalDevice, &properties);
+
+	// A combined image sampler counts against both the sampled image and the sampler limits
+	support.maxImages	= std::min({ DEFAULT_MAX_IMAGES,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+	support.maxBuffers	= std::min({ DEFAULT_MAX_BUFFERS,
+		indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+	// Both arrays are visible to the fragment stage, which has a budget for all of them together
+	uint32_t stageBudget	= indexingProperties.maxPerStageUpdateAfterBindResources;
+	support.maxImages		= std::min(support.maxImages, stageBudget / 2);
+	support.maxBuffers		= std::min(support.maxBuffers, stageBudget - support.maxImages);
+
+	support.features.sType											= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	support.features.runtimeDescriptorArray							= VK_TRUE;
+	support.features.descriptorBindingPartiallyBound				= VK_TRUE;
+	support.features.descriptorBindingUpdateUnusedWhilePending		= VK_TRUE;
+	support.features.descriptorBindingSampledImageUpdateAfterBind	= VK_TRUE;
+	support.features.descriptorBindingStorageBufferUpdateAfterBind	= VK_TRUE;
+	support.features.shaderSampledImageArrayNonUniformIndexing		= indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+	support.features.shaderStorageBufferArrayNonUniformIndexing		= indexingFeatures.shaderStorageBufferArrayNonUniformIndexing;
+	support.isSupported												= support.maxImages > 0 && support.maxBuffers > 0;
+	return support;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanBindlessTable::VulkanBindlessTable()
+	: m_device(VK_NULL_HANDLE)
+	, m_layout(VK_NULL_HANDLE)
+	, m_pool(VK_NULL_HANDLE)
+	, m_set(VK_NULL_HANDLE)
+	, m_frameNumber(0)
+	, m_releaseDelay(DEFAULT_RELEASE_DELAY)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanBindlessTable::~VulkanBindlessTable()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::Initialize(const VkDevice& device, const VulkanBindlessSupport& support, uint32_t releaseDelay)
+{
+	m_device				= device;
+	m_releaseDelay			= releaseDelay;
+	m_frameNumber			= 0;
+	m_imageSlots			= SlotList();
+	m_bufferSlots			= SlotList();
+	m_imageSlots.capacity	= support.maxImages;
+	m_bufferSlots.capacity	= support.maxBuffers;
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings	= {};
+	bindings[0].binding										= IMAGE_BINDING;
+	bindings[0].descriptorType								= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount								= m_imageSlots.capacity;
+	bindings[0].stageFlags									= VK_SHADER_STAGE_ALL;
+	bindings[1].binding										= BUFFER_BINDING;
+	bindings[1].descriptorType								= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount								= m_bufferSlots.capacity;
+	bindings[1].stageFlags									= VK_SHADER_STAGE_ALL;
+
+	// Slots nobody registered yet stay empty, which partially bound allows as long as shaders never read them
+	const VkDescriptorBindingFlagsEXT bindingFlag	= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags	= { bindingFlag, bindingFlag };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo	= {};
+	flagsInfo.sType												= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flagsInfo.bindingCount										= (uint32_t)bindingFlags.size();
+	flagsInfo.pBindingFlags										= bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo	= {};
+	layoutInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext							= &flagsInfo;
+	layoutInfo.flags							= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutInfo.bindingCount						= (uint32_t)bindings.size();
+	layoutInfo.pBindings						= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor set layout!");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes	= {};
+	poolSizes[0].type								= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount					= m_imageSlots.capacity;
+	poolSizes[1].type								= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount					= m_bufferSlots.capacity;
+
+	VkDescriptorPoolCreateInfo poolInfo	= {};
+	poolInfo.sType						= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags						= VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolInfo.poolSizeCount				= (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes					= poolSizes.data();
+	poolInfo.maxSets					= 1;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create bindless descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo	= {};
+	allocInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool				= m_pool;
+	allocInfo.descriptorSetCount			= 1;
+	allocInfo.pSetLayouts					= &m_layout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_set) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate bindless descriptor set!");
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Destroying the pool frees the set allocated from it
+	vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_layout, nullptr);
+	m_pool		= VK_NULL_HANDLE;
+	m_layout	= VK_NULL_HANDLE;
+	m_set		= VK_NULL_HANDLE;
+	m_device	= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::BeginFrame()
+{
+	++m_frameNumber;
+	RecycleSlots(m_imageSlots);
+	RecycleSlots(m_bufferSlots);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanBindlessTable::AddImage(const VkImageView& imageView, const VkSampler& sampler, VkImageLayout layout)
+{
+	uint32_t index = AcquireSlot(m_imageSlots);
+
+	VkDescriptorImageInfo imageInfo	= {};
+	imageInfo.imageLayout			= layout;
+	imageInfo.imageView				= imageView;
+	imageInfo.sampler				= sampler;
+
+	VkWriteDescriptorSet write	= {};
+	write.sType					= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet				= m_set;
+	write.dstBinding			= IMAGE_BINDING;
+	write.dstArrayElement		= index;
+	write.descriptorType		= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount		= 1;
+	write.pImageInfo			= &imageInfo;
+
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	return index;
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanBindlessTable::AddBuffer(const VkBuffer& buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	uint32_t index = AcquireSlot(m_bufferSlots);
+
+	VkDescriptorBufferInfo bufferInfo	= {};
+	bufferInfo.buffer					= buffer;
+	bufferInfo.offset					= offset;
+	bufferInfo.range					= range;
+
+	VkWriteDescriptorSet write	= {};
+	write.sType					= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet				= m_set;
+	write.dstBinding			= BUFFER_BINDING;
+	write.dstArrayElement		= index;
+	write.descriptorType		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.descriptorCount		= 1;
+	write.pBufferInfo			= &bufferInfo;
+
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	return index;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::ReleaseImage(uint32_t index)
+{
+	m_imageSlots.pending.push_back({ index, m_frameNumber });
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::ReleaseBuffer(uint32_t index)
+{
+	m_bufferSlots.pending.push_back({ index, m_frameNumber });
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanBindlessTable::AcquireSlot(SlotList& slots)
+{
+	if (!slots.freeSlots.empty())
+	{
+		uint32_t index = slots.freeSlots.back();
+		slots.freeSlots.pop_back();
+		return index;
+	}
+
+	if (slots.highWater >= slots.capacity)
+	{
+		throw std::runtime_error("bindless descriptor table is full!");
+	}
+	return slots.highWater++;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanBindlessTable::RecycleSlots(SlotList& slots)
+{
+	// Released in frame order, so everything old enough is at the front
+	size_t recycled = 0;
+	while (recycled < slots.pending.size() && slots.pending[recycled].frame + m_releaseDelay <= m_frameNumber)
+	{
+		slots.freeSlots.push_back(slots.pending[recycled].index);
+		++recycled;
+	}
+	slots.pending.erase(slots.pending.begin(), slots.pending.begin() + recycled);
+}
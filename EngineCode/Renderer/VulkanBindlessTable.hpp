@@ -0,0 +1,91 @@
+#pragma once
+
+#ifndef _VULKAN_BINDLESS_TABLE_H_
+#define _VULKAN_BINDLESS_TABLE_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// What the device has to enable for a bindless table, filled in by VulkanBindlessTable::QuerySupport
+struct VulkanBindlessSupport
+{
+	bool											isSupported		= false;
+	uint32_t										maxImages		= 0;
+	uint32_t										maxBuffers		= 0;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT	features		= {};	// Chain into VkDeviceCreateInfo::pNext
+};
+
+//---------------------------------------------------------------------------------------------------
+// One descriptor set holding every sampled image and storage buffer the renderer knows of, as two
+// large, partially bound, update-after-bind arrays. Shaders index them with a per-draw index, so the
+// set is bound once per command buffer no matter how many materials the draws use, and registering a
+// resource never invalidates command buffers that are being recorded or are in flight.
+//
+// A released slot is only reused after releaseDelay further BeginFrame calls, which should be the number
+// of frames in flight, by which time no frame can still be reading it.
+class VulkanBindlessTable
+{
+public:
+	static const uint32_t		IMAGE_BINDING			= 0;
+	static const uint32_t		BUFFER_BINDING			= 1;
+	static const uint32_t		DEFAULT_MAX_IMAGES		= 16 * 1024;
+	static const uint32_t		DEFAULT_MAX_BUFFERS		= 4 * 1024;
+	static const uint32_t		DEFAULT_RELEASE_DELAY	= 3;
+	static const uint32_t		INVALID_INDEX			= ~0u;
+
+	// Needs VK_KHR_get_physical_device_properties2 on the instance, without it bindless is reported unsupported
+	static VulkanBindlessSupport	QuerySupport(const VkInstance& instance, const VkPhysicalDevice& physicalDevice);
+	static const std::vector<const char*>&	GetDeviceExtensions();
+
+public:
+	VulkanBindlessTable();
+	~VulkanBindlessTable();
+
+	void					Initialize(const VkDevice& device, const VulkanBindlessSupport& support, uint32_t releaseDelay = DEFAULT_RELEASE_DELAY);
+	void					Uninitialize();
+	void					BeginFrame();
+
+	uint32_t				AddImage(const VkImageView& imageView, const VkSampler& sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	uint32_t				AddBuffer(const VkBuffer& buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	void					ReleaseImage(uint32_t index);
+	void					ReleaseBuffer(uint32_t index);
+
+	VkDescriptorSetLayout	GetLayout() const		{ return m_layout; }
+	VkDescriptorSet			GetSet() const			{ return m_set; }
+	uint32_t				GetImageCount() const	{ return m_imageSlots.GetLiveCount(); }
+	uint32_t				GetBufferCount() const	{ return m_bufferSlots.GetLiveCount(); }
+
+private:
+	struct PendingRelease
+	{
+		uint32_t				index;
+		uint64_t				frame;
+	};
+
+	struct SlotList
+	{
+		uint32_t						capacity	= 0;
+		uint32_t						highWater	= 0;
+		std::vector<uint32_t>			freeSlots;
+		std::vector<PendingRelease>		pending;
+
+		uint32_t						GetLiveCount() const	{ return highWater - (uint32_t)(freeSlots.size() + pending.size()); }
+	};
+
+private:
+	uint32_t				AcquireSlot(SlotList& slots);
+	void					RecycleSlots(SlotList& slots);
+
+private:
+	VkDevice				m_device;
+	VkDescriptorSetLayout	m_layout;
+	VkDescriptorPool		m_pool;
+	VkDescriptorSet			m_set;
+	SlotList				m_imageSlots;
+	SlotList				m_bufferSlots;
+	uint64_t				m_frameNumber;
+	uint32_t				m_releaseDelay;
+};
+#endif // !_VULKAN_BINDLESS_TABLE_H_
@@ -0,0 +1,315 @@
+#include "VulkanDepthPyramid.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+static uint32_t GetPreviousPowerOfTwo(uint32_t value)
+{
+	uint32_t power = 1;
+	while (power * 2 <= value)
+	{
+		power *= 2;
+	}
+	return power;
+}
+
+//---------------------------------------------------------------------------------------------------
+static VkImageMemoryBarrier MakePyramidBarrier(const VkImage& image, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+	VkImageMemoryBarrier barrier			= {};
+	barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout						= oldLayout;
+	barrier.newLayout						= newLayout;
+	barrier.srcAccessMask					= srcAccess;
+	barrier.dstAccessMask					= dstAccess;
+	barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.image							= image;
+	barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel	= baseLevel;
+	barrier.subresourceRange.levelCount		= levelCount;
+	barrier.subresourceRange.baseArrayLayer	= 0;
+	barrier.subresourceRange.layerCount		= 1;
+	return barrier;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanDepthPyramid::VulkanDepthPyramid()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_descriptorAllocator(nullptr)
+	, m_reduceTemplate(0)
+	, m_setLayout(VK_NULL_HANDLE)
+	, m_pipelineLayout(VK_NULL_HANDLE)
+	, m_pipeline(VK_NULL_HANDLE)
+	, m_sampler(VK_NULL_HANDLE)
+	, m_image(VK_NULL_HANDLE)
+	, m_view(VK_NULL_HANDLE)
+	, m_width(0)
+	, m_height(0)
+	, m_levelCount(0)
+	, m_needsTransition(false)
+	, m_hasHistory(false)
+{
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanDepthPyramid::~VulkanDepthPyramid()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& reduceShader)
+{
+	m_device				= device;
+	m_allocator				= &allocator;
+	m_descriptorAllocator	= &descriptorAllocator;
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding			= 0;
+	bindings[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount	= 1;
+	bindings[0].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding			= 1;
+	bindings[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount	= 1;
+	bindings[1].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo	= {};
+	layoutInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount						= (uint32_t)bindings.size();
+	layoutInfo.pBindings						= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth reduce descriptor set layout!");
+	}
+
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(2);
+	entries[0].dstBinding		= 0;
+	entries[0].dstArrayElement	= 0;
+	entries[0].descriptorCount	= 1;
+	entries[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	entries[0].offset			= offsetof(ReduceDescriptorData, source);
+	entries[0].stride			= sizeof(VkDescriptorImageInfo);
+	entries[1].dstBinding		= 1;
+	entries[1].dstArrayElement	= 0;
+	entries[1].descriptorCount	= 1;
+	entries[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	entries[1].offset			= offsetof(ReduceDescriptorData, destination);
+	entries[1].stride			= sizeof(VkDescriptorImageInfo);
+	m_reduceTemplate = descriptorAllocator.CreateTemplate(m_setLayout, entries, sizeof(ReduceDescriptorData));
+
+	// The reduction fetches texels directly, filtering would blend depths across an edge
+	VkSamplerCreateInfo samplerInfo		= {};
+	samplerInfo.sType					= VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter				= VK_FILTER_NEAREST;
+	samplerInfo.minFilter				= VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode				= VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod					= VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+
+	CreatePipeline(pipelineCache, reduceShader);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	DestroyImage();
+
+	// Descriptor sets and the update template belong to the descriptor allocator
+	vkDestroyPipeline(m_device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+	vkDestroySampler(m_device, m_sampler, nullptr);
+
+	m_pipeline				= VK_NULL_HANDLE;
+	m_pipelineLayout		= VK_NULL_HANDLE;
+	m_setLayout				= VK_NULL_HANDLE;
+	m_sampler				= VK_NULL_HANDLE;
+	m_descriptorAllocator	= nullptr;
+	m_allocator				= nullptr;
+	m_device				= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::Resize(uint32_t depthWidth, uint32_t depthHeight)
+{
+	DestroyImage();
+
+	m_width			= GetPreviousPowerOfTwo(std::max(1u, depthWidth));
+	m_height		= GetPreviousPowerOfTwo(std::max(1u, depthHeight));
+	m_levelCount	= 1;
+	for (uint32_t extent = std::max(m_width, m_height); extent > 1; extent >>= 1)
+	{
+		++m_levelCount;
+	}
+
+	VkImageCreateInfo imageInfo		= {};
+	imageInfo.sType					= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType				= VK_IMAGE_TYPE_2D;
+	imageInfo.format				= FORMAT;
+	imageInfo.extent				= { m_width, m_height, 1 };
+	imageInfo.mipLevels				= m_levelCount;
+	imageInfo.arrayLayers			= 1;
+	imageInfo.samples				= VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling				= VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage					= VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	imageInfo.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout			= VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_device, &imageInfo, nullptr, &m_image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid image!");
+	}
+	m_memory = m_allocator->AllocateForImage(m_image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vkBindImageMemory(m_device, m_image, m_memory.memory, m_memory.offset);
+
+	m_view = CreateView(0, m_levelCount);
+	m_levelViews.resize(m_levelCount);
+	for (uint32_t level = 0; level < m_levelCount; ++level)
+	{
+		m_levelViews[level] = CreateView(level, 1);
+	}
+
+	m_needsTransition	= true;
+	m_hasHistory		= false;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::RecordPending(const VkCommandBuffer& commandBuffer)
+{
+	if (!m_needsTransition)
+	{
+		return;
+	}
+
+	VkImageMemoryBarrier barrier = MakePyramidBarrier(m_image, 0, m_levelCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	m_needsTransition = false;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::RecordBuild(const VkCommandBuffer& commandBuffer, const VkImageView& depthView, const VkExtent2D& depthExtent)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+	ReduceConstants constants;
+	constants.sourceSize[0]	= (int32_t)std::max(1u, depthExtent.width);
+	constants.sourceSize[1]	= (int32_t)std::max(1u, depthExtent.height);
+
+	for (uint32_t level = 0; level < m_levelCount; ++level)
+	{
+		ReduceDescriptorData data;
+		data.source			= level == 0 ? VkDescriptorImageInfo{ m_sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL } : VkDescriptorImageInfo{ m_sampler, m_levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL };
+		data.destination	= { VK_NULL_HANDLE, m_levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+
+		VkDescriptorSet set = m_descriptorAllocator->AllocateFrame(m_reduceTemplate, &data);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+
+		constants.destinationSize[0]	= (int32_t)std::max(1u, m_width >> level);
+		constants.destinationSize[1]	= (int32_t)std::max(1u, m_height >> level);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReduceConstants), &constants);
+		vkCmdDispatch(commandBuffer, (constants.destinationSize[0] + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (constants.destinationSize[1] + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		// The level just written is the next one's source, it stays in GENERAL
+		VkImageMemoryBarrier barrier = MakePyramidBarrier(m_image, level, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		constants.sourceSize[0]	= constants.destinationSize[0];
+		constants.sourceSize[1]	= constants.destinationSize[1];
+	}
+	m_hasHistory = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::DestroyImage()
+{
+	for (VkImageView view : m_levelViews)
+	{
+		vkDestroyImageView(m_device, view, nullptr);
+	}
+	m_levelViews.clear();
+
+	if (m_image != VK_NULL_HANDLE)
+	{
+		vkDestroyImageView(m_device, m_view, nullptr);
+		vkDestroyImage(m_device, m_image, nullptr);
+		m_allocator->Free(m_memory);
+	}
+	m_view			= VK_NULL_HANDLE;
+	m_image			= VK_NULL_HANDLE;
+	m_hasHistory	= false;
+}
+
+//---------------------------------------------------------------------------------------------------
+VkImageView VulkanDepthPyramid::CreateView(uint32_t baseLevel, uint32_t levelCount) const
+{
+	VkImageViewCreateInfo viewInfo				= {};
+	viewInfo.sType								= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image								= m_image;
+	viewInfo.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format								= FORMAT;
+	viewInfo.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel		= baseLevel;
+	viewInfo.subresourceRange.levelCount		= levelCount;
+	viewInfo.subresourceRange.baseArrayLayer	= 0;
+	viewInfo.subresourceRange.layerCount		= 1;
+
+	VkImageView view;
+	if (vkCreateImageView(m_device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid view!");
+	}
+	return view;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDepthPyramid::CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& reduceShader)
+{
+	VkPushConstantRange constantRange			= {};
+	constantRange.stageFlags					= VK_SHADER_STAGE_COMPUTE_BIT;
+	constantRange.offset						= 0;
+	constantRange.size							= sizeof(ReduceConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo	= {};
+	pipelineLayoutInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount				= 1;
+	pipelineLayoutInfo.pSetLayouts					= &m_setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount		= 1;
+	pipelineLayoutInfo.pPushConstantRanges			= &constantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth reduce pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo	= {};
+	pipelineInfo.sType							= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType					= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage					= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module					= reduceShader;
+	pipelineInfo.stage.pName					= "main";
+	pipelineInfo.layout							= m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth reduce pipeline!");
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#ifndef _VULKAN_DEPTH_PYRAMID_H_
+#define _VULKAN_DEPTH_PYRAMID_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanDescriptorAllocator.hpp"
+#include "VulkanMemoryAllocator.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// A hierarchical-Z pyramid of a depth target for occlusion culling. Every texel holds the farthest
+// depth of the area it covers, so anything whose nearest depth lies behind it is hidden there.
+// DepthReduce.comp builds it level by level, level 0 from the depth target and each level after that
+// from the one above it.
+//
+// Level 0 is the power of two at or below the depth target in each dimension, so every later level
+// halves exactly and level 0 takes the farthest of the up to 3x3 depth texels each of its texels
+// overlaps. The pyramid always spans the whole viewport, whatever part of the depth target that was
+// rendered to, and outlives the frame that built it: the culler tests against last frame's pyramid
+// before this frame has any depth.
+class VulkanDepthPyramid
+{
+public:
+	static const uint32_t		WORKGROUP_SIZE		= 8;	// local_size_x and local_size_y of DepthReduce.comp
+	static const VkFormat		FORMAT				= VK_FORMAT_R32_SFLOAT;
+
+public:
+	VulkanDepthPyramid();
+	~VulkanDepthPyramid();
+
+	// The shader module is only used during the call
+	void					Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& reduceShader);
+	void					Uninitialize();
+
+	// Recreates the pyramid for a depth target of that size and drops its history. The previous
+	// pyramid may not be in use on the GPU any more
+	void					Resize(uint32_t depthWidth, uint32_t depthHeight);
+
+	VkImage					GetImage() const			{ return m_image; }
+	VkImageView				GetView() const				{ return m_view; }		// The whole chain
+	VkSampler				GetSampler() const			{ return m_sampler; }	// Nearest, clamped, every level
+	uint32_t				GetWidth() const			{ return m_width; }
+	uint32_t				GetHeight() const			{ return m_height; }
+	uint32_t				GetLevelCount() const		{ return m_levelCount; }
+
+	// Whether a build has been recorded since the last resize, i.e. whether the contents mean anything
+	bool					HasHistory() const			{ return m_hasHistory; }
+
+	// Once after a resize, brings every level into SHADER_READ_ONLY_OPTIMAL, the state it sits in between frames
+	void					RecordPending(const VkCommandBuffer& commandBuffer);
+
+	// The depth view has to be sampleable in SHADER_READ_ONLY_OPTIMAL and the pyramid in GENERAL, where
+	// it is left. Only the depthExtent corner of the depth target is read
+	void					RecordBuild(const VkCommandBuffer& commandBuffer, const VkImageView& depthView, const VkExtent2D& depthExtent);
+
+private:
+	// Contents of the reduce set, in the layout its update template reads
+	struct ReduceDescriptorData
+	{
+		VkDescriptorImageInfo	source;
+		VkDescriptorImageInfo	destination;
+	};
+
+	// Push constants of DepthReduce.comp
+	struct ReduceConstants
+	{
+		int32_t					sourceSize[2];
+		int32_t					destinationSize[2];
+	};
+
+private:
+	void					DestroyImage();
+	VkImageView				CreateView(uint32_t baseLevel, uint32_t levelCount) const;
+	void					CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& reduceShader);
+
+private:
+	VkDevice								m_device;
+	VulkanMemoryAllocator*					m_allocator;
+	VulkanDescriptorAllocator*				m_descriptorAllocator;
+	DescriptorTemplate						m_reduceTemplate;
+	VkDescriptorSetLayout					m_setLayout;
+	VkPipelineLayout						m_pipelineLayout;
+	VkPipeline								m_pipeline;
+	VkSampler								m_sampler;
+	VkImage									m_image;
+	VulkanAllocation						m_memory;
+	VkImageView								m_view;
+	std::vector<VkImageView>				m_levelViews;
+	uint32_t								m_width;
+	uint32_t								m_height;
+	uint32_t								m_levelCount;
+	bool									m_needsTransition;
+	bool									m_hasHistory;
+};
+#endif // !_VULKAN_DEPTH_PYRAMID_H_
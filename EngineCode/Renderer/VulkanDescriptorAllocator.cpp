@@ -0,0 +1,369 @@
+#include "VulkanDescriptorAllocator.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+// Descriptors of each type per set a pool is sized for. A pool rarely runs out of one type long before
+// the others this way, and when it does the chain just moves on to the next pool
+static const struct { VkDescriptorType type; float perSet; } POOL_RATIOS[] =
+{
+	{ VK_DESCRIPTOR_TYPE_SAMPLER,					0.5f },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,	4.0f },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,				4.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,				1.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,		1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,		1.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,			2.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,			2.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,	1.0f },
+	{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,			0.5f },
+};
+
+//---------------------------------------------------------------------------------------------------
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+	// FNV-1a, descriptor data is a few dozen bytes so anything fancier is not worth it
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanDescriptorAllocator::VulkanDescriptorAllocator()
+	: m_device(VK_NULL_HANDLE)
+	, m_useUpdateTemplates(false)
+	, m_createUpdateTemplate(nullptr)
+	, m_destroyUpdateTemplate(nullptr)
+	, m_updateWithTemplate(nullptr)
+	, m_currentFrame(0)
+	, m_cacheHits(0)
+	, m_cacheMisses(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::Initialize(const VkDevice& device, uint32_t frameCount, bool useUpdateTemplates)
+{
+	m_device		= device;
+	m_currentFrame	= 0;
+	m_frameChains.resize(frameCount);
+
+	if (useUpdateTemplates)
+	{
+		m_createUpdateTemplate	= (PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(m_device, "vkCreateDescriptorUpdateTemplateKHR");
+		m_destroyUpdateTemplate	= (PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(m_device, "vkDestroyDescriptorUpdateTemplateKHR");
+		m_updateWithTemplate	= (PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(m_device, "vkUpdateDescriptorSetWithTemplateKHR");
+	}
+	m_useUpdateTemplates = m_createUpdateTemplate && m_destroyUpdateTemplate && m_updateWithTemplate;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (const Template& descriptorTemplate : m_templates)
+	{
+		if (descriptorTemplate.handle != VK_NULL_HANDLE)
+		{
+			m_destroyUpdateTemplate(m_device, descriptorTemplate.handle, nullptr);
+		}
+	}
+	m_templates.clear();
+	m_cache.clear();
+
+	// Destroying a pool frees every set allocated from it
+	for (VkDescriptorPool pool : m_persistentChain.pools)
+	{
+		vkDestroyDescriptorPool(m_device, pool, nullptr);
+	}
+	m_persistentChain = PoolChain();
+
+	for (PoolChain& chain : m_frameChains)
+	{
+		for (VkDescriptorPool pool : chain.pools)
+		{
+			vkDestroyDescriptorPool(m_device, pool, nullptr);
+		}
+	}
+	m_frameChains.clear();
+
+	m_useUpdateTemplates	= false;
+	m_device				= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+	m_currentFrame		= frameIndex % (uint32_t)m_frameChains.size();
+	PoolChain& chain	= m_frameChains[m_currentFrame];
+
+	// Pools that filled up last time are kept, the next frame most likely needs as many sets again
+	for (VkDescriptorPool pool : chain.pools)
+	{
+		vkResetDescriptorPool(m_device, pool, 0);
+	}
+	chain.currentPool	= 0;
+	chain.allocatedSets	= 0;
+}
+
+//---------------------------------------------------------------------------------------------------
+DescriptorTemplate VulkanDescriptorAllocator::CreateTemplate(const VkDescriptorSetLayout& layout, const std::vector<VkDescriptorUpdateTemplateEntryKHR>& entries, size_t dataSize)
+{
+	Template descriptorTemplate;
+	descriptorTemplate.layout	= layout;
+	descriptorTemplate.entries	= entries;
+	descriptorTemplate.dataSize	= dataSize;
+	descriptorTemplate.handle	= VK_NULL_HANDLE;
+
+	if (m_useUpdateTemplates)
+	{
+		VkDescriptorUpdateTemplateCreateInfoKHR templateInfo	= {};
+		templateInfo.sType										= VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+		templateInfo.descriptorUpdateEntryCount					= (uint32_t)entries.size();
+		templateInfo.pDescriptorUpdateEntries					= entries.data();
+		templateInfo.templateType								= VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+		templateInfo.descriptorSetLayout						= layout;
+
+		if (m_createUpdateTemplate(m_device, &templateInfo, nullptr, &descriptorTemplate.handle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor update template!");
+		}
+	}
+
+	m_templates.push_back(descriptorTemplate);
+	return (DescriptorTemplate)m_templates.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorSet VulkanDescriptorAllocator::AllocatePersistent(const VkDescriptorSetLayout& layout)
+{
+	return Allocate(m_persistentChain, layout);
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorSet VulkanDescriptorAllocator::AllocateFrame(const VkDescriptorSetLayout& layout)
+{
+	return Allocate(m_frameChains[m_currentFrame], layout);
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorSet VulkanDescriptorAllocator::AllocateFrame(DescriptorTemplate descriptorTemplate, const void* data)
+{
+	VkDescriptorSet set = AllocateFrame(m_templates[descriptorTemplate].layout);
+	Write(set, descriptorTemplate, data);
+	return set;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::Write(const VkDescriptorSet& set, DescriptorTemplate descriptorTemplate, const void* data)
+{
+	const Template& entry = m_templates[descriptorTemplate];
+	if (m_useUpdateTemplates)
+	{
+		m_updateWithTemplate(m_device, set, entry.handle, data);
+	}
+	else
+	{
+		WriteWithoutTemplate(set, entry, data);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorSet VulkanDescriptorAllocator::GetCached(DescriptorTemplate descriptorTemplate, const void* data)
+{
+	size_t dataSize	= m_templates[descriptorTemplate].dataSize;
+	uint64_t hash	= HashBytes(14695981039346656037ull, &descriptorTemplate, sizeof(descriptorTemplate));
+	hash			= HashBytes(hash, data, dataSize);
+
+	std::vector<CacheEntry>& bucket = m_cache[hash];
+	for (const CacheEntry& entry : bucket)
+	{
+		if (entry.descriptorTemplate == descriptorTemplate && memcmp(entry.data.data(), data, dataSize) == 0)
+		{
+			++m_cacheHits;
+			return entry.set;
+		}
+	}
+
+	++m_cacheMisses;
+	CacheEntry entry;
+	entry.descriptorTemplate	= descriptorTemplate;
+	entry.data.assign((const uint8_t*)data, (const uint8_t*)data + dataSize);
+	entry.set					= AllocatePersistent(m_templates[descriptorTemplate].layout);
+	Write(entry.set, descriptorTemplate, data);
+	bucket.push_back(entry);
+	return entry.set;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::FlushCache()
+{
+	m_cache.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorSet VulkanDescriptorAllocator::Allocate(PoolChain& chain, const VkDescriptorSetLayout& layout)
+{
+	bool isNewPool = chain.pools.empty();
+	if (isNewPool)
+	{
+		chain.pools.push_back(CreatePool(DEFAULT_SETS_PER_POOL));
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo	= {};
+	allocInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount			= 1;
+	allocInfo.pSetLayouts					= &layout;
+
+	for (;;)
+	{
+		allocInfo.descriptorPool = chain.pools[chain.currentPool];
+
+		VkDescriptorSet set;
+		VkResult result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+		if (result == VK_SUCCESS)
+		{
+			++chain.allocatedSets;
+			return set;
+		}
+
+		// Out of pool memory and fragmentation are the expected failures, 1.0 drivers without
+		// maintenance1 may report either as out of memory, so every failure moves on to the next pool.
+		// Only an empty pool failing means the layout can never be allocated
+		if (isNewPool)
+		{
+			throw std::runtime_error("failed to allocate descriptor set!");
+		}
+
+		if (++chain.currentPool == chain.pools.size())
+		{
+			uint32_t maxSets = std::min(MAX_SETS_PER_POOL, DEFAULT_SETS_PER_POOL << std::min<size_t>(chain.pools.size(), 6));
+			chain.pools.push_back(CreatePool(maxSets));
+			isNewPool = true;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDescriptorPool VulkanDescriptorAllocator::CreatePool(uint32_t maxSets)
+{
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& ratio : POOL_RATIOS)
+	{
+		VkDescriptorPoolSize poolSize	= {};
+		poolSize.type					= ratio.type;
+		poolSize.descriptorCount		= std::max(1u, (uint32_t)(ratio.perSet * maxSets));
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo	= {};
+	poolInfo.sType						= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount				= (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes					= poolSizes.data();
+	poolInfo.maxSets					= maxSets;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+	return pool;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::WriteWithoutTemplate(const VkDescriptorSet& set, const Template& descriptorTemplate, const void* data)
+{
+	// Sized up front, the writes point into these
+	uint32_t descriptorCount = 0;
+	for (const VkDescriptorUpdateTemplateEntryKHR& entry : descriptorTemplate.entries)
+	{
+		descriptorCount += entry.descriptorCount;
+	}
+
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	std::vector<VkDescriptorBufferInfo> bufferInfos;
+	std::vector<VkBufferView> texelBufferViews;
+	std::vector<VkWriteDescriptorSet> writes;
+	imageInfos.reserve(descriptorCount);
+	bufferInfos.reserve(descriptorCount);
+	texelBufferViews.reserve(descriptorCount);
+	writes.reserve(descriptorTemplate.entries.size());
+
+	for (const VkDescriptorUpdateTemplateEntryKHR& entry : descriptorTemplate.entries)
+	{
+		const uint8_t* source		= (const uint8_t*)data + entry.offset;
+
+		VkWriteDescriptorSet write	= {};
+		write.sType					= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet				= set;
+		write.dstBinding			= entry.dstBinding;
+		write.dstArrayElement		= entry.dstArrayElement;
+		write.descriptorType		= entry.descriptorType;
+		write.descriptorCount		= entry.descriptorCount;
+
+		switch (entry.descriptorType)
+		{
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			write.pImageInfo = imageInfos.data() + imageInfos.size();
+			for (uint32_t i = 0; i < entry.descriptorCount; ++i)
+			{
+				imageInfos.push_back(*(const VkDescriptorImageInfo*)(source + i * entry.stride));
+			}
+			break;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			write.pTexelBufferView = texelBufferViews.data() + texelBufferViews.size();
+			for (uint32_t i = 0; i < entry.descriptorCount; ++i)
+			{
+				texelBufferViews.push_back(*(const VkBufferView*)(source + i * entry.stride));
+			}
+			break;
+		default:
+			write.pBufferInfo = bufferInfos.data() + bufferInfos.size();
+			for (uint32_t i = 0; i < entry.descriptorCount; ++i)
+			{
+				bufferInfos.push_back(*(const VkDescriptorBufferInfo*)(source + i * entry.stride));
+			}
+			break;
+		}
+		writes.push_back(write);
+	}
+
+	vkUpdateDescriptorSets(m_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanDescriptorAllocator::PrintStats() const
+{
+	size_t framePools = 0;
+	for (const PoolChain& chain : m_frameChains)
+	{
+		framePools += chain.pools.size();
+	}
+
+	std::cout << "descriptor allocator: " << m_persistentChain.allocatedSets << " persistent sets in " << m_persistentChain.pools.size() << " pools, "
+		<< framePools << " frame pools, cache " << m_cacheHits << " hits / " << m_cacheMisses << " misses, "
+		<< (m_useUpdateTemplates ? "update templates" : "plain descriptor writes") << std::endl;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef _VULKAN_DESCRIPTOR_ALLOCATOR_H_
+#define _VULKAN_DESCRIPTOR_ALLOCATOR_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <unordered_map>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+typedef uint32_t DescriptorTemplate;
+
+//---------------------------------------------------------------------------------------------------
+// Hands out descriptor sets from chains of pools that grow whenever the current pool runs dry:
+//  - persistent sets live until Uninitialize,
+//  - frame sets come from the pools of one frame in flight, reset wholesale by BeginFrame once that
+//    frame's fence has signaled, so per-draw sets cost an allocation and a write and nothing else,
+//  - cached sets are persistent sets keyed by their layout and binding contents, written once and
+//    shared by everyone asking for the same contents.
+// Writes go through descriptor update templates: the caller describes once where each descriptor
+// lives in a struct of its own, then writes a whole set from one pointer. Without
+// VK_KHR_descriptor_update_template the same description is turned into vkUpdateDescriptorSets.
+class VulkanDescriptorAllocator
+{
+public:
+	static const uint32_t		DEFAULT_SETS_PER_POOL	= 64;
+	static const uint32_t		MAX_SETS_PER_POOL		= 4096;
+
+public:
+	VulkanDescriptorAllocator();
+	~VulkanDescriptorAllocator();
+
+	void					Initialize(const VkDevice& device, uint32_t frameCount, bool useUpdateTemplates);
+	void					Uninitialize();
+
+	// Resets the pools of this frame, every set allocated from them in its last use becomes invalid
+	void					BeginFrame(uint32_t frameIndex);
+
+	// Entry offsets and strides point into the data later passed to Write, exactly as for an update template
+	DescriptorTemplate		CreateTemplate(const VkDescriptorSetLayout& layout, const std::vector<VkDescriptorUpdateTemplateEntryKHR>& entries, size_t dataSize);
+
+	VkDescriptorSet			AllocatePersistent(const VkDescriptorSetLayout& layout);
+	VkDescriptorSet			AllocateFrame(const VkDescriptorSetLayout& layout);
+	void					Write(const VkDescriptorSet& set, DescriptorTemplate descriptorTemplate, const void* data);
+
+	// A frame set written from data, valid for the current frame only
+	VkDescriptorSet			AllocateFrame(DescriptorTemplate descriptorTemplate, const void* data);
+
+	// Handles are part of the key, and a destroyed resource's handle value may be handed out again to a
+	// new one. Callers destroying a resource a cached set refers to must FlushCache, or the new resource
+	// would match a set whose descriptors point at the destroyed one
+	VkDescriptorSet			GetCached(DescriptorTemplate descriptorTemplate, const void* data);
+
+	// Forgets every cached set. The sets stay allocated in the persistent pools until Uninitialize
+	void					FlushCache();
+
+	bool					IsUsingUpdateTemplates() const	{ return m_useUpdateTemplates; }
+	void					PrintStats() const;
+
+private:
+	struct PoolChain
+	{
+		std::vector<VkDescriptorPool>	pools;
+		uint32_t						currentPool		= 0;
+		uint32_t						allocatedSets	= 0;
+	};
+
+	struct Template
+	{
+		VkDescriptorSetLayout							layout;
+		std::vector<VkDescriptorUpdateTemplateEntryKHR>	entries;
+		size_t											dataSize;
+		VkDescriptorUpdateTemplateKHR					handle;
+	};
+
+	struct CacheEntry
+	{
+		DescriptorTemplate		descriptorTemplate;
+		std::vector<uint8_t>	data;
+		VkDescriptorSet			set;
+	};
+
+private:
+	VkDescriptorSet			Allocate(PoolChain& chain, const VkDescriptorSetLayout& layout);
+	VkDescriptorPool		CreatePool(uint32_t maxSets);
+	void					WriteWithoutTemplate(const VkDescriptorSet& set, const Template& descriptorTemplate, const void* data);
+
+private:
+	VkDevice									m_device;
+	bool										m_useUpdateTemplates;
+	PFN_vkCreateDescriptorUpdateTemplateKHR		m_createUpdateTemplate;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR	m_destroyUpdateTemplate;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR	m_updateWithTemplate;
+	PoolChain									m_persistentChain;
+	std::vector<PoolChain>						m_frameChains;
+	uint32_t									m_currentFrame;
+	std::vector<Template>						m_templates;
+	std::unordered_map<uint64_t, std::vector<CacheEntry>>	m_cache;	// Keyed by a hash of template and data
+	uint32_t									m_cacheHits;
+	uint32_t									m_cacheMisses;
+};
+#endif // !_VULKAN_DESCRIPTOR_ALLOCATOR_H_
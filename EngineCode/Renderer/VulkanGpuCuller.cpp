@@ -0,0 +1,388 @@
+#include "VulkanGpuCuller.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::ExtractFrustumPlanes(const float* clipMatrix, float planes[6][4])
+{
+	// Row i of a column-major matrix. A point is inside when -w <= x, y <= w and 0 <= z <= w
+	auto row = [clipMatrix](int i, int column) { return clipMatrix[column * 4 + i]; };
+
+	for (int column = 0; column < 4; ++column)
+	{
+		planes[0][column] = row(3, column) + row(0, column);	// Left
+		planes[1][column] = row(3, column) - row(0, column);	// Right
+		planes[2][column] = row(3, column) + row(1, column);	// Bottom
+		planes[3][column] = row(3, column) - row(1, column);	// Top
+		planes[4][column] = row(2, column);						// Near
+		planes[5][column] = row(3, column) - row(2, column);	// Far
+	}
+
+	// Normalized, so a plane's distance can be compared against a sphere's radius directly
+	for (int i = 0; i < 6; ++i)
+	{
+		float length = std::sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+		if (length > 0.0f)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				planes[i][column] /= length;
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanGpuCuller::VulkanGpuCuller()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_descriptorAllocator(nullptr)
+	, m_cullTemplate(0)
+	, m_useOcclusion(false)
+	, m_drawIndirectCount(nullptr)
+	, m_maxDrawsPerCall(1)
+	, m_maxObjects(0)
+	, m_objectBuffer(VK_NULL_HANDLE)
+	, m_lodBuffer(VK_NULL_HANDLE)
+	, m_lodLevelBuffer(VK_NULL_HANDLE)
+	, m_currentFrame(0)
+	, m_setLayout(VK_NULL_HANDLE)
+	, m_pipelineLayout(VK_NULL_HANDLE)
+	, m_pipeline(VK_NULL_HANDLE)
+{
+	memset(&m_constants, 0, sizeof(m_constants));
+	memset(&m_occlusion, 0, sizeof(m_occlusion));
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanGpuCuller::~VulkanGpuCuller()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& cullShader, uint32_t frameCount, bool useDrawCount, uint32_t maxDrawsPerCall, bool useOcclusion, uint32_t maxObjects)
+{
+	m_device				= device;
+	m_allocator				= &allocator;
+	m_descriptorAllocator	= &descriptorAllocator;
+	m_useOcclusion			= useOcclusion;
+	m_maxDrawsPerCall		= std::max(1u, maxDrawsPerCall);
+	m_maxObjects		= maxObjects;
+	m_currentFrame		= 0;
+
+	// A count buffer cannot be split across calls, so compaction needs one call to reach every object
+	if (useDrawCount && m_maxDrawsPerCall >= m_maxObjects)
+	{
+		m_drawIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+	m_constants.compact = m_drawIndirectCount ? 1 : 0;
+
+	m_objectBuffer		= CreateBuffer(sizeof(GpuDrawObject) * m_maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_objectMemory);
+	m_lodBuffer			= CreateBuffer(sizeof(GpuMeshLod) * MAX_LODS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_lodMemory);
+	m_lodLevelBuffer	= CreateBuffer(sizeof(uint32_t) * m_maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_lodLevelMemory);
+
+	m_frames.resize(frameCount);
+	for (FrameBuffers& frame : m_frames)
+	{
+		frame.commandBuffer	= CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * m_maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, frame.commandMemory);
+		frame.countBuffer	= CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, frame.countMemory);
+
+		// The early phase always records its verdicts, whether or not a late phase reads them
+		frame.visibilityBuffer	= CreateBuffer(sizeof(uint32_t) * m_maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, frame.visibilityMemory);
+		frame.uniformBuffer		= CreateBuffer(sizeof(GpuOcclusionUniforms), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, frame.uniformMemory, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		if (m_useOcclusion)
+		{
+			frame.lateCommandBuffer	= CreateBuffer(sizeof(VkDrawIndexedIndirectCommand) * m_maxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, frame.lateCommandMemory);
+			frame.lateCountBuffer	= CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, frame.lateCountMemory);
+		}
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, 8> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings[i].binding			= i;
+		bindings[i].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount	= 1;
+		bindings[i].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	bindings[4].descriptorType	= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[5].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo	= {};
+	layoutInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount						= (uint32_t)bindings.size();
+	layoutInfo.pBindings						= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull descriptor set layout!");
+	}
+
+	// One entry per binding, the buffers each a VkDescriptorBufferInfo of CullDescriptorData
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(bindings.size());
+	for (uint32_t i = 0; i < entries.size(); ++i)
+	{
+		entries[i].dstBinding		= i;
+		entries[i].dstArrayElement	= 0;
+		entries[i].descriptorCount	= 1;
+		entries[i].descriptorType	= bindings[i].descriptorType;
+		entries[i].offset			= offsetof(CullDescriptorData, objects) + i * sizeof(VkDescriptorBufferInfo);
+		entries[i].stride			= sizeof(VkDescriptorBufferInfo);
+	}
+	entries[5].offset	= offsetof(CullDescriptorData, depthPyramid);
+	entries[5].stride	= sizeof(VkDescriptorImageInfo);
+	entries[6].offset	= offsetof(CullDescriptorData, lods);
+	entries[7].offset	= offsetof(CullDescriptorData, lodLevels);
+	m_cullTemplate		= descriptorAllocator.CreateTemplate(m_setLayout, entries, sizeof(CullDescriptorData));
+
+	// Written once the depth pyramid is known
+	for (FrameBuffers& frame : m_frames)
+	{
+		frame.descriptorSet = descriptorAllocator.AllocatePersistent(m_setLayout);
+		if (m_useOcclusion)
+		{
+			frame.lateDescriptorSet = descriptorAllocator.AllocatePersistent(m_setLayout);
+		}
+	}
+
+	CreatePipeline(pipelineCache, cullShader);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Descriptor sets belong to the descriptor allocator's pools and go with them
+	vkDestroyPipeline(m_device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+	for (FrameBuffers& frame : m_frames)
+	{
+		vkDestroyBuffer(m_device, frame.commandBuffer, nullptr);
+		vkDestroyBuffer(m_device, frame.countBuffer, nullptr);
+		vkDestroyBuffer(m_device, frame.visibilityBuffer, nullptr);
+		vkDestroyBuffer(m_device, frame.uniformBuffer, nullptr);
+		m_allocator->Free(frame.commandMemory);
+		m_allocator->Free(frame.countMemory);
+		m_allocator->Free(frame.visibilityMemory);
+		m_allocator->Free(frame.uniformMemory);
+		if (m_useOcclusion)
+		{
+			vkDestroyBuffer(m_device, frame.lateCommandBuffer, nullptr);
+			vkDestroyBuffer(m_device, frame.lateCountBuffer, nullptr);
+			m_allocator->Free(frame.lateCommandMemory);
+			m_allocator->Free(frame.lateCountMemory);
+		}
+	}
+	m_frames.clear();
+
+	vkDestroyBuffer(m_device, m_objectBuffer, nullptr);
+	vkDestroyBuffer(m_device, m_lodBuffer, nullptr);
+	vkDestroyBuffer(m_device, m_lodLevelBuffer, nullptr);
+	m_allocator->Free(m_objectMemory);
+	m_allocator->Free(m_lodMemory);
+	m_allocator->Free(m_lodLevelMemory);
+
+	m_objectBuffer		= VK_NULL_HANDLE;
+	m_lodBuffer			= VK_NULL_HANDLE;
+	m_lodLevelBuffer	= VK_NULL_HANDLE;
+	m_pipeline			= VK_NULL_HANDLE;
+	m_pipelineLayout	= VK_NULL_HANDLE;
+	m_setLayout			= VK_NULL_HANDLE;
+	m_drawIndirectCount		= nullptr;
+	m_useOcclusion			= false;
+	m_descriptorAllocator	= nullptr;
+	m_allocator				= nullptr;
+	m_device				= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::SetObjectCount(uint32_t objectCount)
+{
+	if (objectCount > m_maxObjects)
+	{
+		throw std::runtime_error("gpu culler: more objects than it was created for!");
+	}
+	m_constants.objectCount = objectCount;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::SetDepthPyramid(const VkImageView& view, const VkSampler& sampler, uint32_t width, uint32_t height, uint32_t levelCount)
+{
+	m_occlusion.pyramidSize[0]		= (float)width;
+	m_occlusion.pyramidSize[1]		= (float)height;
+	m_occlusion.pyramidLevelCount	= (float)levelCount;
+
+	for (FrameBuffers& frame : m_frames)
+	{
+		CullDescriptorData data;
+		data.objects		= { m_objectBuffer, 0, VK_WHOLE_SIZE };
+		data.commands		= { frame.commandBuffer, 0, VK_WHOLE_SIZE };
+		data.count			= { frame.countBuffer, 0, VK_WHOLE_SIZE };
+		data.visibility		= { frame.visibilityBuffer, 0, VK_WHOLE_SIZE };
+		data.occlusion		= { frame.uniformBuffer, 0, VK_WHOLE_SIZE };
+		data.depthPyramid	= { sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		data.lods			= { m_lodBuffer, 0, VK_WHOLE_SIZE };
+		data.lodLevels		= { m_lodLevelBuffer, 0, VK_WHOLE_SIZE };
+		m_descriptorAllocator->Write(frame.descriptorSet, m_cullTemplate, &data);
+
+		if (m_useOcclusion)
+		{
+			data.commands	= { frame.lateCommandBuffer, 0, VK_WHOLE_SIZE };
+			data.count		= { frame.lateCountBuffer, 0, VK_WHOLE_SIZE };
+			m_descriptorAllocator->Write(frame.lateDescriptorSet, m_cullTemplate, &data);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::BeginFrame(uint32_t frameIndex)
+{
+	m_currentFrame = frameIndex % (uint32_t)m_frames.size();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::SetClipMatrix(const float* clipMatrix)
+{
+	ExtractFrustumPlanes(clipMatrix, m_constants.frustumPlanes);
+
+	memcpy(m_occlusion.previousClipMatrix, m_occlusion.clipMatrix, sizeof(m_occlusion.clipMatrix));
+	memcpy(m_occlusion.clipMatrix, clipMatrix, sizeof(m_occlusion.clipMatrix));
+	memcpy(m_frames[m_currentFrame].uniformMemory.mappedData, &m_occlusion, sizeof(m_occlusion));
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::SetLodView(const float* eyePosition, float errorScale)
+{
+	m_constants.lodView[0] = eyePosition[0];
+	m_constants.lodView[1] = eyePosition[1];
+	m_constants.lodView[2] = eyePosition[2];
+	m_constants.lodView[3] = errorScale;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::RecordClear(const VkCommandBuffer& commandBuffer) const
+{
+	// Only the compacting path counts, the other one writes every slot
+	if (m_constants.compact)
+	{
+		vkCmdFillBuffer(commandBuffer, m_frames[m_currentFrame].countBuffer, 0, sizeof(uint32_t), 0);
+		if (m_useOcclusion)
+		{
+			vkCmdFillBuffer(commandBuffer, m_frames[m_currentFrame].lateCountBuffer, 0, sizeof(uint32_t), 0);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::RecordCull(const VkCommandBuffer& commandBuffer, GpuCullPhase phase, bool testOcclusion) const
+{
+	if (m_constants.objectCount == 0)
+	{
+		return;
+	}
+
+	GpuCullConstants constants	= m_constants;
+	constants.phase				= phase;
+	constants.testOcclusion		= m_useOcclusion && testOcclusion ? 1 : 0;
+
+	// Levels are read and written by every early phase, the last one may have been a frame ago on the
+	// same queue. The render graph does not know about them, the upload that zeroed them is covered by
+	// the upload context's release
+	if (phase == GPU_CULL_PHASE_EARLY)
+	{
+		VkMemoryBarrier barrier	= {};
+		barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	const FrameBuffers& frame = m_frames[m_currentFrame];
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, phase == GPU_CULL_PHASE_EARLY ? &frame.descriptorSet : &frame.lateDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GpuCullConstants), &constants);
+	vkCmdDispatch(commandBuffer, (m_constants.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::RecordDraws(const VkCommandBuffer& commandBuffer, GpuCullPhase phase) const
+{
+	VkBuffer commands	= GetCommandBuffer(phase);
+	uint32_t stride		= sizeof(VkDrawIndexedIndirectCommand);
+
+	if (m_drawIndirectCount)
+	{
+		m_drawIndirectCount(commandBuffer, commands, 0, GetCountBuffer(phase), 0, m_constants.objectCount, stride);
+		return;
+	}
+
+	for (uint32_t first = 0; first < m_constants.objectCount; first += m_maxDrawsPerCall)
+	{
+		uint32_t drawCount = std::min(m_maxDrawsPerCall, m_constants.objectCount - first);
+		vkCmdDrawIndexedIndirect(commandBuffer, commands, (VkDeviceSize)first * stride, drawCount, stride);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkBuffer VulkanGpuCuller::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VulkanAllocation& memory, VkMemoryPropertyFlags properties)
+{
+	VkBufferCreateInfo bufferInfo	= {};
+	bufferInfo.sType				= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size					= size;
+	bufferInfo.usage				= usage;
+	bufferInfo.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+
+	VkBuffer buffer;
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull buffer!");
+	}
+	memory = m_allocator->AllocateForBuffer(buffer, properties);
+	return buffer;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuCuller::CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& cullShader)
+{
+	VkPushConstantRange constantRange			= {};
+	constantRange.stageFlags					= VK_SHADER_STAGE_COMPUTE_BIT;
+	constantRange.offset						= 0;
+	constantRange.size							= sizeof(GpuCullConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo	= {};
+	pipelineLayoutInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount				= 1;
+	pipelineLayoutInfo.pSetLayouts					= &m_setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount		= 1;
+	pipelineLayoutInfo.pPushConstantRanges			= &constantRange;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo	= {};
+	pipelineInfo.sType							= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType					= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage					= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module					= cullShader;
+	pipelineInfo.stage.pName					= "main";
+	pipelineInfo.layout							= m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create cull pipeline!");
+	}
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#ifndef _VULKAN_GPU_CULLER_H_
+#define _VULKAN_GPU_CULLER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanDescriptorAllocator.hpp"
+#include "VulkanMemoryAllocator.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// One object as DrawCull.comp reads it, std430. The draw fields are copied into the indirect command
+// of every object that survives culling, the index range replaced by that of the level of detail picked
+struct GpuDrawObject
+{
+	float		boundingSphere[4];	// Object space center and radius
+	uint32_t	indexCount;
+	uint32_t	instanceCount;
+	uint32_t	firstIndex;
+	int32_t		vertexOffset;
+	uint32_t	firstInstance;
+	uint32_t	firstLod;			// Of the object's mesh in the LOD buffer
+	uint32_t	lodCount;			// One for a mesh without levels
+	float		lodErrorScale;		// Takes the mesh's LOD errors into object space, the largest instance scale
+};
+
+//---------------------------------------------------------------------------------------------------
+// One level of detail of a mesh as DrawCull.comp reads it, std430
+struct GpuMeshLod
+{
+	uint32_t	firstIndex;
+	uint32_t	indexCount;
+	float		error;				// Object space distance, of the mesh before instance transforms
+	uint32_t	padding;
+};
+
+//---------------------------------------------------------------------------------------------------
+// Push constants of DrawCull.comp
+struct GpuCullConstants
+{
+	float		frustumPlanes[6][4];	// Normalized, pointing inwards
+	uint32_t	objectCount;
+	uint32_t	compact;
+	uint32_t	phase;
+	uint32_t	testOcclusion;
+	float		lodView[4];				// Object space eye position, and the pixels a unit of error at unit distance covers over the threshold
+};
+
+//---------------------------------------------------------------------------------------------------
+// Uniforms of DrawCull.comp's occlusion test, std140
+struct GpuOcclusionUniforms
+{
+	float		clipMatrix[16];
+	float		previousClipMatrix[16];
+	float		pyramidSize[2];
+	float		pyramidLevelCount;
+	float		padding;
+};
+
+//---------------------------------------------------------------------------------------------------
+// The early phase culls against the frustum and last frame's depth pyramid and draws what survives.
+// Once the pyramid has been rebuilt from that depth, the late phase re-tests only what the early
+// phase found occluded, so whatever came into view this frame is drawn after all
+enum GpuCullPhase
+{
+	GPU_CULL_PHASE_EARLY,
+	GPU_CULL_PHASE_LATE,
+};
+
+//---------------------------------------------------------------------------------------------------
+// Culls draws on the GPU. Object bounds and draw parameters live in a storage buffer, a compute pass
+// tests each of them against the frustum and writes the indirect commands the main pass draws with,
+// so the CPU records the same handful of commands whether there are ten objects or a hundred thousand.
+//
+// With VK_KHR_draw_indirect_count the survivors are compacted and counted on the GPU and drawn with a
+// single vkCmdDrawIndexedIndirectCountKHR. Without it every object keeps its slot and a culled one gets
+// an instance count of zero, drawn with as few vkCmdDrawIndexedIndirect calls as maxDrawIndirectCount allows.
+//
+// With occlusion culling the cull runs in two phases, see GpuCullPhase, each with its own command and
+// count buffers. Objects are then also tested against a VulkanDepthPyramid.
+//
+// The early phase also picks each object's level of detail, the coarsest whose error stays within the
+// threshold on screen from the nearest point of its bounds. The level picked is kept for the next frame,
+// moving to a coarser one takes LOD_HYSTERESIS more margin than staying, so objects near a switching
+// distance do not flicker between two levels. The late phase draws with the early phase's pick.
+//
+// Command and count buffers exist once per frame in flight, the frame's fence covers their reuse.
+class VulkanGpuCuller
+{
+public:
+	static const uint32_t		WORKGROUP_SIZE			= 64;	// local_size_x of DrawCull.comp
+	static const uint32_t		DEFAULT_MAX_OBJECTS		= 128 * 1024;
+	static const uint32_t		MAX_LODS				= 64 * 1024;	// Of every mesh together
+	static constexpr float		LOD_HYSTERESIS			= 0.25f;	// Matches DrawCull.comp
+
+	// Planes of the frustum a column-major clip matrix projects into, for a [0, 1] depth range
+	static void					ExtractFrustumPlanes(const float* clipMatrix, float planes[6][4]);
+
+public:
+	VulkanGpuCuller();
+	~VulkanGpuCuller();
+
+	// The shader module is only used during the call. maxDrawsPerCall is maxDrawIndirectCount, or 1
+	// without multiDrawIndirect. Draw count is only used when a single call can cover every object
+	void					Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& cullShader, uint32_t frameCount, bool useDrawCount, uint32_t maxDrawsPerCall, bool useOcclusion, uint32_t maxObjects = DEFAULT_MAX_OBJECTS);
+	void					Uninitialize();
+
+	// The caller uploads the objects into GetObjectBuffer, count of them, before the next cull
+	void					SetObjectCount(uint32_t objectCount);
+	uint32_t				GetObjectCount() const		{ return m_constants.objectCount; }
+	uint32_t				GetMaxObjects() const		{ return m_maxObjects; }
+	VkBuffer				GetObjectBuffer() const		{ return m_objectBuffer; }
+
+	// The levels of detail objects point into, at most MAX_LODS of them. Alongside the objects, the caller
+	// also zeroes the first count entries of GetLodLevelBuffer, the level each object was last drawn with
+	VkBuffer				GetLodBuffer() const		{ return m_lodBuffer; }
+	VkBuffer				GetLodLevelBuffer() const	{ return m_lodLevelBuffer; }
+
+	// Has to be called before the first cull and again whenever the pyramid is recreated, while no
+	// frame is in flight. The cull set always samples a pyramid, without occlusion it is never read
+	void					SetDepthPyramid(const VkImageView& view, const VkSampler& sampler, uint32_t width, uint32_t height, uint32_t levelCount);
+
+	void					BeginFrame(uint32_t frameIndex);
+
+	// Once a frame, the previous one is kept to test against the pyramid built last frame
+	void					SetClipMatrix(const float* clipMatrix);
+
+	// Once a frame, the eye in the space of the clip matrix and the pixels an error of one covers at a
+	// distance of one, over the error in pixels a level of detail may show
+	void					SetLodView(const float* eyePosition, float errorScale);
+
+	// The current frame's outputs: written by RecordClear and RecordCull, read by RecordDraws
+	VkBuffer				GetCommandBuffer(GpuCullPhase phase = GPU_CULL_PHASE_EARLY) const	{ return phase == GPU_CULL_PHASE_EARLY ? m_frames[m_currentFrame].commandBuffer : m_frames[m_currentFrame].lateCommandBuffer; }
+	VkBuffer				GetCountBuffer(GpuCullPhase phase = GPU_CULL_PHASE_EARLY) const		{ return phase == GPU_CULL_PHASE_EARLY ? m_frames[m_currentFrame].countBuffer : m_frames[m_currentFrame].lateCountBuffer; }
+	VkBuffer				GetVisibilityBuffer() const	{ return m_frames[m_currentFrame].visibilityBuffer; }
+	bool					IsUsingDrawCount() const	{ return m_drawIndirectCount != nullptr; }
+	bool					IsUsingOcclusion() const	{ return m_useOcclusion; }
+
+	// Clears the counts of both phases
+	void					RecordClear(const VkCommandBuffer& commandBuffer) const;
+
+	// The early phase only tests occlusion when asked to, i.e. once the pyramid holds a previous frame
+	void					RecordCull(const VkCommandBuffer& commandBuffer, GpuCullPhase phase = GPU_CULL_PHASE_EARLY, bool testOcclusion = false) const;
+	void					RecordDraws(const VkCommandBuffer& commandBuffer, GpuCullPhase phase = GPU_CULL_PHASE_EARLY) const;
+
+private:
+	struct FrameBuffers
+	{
+		VkBuffer				commandBuffer	= VK_NULL_HANDLE;
+		VulkanAllocation		commandMemory;
+		VkBuffer				countBuffer		= VK_NULL_HANDLE;
+		VulkanAllocation		countMemory;
+		VkBuffer				lateCommandBuffer	= VK_NULL_HANDLE;	// Occlusion only
+		VulkanAllocation		lateCommandMemory;
+		VkBuffer				lateCountBuffer		= VK_NULL_HANDLE;
+		VulkanAllocation		lateCountMemory;
+		VkBuffer				visibilityBuffer	= VK_NULL_HANDLE;
+		VulkanAllocation		visibilityMemory;
+		VkBuffer				uniformBuffer		= VK_NULL_HANDLE;	// Host visible, written by SetClipMatrix
+		VulkanAllocation		uniformMemory;
+		VkDescriptorSet			descriptorSet		= VK_NULL_HANDLE;
+		VkDescriptorSet			lateDescriptorSet	= VK_NULL_HANDLE;	// Binds the late command and count buffers instead
+	};
+
+	// Contents of the cull set, in the layout its update template reads
+	struct CullDescriptorData
+	{
+		VkDescriptorBufferInfo	objects;
+		VkDescriptorBufferInfo	commands;
+		VkDescriptorBufferInfo	count;
+		VkDescriptorBufferInfo	visibility;
+		VkDescriptorBufferInfo	occlusion;
+		VkDescriptorImageInfo	depthPyramid;
+		VkDescriptorBufferInfo	lods;
+		VkDescriptorBufferInfo	lodLevels;
+	};
+
+private:
+	VkBuffer				CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VulkanAllocation& memory, VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	void					CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& cullShader);
+
+private:
+	VkDevice								m_device;
+	VulkanMemoryAllocator*					m_allocator;
+	VulkanDescriptorAllocator*				m_descriptorAllocator;
+	DescriptorTemplate						m_cullTemplate;
+	bool									m_useOcclusion;
+	PFN_vkCmdDrawIndexedIndirectCountKHR	m_drawIndirectCount;
+	uint32_t								m_maxDrawsPerCall;
+	uint32_t								m_maxObjects;
+	VkBuffer								m_objectBuffer;
+	VulkanAllocation						m_objectMemory;
+	VkBuffer								m_lodBuffer;
+	VulkanAllocation						m_lodMemory;
+	VkBuffer								m_lodLevelBuffer;		// Level each object was drawn with last, kept across frames
+	VulkanAllocation						m_lodLevelMemory;
+	std::vector<FrameBuffers>				m_frames;
+	uint32_t								m_currentFrame;
+	VkDescriptorSetLayout					m_setLayout;
+	VkPipelineLayout						m_pipelineLayout;
+	VkPipeline								m_pipeline;
+	GpuCullConstants						m_constants;
+	GpuOcclusionUniforms					m_occlusion;
+};
+#endif // !_VULKAN_GPU_CULLER_H_
@@ -0,0 +1,262 @@
+#include "VulkanGpuProfiler.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+VulkanGpuProfiler::VulkanGpuProfiler()
+	: m_device(VK_NULL_HANDLE)
+	, m_isSupported(false)
+	, m_timestampPeriod(1.0)
+	, m_timestampMask(~0ull)
+	, m_maxScopes(0)
+	, m_currentFrame(0)
+	, m_frameNumber(0)
+	, m_lastResultFrame(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanGpuProfiler::~VulkanGpuProfiler()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, uint32_t queueFamily, uint32_t frameCount, uint32_t maxScopesPerFrame)
+{
+	m_device		= device;
+	m_maxScopes		= maxScopesPerFrame;
+	m_currentFrame	= 0;
+	m_frameNumber	= 0;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	m_timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// Zero valid bits means the queue cannot write timestamps at all, every call becomes a no-op then
+	uint32_t validBits	= queueFamily < queueFamilyCount ? queueFamilies[queueFamily].timestampValidBits : 0;
+	m_isSupported		= validBits > 0;
+	m_timestampMask		= validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	if (!m_isSupported)
+	{
+		std::cout << "GPU profiler: timestamps not supported on queue family " << queueFamily << ", disabled" << std::endl;
+		return;
+	}
+
+	VkQueryPoolCreateInfo poolInfo	= {};
+	poolInfo.sType					= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType				= VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount				= m_maxScopes * 2;
+
+	m_frames.resize(frameCount);
+	for (FrameQueries& frame : m_frames)
+	{
+		if (vkCreateQueryPool(m_device, &poolInfo, nullptr, &frame.queryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+		frame.scopes.reserve(m_maxScopes);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (FrameQueries& frame : m_frames)
+	{
+		vkDestroyQueryPool(m_device, frame.queryPool, nullptr);
+	}
+	m_frames.clear();
+	m_scopeStack.clear();
+
+	m_isSupported	= false;
+	m_device		= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::BeginFrame(uint32_t frameIndex)
+{
+	if (!m_isSupported)
+	{
+		return;
+	}
+
+	m_currentFrame		= frameIndex % (uint32_t)m_frames.size();
+	FrameQueries& frame	= m_frames[m_currentFrame];
+
+	if (frame.isPending)
+	{
+		Resolve(frame);
+	}
+
+	frame.scopes.clear();
+	frame.frameNumber	= m_frameNumber++;
+	frame.isPending		= false;
+	m_scopeStack.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::ResetQueries(const VkCommandBuffer& commandBuffer)
+{
+	if (!m_isSupported)
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_frames[m_currentFrame].queryPool, 0, m_maxScopes * 2);
+	m_frames[m_currentFrame].isPending = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::BeginScope(const VkCommandBuffer& commandBuffer, const char* name)
+{
+	if (!m_isSupported)
+	{
+		return;
+	}
+
+	FrameQueries& frame = m_frames[m_currentFrame];
+	if (frame.scopes.size() >= m_maxScopes)
+	{
+		m_scopeStack.push_back(INVALID_SCOPE);
+		return;
+	}
+
+	Scope scope;
+	scope.name		= name;
+	scope.parent	= m_scopeStack.empty() ? INVALID_SCOPE : m_scopeStack.back();
+	scope.depth		= (uint32_t)m_scopeStack.size();
+
+	uint32_t scopeIndex = (uint32_t)frame.scopes.size();
+	frame.scopes.push_back(scope);
+	m_scopeStack.push_back(scopeIndex);
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, scopeIndex * 2);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::EndScope(const VkCommandBuffer& commandBuffer)
+{
+	if (!m_isSupported || m_scopeStack.empty())
+	{
+		return;
+	}
+
+	uint32_t scopeIndex = m_scopeStack.back();
+	m_scopeStack.pop_back();
+
+	if (scopeIndex != INVALID_SCOPE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frames[m_currentFrame].queryPool, scopeIndex * 2 + 1);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::Resolve(FrameQueries& frame)
+{
+	frame.isPending = false;
+	if (frame.scopes.empty())
+	{
+		return;
+	}
+
+	// No WAIT bit: the fence has signaled, so anything not available now never will be (e.g. a scope
+	// that was begun but never ended). Such a frame is dropped rather than stalling on it
+	uint32_t queryCount = (uint32_t)frame.scopes.size() * 2;
+	std::vector<uint64_t> timestamps(queryCount);
+	if (vkGetQueryPoolResults(m_device, frame.queryPool, 0, queryCount, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	m_lastResults.resize(frame.scopes.size());
+	for (uint32_t i = 0; i < frame.scopes.size(); ++i)
+	{
+		const Scope& scope		= frame.scopes[i];
+		GpuScopeResult& result	= m_lastResults[i];
+
+		uint64_t ticks			= (timestamps[i * 2 + 1] - timestamps[i * 2]) & m_timestampMask;
+		result.name				= scope.name;
+		result.path				= scope.parent == INVALID_SCOPE ? result.name : m_lastResults[scope.parent].path + "/" + result.name;
+		result.depth			= scope.depth;
+		result.milliseconds		= ticks * m_timestampPeriod / 1000000.0;
+
+		auto found = m_history.find(result.path);
+		if (found == m_history.end())
+		{
+			found = m_history.emplace(result.path, ScopeHistory()).first;
+			found->second.samples.reserve(HISTORY_LENGTH);
+			m_historyOrder.push_back(result.path);
+		}
+
+		ScopeHistory& history = found->second;
+		if (history.samples.size() < HISTORY_LENGTH)
+		{
+			history.samples.push_back(result.milliseconds);
+		}
+		else
+		{
+			history.samples[history.next] = result.milliseconds;
+		}
+		history.next = (history.next + 1) % HISTORY_LENGTH;
+	}
+	m_lastResultFrame = frame.frameNumber;
+}
+
+//---------------------------------------------------------------------------------------------------
+GpuScopeStats VulkanGpuProfiler::GetStats(const std::string& path) const
+{
+	GpuScopeStats stats;
+
+	auto found = m_history.find(path);
+	if (found == m_history.end() || found->second.samples.empty())
+	{
+		return stats;
+	}
+
+	const std::vector<double>& samples = found->second.samples;
+	stats.minMilliseconds	= *std::min_element(samples.begin(), samples.end());
+	stats.maxMilliseconds	= *std::max_element(samples.begin(), samples.end());
+	stats.sampleCount		= (uint32_t)samples.size();
+
+	double total = 0.0;
+	for (double sample : samples)
+	{
+		total += sample;
+	}
+	stats.avgMilliseconds = total / samples.size();
+
+	return stats;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanGpuProfiler::PrintStats() const
+{
+	if (!m_isSupported)
+	{
+		return;
+	}
+
+	std::cout << "GPU timings over the last " << HISTORY_LENGTH << " frames (min/avg/max ms):" << std::endl;
+	for (const std::string& path : m_historyOrder)
+	{
+		GpuScopeStats stats = GetStats(path);
+		std::cout << "\t" << path << ": " << std::fixed << std::setprecision(3)
+			<< stats.minMilliseconds << " / " << stats.avgMilliseconds << " / " << stats.maxMilliseconds << std::defaultfloat << std::endl;
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#ifndef _VULKAN_GPU_PROFILER_H_
+#define _VULKAN_GPU_PROFILER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+struct GpuScopeResult
+{
+	std::string		name;
+	std::string		path;			// Parent names joined with '/', e.g. "Frame/MainPass"
+	uint32_t		depth			= 0;
+	double			milliseconds	= 0.0;
+};
+
+//---------------------------------------------------------------------------------------------------
+struct GpuScopeStats
+{
+	double			minMilliseconds	= 0.0;
+	double			avgMilliseconds	= 0.0;
+	double			maxMilliseconds	= 0.0;
+	uint32_t		sampleCount		= 0;
+};
+
+//---------------------------------------------------------------------------------------------------
+// Measures GPU time of named, nestable scopes with vkCmdWriteTimestamp. Every frame in flight owns a
+// query pool, and a frame's timestamps are only read back once its fence has signaled, so resolving
+// never waits on the GPU. Scopes have to be recorded from a single thread into primary command buffers.
+class VulkanGpuProfiler
+{
+public:
+	VulkanGpuProfiler();
+	~VulkanGpuProfiler();
+
+	void							Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, uint32_t queueFamily, uint32_t frameCount, uint32_t maxScopesPerFrame = DEFAULT_MAX_SCOPES);
+	void							Uninitialize();
+
+	// The frame's fence must have been waited on, this resolves whatever that slot measured last time
+	void							BeginFrame(uint32_t frameIndex);
+
+	// Has to be recorded into the frame's command buffer before its first scope and outside a render pass
+	void							ResetQueries(const VkCommandBuffer& commandBuffer);
+
+	// Timestamps may not be written inside a render pass whose contents are secondary command buffers,
+	// such a pass is scoped from outside its vkCmdBeginRenderPass/vkCmdEndRenderPass instead
+	void							BeginScope(const VkCommandBuffer& commandBuffer, const char* name);
+	void							EndScope(const VkCommandBuffer& commandBuffer);
+
+	bool							IsSupported() const			{ return m_isSupported; }
+	const std::vector<GpuScopeResult>&	GetLastResults() const	{ return m_lastResults; }
+	uint64_t						GetLastResultFrame() const	{ return m_lastResultFrame; }
+	GpuScopeStats					GetStats(const std::string& path) const;
+	void							PrintStats() const;
+
+public:
+	static const uint32_t			DEFAULT_MAX_SCOPES	= 64;
+	static const uint32_t			HISTORY_LENGTH		= 120;
+
+private:
+	struct Scope
+	{
+		std::string					name;				// Copied, a pass name may be gone before the frame resolves
+		uint32_t					parent		= INVALID_SCOPE;
+		uint32_t					depth		= 0;
+	};
+
+	struct FrameQueries
+	{
+		VkQueryPool					queryPool	= VK_NULL_HANDLE;
+		std::vector<Scope>			scopes;		// Scope i owns queries 2 * i and 2 * i + 1
+		uint64_t					frameNumber	= 0;
+		bool						isPending	= false;
+	};
+
+	struct ScopeHistory
+	{
+		std::vector<double>			samples;
+		uint32_t					next		= 0;
+	};
+
+	static const uint32_t			INVALID_SCOPE		= ~0u;
+
+private:
+	void							Resolve(FrameQueries& frame);
+
+private:
+	VkDevice						m_device;
+	bool							m_isSupported;
+	double							m_timestampPeriod;	// Nanoseconds per tick
+	uint64_t						m_timestampMask;
+	uint32_t						m_maxScopes;
+	uint32_t						m_currentFrame;
+	uint64_t						m_frameNumber;
+	std::vector<FrameQueries>		m_frames;
+	std::vector<uint32_t>			m_scopeStack;		// INVALID_SCOPE marks a scope dropped for lack of queries
+	std::vector<GpuScopeResult>		m_lastResults;
+	uint64_t						m_lastResultFrame;
+	std::unordered_map<std::string, ScopeHistory>	m_history;
+	std::vector<std::string>		m_historyOrder;		// First-seen order, keeps PrintStats in tree order
+};
+
+//---------------------------------------------------------------------------------------------------
+// Scope guard for VulkanGpuProfiler::BeginScope/EndScope
+class VulkanGpuScope
+{
+public:
+	VulkanGpuScope(VulkanGpuProfiler& profiler, const VkCommandBuffer& commandBuffer, const char* name)
+		: m_profiler(profiler)
+		, m_commandBuffer(commandBuffer)
+	{
+		m_profiler.BeginScope(m_commandBuffer, name);
+	}
+
+	~VulkanGpuScope()
+	{
+		m_profiler.EndScope(m_commandBuffer);
+	}
+
+private:
+	VulkanGpuProfiler&				m_profiler;
+	VkCommandBuffer					m_commandBuffer;
+};
+#endif // !_VULKAN_GPU_PROFILER_H_
@@ -0,0 +1,487 @@
+#include "VulkanMemoryAllocator.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+const VkDeviceSize VulkanMemoryAllocator::DEFAULT_BLOCK_SIZE;
+const VkDeviceSize VulkanMemoryAllocator::MIN_ALLOCATION_SIZE;
+
+//---------------------------------------------------------------------------------------------------
+static uint32_t Log2(VkDeviceSize value)
+{
+	uint32_t result = 0;
+	while (value > 1)
+	{
+		value >>= 1;
+		++result;
+	}
+	return result;
+}
+
+//---------------------------------------------------------------------------------------------------
+static VkDeviceSize NextPowerOfTwo(VkDeviceSize value)
+{
+	VkDeviceSize result = 1;
+	while (result < value)
+	{
+		result <<= 1;
+	}
+	return result;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanMemoryAllocator::VulkanMemoryAllocator()
+	: m_device(VK_NULL_HANDLE)
+	, m_memoryProperties()
+	, m_preferredBlockSize(DEFAULT_BLOCK_SIZE)
+	, m_maxDeviceAllocations(0)
+	, m_deviceAllocationCount(0)
+	, m_nextBlockId(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanMemoryAllocator::~VulkanMemoryAllocator()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VkDeviceSize preferredBlockSize)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	m_maxDeviceAllocations = deviceProperties.limits.maxMemoryAllocationCount;
+
+	// Buddy splitting needs a power of two block
+	m_preferredBlockSize = std::max(MIN_ALLOCATION_SIZE, (VkDeviceSize)1 << Log2(preferredBlockSize));
+	m_pools.clear();
+	m_pools.resize(m_memoryProperties.memoryTypeCount);
+	m_memoryTypeCache.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::Uninitialize()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (MemoryTypePool& pool : m_pools)
+	{
+		for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+		{
+			if (block->allocationCount > 0)
+			{
+				std::cerr << "memory allocator: block " << block->id << " destroyed with " << block->allocationCount << " live allocations" << std::endl;
+			}
+			DestroyBlock(*block);
+		}
+		if (pool.dedicatedCount > 0)
+		{
+			std::cerr << "memory allocator: " << pool.dedicatedCount << " dedicated allocations were never freed" << std::endl;
+		}
+	}
+	m_pools.clear();
+	m_memoryTypeCache.clear();
+	m_deviceAllocationCount = 0;
+	m_device = VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocation VulkanMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool isOptimalImage)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint32_t		memoryTypeIndex	= FindMemoryTypeLocked(requirements.memoryTypeBits, properties);
+	VkDeviceSize	blockSize		= GetBlockSize(memoryTypeIndex);
+
+	// Buddy nodes are aligned to their own size, so rounding up to a power of two covers the alignment too
+	VkDeviceSize	nodeSize		= NextPowerOfTwo(std::max(std::max(requirements.size, requirements.alignment), MIN_ALLOCATION_SIZE));
+
+	// Anything that would eat more than half a block gets its own device allocation
+	if (nodeSize > blockSize / 2)
+	{
+		return AllocateDedicated(requirements, memoryTypeIndex);
+	}
+
+	uint32_t		order			= Log2(nodeSize / MIN_ALLOCATION_SIZE);
+	MemoryTypePool&	pool			= m_pools[memoryTypeIndex];
+	MemoryBlock*	targetBlock		= nullptr;
+	VkDeviceSize	offset			= 0;
+
+	for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+	{
+		if (block->isOptimalImage == isOptimalImage && AllocateFromBlock(*block, order, offset))
+		{
+			targetBlock = block.get();
+			break;
+		}
+	}
+
+	if (!targetBlock)
+	{
+		targetBlock = CreateBlock(memoryTypeIndex, isOptimalImage);
+		if (!AllocateFromBlock(*targetBlock, order, offset))
+		{
+			throw std::runtime_error("failed to sub-allocate from a fresh memory block!");
+		}
+	}
+
+	targetBlock->allocationCount++;
+	targetBlock->bytesInUse		+= nodeSize;
+	targetBlock->bytesRequested	+= requirements.size;
+
+	VulkanAllocation allocation;
+	allocation.memory			= targetBlock->memory;
+	allocation.offset			= offset;
+	allocation.size				= requirements.size;
+	allocation.mappedData		= targetBlock->mappedData ? targetBlock->mappedData + offset : nullptr;
+	allocation.memoryTypeIndex	= memoryTypeIndex;
+	allocation.blockId			= targetBlock->id;
+	allocation.order			= order;
+	allocation.isDedicated		= false;
+	return allocation;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocation VulkanMemoryAllocator::AllocateForBuffer(const VkBuffer& buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(m_device, buffer, &memRequirements);
+
+	VulkanAllocation allocation = Allocate(memRequirements, properties, false);
+	vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+	return allocation;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocation VulkanMemoryAllocator::AllocateForImage(const VkImage& image, VkMemoryPropertyFlags properties, bool isOptimalImage)
+{
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(m_device, image, &memRequirements);
+
+	return Allocate(memRequirements, properties, isOptimalImage);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::Free(VulkanAllocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	MemoryTypePool& pool = m_pools[allocation.memoryTypeIndex];
+
+	if (allocation.isDedicated)
+	{
+		if (allocation.mappedData)
+		{
+			vkUnmapMemory(m_device, allocation.memory);
+		}
+		vkFreeMemory(m_device, allocation.memory, nullptr);
+
+		pool.dedicatedCount--;
+		pool.dedicatedBytes				-= allocation.size;
+		pool.dedicatedBytesRequested	-= allocation.size;
+		m_deviceAllocationCount--;
+		allocation = VulkanAllocation();
+		return;
+	}
+
+	for (size_t i = 0; i < pool.blocks.size(); ++i)
+	{
+		MemoryBlock& block = *pool.blocks[i];
+		if (block.id != allocation.blockId)
+		{
+			continue;
+		}
+
+		FreeToBlock(block, allocation.order, allocation.offset);
+		block.allocationCount--;
+		block.bytesInUse		-= MIN_ALLOCATION_SIZE << allocation.order;
+		block.bytesRequested	-= allocation.size;
+
+		// Hand empty blocks back to the driver, but keep one around per kind so a lone
+		// allocate/free pair does not thrash vkAllocateMemory
+		if (block.allocationCount == 0)
+		{
+			size_t sameKindBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [&block](const std::unique_ptr<MemoryBlock>& other) { return other->isOptimalImage == block.isOptimalImage; });
+			if (sameKindBlocks > 1)
+			{
+				DestroyBlock(block);
+				pool.blocks.erase(pool.blocks.begin() + i);
+			}
+		}
+		allocation = VulkanAllocation();
+		return;
+	}
+
+	throw std::runtime_error("tried to free an allocation that does not belong to this allocator!");
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanMemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return FindMemoryTypeLocked(typeFilter, properties);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanMemoryAllocator::FindMemoryTypeLocked(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	uint64_t key = ((uint64_t)typeFilter << 32) | properties;
+	auto cached = m_memoryTypeCache.find(key);
+	if (cached != m_memoryTypeCache.end())
+	{
+		return cached->second;
+	}
+
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+	{
+		if (typeFilter & (1 << i) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			m_memoryTypeCache[key] = i;
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocatorStats VulkanMemoryAllocator::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	VulkanAllocatorStats stats;
+	for (const MemoryTypePool& pool : m_pools)
+	{
+		AccumulateStats(pool, stats);
+	}
+	stats.deviceAllocationCount = m_deviceAllocationCount;
+	return stats;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocatorStats VulkanMemoryAllocator::GetStats(uint32_t memoryTypeIndex) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	VulkanAllocatorStats stats;
+	if (memoryTypeIndex < m_pools.size())
+	{
+		AccumulateStats(m_pools[memoryTypeIndex], stats);
+		stats.deviceAllocationCount = stats.blockCount + stats.dedicatedAllocationCount;
+	}
+	return stats;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::PrintStats() const
+{
+	VulkanAllocatorStats total = GetStats();
+	std::cout << "GPU memory: " << total.allocationCount << " allocations in " << total.deviceAllocationCount << "/" << m_maxDeviceAllocations << " device allocations, "
+		<< total.bytesRequested / 1024 << " KiB requested, " << total.bytesInUse / 1024 << " KiB in use, " << total.bytesReserved / 1024 << " KiB reserved" << std::endl;
+
+	for (uint32_t i = 0; i < (uint32_t)m_pools.size(); ++i)
+	{
+		VulkanAllocatorStats stats = GetStats(i);
+		if (stats.deviceAllocationCount == 0)
+		{
+			continue;
+		}
+		std::cout << "\tmemory type " << i << ": " << stats.blockCount << " blocks, " << stats.dedicatedAllocationCount << " dedicated, "
+			<< stats.allocationCount << " allocations, " << stats.bytesInUse / 1024 << "/" << stats.bytesReserved / 1024 << " KiB" << std::endl;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkDeviceSize VulkanMemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex) const
+{
+	// Small heaps (e.g. the 256 MiB host visible device local heap) should not be swallowed by a few blocks
+	VkDeviceSize heapSize	= m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	VkDeviceSize blockSize	= m_preferredBlockSize;
+	while (blockSize > heapSize / 8 && blockSize > MIN_ALLOCATION_SIZE * 2)
+	{
+		blockSize >>= 1;
+	}
+	return blockSize;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanMemoryAllocator::MemoryBlock* VulkanMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, bool isOptimalImage)
+{
+	if (m_deviceAllocationCount >= m_maxDeviceAllocations)
+	{
+		throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+	}
+
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+	block->size				= GetBlockSize(memoryTypeIndex);
+	block->id				= m_nextBlockId++;
+	block->maxOrder			= Log2(block->size / MIN_ALLOCATION_SIZE);
+	block->isOptimalImage	= isOptimalImage;
+	block->freeLists.resize(block->maxOrder + 1);
+	block->freeLists[block->maxOrder].insert(0);
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize		= block->size;
+	allocInfo.memoryTypeIndex		= memoryTypeIndex;
+
+	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate memory block!");
+	}
+	m_deviceAllocationCount++;
+
+	// Host visible blocks stay mapped for their whole lifetime; sub-allocations just offset the pointer
+	if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		if (vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to map memory block!");
+		}
+		block->mappedData = static_cast<uint8_t*>(data);
+	}
+
+	m_pools[memoryTypeIndex].blocks.push_back(std::move(block));
+	return m_pools[memoryTypeIndex].blocks.back().get();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::DestroyBlock(MemoryBlock& block)
+{
+	if (block.mappedData)
+	{
+		vkUnmapMemory(m_device, block.memory);
+		block.mappedData = nullptr;
+	}
+	vkFreeMemory(m_device, block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+	m_deviceAllocationCount--;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanMemoryAllocator::AllocateFromBlock(MemoryBlock& block, uint32_t order, VkDeviceSize& offset)
+{
+	if (order > block.maxOrder)
+	{
+		return false;
+	}
+
+	uint32_t freeOrder = order;
+	while (freeOrder <= block.maxOrder && block.freeLists[freeOrder].empty())
+	{
+		++freeOrder;
+	}
+
+	if (freeOrder > block.maxOrder)
+	{
+		return false;
+	}
+
+	// Lowest free offset first keeps allocations packed towards the start of the block
+	offset = *block.freeLists[freeOrder].begin();
+	block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+	while (freeOrder > order)
+	{
+		--freeOrder;
+		block.freeLists[freeOrder].insert(offset + (MIN_ALLOCATION_SIZE << freeOrder));
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::FreeToBlock(MemoryBlock& block, uint32_t order, VkDeviceSize offset)
+{
+	while (order < block.maxOrder)
+	{
+		VkDeviceSize buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+		auto buddyNode = block.freeLists[order].find(buddy);
+		if (buddyNode == block.freeLists[order].end())
+		{
+			break;
+		}
+
+		block.freeLists[order].erase(buddyNode);
+		offset = std::min(offset, buddy);
+		++order;
+	}
+	block.freeLists[order].insert(offset);
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanAllocation VulkanMemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex)
+{
+	if (m_deviceAllocationCount >= m_maxDeviceAllocations)
+	{
+		throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+	}
+
+	VulkanAllocation allocation;
+
+	VkMemoryAllocateInfo allocInfo	= {};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize		= requirements.size;
+	allocInfo.memoryTypeIndex		= memoryTypeIndex;
+
+	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate dedicated memory!");
+	}
+	m_deviceAllocationCount++;
+
+	if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(m_device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mappedData) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to map dedicated memory!");
+		}
+	}
+
+	allocation.offset			= 0;
+	allocation.size				= requirements.size;
+	allocation.memoryTypeIndex	= memoryTypeIndex;
+	allocation.isDedicated		= true;
+
+	MemoryTypePool& pool = m_pools[memoryTypeIndex];
+	pool.dedicatedCount++;
+	pool.dedicatedBytes				+= requirements.size;
+	pool.dedicatedBytesRequested	+= requirements.size;
+	return allocation;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMemoryAllocator::AccumulateStats(const MemoryTypePool& pool, VulkanAllocatorStats& stats) const
+{
+	for (const std::unique_ptr<MemoryBlock>& block : pool.blocks)
+	{
+		stats.blockCount++;
+		stats.allocationCount	+= block->allocationCount;
+		stats.bytesReserved		+= block->size;
+		stats.bytesInUse		+= block->bytesInUse;
+		stats.bytesRequested	+= block->bytesRequested;
+	}
+	stats.dedicatedAllocationCount	+= pool.dedicatedCount;
+	stats.allocationCount			+= pool.dedicatedCount;
+	stats.bytesReserved				+= pool.dedicatedBytes;
+	stats.bytesInUse				+= pool.dedicatedBytes;
+	stats.bytesRequested			+= pool.dedicatedBytesRequested;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef _VULKAN_MEMORY_ALLOCATOR_H_
+#define _VULKAN_MEMORY_ALLOCATOR_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+struct VulkanAllocation
+{
+	VkDeviceMemory	memory			= VK_NULL_HANDLE;
+	VkDeviceSize	offset			= 0;
+	VkDeviceSize	size			= 0;
+	void*			mappedData		= nullptr;
+	uint32_t		memoryTypeIndex	= 0;
+	uint32_t		blockId			= 0;
+	uint32_t		order			= 0;
+	bool			isDedicated		= false;
+};
+
+//---------------------------------------------------------------------------------------------------
+struct VulkanAllocatorStats
+{
+	uint32_t		blockCount					= 0;
+	uint32_t		dedicatedAllocationCount	= 0;
+	uint32_t		allocationCount				= 0;
+	uint32_t		deviceAllocationCount		= 0;
+	VkDeviceSize	bytesReserved				= 0;
+	VkDeviceSize	bytesInUse					= 0;
+	VkDeviceSize	bytesRequested				= 0;
+};
+
+//---------------------------------------------------------------------------------------------------
+// Pools device memory into large blocks per memory type and hands out buddy sub-allocations from them.
+// Buffers and linear images never share a block with optimally tiled images, which keeps every block
+// clear of bufferImageGranularity conflicts without having to pad individual allocations.
+class VulkanMemoryAllocator
+{
+public:
+	VulkanMemoryAllocator();
+	~VulkanMemoryAllocator();
+
+	void					Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+	void					Uninitialize();
+
+	VulkanAllocation		Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool isOptimalImage);
+	VulkanAllocation		AllocateForBuffer(const VkBuffer& buffer, VkMemoryPropertyFlags properties);
+	VulkanAllocation		AllocateForImage(const VkImage& image, VkMemoryPropertyFlags properties, bool isOptimalImage = true);
+	void					Free(VulkanAllocation& allocation);
+
+	uint32_t				FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	VulkanAllocatorStats	GetStats() const;
+	VulkanAllocatorStats	GetStats(uint32_t memoryTypeIndex) const;
+	void					PrintStats() const;
+
+public:
+	static const VkDeviceSize	DEFAULT_BLOCK_SIZE		= 64 * 1024 * 1024;
+	static const VkDeviceSize	MIN_ALLOCATION_SIZE		= 256;
+
+private:
+	struct MemoryBlock
+	{
+		VkDeviceMemory						memory			= VK_NULL_HANDLE;
+		uint8_t*							mappedData		= nullptr;
+		VkDeviceSize						size			= 0;
+		uint32_t							id				= 0;
+		uint32_t							maxOrder		= 0;
+		uint32_t							allocationCount	= 0;
+		VkDeviceSize						bytesInUse		= 0;
+		VkDeviceSize						bytesRequested	= 0;
+		bool								isOptimalImage	= false;
+		std::vector<std::set<VkDeviceSize>>	freeLists;
+	};
+
+	struct MemoryTypePool
+	{
+		std::vector<std::unique_ptr<MemoryBlock>>	blocks;
+		uint32_t									dedicatedCount			= 0;
+		VkDeviceSize								dedicatedBytes			= 0;
+		VkDeviceSize								dedicatedBytesRequested	= 0;
+	};
+
+private:
+	uint32_t				FindMemoryTypeLocked(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	VkDeviceSize			GetBlockSize(uint32_t memoryTypeIndex) const;
+	MemoryBlock*			CreateBlock(uint32_t memoryTypeIndex, bool isOptimalImage);
+	void					DestroyBlock(MemoryBlock& block);
+	bool					AllocateFromBlock(MemoryBlock& block, uint32_t order, VkDeviceSize& offset);
+	void					FreeToBlock(MemoryBlock& block, uint32_t order, VkDeviceSize offset);
+	VulkanAllocation		AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex);
+	void					AccumulateStats(const MemoryTypePool& pool, VulkanAllocatorStats& stats) const;
+
+private:
+	VkDevice									m_device;
+	VkPhysicalDeviceMemoryProperties			m_memoryProperties;
+	VkDeviceSize								m_preferredBlockSize;
+	uint32_t									m_maxDeviceAllocations;
+	uint32_t									m_deviceAllocationCount;
+	uint32_t									m_nextBlockId;
+	std::vector<MemoryTypePool>					m_pools;
+	std::unordered_map<uint64_t, uint32_t>		m_memoryTypeCache;
+	mutable std::mutex							m_mutex;
+};
+#endif // !_VULKAN_MEMORY_ALLOCATOR_H_
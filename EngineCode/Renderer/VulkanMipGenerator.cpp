@@ -0,0 +1,364 @@
+#include "VulkanMipGenerator.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+static VkImageMemoryBarrier MakeLevelBarrier(const VkImage& image, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+	VkImageMemoryBarrier barrier			= {};
+	barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout						= oldLayout;
+	barrier.newLayout						= newLayout;
+	barrier.srcAccessMask					= srcAccess;
+	barrier.dstAccessMask					= dstAccess;
+	barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.image							= image;
+	barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel	= baseLevel;
+	barrier.subresourceRange.levelCount		= levelCount;
+	barrier.subresourceRange.baseArrayLayer	= 0;
+	barrier.subresourceRange.layerCount		= 1;
+	return barrier;
+}
+
+//---------------------------------------------------------------------------------------------------
+static uint32_t GetLevelExtent(uint32_t extent, uint32_t level)
+{
+	return std::max(1u, extent >> level);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanMipGenerator::GetMipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	for (uint32_t extent = std::max(width, height); extent > 1; extent >>= 1)
+	{
+		++levels;
+	}
+	return levels;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanMipGenerator::VulkanMipGenerator()
+	: m_device(VK_NULL_HANDLE)
+	, m_physicalDevice(VK_NULL_HANDLE)
+	, m_descriptorAllocator(nullptr)
+	, m_downsampleTemplate(0)
+	, m_setLayout(VK_NULL_HANDLE)
+	, m_pipelineLayout(VK_NULL_HANDLE)
+	, m_pipeline(VK_NULL_HANDLE)
+	, m_sampler(VK_NULL_HANDLE)
+	, m_currentFrame(0)
+{
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanMipGenerator::~VulkanMipGenerator()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& downsampleShader, uint32_t frameCount)
+{
+	m_device				= device;
+	m_physicalDevice		= physicalDevice;
+	m_descriptorAllocator	= &descriptorAllocator;
+	m_currentFrame			= 0;
+	m_frameViews.resize(frameCount);
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding			= 0;
+	bindings[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount	= 1;
+	bindings[0].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding			= 1;
+	bindings[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount	= 1;
+	bindings[1].stageFlags		= VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo	= {};
+	layoutInfo.sType							= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount						= (uint32_t)bindings.size();
+	layoutInfo.pBindings						= bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_setLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip downsample descriptor set layout!");
+	}
+
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(2);
+	entries[0].dstBinding		= 0;
+	entries[0].dstArrayElement	= 0;
+	entries[0].descriptorCount	= 1;
+	entries[0].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	entries[0].offset			= offsetof(DownsampleDescriptorData, source);
+	entries[0].stride			= sizeof(VkDescriptorImageInfo);
+	entries[1].dstBinding		= 1;
+	entries[1].dstArrayElement	= 0;
+	entries[1].descriptorCount	= 1;
+	entries[1].descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	entries[1].offset			= offsetof(DownsampleDescriptorData, destination);
+	entries[1].stride			= sizeof(VkDescriptorImageInfo);
+	m_downsampleTemplate = descriptorAllocator.CreateTemplate(m_setLayout, entries, sizeof(DownsampleDescriptorData));
+
+	// Sampling the middle of a destination texel bilinearly averages the 2x2 source texels under it
+	VkSamplerCreateInfo samplerInfo		= {};
+	samplerInfo.sType					= VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter				= VK_FILTER_LINEAR;
+	samplerInfo.minFilter				= VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode				= VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW			= VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod					= 0.0f;
+
+	if (vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip downsample sampler!");
+	}
+
+	CreatePipeline(pipelineCache, downsampleShader);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	for (std::vector<VkImageView>& views : m_frameViews)
+	{
+		for (VkImageView view : views)
+		{
+			vkDestroyImageView(m_device, view, nullptr);
+		}
+	}
+	m_frameViews.clear();
+	m_pendingJobs.clear();
+
+	// Descriptor sets and the update template belong to the descriptor allocator
+	vkDestroyPipeline(m_device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+	vkDestroySampler(m_device, m_sampler, nullptr);
+
+	m_pipeline				= VK_NULL_HANDLE;
+	m_pipelineLayout		= VK_NULL_HANDLE;
+	m_setLayout				= VK_NULL_HANDLE;
+	m_sampler				= VK_NULL_HANDLE;
+	m_descriptorAllocator	= nullptr;
+	m_physicalDevice		= VK_NULL_HANDLE;
+	m_device				= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanMipGenerator::CanBlit(VkFormat format) const
+{
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (properties.optimalTilingFeatures & required) == required;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanMipGenerator::CanGenerate(VkFormat format) const
+{
+	if (CanBlit(format))
+	{
+		return true;
+	}
+
+	// The downsample shader writes through an rgba8 storage image
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return format == VK_FORMAT_R8G8B8A8_UNORM && (properties.optimalTilingFeatures & required) == required;
+}
+
+//---------------------------------------------------------------------------------------------------
+VkImageUsageFlags VulkanMipGenerator::GetRequiredUsage(VkFormat format) const
+{
+	if (CanBlit(format))
+	{
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+	return VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::Enqueue(const VkImage& image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	Job job;
+	job.image		= image;
+	job.format		= format;
+	job.width		= width;
+	job.height		= height;
+	job.mipLevels	= mipLevels;
+	m_pendingJobs.push_back(job);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::BeginFrame(uint32_t frameIndex)
+{
+	m_currentFrame = frameIndex % (uint32_t)m_frameViews.size();
+
+	for (VkImageView view : m_frameViews[m_currentFrame])
+	{
+		vkDestroyImageView(m_device, view, nullptr);
+	}
+	m_frameViews[m_currentFrame].clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::RecordPending(const VkCommandBuffer& commandBuffer)
+{
+	for (const Job& job : m_pendingJobs)
+	{
+		if (job.mipLevels <= 1)
+		{
+			VkImageMemoryBarrier barrier = MakeLevelBarrier(job.image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+		else if (CanBlit(job.format))
+		{
+			RecordBlits(commandBuffer, job);
+		}
+		else
+		{
+			RecordDownsamples(commandBuffer, job);
+		}
+	}
+	m_pendingJobs.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::RecordBlits(const VkCommandBuffer& commandBuffer, const Job& job) const
+{
+	VkImageMemoryBarrier barrier = MakeLevelBarrier(job.image, 1, job.mipLevels - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	for (uint32_t level = 1; level < job.mipLevels; ++level)
+	{
+		// The level above has just been written, by the upload or the previous blit
+		barrier = MakeLevelBarrier(job.image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageBlit blit					= {};
+		blit.srcSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel		= level - 1;
+		blit.srcSubresource.baseArrayLayer	= 0;
+		blit.srcSubresource.layerCount		= 1;
+		blit.srcOffsets[1].x				= (int32_t)GetLevelExtent(job.width, level - 1);
+		blit.srcOffsets[1].y				= (int32_t)GetLevelExtent(job.height, level - 1);
+		blit.srcOffsets[1].z				= 1;
+		blit.dstSubresource					= blit.srcSubresource;
+		blit.dstSubresource.mipLevel		= level;
+		blit.dstOffsets[1].x				= (int32_t)GetLevelExtent(job.width, level);
+		blit.dstOffsets[1].y				= (int32_t)GetLevelExtent(job.height, level);
+		blit.dstOffsets[1].z				= 1;
+
+		vkCmdBlitImage(commandBuffer, job.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, job.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+	}
+
+	// Every level but the last was read as a source, the last one was only written
+	std::array<VkImageMemoryBarrier, 2> barriers;
+	barriers[0] = MakeLevelBarrier(job.image, 0, job.mipLevels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+	barriers[1] = MakeLevelBarrier(job.image, job.mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, (uint32_t)barriers.size(), barriers.data());
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::RecordDownsamples(const VkCommandBuffer& commandBuffer, const Job& job)
+{
+	// Level 0 becomes the first source, the rest are written as storage images
+	std::array<VkImageMemoryBarrier, 2> barriers;
+	barriers[0] = MakeLevelBarrier(job.image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+	barriers[1] = MakeLevelBarrier(job.image, 1, job.mipLevels - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, (uint32_t)barriers.size(), barriers.data());
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+	VkImageView sourceView = CreateLevelView(job, 0);
+	for (uint32_t level = 1; level < job.mipLevels; ++level)
+	{
+		VkImageView destinationView = CreateLevelView(job, level);
+
+		DownsampleDescriptorData data;
+		data.source			= { m_sampler, sourceView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		data.destination	= { VK_NULL_HANDLE, destinationView, VK_IMAGE_LAYOUT_GENERAL };
+
+		VkDescriptorSet set = m_descriptorAllocator->AllocateFrame(m_downsampleTemplate, &data);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+
+		uint32_t width	= GetLevelExtent(job.width, level);
+		uint32_t height	= GetLevelExtent(job.height, level);
+		vkCmdDispatch(commandBuffer, (width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		// Written level becomes the next source, and is final from here on
+		VkImageMemoryBarrier barrier = MakeLevelBarrier(job.image, level, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		sourceView = destinationView;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkImageView VulkanMipGenerator::CreateLevelView(const Job& job, uint32_t level)
+{
+	VkImageViewCreateInfo viewInfo				= {};
+	viewInfo.sType								= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image								= job.image;
+	viewInfo.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format								= job.format;
+	viewInfo.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel		= level;
+	viewInfo.subresourceRange.levelCount		= 1;
+	viewInfo.subresourceRange.baseArrayLayer	= 0;
+	viewInfo.subresourceRange.layerCount		= 1;
+
+	VkImageView view;
+	if (vkCreateImageView(m_device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip level view!");
+	}
+
+	// Referenced by this frame's sets until its fence has signaled
+	m_frameViews[m_currentFrame].push_back(view);
+	return view;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanMipGenerator::CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& downsampleShader)
+{
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo	= {};
+	pipelineLayoutInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount				= 1;
+	pipelineLayoutInfo.pSetLayouts					= &m_setLayout;
+
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip downsample pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo	= {};
+	pipelineInfo.sType							= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType					= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage					= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module					= downsampleShader;
+	pipelineInfo.stage.pName					= "main";
+	pipelineInfo.layout							= m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create mip downsample pipeline!");
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef _VULKAN_MIP_GENERATOR_H_
+#define _VULKAN_MIP_GENERATOR_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanDescriptorAllocator.hpp"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Fills the mip chain of an image from its level 0 on the GPU. Where the format can be blitted with
+// linear filtering every level is a vkCmdBlitImage of the one above it, otherwise MipDownsample.comp
+// averages it down level by level through per-level views.
+//
+// Blits need a graphics queue, so generation is recorded into the frame's command buffer instead of
+// the upload batch: the texture upload enqueues its image once the batch has completed and the next
+// frame records the chain right after taking ownership of the upload. Every level is transitioned on
+// its own as it goes from written to read, and the whole chain ends in SHADER_READ_ONLY_OPTIMAL.
+class VulkanMipGenerator
+{
+public:
+	static const uint32_t		WORKGROUP_SIZE		= 8;	// local_size_x and local_size_y of MipDownsample.comp
+
+	// A full chain, down to 1x1
+	static uint32_t				GetMipLevelCount(uint32_t width, uint32_t height);
+
+public:
+	VulkanMipGenerator();
+	~VulkanMipGenerator();
+
+	// The shader module is only used during the call
+	void					Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VulkanDescriptorAllocator& descriptorAllocator, const VkPipelineCache& pipelineCache, const VkShaderModule& downsampleShader, uint32_t frameCount);
+	void					Uninitialize();
+
+	// Whether a chain can be generated for the format at all, and the usage its image needs for it
+	bool					CanGenerate(VkFormat format) const;
+	VkImageUsageFlags		GetRequiredUsage(VkFormat format) const;
+
+	// Level 0 has to be in TRANSFER_DST_OPTIMAL and owned by the graphics queue by the time the chain is
+	// recorded, the contents and layouts of the other levels are discarded
+	void					Enqueue(const VkImage& image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+	// Destroys the level views of the chains this frame generated in its last use
+	void					BeginFrame(uint32_t frameIndex);
+	void					RecordPending(const VkCommandBuffer& commandBuffer);
+
+private:
+	struct Job
+	{
+		VkImage			image;
+		VkFormat		format;
+		uint32_t		width;
+		uint32_t		height;
+		uint32_t		mipLevels;
+	};
+
+	// Contents of the downsample set, in the layout its update template reads
+	struct DownsampleDescriptorData
+	{
+		VkDescriptorImageInfo	source;
+		VkDescriptorImageInfo	destination;
+	};
+
+private:
+	bool					CanBlit(VkFormat format) const;
+	void					RecordBlits(const VkCommandBuffer& commandBuffer, const Job& job) const;
+	void					RecordDownsamples(const VkCommandBuffer& commandBuffer, const Job& job);
+	VkImageView				CreateLevelView(const Job& job, uint32_t level);
+	void					CreatePipeline(const VkPipelineCache& pipelineCache, const VkShaderModule& downsampleShader);
+
+private:
+	VkDevice								m_device;
+	VkPhysicalDevice						m_physicalDevice;
+	VulkanDescriptorAllocator*				m_descriptorAllocator;
+	DescriptorTemplate						m_downsampleTemplate;
+	VkDescriptorSetLayout					m_setLayout;
+	VkPipelineLayout						m_pipelineLayout;
+	VkPipeline								m_pipeline;
+	VkSampler								m_sampler;
+	std::vector<Job>						m_pendingJobs;
+	std::vector<std::vector<VkImageView>>	m_frameViews;	// Level views per frame in flight, alive until its fence
+	uint32_t								m_currentFrame;
+};
+#endif // !_VULKAN_MIP_GENERATOR_H_
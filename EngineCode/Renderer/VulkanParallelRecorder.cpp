@@ -0,0 +1,275 @@
+#include "VulkanParallelRecorder.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+//---------------------------------------------------------------------------------------------------
+VulkanParallelRecorder::VulkanParallelRecorder()
+	: m_device(VK_NULL_HANDLE)
+	, m_frameCount(0)
+	, m_currentFrame(0)
+	, m_jobGeneration(0)
+	, m_workersPending(0)
+	, m_shutdown(false)
+	, m_recordSlice(nullptr)
+	, m_inheritance(nullptr)
+	, m_itemCount(0)
+	, m_sliceCount(0)
+	, m_nextSlice(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanParallelRecorder::~VulkanParallelRecorder()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::Initialize(const VkDevice& device, uint32_t queueFamily, uint32_t frameCount, uint32_t workerCount)
+{
+	m_device		= device;
+	m_frameCount	= frameCount;
+	m_currentFrame	= 0;
+	m_jobGeneration	= 0;
+	m_shutdown		= false;
+
+	if (workerCount == DEFAULT_WORKER_COUNT)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	VkCommandPoolCreateInfo poolInfo	= {};
+	poolInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags						= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex			= queueFamily;
+
+	m_pools.resize(m_frameCount);
+	for (auto& framePools : m_pools)
+	{
+		framePools.resize(workerCount + 1);
+		for (auto& pool : framePools)
+		{
+			if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &pool.commandPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create recording thread command pool!");
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		m_workers.emplace_back(&VulkanParallelRecorder::WorkerLoop, this, i);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+	m_workAvailable.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+
+	for (auto& framePools : m_pools)
+	{
+		for (auto& pool : framePools)
+		{
+			vkDestroyCommandPool(m_device, pool.commandPool, nullptr);
+		}
+	}
+	m_pools.clear();
+
+	m_device = VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::BeginFrame(uint32_t frameIndex)
+{
+	m_currentFrame = frameIndex % m_frameCount;
+
+	for (auto& pool : m_pools[m_currentFrame])
+	{
+		vkResetCommandPool(m_device, pool.commandPool, 0);
+		pool.usedCount = 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::Record(const VkCommandBuffer& primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount, const RecordSliceFunction& recordSlice)
+{
+	if (itemCount == 0)
+	{
+		return;
+	}
+
+	// Small lists are not worth waking anybody for, a single slice is recorded on the calling thread
+	uint32_t maxSlices	= GetThreadCount() * 2;
+	m_sliceCount		= std::min(maxSlices, (itemCount + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE);
+	m_itemCount			= itemCount;
+	m_recordSlice		= &recordSlice;
+	m_inheritance		= &inheritance;
+	m_sliceBuffers.assign(m_sliceCount, VK_NULL_HANDLE);
+	m_nextSlice			= 0;
+
+	if (m_sliceCount > 1 && !m_workers.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_workersPending = (uint32_t)m_workers.size();
+			++m_jobGeneration;
+		}
+		m_workAvailable.notify_all();
+	}
+
+	std::exception_ptr error;
+	try
+	{
+		RunSlices(GetThreadCount() - 1);
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+		m_nextSlice = m_sliceCount;
+	}
+
+	// Every woken worker has to check back in, not just every slice, so none of them can still be
+	// reading this job's state when the next Record overwrites it or an exception unwinds it
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_workFinished.wait(lock, [this]() { return m_workersPending == 0; });
+		if (!error)
+		{
+			error = m_workerError;
+		}
+		m_workerError = nullptr;
+	}
+
+	m_recordSlice	= nullptr;
+	m_inheritance	= nullptr;
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+
+	// Slices are executed in list order no matter which thread recorded them
+	vkCmdExecuteCommands(primary, m_sliceCount, m_sliceBuffers.data());
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::WorkerLoop(uint32_t threadIndex)
+{
+	PROFILE_THREAD_NAME(("Command Recorder " + std::to_string(threadIndex)).c_str());
+	uint64_t seenGeneration = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workAvailable.wait(lock, [this, seenGeneration]() { return m_shutdown || m_jobGeneration != seenGeneration; });
+			if (m_shutdown)
+			{
+				return;
+			}
+			seenGeneration = m_jobGeneration;
+		}
+
+		// Nothing above this thread would catch it, so the exception goes back to Record
+		std::exception_ptr error;
+		try
+		{
+			RunSlices(threadIndex);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+			m_nextSlice = m_sliceCount;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (error && !m_workerError)
+			{
+				m_workerError = error;
+			}
+			if (--m_workersPending > 0)
+			{
+				continue;
+			}
+		}
+		m_workFinished.notify_one();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanParallelRecorder::RunSlices(uint32_t threadIndex)
+{
+	uint32_t itemsPerSlice = (m_itemCount + m_sliceCount - 1) / m_sliceCount;
+
+	for (uint32_t slice = m_nextSlice++; slice < m_sliceCount; slice = m_nextSlice++)
+	{
+		uint32_t firstItem	= slice * itemsPerSlice;
+		uint32_t itemCount	= std::min(itemsPerSlice, m_itemCount - std::min(firstItem, m_itemCount));
+		PROFILE_ZONE("RecordSlice");
+
+		VkCommandBuffer commandBuffer = AcquireCommandBuffer(threadIndex);
+
+		VkCommandBufferBeginInfo beginInfo	= {};
+		beginInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags						= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo			= m_inheritance;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (itemCount > 0)
+		{
+			(*m_recordSlice)(commandBuffer, firstItem, itemCount);
+		}
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+
+		m_sliceBuffers[slice] = commandBuffer;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VkCommandBuffer VulkanParallelRecorder::AcquireCommandBuffer(uint32_t threadIndex)
+{
+	ThreadPool& pool = m_pools[m_currentFrame][threadIndex];
+
+	if (pool.usedCount == pool.commandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo	= {};
+		allocInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool					= pool.commandPool;
+		allocInfo.level							= VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount			= 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+		pool.commandBuffers.push_back(commandBuffer);
+	}
+
+	return pool.commandBuffers[pool.usedCount++];
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef _VULKAN_PARALLEL_RECORDER_H_
+#define _VULKAN_PARALLEL_RECORDER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Records secondary command buffers for slices of a draw list on a pool of worker threads. Every thread
+// owns a transient command pool per frame in flight, so recording never contends on a pool and a whole
+// frame's worth of buffers is recycled with one vkResetCommandPool per thread once its fence signals.
+class VulkanParallelRecorder
+{
+public:
+	typedef std::function<void(const VkCommandBuffer& commandBuffer, uint32_t firstItem, uint32_t itemCount)> RecordSliceFunction;
+
+	VulkanParallelRecorder();
+	~VulkanParallelRecorder();
+
+	void					Initialize(const VkDevice& device, uint32_t queueFamily, uint32_t frameCount, uint32_t workerCount = DEFAULT_WORKER_COUNT);
+	void					Uninitialize();
+
+	// The frame's fence must have been waited on, this resets every command pool that frame used
+	void					BeginFrame(uint32_t frameIndex);
+
+	// Splits [0, itemCount) into slices, records each into a secondary command buffer continuing the
+	// render pass described by inheritance, and executes them in order from the primary buffer. The
+	// primary must be inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+	// Whatever a slice throws, on any thread, is rethrown here once every worker is done with the job.
+	void					Record(const VkCommandBuffer& primary, const VkCommandBufferInheritanceInfo& inheritance, uint32_t itemCount, const RecordSliceFunction& recordSlice);
+
+	uint32_t				GetThreadCount() const	{ return (uint32_t)m_workers.size() + 1; }
+
+public:
+	static const uint32_t	DEFAULT_WORKER_COUNT	= ~0u; // One less than the hardware thread count
+	static const uint32_t	MIN_ITEMS_PER_SLICE		= 256;
+
+private:
+	struct ThreadPool
+	{
+		VkCommandPool					commandPool		= VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer>	commandBuffers;
+		uint32_t						usedCount		= 0;
+	};
+
+private:
+	void					WorkerLoop(uint32_t threadIndex);
+	void					RunSlices(uint32_t threadIndex);
+	VkCommandBuffer			AcquireCommandBuffer(uint32_t threadIndex);
+
+private:
+	VkDevice								m_device;
+	uint32_t								m_frameCount;
+	uint32_t								m_currentFrame;
+	std::vector<std::vector<ThreadPool>>	m_pools; // [frame][thread], the calling thread is the last one
+	std::vector<std::thread>				m_workers;
+
+	std::mutex								m_mutex;
+	std::condition_variable					m_workAvailable;
+	std::condition_variable					m_workFinished;
+	uint64_t								m_jobGeneration;
+	uint32_t								m_workersPending;
+	std::exception_ptr						m_workerError; // First exception a worker threw during the job
+	bool									m_shutdown;
+
+	// State of the job currently being recorded, only written while no worker is running
+	const RecordSliceFunction*				m_recordSlice;
+	const VkCommandBufferInheritanceInfo*	m_inheritance;
+	uint32_t								m_itemCount;
+	uint32_t								m_sliceCount;
+	std::vector<VkCommandBuffer>			m_sliceBuffers;
+	std::atomic<uint32_t>					m_nextSlice;
+};
+#endif // !_VULKAN_PARALLEL_RECORDER_H_
@@ -0,0 +1,198 @@
+#include "VulkanPipelineCache.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+VulkanPipelineCache::VulkanPipelineCache()
+	: m_device(VK_NULL_HANDLE)
+	, m_deviceProperties()
+	, m_cache(VK_NULL_HANDLE)
+	, m_loadedFromDisk(false)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanPipelineCache::~VulkanPipelineCache()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanPipelineCache::Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const std::string& filePath)
+{
+	m_device	= device;
+	m_filePath	= filePath;
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_deviceProperties);
+
+	std::vector<char> cacheData;
+	m_loadedFromDisk = LoadFromDisk(cacheData);
+
+	VkPipelineCacheCreateInfo createInfo	= {};
+	createInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize				= m_loadedFromDisk ? cacheData.size() : 0;
+	createInfo.pInitialData					= m_loadedFromDisk ? cacheData.data() : nullptr;
+
+	if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS)
+	{
+		// A driver may still reject data that passed our checks, start over with an empty cache then
+		m_loadedFromDisk			= false;
+		createInfo.initialDataSize	= 0;
+		createInfo.pInitialData		= nullptr;
+
+		if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+	}
+
+	std::cout << "pipeline cache: " << (m_loadedFromDisk ? "loaded " + std::to_string(cacheData.size()) + " bytes from " : "starting empty, nothing usable in ") << m_filePath << std::endl;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanPipelineCache::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Save();
+	vkDestroyPipelineCache(m_device, m_cache, nullptr);
+
+	m_cache		= VK_NULL_HANDLE;
+	m_device	= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanPipelineCache::Save() const
+{
+	PROFILE_FUNCTION();
+	size_t dataSize = GetDataSize();
+	if (dataSize == 0)
+	{
+		return;
+	}
+
+	std::vector<char> cacheData(dataSize);
+	if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, cacheData.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	FileHeader header		= {};
+	header.magic			= FILE_MAGIC;
+	header.headerVersion	= FILE_HEADER_VERSION;
+	header.vendorID			= m_deviceProperties.vendorID;
+	header.deviceID			= m_deviceProperties.deviceID;
+	header.driverVersion	= m_deviceProperties.driverVersion;
+	header.dataSize			= dataSize;
+	header.dataHash			= HashData(cacheData.data(), dataSize);
+	memcpy(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	// Write next to the old file and swap it in, so a crash mid-write never leaves a torn cache behind
+	std::string tempPath = m_filePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "pipeline cache: failed to open " << tempPath << " for writing" << std::endl;
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(cacheData.data(), dataSize);
+	}
+
+	std::remove(m_filePath.c_str());
+	if (std::rename(tempPath.c_str(), m_filePath.c_str()) != 0)
+	{
+		std::cerr << "pipeline cache: failed to replace " << m_filePath << std::endl;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+size_t VulkanPipelineCache::GetDataSize() const
+{
+	size_t dataSize = 0;
+	vkGetPipelineCacheData(m_device, m_cache, &dataSize, nullptr);
+	return dataSize;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanPipelineCache::LoadFromDisk(std::vector<char>& cacheData) const
+{
+	std::ifstream file(m_filePath, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	if (fileSize < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!IsHeaderValid(header) || header.dataSize != fileSize - sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	cacheData.resize((size_t)header.dataSize);
+	file.read(cacheData.data(), cacheData.size());
+
+	if (!file.good() || HashData(cacheData.data(), cacheData.size()) != header.dataHash)
+	{
+		return false;
+	}
+
+	// The blob starts with the driver's own VkPipelineCacheHeaderVersionOne: length, version, vendor,
+	// device and UUID. Check it too, the driver is only required to ignore a mismatch, not report it
+	const size_t vulkanHeaderSize = 16 + VK_UUID_SIZE;
+	if (cacheData.size() < vulkanHeaderSize)
+	{
+		return false;
+	}
+
+	uint32_t vulkanHeader[4];
+	memcpy(vulkanHeader, cacheData.data(), sizeof(vulkanHeader));
+	return vulkanHeader[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vulkanHeader[2] == m_deviceProperties.vendorID
+		&& vulkanHeader[3] == m_deviceProperties.deviceID
+		&& memcmp(cacheData.data() + 16, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanPipelineCache::IsHeaderValid(const FileHeader& header) const
+{
+	// The driver version is not part of the Vulkan cache header, but a driver update is exactly when
+	// stale data is most likely to be accepted and then miscompiled, so it is checked here as well
+	return header.magic == FILE_MAGIC
+		&& header.headerVersion == FILE_HEADER_VERSION
+		&& header.vendorID == m_deviceProperties.vendorID
+		&& header.deviceID == m_deviceProperties.deviceID
+		&& header.driverVersion == m_deviceProperties.driverVersion
+		&& memcmp(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+//---------------------------------------------------------------------------------------------------
+uint64_t VulkanPipelineCache::HashData(const char* data, size_t size)
+{
+	// FNV-1a, only meant to catch truncated or corrupted files
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (uint8_t)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef _VULKAN_PIPELINE_CACHE_H_
+#define _VULKAN_PIPELINE_CACHE_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Owns the VkPipelineCache every pipeline is created through and persists it between runs. The blob on
+// disk is prefixed with our own header so data from another GPU, driver or a truncated write is thrown
+// away instead of being handed to the driver.
+class VulkanPipelineCache
+{
+public:
+	VulkanPipelineCache();
+	~VulkanPipelineCache();
+
+	void					Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, const std::string& filePath);
+	void					Uninitialize();
+	void					Save() const;
+	size_t					GetDataSize() const;
+
+	VkPipelineCache			GetCache() const			{ return m_cache; }
+	bool					WasLoadedFromDisk() const	{ return m_loadedFromDisk; }
+
+private:
+	struct FileHeader
+	{
+		uint32_t			magic;
+		uint32_t			headerVersion;
+		uint32_t			vendorID;
+		uint32_t			deviceID;
+		uint32_t			driverVersion;
+		uint8_t				pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t			dataSize;
+		uint64_t			dataHash;
+	};
+
+private:
+	bool					LoadFromDisk(std::vector<char>& cacheData) const;
+	bool					IsHeaderValid(const FileHeader& header) const;
+	static uint64_t			HashData(const char* data, size_t size);
+
+private:
+	static const uint32_t	FILE_MAGIC			= 0x43505344; // "DSPC"
+	static const uint32_t	FILE_HEADER_VERSION	= 1;
+
+	VkDevice					m_device;
+	VkPhysicalDeviceProperties	m_deviceProperties;
+	VkPipelineCache				m_cache;
+	std::string					m_filePath;
+	bool						m_loadedFromDisk;
+};
+#endif // !_VULKAN_PIPELINE_CACHE_H_
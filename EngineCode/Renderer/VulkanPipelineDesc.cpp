@@ -0,0 +1,143 @@
+#include "VulkanPipelineDesc.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+VkPipeline VulkanPipelineDesc::Create(const VkDevice& device, const VkPipelineCache& cache) const
+{
+	VkPipelineShaderStageCreateInfo shaderStages[2]		= {};
+	shaderStages[0].sType								= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage								= VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module								= vertexShader;
+	shaderStages[0].pName								= "main";
+	shaderStages[1].sType								= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage								= VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module								= fragmentShader;
+	shaderStages[1].pName								= "main";
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo	= {};
+	vertexInputInfo.sType									= VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount			= (uint32_t)vertexBindings.size();
+	vertexInputInfo.pVertexBindingDescriptions				= vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount			= (uint32_t)vertexAttributes.size();
+	vertexInputInfo.pVertexAttributeDescriptions			= vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly	= {};
+	inputAssembly.sType										= VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology									= topology;
+	inputAssembly.primitiveRestartEnable					= VK_FALSE;
+
+	// Counts only, the actual rectangles are recorded with vkCmdSetViewport/vkCmdSetScissor
+	VkPipelineViewportStateCreateInfo viewportState		= {};
+	viewportState.sType									= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount							= 1;
+	viewportState.pViewports							= nullptr;
+	viewportState.scissorCount							= 1;
+	viewportState.pScissors								= nullptr;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer	= {};
+	rasterizer.sType									= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable							= VK_FALSE;
+	rasterizer.rasterizerDiscardEnable					= VK_FALSE;
+	rasterizer.polygonMode								= polygonMode;
+	rasterizer.lineWidth								= 1.0f;
+	rasterizer.cullMode									= cullMode;
+	rasterizer.frontFace								= frontFace;
+	rasterizer.depthBiasEnable							= VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling	= {};
+	multisampling.sType									= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable					= VK_FALSE;
+	multisampling.rasterizationSamples					= VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading						= 1.0f;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment	= {};
+	colorBlendAttachment.colorWriteMask							= VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable							= blendEnable ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor					= VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor					= VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp							= VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor					= VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor					= VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp							= VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending	= {};
+	colorBlending.sType									= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable							= VK_FALSE;
+	colorBlending.logicOp								= VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount						= 1;
+	colorBlending.pAttachments							= &colorBlendAttachment;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil	= {};
+	depthStencil.sType									= VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable						= depthTestEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable						= depthWriteEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp							= depthCompareOp;
+	depthStencil.depthBoundsTestEnable					= VK_FALSE;
+	depthStencil.minDepthBounds							= 0.0f;
+	depthStencil.maxDepthBounds							= 1.0f;
+	depthStencil.stencilTestEnable						= VK_FALSE;
+
+	std::vector<VkDynamicState> dynamicStates			= { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	dynamicStates.insert(dynamicStates.end(), extraDynamicStates.begin(), extraDynamicStates.end());
+
+	VkPipelineDynamicStateCreateInfo dynamicState		= {};
+	dynamicState.sType									= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount						= (uint32_t)dynamicStates.size();
+	dynamicState.pDynamicStates							= dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo			= {};
+	pipelineInfo.sType									= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount								= 2;
+	pipelineInfo.pStages								= shaderStages;
+	pipelineInfo.pVertexInputState						= &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState					= &inputAssembly;
+	pipelineInfo.pViewportState							= &viewportState;
+	pipelineInfo.pRasterizationState					= &rasterizer;
+	pipelineInfo.pMultisampleState						= &multisampling;
+	pipelineInfo.pDepthStencilState						= &depthStencil;
+	pipelineInfo.pColorBlendState						= &colorBlending;
+	pipelineInfo.pDynamicState							= &dynamicState;
+	pipelineInfo.layout									= layout;
+	pipelineInfo.renderPass								= renderPass;
+	pipelineInfo.subpass								= subpass;
+	pipelineInfo.basePipelineHandle						= VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex						= -1;
+
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	return pipeline;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanViewState VulkanViewState::FromExtent(const VkExtent2D& extent)
+{
+	VkRect2D rect	= {};
+	rect.offset		= { 0, 0 };
+	rect.extent		= extent;
+	return FromRect(rect);
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanViewState VulkanViewState::FromRect(const VkRect2D& rect)
+{
+	VulkanViewState view;
+	view.viewport.x			= (float)rect.offset.x;
+	view.viewport.y			= (float)rect.offset.y;
+	view.viewport.width		= (float)rect.extent.width;
+	view.viewport.height	= (float)rect.extent.height;
+	view.viewport.minDepth	= 0.0f;
+	view.viewport.maxDepth	= 1.0f;
+	view.scissor			= rect;
+	return view;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanViewState::Apply(const VkCommandBuffer& commandBuffer) const
+{
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#ifndef _VULKAN_PIPELINE_DESC_H_
+#define _VULKAN_PIPELINE_DESC_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+// Everything a graphics pipeline is compiled from. Nothing in here depends on the render target size:
+// viewport and scissor are always dynamic and come from a VulkanViewState at record time, so one
+// pipeline serves every window size, resolution scale and view.
+struct VulkanPipelineDesc
+{
+	VkShaderModule									vertexShader		= VK_NULL_HANDLE;
+	VkShaderModule									fragmentShader		= VK_NULL_HANDLE;
+	std::vector<VkVertexInputBindingDescription>	vertexBindings;
+	std::vector<VkVertexInputAttributeDescription>	vertexAttributes;
+	VkPrimitiveTopology								topology			= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode									polygonMode			= VK_POLYGON_MODE_FILL;
+	VkCullModeFlags									cullMode			= VK_CULL_MODE_BACK_BIT;
+	VkFrontFace										frontFace			= VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	bool											depthTestEnable		= true;
+	bool											depthWriteEnable	= true;
+	VkCompareOp										depthCompareOp		= VK_COMPARE_OP_LESS;
+	bool											blendEnable			= true;
+	std::vector<VkDynamicState>						extraDynamicStates;
+	VkPipelineLayout								layout				= VK_NULL_HANDLE;
+	VkRenderPass									renderPass			= VK_NULL_HANDLE;
+	uint32_t										subpass				= 0;
+
+	VkPipeline										Create(const VkDevice& device, const VkPipelineCache& cache) const;
+};
+
+//---------------------------------------------------------------------------------------------------
+// The per-frame half of the pipeline state. Cheap to change every frame or every view.
+struct VulkanViewState
+{
+	VkViewport										viewport			= {};
+	VkRect2D										scissor				= {};
+
+	static VulkanViewState							FromExtent(const VkExtent2D& extent);
+	static VulkanViewState							FromRect(const VkRect2D& rect);
+	void											Apply(const VkCommandBuffer& commandBuffer) const;
+};
+#endif // !_VULKAN_PIPELINE_DESC_H_
@@ -0,0 +1,850 @@
+#include "VulkanRenderGraph.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "VulkanGpuProfiler.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+static const VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+											| VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+//---------------------------------------------------------------------------------------------------
+static VkImageUsageFlags ImageUsageFromGraphUsage(RenderGraphUsage usage)
+{
+	switch (usage)
+	{
+	case RENDER_GRAPH_COLOR_ATTACHMENT:			return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RENDER_GRAPH_DEPTH_ATTACHMENT:
+	case RENDER_GRAPH_DEPTH_READ_ONLY:			return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RENDER_GRAPH_SAMPLED_FRAGMENT:
+	case RENDER_GRAPH_SAMPLED_COMPUTE:			return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RENDER_GRAPH_STORAGE_READ_COMPUTE:
+	case RENDER_GRAPH_STORAGE_WRITE_COMPUTE:	return VK_IMAGE_USAGE_STORAGE_BIT;
+	case RENDER_GRAPH_TRANSFER_SRC:				return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case RENDER_GRAPH_TRANSFER_DST:				return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	default:									return 0;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanResourceState VulkanResourceState::FromUsage(RenderGraphUsage usage, bool* isWrite)
+{
+	VulkanResourceState state;
+	bool writes = false;
+
+	switch (usage)
+	{
+	case RENDER_GRAPH_COLOR_ATTACHMENT:
+		state.stageMask		= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		state.accessMask	= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		writes				= true;
+		break;
+	case RENDER_GRAPH_DEPTH_ATTACHMENT:
+		state.stageMask		= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		state.accessMask	= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		writes				= true;
+		break;
+	case RENDER_GRAPH_DEPTH_READ_ONLY:
+		state.stageMask		= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		state.accessMask	= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		break;
+	case RENDER_GRAPH_SAMPLED_FRAGMENT:
+		state.stageMask		= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_SHADER_READ_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case RENDER_GRAPH_SAMPLED_COMPUTE:
+		state.stageMask		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_SHADER_READ_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case RENDER_GRAPH_STORAGE_READ_COMPUTE:
+		state.stageMask		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_SHADER_READ_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case RENDER_GRAPH_STORAGE_WRITE_COMPUTE:
+		state.stageMask		= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_GENERAL;
+		writes				= true;
+		break;
+	case RENDER_GRAPH_TRANSFER_SRC:
+		state.stageMask		= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		state.accessMask	= VK_ACCESS_TRANSFER_READ_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		break;
+	case RENDER_GRAPH_TRANSFER_DST:
+		state.stageMask		= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		state.accessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+		state.layout		= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		writes				= true;
+		break;
+	case RENDER_GRAPH_VERTEX_BUFFER:
+		state.stageMask		= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		state.accessMask	= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		break;
+	case RENDER_GRAPH_INDEX_BUFFER:
+		state.stageMask		= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		state.accessMask	= VK_ACCESS_INDEX_READ_BIT;
+		break;
+	case RENDER_GRAPH_INDIRECT_BUFFER:
+		state.stageMask		= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		state.accessMask	= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		break;
+	case RENDER_GRAPH_UNIFORM_BUFFER:
+		state.stageMask		= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_UNIFORM_READ_BIT;
+		break;
+	case RENDER_GRAPH_HOST_READ:
+		state.stageMask		= VK_PIPELINE_STAGE_HOST_BIT;
+		state.accessMask	= VK_ACCESS_HOST_READ_BIT;
+		break;
+	}
+
+	if (isWrite)
+	{
+		*isWrite = writes;
+	}
+	return state;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanResourceState VulkanResourceState::FromLayout(VkImageLayout layout)
+{
+	VulkanResourceState state;
+	state.layout = layout;
+
+	switch (layout)
+	{
+	case VK_IMAGE_LAYOUT_UNDEFINED:
+		state.stageMask		= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_PREINITIALIZED:
+		state.stageMask		= VK_PIPELINE_STAGE_HOST_BIT;
+		state.accessMask	= VK_ACCESS_HOST_WRITE_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+		return FromUsage(RENDER_GRAPH_COLOR_ATTACHMENT);
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		return FromUsage(RENDER_GRAPH_DEPTH_ATTACHMENT);
+	case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+		return FromUsage(RENDER_GRAPH_DEPTH_READ_ONLY);
+	case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+		state.stageMask		= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.accessMask	= VK_ACCESS_SHADER_READ_BIT;
+		break;
+	case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+		return FromUsage(RENDER_GRAPH_TRANSFER_SRC);
+	case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+		return FromUsage(RENDER_GRAPH_TRANSFER_DST);
+	case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+		state.stageMask		= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		break;
+	default:
+		// GENERAL and anything unusual: correct, if blunt
+		state.stageMask		= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		state.accessMask	= VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		break;
+	}
+	return state;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::PassBuilder& VulkanRenderGraph::PassBuilder::Read(RenderGraphResource resource, RenderGraphUsage usage)
+{
+	ResourceAccess access;
+	access.resource	= resource;
+	access.state	= VulkanResourceState::FromUsage(usage);
+	access.isRead	= true;
+	if (!m_graph.m_resources[resource].isImage)
+	{
+		access.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;	// Buffers have no layout to transition
+	}
+
+	// Read and written by the same pass: one access with both, the layouts have to agree
+	for (ResourceAccess& existing : m_graph.m_passes[m_passIndex].accesses)
+	{
+		if (existing.resource == resource)
+		{
+			if (m_graph.m_resources[resource].isImage && existing.state.layout != access.state.layout)
+			{
+				throw std::runtime_error("render graph: conflicting layouts for one resource within a pass!");
+			}
+			existing.state.stageMask	|= access.state.stageMask;
+			existing.state.accessMask	|= access.state.accessMask;
+			existing.isRead				= true;
+			return *this;
+		}
+	}
+
+	m_graph.m_resources[resource].desc.usage |= ImageUsageFromGraphUsage(usage);
+	m_graph.m_passes[m_passIndex].accesses.push_back(access);
+	return *this;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::PassBuilder& VulkanRenderGraph::PassBuilder::Write(RenderGraphResource resource, RenderGraphUsage usage)
+{
+	ResourceAccess access;
+	access.resource	= resource;
+	access.state	= VulkanResourceState::FromUsage(usage);
+	access.isWrite	= true;
+	if (!m_graph.m_resources[resource].isImage)
+	{
+		access.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;	// Buffers have no layout to transition
+	}
+
+	for (ResourceAccess& existing : m_graph.m_passes[m_passIndex].accesses)
+	{
+		if (existing.resource == resource)
+		{
+			if (m_graph.m_resources[resource].isImage && existing.state.layout != access.state.layout)
+			{
+				throw std::runtime_error("render graph: conflicting layouts for one resource within a pass!");
+			}
+			existing.state.stageMask	|= access.state.stageMask;
+			existing.state.accessMask	|= access.state.accessMask;
+			existing.isWrite			= true;
+			return *this;
+		}
+	}
+
+	m_graph.m_resources[resource].desc.usage |= ImageUsageFromGraphUsage(usage);
+	m_graph.m_passes[m_passIndex].accesses.push_back(access);
+	return *this;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::PassBuilder& VulkanRenderGraph::PassBuilder::SetSideEffects()
+{
+	m_graph.m_passes[m_passIndex].hasSideEffects = true;
+	return *this;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::VulkanRenderGraph()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_isCompiled(false)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::~VulkanRenderGraph()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator)
+{
+	m_device	= device;
+	m_allocator	= &allocator;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Reset();
+	m_allocator	= nullptr;
+	m_device	= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::Reset()
+{
+	DestroyTransients();
+	m_passes.clear();
+	m_resources.clear();
+	m_schedule.clear();
+	m_passBarriers.clear();
+	m_finalBarriers = BarrierBatch();
+	m_isCompiled	= false;
+}
+
+//---------------------------------------------------------------------------------------------------
+RenderGraphResource VulkanRenderGraph::CreateImage(const std::string& name, const RenderGraphImageDesc& desc)
+{
+	Resource resource;
+	resource.name	= name;
+	resource.desc	= desc;
+	m_resources.push_back(resource);
+	return (RenderGraphResource)m_resources.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+RenderGraphResource VulkanRenderGraph::ImportImage(const std::string& name, VkImageAspectFlags aspect, const VulkanResourceState& initialState, const VulkanResourceState& finalState)
+{
+	Resource resource;
+	resource.name			= name;
+	resource.isImported		= true;
+	resource.desc.aspect	= aspect;
+	resource.initialState	= initialState;
+	resource.finalState		= finalState;
+	m_resources.push_back(resource);
+	return (RenderGraphResource)m_resources.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+RenderGraphResource VulkanRenderGraph::ImportBuffer(const std::string& name, const VulkanResourceState& initialState, const VulkanResourceState& finalState)
+{
+	Resource resource;
+	resource.name				= name;
+	resource.isImage			= false;
+	resource.isImported			= true;
+	resource.initialState		= initialState;
+	resource.finalState			= finalState;
+	resource.initialState.layout	= VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.finalState.layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+	m_resources.push_back(resource);
+	return (RenderGraphResource)m_resources.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::SetImportedImage(RenderGraphResource resource, const VkImage& image, const VkImageView& view)
+{
+	m_resources[resource].image	= image;
+	m_resources[resource].view	= view;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::SetImportedBuffer(RenderGraphResource resource, const VkBuffer& buffer)
+{
+	m_resources[resource].buffer = buffer;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRenderGraph::PassBuilder VulkanRenderGraph::AddPass(const std::string& name, const ExecuteFunction& execute)
+{
+	if (m_isCompiled)
+	{
+		throw std::runtime_error("render graph: passes cannot be added once the graph is compiled!");
+	}
+
+	Pass pass;
+	pass.name		= name;
+	pass.execute	= execute;
+	m_passes.push_back(pass);
+	return PassBuilder(*this, (uint32_t)m_passes.size() - 1);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::Compile()
+{
+	DestroyTransients();
+
+	CullPasses();
+	ComputeLifetimes();
+	CreateTransients();
+	BuildBarriers();
+
+	m_isCompiled = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::CullPasses()
+{
+	// Walk backwards keeping track of which resources still have a reader waiting for their current
+	// contents. Imported ones are always waited for, whoever owns them reads them after the graph
+	std::vector<bool> isNeeded(m_resources.size(), false);
+	for (uint32_t i = 0; i < m_resources.size(); ++i)
+	{
+		isNeeded[i] = m_resources[i].isImported;
+	}
+
+	for (uint32_t passIndex = (uint32_t)m_passes.size(); passIndex-- > 0;)
+	{
+		Pass& pass		= m_passes[passIndex];
+		pass.isCulled	= !pass.hasSideEffects;
+
+		for (const ResourceAccess& access : pass.accesses)
+		{
+			if (access.isWrite && isNeeded[access.resource])
+			{
+				pass.isCulled = false;
+			}
+		}
+
+		if (pass.isCulled)
+		{
+			continue;
+		}
+
+		// A plain write replaces the contents, whatever produced them before is no longer needed for it
+		for (const ResourceAccess& access : pass.accesses)
+		{
+			if (access.isWrite && !access.isRead)
+			{
+				isNeeded[access.resource] = false;
+			}
+		}
+		for (const ResourceAccess& access : pass.accesses)
+		{
+			if (access.isRead)
+			{
+				isNeeded[access.resource] = true;
+			}
+		}
+	}
+
+	m_schedule.clear();
+	for (uint32_t passIndex = 0; passIndex < m_passes.size(); ++passIndex)
+	{
+		if (!m_passes[passIndex].isCulled)
+		{
+			m_schedule.push_back(passIndex);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::ComputeLifetimes()
+{
+	for (Resource& resource : m_resources)
+	{
+		resource.firstPass		= ~0u;
+		resource.lastPass		= 0;
+		resource.memoryGroup	= ~0u;
+	}
+
+	for (uint32_t position = 0; position < m_schedule.size(); ++position)
+	{
+		const Pass& pass = m_passes[m_schedule[position]];
+		for (const ResourceAccess& access : pass.accesses)
+		{
+			Resource& resource = m_resources[access.resource];
+			if (resource.firstPass == ~0u)
+			{
+				// Transient contents start out undefined, reading them first is always a bug
+				if (!resource.isImported && !access.isWrite)
+				{
+					throw std::runtime_error("render graph: pass '" + pass.name + "' reads '" + resource.name + "' before anything writes it!");
+				}
+				resource.firstPass = position;
+			}
+			resource.lastPass = position;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::CreateTransients()
+{
+	std::vector<RenderGraphResource> transients;
+	std::vector<VkMemoryRequirements> requirements(m_resources.size());
+
+	for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+	{
+		Resource& resource = m_resources[i];
+		if (resource.isImported || resource.firstPass == ~0u)
+		{
+			continue;
+		}
+
+		VkImageCreateInfo imageInfo	= {};
+		imageInfo.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType			= VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width		= resource.desc.extent.width;
+		imageInfo.extent.height		= resource.desc.extent.height;
+		imageInfo.extent.depth		= 1;
+		imageInfo.mipLevels			= 1;
+		imageInfo.arrayLayers		= 1;
+		imageInfo.format			= resource.desc.format;
+		imageInfo.tiling			= VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage				= resource.desc.usage;
+		imageInfo.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples			= VK_SAMPLE_COUNT_1_BIT;
+
+		if (vkCreateImage(m_device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create render graph image!");
+		}
+		vkGetImageMemoryRequirements(m_device, resource.image, &requirements[i]);
+		transients.push_back(i);
+	}
+
+	// Largest first, then first fit into any group whose members are all dead or not yet born
+	std::sort(transients.begin(), transients.end(), [&requirements](RenderGraphResource a, RenderGraphResource b)
+	{
+		return requirements[a].size > requirements[b].size;
+	});
+
+	for (RenderGraphResource index : transients)
+	{
+		Resource& resource					= m_resources[index];
+		const VkMemoryRequirements& request	= requirements[index];
+
+		for (uint32_t groupIndex = 0; groupIndex < m_memoryGroups.size() && resource.memoryGroup == ~0u; ++groupIndex)
+		{
+			MemoryGroup& group = m_memoryGroups[groupIndex];
+			if ((group.requirements.memoryTypeBits & request.memoryTypeBits) == 0)
+			{
+				continue;
+			}
+
+			bool overlaps = false;
+			for (RenderGraphResource member : group.members)
+			{
+				overlaps |= resource.firstPass <= m_resources[member].lastPass && m_resources[member].firstPass <= resource.lastPass;
+			}
+
+			if (!overlaps)
+			{
+				group.requirements.size				= std::max(group.requirements.size, request.size);
+				group.requirements.alignment		= std::max(group.requirements.alignment, request.alignment);
+				group.requirements.memoryTypeBits	&= request.memoryTypeBits;
+				group.members.push_back(index);
+				resource.memoryGroup = groupIndex;
+			}
+		}
+
+		if (resource.memoryGroup == ~0u)
+		{
+			MemoryGroup group;
+			group.requirements	= request;
+			group.members.push_back(index);
+			resource.memoryGroup = (uint32_t)m_memoryGroups.size();
+			m_memoryGroups.push_back(group);
+		}
+	}
+
+	for (MemoryGroup& group : m_memoryGroups)
+	{
+		group.memory = m_allocator->Allocate(group.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
+
+		std::sort(group.members.begin(), group.members.end(), [this](RenderGraphResource a, RenderGraphResource b)
+		{
+			return m_resources[a].firstPass < m_resources[b].firstPass;
+		});
+
+		for (RenderGraphResource member : group.members)
+		{
+			Resource& resource = m_resources[member];
+			vkBindImageMemory(m_device, resource.image, group.memory.memory, group.memory.offset);
+
+			VkImageViewCreateInfo viewInfo				= {};
+			viewInfo.sType								= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image								= resource.image;
+			viewInfo.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format								= resource.desc.format;
+			viewInfo.subresourceRange.aspectMask		= resource.desc.aspect;
+			viewInfo.subresourceRange.baseMipLevel		= 0;
+			viewInfo.subresourceRange.levelCount		= 1;
+			viewInfo.subresourceRange.baseArrayLayer	= 0;
+			viewInfo.subresourceRange.layerCount		= 1;
+
+			if (vkCreateImageView(m_device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create render graph image view!");
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::DestroyTransients()
+{
+	for (Resource& resource : m_resources)
+	{
+		if (resource.isImported)
+		{
+			continue;
+		}
+		if (resource.view != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(m_device, resource.view, nullptr);
+		}
+		if (resource.image != VK_NULL_HANDLE)
+		{
+			vkDestroyImage(m_device, resource.image, nullptr);
+		}
+		resource.view	= VK_NULL_HANDLE;
+		resource.image	= VK_NULL_HANDLE;
+	}
+
+	for (MemoryGroup& group : m_memoryGroups)
+	{
+		m_allocator->Free(group.memory);
+	}
+	m_memoryGroups.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanRenderGraph::TransitionTo(TrackedState& tracked, const VulkanResourceState& target, bool isWrite, bool isRead, Barrier& barrier, BarrierBatch& batch)
+{
+	UNUSED(isRead);
+	bool layoutChange = target.layout != tracked.layout;
+
+	barrier.dstAccess	= target.accessMask;
+	barrier.oldLayout	= tracked.layout;
+	barrier.newLayout	= target.layout;
+
+	if (!layoutChange && !isWrite)
+	{
+		// Read after read needs nothing, read after write only once per stage and access it becomes visible to
+		bool alreadyVisible = (tracked.readStages & target.stageMask) == target.stageMask && (tracked.readAccess & target.accessMask) == target.accessMask;
+		if (alreadyVisible || tracked.writeStages == 0)
+		{
+			tracked.readStages	|= target.stageMask;
+			tracked.readAccess	|= target.accessMask;
+			return false;
+		}
+
+		barrier.srcAccess	= tracked.writeAccess;
+		batch.srcStages		|= tracked.writeStages;
+		batch.dstStages		|= target.stageMask;
+
+		tracked.readStages	|= target.stageMask;
+		tracked.readAccess	|= target.accessMask;
+		return true;
+	}
+
+	// Writes and layout transitions wait for every earlier reader and writer. Readers only need an
+	// execution dependency, there is nothing of theirs to make available
+	VkPipelineStageFlags srcStages = tracked.writeStages | tracked.readStages;
+	barrier.srcAccess = tracked.writeAccess;
+	bool needsBarrier = layoutChange || srcStages != 0;
+
+	if (needsBarrier)
+	{
+		batch.srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		batch.dstStages |= target.stageMask != 0 ? target.stageMask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	}
+
+	if (isWrite)
+	{
+		tracked.writeStages	= target.stageMask;
+		tracked.writeAccess	= target.accessMask & WRITE_ACCESS_MASK;
+		tracked.readStages	= 0;
+		tracked.readAccess	= 0;
+	}
+	else
+	{
+		// The transition is the last write, later readers chain off the stage that waited for it
+		tracked.writeStages	= target.stageMask;
+		tracked.writeAccess	= 0;
+		tracked.readStages	= target.stageMask;
+		tracked.readAccess	= target.accessMask;
+	}
+	tracked.layout = target.layout;
+	return needsBarrier;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::BuildBarriers()
+{
+	auto initialTracked = [](const VulkanResourceState& state)
+	{
+		TrackedState tracked;
+		tracked.writeStages	= state.stageMask;
+		tracked.writeAccess	= state.accessMask & WRITE_ACCESS_MASK;
+		tracked.layout		= state.layout;
+		return tracked;
+	};
+
+	auto simulate = [this](std::vector<TrackedState>& tracked, bool record)
+	{
+		for (uint32_t position = 0; position < m_schedule.size(); ++position)
+		{
+			BarrierBatch batch;
+			for (const ResourceAccess& access : m_passes[m_schedule[position]].accesses)
+			{
+				Barrier barrier		= {};
+				barrier.resource	= access.resource;
+				if (TransitionTo(tracked[access.resource], access.state, access.isWrite, access.isRead, barrier, batch))
+				{
+					batch.barriers.push_back(barrier);
+				}
+			}
+			if (record)
+			{
+				m_passBarriers.push_back(batch);
+			}
+		}
+	};
+
+	// First run finds where each transient ends up. A transient then starts from the end state of
+	// whoever used its memory before it, which for the first member of a group is the last member of
+	// the previous frame, so aliasing and frame-to-frame reuse are covered by the same barrier
+	std::vector<TrackedState> tracked(m_resources.size());
+	for (uint32_t i = 0; i < m_resources.size(); ++i)
+	{
+		tracked[i] = initialTracked(m_resources[i].initialState);
+	}
+	simulate(tracked, false);
+	std::vector<TrackedState> endStates = tracked;
+
+	for (uint32_t i = 0; i < m_resources.size(); ++i)
+	{
+		const Resource& resource = m_resources[i];
+		if (!resource.isImported && resource.memoryGroup != ~0u)
+		{
+			const std::vector<RenderGraphResource>& members = m_memoryGroups[resource.memoryGroup].members;
+			uint32_t memberIndex	= (uint32_t)(std::find(members.begin(), members.end(), i) - members.begin());
+			const TrackedState& end	= endStates[members[(memberIndex + members.size() - 1) % members.size()]];
+
+			tracked[i]				= TrackedState();
+			tracked[i].writeStages	= end.writeStages | end.readStages;
+			tracked[i].writeAccess	= end.writeAccess;
+			tracked[i].layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		else
+		{
+			tracked[i] = initialTracked(resource.initialState);
+		}
+	}
+
+	m_passBarriers.clear();
+	simulate(tracked, true);
+
+	m_finalBarriers = BarrierBatch();
+	for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+	{
+		const Resource& resource = m_resources[i];
+		bool hasFinalState = resource.isImage ? resource.finalState.layout != VK_IMAGE_LAYOUT_UNDEFINED : resource.finalState.stageMask != 0;
+		if (!resource.isImported || !hasFinalState || resource.firstPass == ~0u)
+		{
+			continue;
+		}
+
+		Barrier barrier		= {};
+		barrier.resource	= i;
+		if (TransitionTo(tracked[i], resource.finalState, false, true, barrier, m_finalBarriers))
+		{
+			m_finalBarriers.barriers.push_back(barrier);
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::Execute(const VkCommandBuffer& commandBuffer, VulkanGpuProfiler* profiler) const
+{
+	if (!m_isCompiled)
+	{
+		throw std::runtime_error("render graph: executed before it was compiled!");
+	}
+
+	for (uint32_t position = 0; position < m_schedule.size(); ++position)
+	{
+		const Pass& pass = m_passes[m_schedule[position]];
+		RecordBatch(commandBuffer, m_passBarriers[position]);
+
+		if (profiler)
+		{
+			profiler->BeginScope(commandBuffer, pass.name.c_str());
+		}
+		pass.execute(commandBuffer, *this);
+		if (profiler)
+		{
+			profiler->EndScope(commandBuffer);
+		}
+	}
+
+	RecordBatch(commandBuffer, m_finalBarriers);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::RecordBatch(const VkCommandBuffer& commandBuffer, const BarrierBatch& batch) const
+{
+	if (batch.barriers.empty())
+	{
+		return;
+	}
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+
+	for (const Barrier& barrier : batch.barriers)
+	{
+		const Resource& resource = m_resources[barrier.resource];
+		if (resource.isImage)
+		{
+			VkImageMemoryBarrier imageBarrier				= {};
+			imageBarrier.sType								= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask						= barrier.srcAccess;
+			imageBarrier.dstAccessMask						= barrier.dstAccess;
+			imageBarrier.oldLayout							= barrier.oldLayout;
+			imageBarrier.newLayout							= barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image								= resource.image;
+			imageBarrier.subresourceRange.aspectMask		= resource.desc.aspect;
+			imageBarrier.subresourceRange.baseMipLevel		= 0;
+			imageBarrier.subresourceRange.levelCount		= VK_REMAINING_MIP_LEVELS;
+			imageBarrier.subresourceRange.baseArrayLayer	= 0;
+			imageBarrier.subresourceRange.layerCount		= VK_REMAINING_ARRAY_LAYERS;
+			imageBarriers.push_back(imageBarrier);
+		}
+		else
+		{
+			VkBufferMemoryBarrier bufferBarrier	= {};
+			bufferBarrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask			= barrier.srcAccess;
+			bufferBarrier.dstAccessMask			= barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer				= resource.buffer;
+			bufferBarrier.offset				= 0;
+			bufferBarrier.size					= VK_WHOLE_SIZE;
+			bufferBarriers.push_back(bufferBarrier);
+		}
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, batch.srcStages, batch.dstStages, 0, 0, nullptr, (uint32_t)bufferBarriers.size(), bufferBarriers.data(), (uint32_t)imageBarriers.size(), imageBarriers.data());
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanRenderGraph::IsPassCulled(const std::string& name) const
+{
+	for (const Pass& pass : m_passes)
+	{
+		if (pass.name == name)
+		{
+			return pass.isCulled;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderGraph::PrintStats() const
+{
+	uint32_t barrierCount	= (uint32_t)m_finalBarriers.barriers.size();
+	uint32_t batchCount		= m_finalBarriers.barriers.empty() ? 0 : 1;
+	for (const BarrierBatch& batch : m_passBarriers)
+	{
+		barrierCount	+= (uint32_t)batch.barriers.size();
+		batchCount		+= batch.barriers.empty() ? 0 : 1;
+	}
+
+	uint32_t transientCount		= 0;
+	VkDeviceSize aliasedBytes	= 0;
+	VkDeviceSize unaliasedBytes	= 0;
+	for (const MemoryGroup& group : m_memoryGroups)
+	{
+		aliasedBytes += group.requirements.size;
+		for (RenderGraphResource member : group.members)
+		{
+			VkMemoryRequirements requirements;
+			vkGetImageMemoryRequirements(m_device, m_resources[member].image, &requirements);
+			unaliasedBytes += requirements.size;
+			++transientCount;
+		}
+	}
+
+	std::cout << "render graph: " << m_schedule.size() << "/" << m_passes.size() << " passes (" << m_passes.size() - m_schedule.size() << " culled), "
+		<< barrierCount << " barriers in " << batchCount << " batches, " << transientCount << " transients in " << m_memoryGroups.size() << " memory groups, "
+		<< aliasedBytes / 1024 << " KiB (" << unaliasedBytes / 1024 << " KiB without aliasing)" << std::endl;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#ifndef _VULKAN_RENDER_GRAPH_H_
+#define _VULKAN_RENDER_GRAPH_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanMemoryAllocator.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+class VulkanGpuProfiler;
+
+//---------------------------------------------------------------------------------------------------
+typedef uint32_t RenderGraphResource;
+static const RenderGraphResource INVALID_RENDER_GRAPH_RESOURCE = ~0u;
+
+//---------------------------------------------------------------------------------------------------
+// How a pass touches a resource. Each one maps to the exact stages, accesses and layout it needs, which
+// is all the graph requires to work out the barriers between passes.
+enum RenderGraphUsage
+{
+	RENDER_GRAPH_COLOR_ATTACHMENT,
+	RENDER_GRAPH_DEPTH_ATTACHMENT,
+	RENDER_GRAPH_DEPTH_READ_ONLY,
+	RENDER_GRAPH_SAMPLED_FRAGMENT,
+	RENDER_GRAPH_SAMPLED_COMPUTE,
+	RENDER_GRAPH_STORAGE_READ_COMPUTE,
+	RENDER_GRAPH_STORAGE_WRITE_COMPUTE,
+	RENDER_GRAPH_TRANSFER_SRC,
+	RENDER_GRAPH_TRANSFER_DST,
+	RENDER_GRAPH_VERTEX_BUFFER,
+	RENDER_GRAPH_INDEX_BUFFER,
+	RENDER_GRAPH_INDIRECT_BUFFER,
+	RENDER_GRAPH_UNIFORM_BUFFER,
+	RENDER_GRAPH_HOST_READ,
+};
+
+//---------------------------------------------------------------------------------------------------
+struct VulkanResourceState
+{
+	VkPipelineStageFlags	stageMask	= 0;
+	VkAccessFlags			accessMask	= 0;
+	VkImageLayout			layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// The state a usage needs, and whether it writes
+	static VulkanResourceState	FromUsage(RenderGraphUsage usage, bool* isWrite = nullptr);
+
+	// The canonical state of an image sitting in a layout, for one-off transitions outside a graph
+	static VulkanResourceState	FromLayout(VkImageLayout layout);
+};
+
+//---------------------------------------------------------------------------------------------------
+struct RenderGraphImageDesc
+{
+	VkFormat				format		= VK_FORMAT_UNDEFINED;
+	VkExtent2D				extent		= {};
+	VkImageUsageFlags		usage		= 0;
+	VkImageAspectFlags		aspect		= VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+//---------------------------------------------------------------------------------------------------
+// A frame graph. Passes declare what they read and write, Compile then
+//  - culls every pass whose output nobody consumes (imported resources and side effects count as consumed),
+//  - derives the barriers between passes from the declared usages, batched into one call per pass,
+//  - creates the transient images and aliases their memory wherever their lifetimes do not overlap.
+// Execute only replays that schedule, so the graph is built once and recompiled only when it changes
+// shape, e.g. on a resize. Imported resources may be swapped every frame with SetImportedImage/Buffer.
+//
+// Render passes executed inside the graph should use the attachment layout as both their initial and
+// final layout and no external subpass dependencies, the graph has already done those transitions.
+class VulkanRenderGraph
+{
+public:
+	typedef std::function<void(const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)> ExecuteFunction;
+
+	class PassBuilder
+	{
+	public:
+		PassBuilder(VulkanRenderGraph& graph, uint32_t passIndex) : m_graph(graph), m_passIndex(passIndex) {}
+
+		PassBuilder&		Read(RenderGraphResource resource, RenderGraphUsage usage);
+		PassBuilder&		Write(RenderGraphResource resource, RenderGraphUsage usage);
+
+		// Never culled, for passes whose effect is outside the graph (queries, host writes, ...)
+		PassBuilder&		SetSideEffects();
+
+	private:
+		VulkanRenderGraph&	m_graph;
+		uint32_t			m_passIndex;
+	};
+
+public:
+	VulkanRenderGraph();
+	~VulkanRenderGraph();
+
+	void					Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator);
+	void					Uninitialize();
+
+	// Drops every pass and resource and frees the transient images, ready to be built again
+	void					Reset();
+
+	RenderGraphResource		CreateImage(const std::string& name, const RenderGraphImageDesc& desc);
+
+	// The initial state is assumed at the start of every Execute. A final layout of UNDEFINED leaves the
+	// resource in whatever state its last pass put it in
+	RenderGraphResource		ImportImage(const std::string& name, VkImageAspectFlags aspect, const VulkanResourceState& initialState, const VulkanResourceState& finalState);
+	RenderGraphResource		ImportBuffer(const std::string& name, const VulkanResourceState& initialState, const VulkanResourceState& finalState);
+	void					SetImportedImage(RenderGraphResource resource, const VkImage& image, const VkImageView& view);
+	void					SetImportedBuffer(RenderGraphResource resource, const VkBuffer& buffer);
+
+	PassBuilder				AddPass(const std::string& name, const ExecuteFunction& execute);
+
+	void					Compile();
+	void					Execute(const VkCommandBuffer& commandBuffer, VulkanGpuProfiler* profiler = nullptr) const;
+
+	VkImage					GetImage(RenderGraphResource resource) const		{ return m_resources[resource].image; }
+	VkImageView				GetImageView(RenderGraphResource resource) const	{ return m_resources[resource].view; }
+	VkBuffer				GetBuffer(RenderGraphResource resource) const		{ return m_resources[resource].buffer; }
+	bool					IsPassCulled(const std::string& name) const;
+	void					PrintStats() const;
+
+private:
+	struct ResourceAccess
+	{
+		RenderGraphResource		resource	= INVALID_RENDER_GRAPH_RESOURCE;
+		VulkanResourceState		state;
+		bool					isRead		= false;
+		bool					isWrite		= false;
+	};
+
+	struct Pass
+	{
+		std::string					name;
+		ExecuteFunction				execute;
+		std::vector<ResourceAccess>	accesses;
+		bool						hasSideEffects	= false;
+		bool						isCulled		= false;
+	};
+
+	struct Resource
+	{
+		std::string				name;
+		bool					isImage			= true;
+		bool					isImported		= false;
+		RenderGraphImageDesc	desc;
+		VulkanResourceState		initialState;
+		VulkanResourceState		finalState;
+		VkImage					image			= VK_NULL_HANDLE;
+		VkImageView				view			= VK_NULL_HANDLE;
+		VkBuffer				buffer			= VK_NULL_HANDLE;
+		uint32_t				firstPass		= ~0u;	// Lifetime over the surviving passes
+		uint32_t				lastPass		= 0;
+		uint32_t				memoryGroup		= ~0u;
+	};
+
+	// The state tracked while walking the passes. Readers are accumulated so a later write or
+	// transition waits for all of them, and a read only needs a barrier the first time its access
+	// becomes visible
+	struct TrackedState
+	{
+		VkPipelineStageFlags	writeStages		= 0;
+		VkAccessFlags			writeAccess		= 0;
+		VkPipelineStageFlags	readStages		= 0;
+		VkAccessFlags			readAccess		= 0;
+		VkImageLayout			layout			= VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct Barrier
+	{
+		RenderGraphResource		resource;
+		VkAccessFlags			srcAccess;
+		VkAccessFlags			dstAccess;
+		VkImageLayout			oldLayout;
+		VkImageLayout			newLayout;
+	};
+
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags	srcStages		= 0;
+		VkPipelineStageFlags	dstStages		= 0;
+		std::vector<Barrier>	barriers;
+	};
+
+	struct MemoryGroup
+	{
+		VkMemoryRequirements			requirements	= {};
+		VulkanAllocation				memory;
+		std::vector<RenderGraphResource>	members;	// Sorted by first use
+	};
+
+private:
+	void					CullPasses();
+	void					ComputeLifetimes();
+	void					CreateTransients();
+	void					DestroyTransients();
+	void					BuildBarriers();
+	static bool				TransitionTo(TrackedState& tracked, const VulkanResourceState& target, bool isWrite, bool isRead, Barrier& barrier, BarrierBatch& batch);
+	void					RecordBatch(const VkCommandBuffer& commandBuffer, const BarrierBatch& batch) const;
+
+private:
+	VkDevice					m_device;
+	VulkanMemoryAllocator*		m_allocator;
+	std::vector<Pass>			m_passes;
+	std::vector<Resource>		m_resources;
+	std::vector<MemoryGroup>	m_memoryGroups;
+	std::vector<uint32_t>		m_schedule;			// Surviving passes in submission order
+	std::vector<BarrierBatch>	m_passBarriers;		// Parallel to m_schedule
+	BarrierBatch				m_finalBarriers;
+	bool						m_isCompiled;
+};
+#endif // !_VULKAN_RENDER_GRAPH_H_
@@ -1,5 +1,7 @@
 #include "VulkanRenderer.hpp"
 #include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include "TextureContainer.hpp"
 #include "glfw3.h"
 #include <iostream>
 #include <set>
@@ -14,6 +16,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "ExtLibs/stb/stb_image.h"
 #include <chrono>
+#include <cstddef>
+#include <cstring>
 
 
 //---------------------------------------------------------------------------------------------------
@@ -24,11 +28,20 @@ struct UniformBufferObject
 	glm::mat4 proj;
 };
 
+//---------------------------------------------------------------------------------------------------
+// Contents of the material set, in the layout its update template reads
+struct MaterialDescriptorData
+{
+	VkDescriptorBufferInfo	uniforms;
+	VkDescriptorImageInfo	texture;
+};
+
 //---------------------------------------------------------------------------------------------------
 const int WIDTH = 800;
 const int HEIGHT = 600;
 const std::string MODEL_PATH	= "EngineCode/Renderer/Models/Chalet.obj";
 const std::string TEXTURE_PATH	= "EngineCode/Renderer/Textures/Chalet.jpg";
+const std::string PIPELINE_CACHE_PATH	= "PipelineCache.bin";
 
 //---------------------------------------------------------------------------------------------------
 VulkanRenderer::VulkanRenderer(BaseApp* appHandle)
@@ -36,13 +49,57 @@ VulkanRenderer::VulkanRenderer(BaseApp* appHandle)
 	, m_instance(VK_NULL_HANDLE)
 	, m_enableValidationLayers(true)
 	, m_validationCallback(VK_NULL_HANDLE)
-/*	, m_surface(VK_NULL_HANDLE)*/
+	, m_surface(VK_NULL_HANDLE)
 	, m_window(nullptr)
+	, m_isHeadless(false)
+	, m_headlessExtent({ WIDTH, HEIGHT })
+	, m_frameNumber(0)
+	, m_transferQueue(VK_NULL_HANDLE)
 	, m_swapChain(VK_NULL_HANDLE)
+	, m_lateRenderPass(VK_NULL_HANDLE)
+	, m_framesInFlight(DEFAULT_FRAMES_IN_FLIGHT)
+	, m_currentFrame(0)
+	, m_isDrawListDirty(false)
+	, m_instanceBuffer(VK_NULL_HANDLE)
+	, m_isBindlessRequested(true)
+	, m_isBindless(false)
+	, m_textureBindlessIndex(0)
+	, m_isGpuCullingRequested(true)
+	, m_isGpuCulling(false)
+	, m_hasDrawIndirectCount(false)
+	, m_maxDrawIndirectCount(1)
+	, m_isOcclusionCullingRequested(true)
+	, m_isOcclusionCulling(false)
+	, m_backBufferResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_depthResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_readbackResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_drawCommandsResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_drawCountResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_depthPyramidResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_visibilityResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_lateDrawCommandsResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_lateDrawCountResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_sceneColorResource(INVALID_RENDER_GRAPH_RESOURCE)
+	, m_recordingImageIndex(0)
+	, m_swapChainImageUsage(0)
+	, m_isDynamicResolutionRequested(false)
+	, m_isDynamicResolution(false)
+	, m_sceneFrameBuffer(VK_NULL_HANDLE)
+	, m_upscaleFilter(VK_FILTER_LINEAR)
+	, m_renderExtent({ WIDTH, HEIGHT })
+	, m_dynamicResolutionFrame(~0ull)
+	, m_hasUpdateTemplates(false)
+	, m_materialTemplate(0)
+	, m_hasTextureCompressionBC(false)
+	, m_textureFormat(VK_FORMAT_R8G8B8A8_UNORM)
+	, m_textureMipLevels(1)
+	, m_maxSamplerAnisotropy(0.0f)
+	, m_isVertexCompression(true)
+	, m_isMeshLods(true)
 {
 	m_physicalDevices.reserve(5);
 	m_logicalDevices.reserve(4);
-	m_depthImageView = nullptr;
+	memset(m_vertexStreamOffsets, 0, sizeof(m_vertexStreamOffsets));
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -69,49 +126,96 @@ VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer::ValidationLayerCallback(VkDebugRe
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::Initialize(BaseWindow* window)
 {
+	PROFILE_FUNCTION();
 	m_window = window;
+	if (!m_window)
+	{
+		m_isHeadless = true;
+	}
+
 	CheckValidationLayers();
 	CreateInstance();
 	CreateSurface();
 	SetupValidationLayerCallback();
 	GatherPhysicalDevices();
 	CreateLogicalDevice(m_physicalDevices[0]);
-	CreateSwapChain();
+	m_memoryAllocator.Initialize(m_logicalDevices[0], m_physicalDevices[0]);
+	m_pipelineCache.Initialize(m_logicalDevices[0], m_physicalDevices[0], PIPELINE_CACHE_PATH);
+	if (m_isHeadless)
+	{
+		CreateOffscreenImages();
+	}
+	else
+	{
+		CreateSwapChain();
+	}
 	CreateImageViews();
 	CreateRenderPass();
 	CreateDescriptorSetLayout(m_logicalDevices[0]);
+	if (m_isBindless)
+	{
+		m_bindlessTable.Initialize(m_logicalDevices[0], m_bindlessSupport, m_framesInFlight);
+	}
 	CreateGraphicsPipeline();
-	CreateCommandPool();
-	CreateDepthResources(m_logicalDevices[0]);
+	CreateUploadContext();
+	CreateFrameResources();
+	m_renderGraph.Initialize(m_logicalDevices[0], m_memoryAllocator);
+	BuildRenderGraph();
 	CreateFrameBuffers();
+	CreateDescriptorAllocator(m_logicalDevices[0]);
+	CreateMipGenerator(m_logicalDevices[0]);
 	CreateTextureResources(m_logicalDevices[0]);
+	BuildMeshes();
 	CreateVertexBuffer();
 	CreateIndexBuffer();
 	CreateUniformBuffer();
-	CreateDescriptorPool(m_logicalDevices[0]);
 	CreateDescriptorSet(m_logicalDevices[0]);
-	CreateCommandBuffers();
-	CreateSemaphores();
+	CreateGpuCuller(m_logicalDevices[0]);
+
+	// Until the application places instances of its own, the model is drawn once where it always was
+	if (m_instances.empty() && !m_meshes.empty())
+	{
+		AddInstance(0, GetDefaultMaterial(), glm::mat4());
+	}
+	BuildDrawList();
+
+	// Texture, vertex, index and instance uploads above were only recorded. Submit them as one batch and wait once
+	m_uploadContext.Wait(m_uploadContext.Submit());
+
+	m_memoryAllocator.PrintStats();
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::Uninitialize()
 {
-	DestroySemaphores();
-	DestroyCommandBuffers();
-	DestroyDescriptorPool(m_logicalDevices[0]);
+	vkDeviceWaitIdle(m_logicalDevices[0]);
+	DestroyGpuCuller();
+	DestroyMipGenerator();
+	DestroyDescriptorAllocator();
 	DestroyUniformBuffer();
+	DestroyInstanceBuffer();
 	DestroyIndexBuffer();
 	DestroyVertexBuffer();
 	DestroyTextureResources(m_logicalDevices[0]);
 	DestroyFrameBuffers();
-	DestroyDepthResources(m_logicalDevices[0]);
-	DestroyCommandPool();
+	m_renderGraph.Uninitialize();
+	DestroyFrameResources();
+	DestroyUploadContext();
 	DestroyGraphicsPipeline();
+	m_bindlessTable.Uninitialize();
 	DestroyDescriptorSetLayout(m_logicalDevices[0]);
 	DestroyRenderPass();
 	DestroyImageViews();
-	DestroySwapChain();
+	if (m_isHeadless)
+	{
+		DestroyOffscreenImages();
+	}
+	else
+	{
+		DestroySwapChain();
+	}
+	m_pipelineCache.Uninitialize();
+	m_memoryAllocator.Uninitialize();
 	DestroyLogicalDevices();
 	DestroyPhysicalDevices();
 	DestroyDebugReportCallbackEXT(m_instance, m_validationCallback, nullptr);
@@ -122,48 +226,101 @@ void VulkanRenderer::Uninitialize()
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::RecreateSwapChain()
 {
+	PROFILE_FUNCTION();
+	// A minimized window reports a zero extent, which is not a valid swap chain size. Keep the old one
+	// until the window comes back, acquire will keep reporting out of date until then
+	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_physicalDevices[0]);
+	if (swapChainSupport.capabilities.currentExtent.width == 0 || swapChainSupport.capabilities.currentExtent.height == 0)
+	{
+		return;
+	}
+
 	vkDeviceWaitIdle(m_logicalDevices[0]);
-	DestroyCommandBuffers();
-	DestroyDescriptorPool(m_logicalDevices[0]);
-	DestroyUniformBuffer();
-	DestroyIndexBuffer();
-	DestroyVertexBuffer();
-	DestroyTextureResources(m_logicalDevices[0], true);
+
+	// Only objects sized to the window are rebuilt. Geometry, textures, descriptors and the render pass
+	// are independent of the extent and stay resident across a resize
+	VkFormat oldImageFormat = m_swapChainImageFormat;
 	DestroyFrameBuffers();
-	DestroyDepthResources(m_logicalDevices[0]);
-	DestroyGraphicsPipeline();
-	DestroyDescriptorSetLayout(m_logicalDevices[0]);
-	DestroyRenderPass();
+	m_renderGraph.Reset();
 	DestroyImageViews();
 
+	// Hands the old swap chain over through oldSwapchain and retires it once the new one exists
 	CreateSwapChain();
 	CreateImageViews();
-	CreateDepthResources(m_logicalDevices[0]);
-	CreateTextureResources(m_logicalDevices[0], true);
-	CreateRenderPass();
-	CreateDescriptorSetLayout(m_logicalDevices[0]);
-	CreateGraphicsPipeline();
-	CreateDepthResources(m_logicalDevices[0]);
+	BuildRenderGraph();
+	if (m_isOcclusionCulling)
+	{
+		ResizeDepthPyramid();
+	}
+
+	// Viewport and scissor are dynamic, so the pipeline only has to follow the render pass, which
+	// depends on the surface format alone and that almost never changes on a resize
+	if (m_swapChainImageFormat != oldImageFormat)
+	{
+		DestroyGraphicsPipeline();
+		DestroyRenderPass();
+		CreateRenderPass();
+		CreateGraphicsPipeline();
+	}
 	CreateFrameBuffers();
-	CreateVertexBuffer();
-	CreateIndexBuffer();
-	CreateUniformBuffer();
-	CreateDescriptorPool(m_logicalDevices[0]);
-	CreateDescriptorSet(m_logicalDevices[0]);
-	CreateCommandBuffers();
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::Update()
 {
+	PROFILE_FUNCTION();
+
+	// Block until the GPU has retired the last submission that used this frame's resources. Everything
+	// in m_frames[m_currentFrame] is safe to overwrite once this returns.
+	FrameData& frame = m_frames[m_currentFrame];
+	{
+		PROFILE_ZONE("WaitForFrameFence");
+		vkWaitForFences(m_logicalDevices[0], 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	if (frame.readbackPending)
+	{
+		DeliverReadback(frame);
+	}
+	if (m_isDrawListDirty)
+	{
+		RebuildDrawList();
+	}
+	m_frameRingBuffer.BeginFrame(m_currentFrame);
+	m_parallelRecorder.BeginFrame(m_currentFrame);
+	m_gpuProfiler.BeginFrame(m_currentFrame);
+	m_descriptorAllocator.BeginFrame(m_currentFrame);
+	m_mipGenerator.BeginFrame(m_currentFrame);
+	UpdateRenderExtent();
+	if (m_isGpuCulling)
+	{
+		m_gpuCuller.BeginFrame(m_currentFrame);
+	}
+	if (m_isBindless)
+	{
+		m_bindlessTable.BeginFrame();
+	}
+
 	UpdateUniformBuffer(m_logicalDevices[0]);
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::Draw()
 {
+	PROFILE_FUNCTION();
+	FrameData& frame = m_frames[m_currentFrame];
+
+	if (m_isHeadless)
+	{
+		DrawOffscreen(frame);
+		return;
+	}
+
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(m_logicalDevices[0], m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	VkResult result;
+	{
+		PROFILE_ZONE("AcquireNextImage");
+		result = vkAcquireNextImageKHR(m_logicalDevices[0], m_swapChain, std::numeric_limits<uint64_t>::max(), frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) 
 	{
@@ -174,22 +331,31 @@ void VulkanRenderer::Draw()
 	{
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
-	
+
+	// The swap chain can hand back an image that an older frame slot is still rendering to
+	if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE && m_imagesInFlight[imageIndex] != frame.inFlightFence)
+	{
+		vkWaitForFences(m_logicalDevices[0], 1, &m_imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	m_imagesInFlight[imageIndex] = frame.inFlightFence;
+
+	RecordCommandBuffer(frame, imageIndex);
 
 	VkSubmitInfo submitInfo				= {};
 	submitInfo.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	VkSemaphore waitSemaphores[]		= { m_imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[]		= { frame.imageAvailableSemaphore };
 	VkPipelineStageFlags waitStages[]	= { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.waitSemaphoreCount		= 1;
 	submitInfo.pWaitSemaphores			= waitSemaphores;
 	submitInfo.pWaitDstStageMask		= waitStages;
 	submitInfo.commandBufferCount		= 1;
-	submitInfo.pCommandBuffers			= &m_commandBuffers[imageIndex];
-	VkSemaphore signalSemaphores[]		= { m_renderFinishedSemaphore };
+	submitInfo.pCommandBuffers			= &frame.commandBuffer;
+	VkSemaphore signalSemaphores[]		= { frame.renderFinishedSemaphore };
 	submitInfo.signalSemaphoreCount		= 1;
 	submitInfo.pSignalSemaphores		= signalSemaphores;
 
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) 
+	vkResetFences(m_logicalDevices[0], 1, &frame.inFlightFence);
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) 
 	{
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
@@ -204,7 +370,11 @@ void VulkanRenderer::Draw()
 	presentInfo.pImageIndices		= &imageIndex;
 	presentInfo.pResults			= nullptr; // Optional
 
-	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	{
+		PROFILE_ZONE("QueuePresent");
+		result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	}
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) 
 	{
@@ -221,7 +391,149 @@ void VulkanRenderer::OnWindowResize(int width, int height)
 {
 	UNUSED(width);
 	UNUSED(height);
-	RecreateSwapChain();
+	if (!m_isHeadless)
+	{
+		RecreateSwapChain();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetFramesInFlight(uint32_t framesInFlight)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("frames in flight can only be changed before the renderer is initialized!");
+	}
+	m_framesInFlight = std::max(1u, framesInFlight);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetHeadless(uint32_t width, uint32_t height)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("headless mode can only be enabled before the renderer is initialized!");
+	}
+	m_isHeadless		= true;
+	m_headlessExtent	= { std::max(1u, width), std::max(1u, height) };
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetBindless(bool enabled)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("bindless mode can only be changed before the renderer is initialized!");
+	}
+	m_isBindlessRequested = enabled;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetGpuCulling(bool enabled)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("gpu culling can only be changed before the renderer is initialized!");
+	}
+	m_isGpuCullingRequested = enabled;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetOcclusionCulling(bool enabled)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("occlusion culling can only be changed before the renderer is initialized!");
+	}
+	m_isOcclusionCullingRequested = enabled;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetVertexCompression(bool enabled)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("vertex compression can only be changed before the renderer is initialized!");
+	}
+	m_isVertexCompression = enabled;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetMeshLods(bool enabled)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("mesh lods can only be changed before the renderer is initialized!");
+	}
+	m_isMeshLods = enabled;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetDynamicResolution(bool enabled, const DynamicResolutionSettings& settings)
+{
+	if (m_isInitialized || !m_frames.empty())
+	{
+		throw std::runtime_error("dynamic resolution can only be changed before the renderer is initialized!");
+	}
+	m_isDynamicResolutionRequested = enabled;
+	m_dynamicResolution.SetSettings(settings);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetDynamicResolutionSettings(const DynamicResolutionSettings& settings)
+{
+	// Frame times come back a full round of frames in flight late, anything sooner still saw the old scale
+	DynamicResolutionSettings adjustedSettings	= settings;
+	adjustedSettings.latencyFrames				= std::max(settings.latencyFrames, m_framesInFlight);
+	m_dynamicResolution.SetSettings(adjustedSettings);
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanRenderer::AddInstance(uint32_t mesh, uint32_t material, const glm::mat4& transform, const glm::vec4& parameters)
+{
+	if (mesh >= m_meshes.size())
+	{
+		throw std::runtime_error("instance of a mesh that does not exist!");
+	}
+
+	SceneInstance instance;
+	instance.mesh					= mesh;
+	instance.data.transform			= transform;
+	instance.data.parameters		= parameters;
+	instance.data.materialIndex		= material;
+	m_instances.push_back(instance);
+	m_isDrawListDirty				= true;
+	return (uint32_t)m_instances.size() - 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::ClearInstances()
+{
+	m_instances.clear();
+	m_isDrawListDirty = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SetFrameReadyCallback(const FrameReadyFunction& callback)
+{
+	m_frameReadyCallback = callback;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::FlushReadbacks()
+{
+	PROFILE_FUNCTION();
+
+	// Oldest first, which is the slot that would be reused next
+	for (uint32_t i = 0; i < m_frames.size(); ++i)
+	{
+		FrameData& frame = m_frames[(m_currentFrame + i) % m_frames.size()];
+		if (frame.readbackPending)
+		{
+			vkWaitForFences(m_logicalDevices[0], 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			DeliverReadback(frame);
+		}
+	}
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -243,18 +555,11 @@ void VulkanRenderer::CreateInstance()
 	VkInstanceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions;
-
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
 	auto vulkanExtensions = GetRequiredExtensions();
 	createInfo.enabledExtensionCount	= (uint32_t)vulkanExtensions.size();
 	createInfo.ppEnabledExtensionNames	= vulkanExtensions.data();
 
-	//createInfo.enabledExtensionCount = glfwExtensionCount;
-	//createInfo.ppEnabledExtensionNames = glfwExtensions;
-	
 	if (m_enableValidationLayers) 
 	{
 		createInfo.enabledLayerCount	= (uint32_t)m_validationLayers.size();
@@ -331,13 +636,17 @@ std::vector<const char*> VulkanRenderer::GetRequiredExtensions()
 {
 	std::vector<const char*> extensions;
 
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-	for (unsigned int i = 0; i < glfwExtensionCount; i++) 
+	// Surface extensions are only needed to present, headless never touches GLFW
+	if (!m_isHeadless)
 	{
-		extensions.push_back(glfwExtensions[i]);
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+		for (unsigned int i = 0; i < glfwExtensionCount; i++) 
+		{
+			extensions.push_back(glfwExtensions[i]);
+		}
 	}
 
 	if (m_enableValidationLayers) 
@@ -345,6 +654,23 @@ std::vector<const char*> VulkanRenderer::GetRequiredExtensions()
 		extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 	}
 
+	// Needed to query descriptor indexing support on a 1.0 instance
+	if (m_isBindlessRequested)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions)
+		{
+			if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+			{
+				extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			}
+		}
+	}
+
 	return extensions;
 }
 
@@ -402,12 +728,36 @@ void VulkanRenderer::GatherPhysicalDevices()
 	}
 	m_physicalDevices = std::vector < VkPhysicalDevice>(deviceCount);
 	vkEnumeratePhysicalDevices(m_instance, &deviceCount, m_physicalDevices.data());
+	// Everything after this uses m_physicalDevices[0], so the best suitable device is moved to the front.
+	// Hardware is preferred, but a software implementation is still better than nothing headless
+	auto deviceRank = [](VkPhysicalDeviceType type)
+	{
+		switch (type)
+		{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:		return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:	return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:		return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:				return 1;
+		default:										return 0;
+		}
+	};
+
 	int numValidDevices = 0;
-	for (const auto& device : m_physicalDevices) 
+	int bestDevice		= -1;
+	int bestRank		= -1;
+	for (uint32_t i = 0; i < deviceCount; ++i) 
 	{
-		if (IsPhysicalDeviceSuitable(device)) 
+		if (IsPhysicalDeviceSuitable(m_physicalDevices[i])) 
 		{
 			++numValidDevices;
+
+			VkPhysicalDeviceProperties deviceProperties;
+			vkGetPhysicalDeviceProperties(m_physicalDevices[i], &deviceProperties);
+			if (deviceRank(deviceProperties.deviceType) > bestRank)
+			{
+				bestRank	= deviceRank(deviceProperties.deviceType);
+				bestDevice	= (int)i;
+			}
 		}
 	}
 
@@ -415,6 +765,7 @@ void VulkanRenderer::GatherPhysicalDevices()
 	{
 		throw std::runtime_error("failed to find a suitable GPU!");
 	}
+	std::swap(m_physicalDevices[0], m_physicalDevices[bestDevice]);
 
 	std::cout << "Number of suitable devices found: " << numValidDevices << std::endl;
 }
@@ -429,6 +780,13 @@ bool VulkanRenderer::IsPhysicalDeviceSuitable(VkPhysicalDevice deviceToCheck)
 	vkGetPhysicalDeviceFeatures(deviceToCheck, &deviceFeatures);
 
 	QueueFamilyIndices indices	= FindQueueFamilies(deviceToCheck);
+
+	// Nothing is presented headless, so any device that can draw will do, software ones like lavapipe included
+	if (m_isHeadless)
+	{
+		return indices.IsComplete(false);
+	}
+
 	bool extensionsSupported	= CheckDeviceExtensioSupport(deviceToCheck);
 
 	bool swapChainAdequate = false;
@@ -463,21 +821,27 @@ QueueFamilyIndices VulkanRenderer::FindQueueFamilies(const VkPhysicalDevice& dev
 	for (const auto& queueFamily : queueFamilies)
 	{
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(deviceToFindQueues, i, m_surface, &presentSupport);
+		if (m_surface != VK_NULL_HANDLE)
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(deviceToFindQueues, i, m_surface, &presentSupport);
+		}
 
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		// The first matching families are kept, the scan only goes on to look for a transfer family
+		if (indices.graphicsFamily < 0 && queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 		{
 			indices.graphicsFamily = i;
 		}
 
-		if (queueFamily.queueCount > 0 && presentSupport)
+		if (indices.presentFamily < 0 && queueFamily.queueCount > 0 && presentSupport)
 		{
 			indices.presentFamily = i;
 		}
 
-		if (indices.IsComplete())
+		// A transfer-only family maps to the DMA engines, which can copy while the graphics queue renders
+		const VkQueueFlags transferOnlyMask = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+		if (indices.transferFamily < 0 && queueFamily.queueCount > 0 && (queueFamily.queueFlags & transferOnlyMask) == VK_QUEUE_TRANSFER_BIT)
 		{
-			break;
+			indices.transferFamily = i;
 		}
 
 		i++;
@@ -505,6 +869,25 @@ bool VulkanRenderer::CheckDeviceExtensioSupport(const VkPhysicalDevice& device)
 	return requiredExtensions.empty();
 }
 
+//---------------------------------------------------------------------------------------------------
+bool VulkanRenderer::IsDeviceExtensionAvailable(const VkPhysicalDevice& device, const char* extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateLogicalDevice(const VkPhysicalDevice& physicalDevice)
 {
@@ -512,7 +895,15 @@ void VulkanRenderer::CreateLogicalDevice(const VkPhysicalDevice& physicalDevice)
 
 	float queuePriority = 1.0f;
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily };
+	if (indices.presentFamily > -1)
+	{
+		uniqueQueueFamilies.insert(indices.presentFamily);
+	}
+	if (indices.transferFamily > -1)
+	{
+		uniqueQueueFamilies.insert(indices.transferFamily);
+	}
 
 	for (int queueFamily : uniqueQueueFamilies)
 	{
@@ -526,14 +917,72 @@ void VulkanRenderer::CreateLogicalDevice(const VkPhysicalDevice& physicalDevice)
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 
+	// Instanced draws start at their run of the instance buffer through firstInstance, which indirect
+	// draws only honour with drawIndirectFirstInstance. Multi-draw and draw count only make it cheaper
+	VkPhysicalDeviceFeatures supportedFeatures;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	m_isGpuCulling = m_isGpuCullingRequested && supportedFeatures.drawIndirectFirstInstance;
+	if (m_isGpuCulling)
+	{
+		deviceFeatures.drawIndirectFirstInstance	= VK_TRUE;
+		deviceFeatures.multiDrawIndirect			= supportedFeatures.multiDrawIndirect;
+		m_maxDrawIndirectCount						= supportedFeatures.multiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+	}
+
+	// Sampling mip chains at grazing angles. Without the feature the sampler stays trilinear
+	deviceFeatures.samplerAnisotropy	= supportedFeatures.samplerAnisotropy;
+	m_maxSamplerAnisotropy				= supportedFeatures.samplerAnisotropy ? std::min(16.0f, deviceProperties.limits.maxSamplerAnisotropy) : 0.0f;
+
+	// BC formats are only guaranteed to be sampleable with the feature enabled
+	deviceFeatures.textureCompressionBC	= supportedFeatures.textureCompressionBC;
+	m_hasTextureCompressionBC			= supportedFeatures.textureCompressionBC == VK_TRUE;
+
+	std::vector<const char*> deviceExtensions;
+	if (!m_isHeadless)
+	{
+		deviceExtensions = m_deviceExtensions;
+	}
+
+	m_bindlessSupport	= m_isBindlessRequested ? VulkanBindlessTable::QuerySupport(m_instance, physicalDevice) : VulkanBindlessSupport();
+	m_isBindless		= m_bindlessSupport.isSupported;
+	if (m_isBindless)
+	{
+		const std::vector<const char*>& bindlessExtensions = VulkanBindlessTable::GetDeviceExtensions();
+		deviceExtensions.insert(deviceExtensions.end(), bindlessExtensions.begin(), bindlessExtensions.end());
+	}
+	std::cout << "bindless descriptors " << (m_isBindless ? "enabled" : "not available, binding per material") << std::endl;
+
+	// Core in 1.1, an extension on the 1.0 device created here. Plain descriptor writes otherwise
+	m_hasUpdateTemplates = IsDeviceExtensionAvailable(physicalDevice, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	if (m_hasUpdateTemplates)
+	{
+		deviceExtensions.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	}
+
+	m_hasDrawIndirectCount = m_isGpuCulling && IsDeviceExtensionAvailable(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (m_hasDrawIndirectCount)
+	{
+		deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+	std::cout << "gpu culling " << (m_isGpuCulling ? (m_hasDrawIndirectCount ? "enabled with draw count" : "enabled without draw count") : "not available, recording every draw") << std::endl;
+
+	m_isOcclusionCulling = m_isGpuCulling && m_isOcclusionCullingRequested && CanCullOcclusion(physicalDevice);
+	if (m_isOcclusionCulling)
+	{
+		std::cout << "occlusion culling enabled" << std::endl;
+	}
+
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+	createInfo.pNext					= m_isBindless ? &m_bindlessSupport.features : nullptr;
 	createInfo.pQueueCreateInfos		= queueCreateInfos.data();
 	createInfo.queueCreateInfoCount		= (uint32_t)queueCreateInfos.size();
 	createInfo.pEnabledFeatures			= &deviceFeatures;
-	createInfo.enabledExtensionCount	= (uint32_t)m_deviceExtensions.size();
-	createInfo.ppEnabledExtensionNames	= m_deviceExtensions.data();
+	createInfo.enabledExtensionCount	= (uint32_t)deviceExtensions.size();
+	createInfo.ppEnabledExtensionNames	= deviceExtensions.empty() ? nullptr : deviceExtensions.data();
 
 	if (m_enableValidationLayers) 
 	{
@@ -557,7 +1006,14 @@ void VulkanRenderer::CreateLogicalDevice(const VkPhysicalDevice& physicalDevice)
 	}
 	
 	vkGetDeviceQueue(newLogicalDevice, indices.graphicsFamily, 0, &m_graphicsQueue);
-	vkGetDeviceQueue(newLogicalDevice, indices.presentFamily, 0, &m_presentQueue);
+	if (indices.presentFamily > -1)
+	{
+		vkGetDeviceQueue(newLogicalDevice, indices.presentFamily, 0, &m_presentQueue);
+	}
+	if (indices.transferFamily > -1)
+	{
+		vkGetDeviceQueue(newLogicalDevice, indices.transferFamily, 0, &m_transferQueue);
+	}
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -586,7 +1042,12 @@ void VulkanRenderer::CreateSurface()
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::DestroySurface()
 {
-	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	// Headless never creates one and never enables the surface extension
+	if (m_surface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+		m_surface = VK_NULL_HANDLE;
+	}
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -707,6 +1168,12 @@ void VulkanRenderer::CreateSwapChain()
 	createInfo.imageExtent = extent;
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// Dynamic resolution blits the scene into the swap chain image instead of rendering to it
+	if (m_isDynamicResolutionRequested && (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+	{
+		createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+	m_swapChainImageUsage = createInfo.imageUsage;
 
 	QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevices[0]);
 	uint32_t queueFamilyIndices[] = { (uint32_t)indices.graphicsFamily, (uint32_t)indices.presentFamily };
@@ -743,6 +1210,7 @@ void VulkanRenderer::CreateSwapChain()
 	vkGetSwapchainImagesKHR(m_logicalDevices[0], m_swapChain, &imageCount, m_swapChainImages.data());
 	m_swapChainImageFormat	= surfaceFormat.format;
 	m_swapChainExtent		= extent;
+	m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -752,6 +1220,41 @@ void VulkanRenderer::DestroySwapChain()
 	vkDestroySwapchainKHR(m_logicalDevices[0], m_swapChain, nullptr);
 }
 
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateOffscreenImages()
+{
+	// Stands in for the swap chain: one color target per frame in flight, so the next frame can render
+	// while the previous one is still being copied out
+	m_swapChainImageFormat	= HEADLESS_COLOR_FORMAT;
+	m_swapChainExtent		= m_headlessExtent;
+	m_swapChainImages.resize(m_framesInFlight, VK_NULL_HANDLE);
+	m_offscreenImageMemory.resize(m_framesInFlight);
+	m_swapChainImageUsage	= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	if (m_isDynamicResolutionRequested)
+	{
+		m_swapChainImageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	for (uint32_t i = 0; i < m_framesInFlight; ++i)
+	{
+		CreateImage(m_logicalDevices[0], m_swapChainImages[i], m_swapChainImageUsage, m_swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, m_swapChainExtent.width, m_swapChainExtent.height);
+		AllocateImageMemory(m_logicalDevices[0], m_offscreenImageMemory[i], m_swapChainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		BindImage(m_logicalDevices[0], m_swapChainImages[i], m_offscreenImageMemory[i]);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DestroyOffscreenImages()
+{
+	for (uint32_t i = 0; i < m_swapChainImages.size(); ++i)
+	{
+		DestroyImage(m_logicalDevices[0], m_swapChainImages[i]);
+		FreeImageMemory(m_logicalDevices[0], m_offscreenImageMemory[i]);
+	}
+	m_swapChainImages.clear();
+	m_offscreenImageMemory.clear();
+}
+
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateImageViews()
 {
@@ -762,7 +1265,7 @@ void VulkanRenderer::CreateImageViews()
 	}
 }
 
-void VulkanRenderer::CreateImageView(const VkDevice& device, VkImageView& imageViewToCreate, const VkImage& imageToCreateViewFor, VkFormat imageFormat, VkImageAspectFlags aspectFlags)
+void VulkanRenderer::CreateImageView(const VkDevice& device, VkImageView& imageViewToCreate, const VkImage& imageToCreateViewFor, VkFormat imageFormat, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -775,7 +1278,7 @@ void VulkanRenderer::CreateImageView(const VkDevice& device, VkImageView& imageV
 	createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 	createInfo.subresourceRange.aspectMask = aspectFlags;
 	createInfo.subresourceRange.baseMipLevel = 0;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.levelCount = mipLevels;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 	createInfo.subresourceRange.layerCount = 1;
 
@@ -806,162 +1309,48 @@ void VulkanRenderer::CreateGraphicsPipeline()
 	VkShaderModule vertShaderModule;
 	VkShaderModule fragShaderModule;
 
-	auto vertShaderCode = ReadFile("EngineCode/Renderer/Shaders/DefaultShader.vert.spv");
-	auto fragShaderCode = ReadFile("EngineCode/Renderer/Shaders/DefaultShader.frag.spv");
+	auto vertShaderCode = ReadFile(m_isBindless ? "EngineCode/Renderer/Shaders/DefaultShaderBindless.vert.spv" : "EngineCode/Renderer/Shaders/DefaultShader.vert.spv");
+	auto fragShaderCode = ReadFile(m_isBindless ? "EngineCode/Renderer/Shaders/DefaultShaderBindless.frag.spv" : "EngineCode/Renderer/Shaders/DefaultShader.frag.spv");
 
 	CreateShaderModule(vertShaderCode, vertShaderModule);
 	CreateShaderModule(fragShaderCode, fragShaderModule);
 
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[]			= { vertShaderStageInfo, fragShaderStageInfo };
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo	= {};
-	auto bindingDescription									= Vertex::GetBindingDescription();
-	auto attributeDescriptions								= Vertex::GetAttributeDescriptions();
-	vertexInputInfo.sType									= VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount			= 1;
-	vertexInputInfo.pVertexBindingDescriptions				= &bindingDescription; // Optional
-	vertexInputInfo.vertexAttributeDescriptionCount			= attributeDescriptions.size();
-	vertexInputInfo.pVertexAttributeDescriptions			= attributeDescriptions.data(); // Optional
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly	= {};
-	inputAssembly.sType										= VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology									= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable					= VK_FALSE;
-
-	VkViewport viewport = {};
-	viewport.x			= 0.0f;
-	viewport.y			= 0.0f;
-	viewport.width		= (float)m_swapChainExtent.width;
-	viewport.height		= (float)m_swapChainExtent.height;
-	viewport.minDepth	= 0.0f;
-	viewport.maxDepth	= 1.0f;
-
-	VkRect2D scissor	= {};
-	scissor.offset		= { 0, 0 };
-	scissor.extent		= m_swapChainExtent;
-
-	VkPipelineViewportStateCreateInfo viewportState	= {};
-	viewportState.sType								= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount						= 1;
-	viewportState.pViewports						= &viewport;
-	viewportState.scissorCount						= 1;
-	viewportState.pScissors							= &scissor;
-
-
-	VkPipelineRasterizationStateCreateInfo rasterizer	= {};
-	rasterizer.sType									= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable							= VK_FALSE;
-	rasterizer.rasterizerDiscardEnable					= VK_FALSE;
-	rasterizer.polygonMode								= VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth								= 1.0f;
-	rasterizer.cullMode									= VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace								= VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizer.depthBiasEnable							= VK_FALSE;
-	rasterizer.depthBiasConstantFactor					= 0.0f; // Optional
-	rasterizer.depthBiasClamp							= 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor						= 0.0f; // Optional
-
-	VkPipelineMultisampleStateCreateInfo multisampling	= {};
-	multisampling.sType									= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable					= VK_FALSE;
-	multisampling.rasterizationSamples					= VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading						= 1.0f;		// Optional
-	multisampling.pSampleMask							= nullptr;	// Optional
-	multisampling.alphaToCoverageEnable					= VK_FALSE; // Optional
-	multisampling.alphaToOneEnable						= VK_FALSE; // Optional
-
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment	= {};
-	colorBlendAttachment.colorWriteMask							= VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable							= VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor					= VK_BLEND_FACTOR_SRC_ALPHA; // Optional
-	colorBlendAttachment.dstColorBlendFactor					= VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Optional
-	colorBlendAttachment.colorBlendOp							= VK_BLEND_OP_ADD; // Optional
-	colorBlendAttachment.srcAlphaBlendFactor					= VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstAlphaBlendFactor					= VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.alphaBlendOp							= VK_BLEND_OP_ADD; // Optional
-
-	VkPipelineColorBlendStateCreateInfo colorBlending	= {};
-	colorBlending.sType									= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable							= VK_FALSE;
-	colorBlending.logicOp								= VK_LOGIC_OP_COPY; // Optional
-	colorBlending.attachmentCount						= 1;
-	colorBlending.pAttachments							= &colorBlendAttachment;
-	colorBlending.blendConstants[0]						= 0.0f; // Optional
-	colorBlending.blendConstants[1]						= 0.0f; // Optional
-	colorBlending.blendConstants[2]						= 0.0f; // Optional
-	colorBlending.blendConstants[3]						= 0.0f; // Optional
-
-	VkDynamicState dynamicStates[] = 
-	{
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
-	};
+	// Bindless adds the table as set 1. The draw's material index arrives as its firstInstance
+	VkDescriptorSetLayout setLayouts[]					= { m_descriptorSetLayout, m_bindlessTable.GetLayout() };
 
-	VkPipelineDynamicStateCreateInfo dynamicState		= {};
-	dynamicState.sType									= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount						= 2;
-	dynamicState.pDynamicStates							= dynamicStates;
-
-	VkPipelineDepthStencilStateCreateInfo depthStencil	= {};
-	depthStencil.sType									= VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable						= VK_TRUE;
-	depthStencil.depthWriteEnable						= VK_TRUE;
-	depthStencil.depthCompareOp							= VK_COMPARE_OP_LESS;
-	depthStencil.depthBoundsTestEnable					= VK_FALSE;
-	depthStencil.minDepthBounds							= 0.0f; // Optional
-	depthStencil.maxDepthBounds							= 1.0f; // Optional
-	depthStencil.stencilTestEnable						= VK_FALSE;
-	depthStencil.front									= {}; // Optional
-	depthStencil.back									= {}; // Optional
-
-	VkDescriptorSetLayout setLayouts[]					= { m_descriptorSetLayout };
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo		= {};
 	pipelineLayoutInfo.sType							= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount					= 1; 
+	pipelineLayoutInfo.setLayoutCount					= m_isBindless ? 2 : 1;
 	pipelineLayoutInfo.pSetLayouts						= setLayouts;
-	pipelineLayoutInfo.pushConstantRangeCount			= 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges				= 0; // Optional
+	pipelineLayoutInfo.pushConstantRangeCount			= 0;
+	pipelineLayoutInfo.pPushConstantRanges				= nullptr;
 
 	if (vkCreatePipelineLayout(m_logicalDevices[0], &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) 
 	{
 		throw std::runtime_error("failed to create pipeline layout!");
 	}
 
-	VkGraphicsPipelineCreateInfo pipelineInfo			= {};
-	pipelineInfo.sType									= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount								= 2;
-	pipelineInfo.pStages								= shaderStages;
-	pipelineInfo.pVertexInputState						= &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState					= &inputAssembly;
-	pipelineInfo.pViewportState							= &viewportState;
-	pipelineInfo.pRasterizationState					= &rasterizer;
-	pipelineInfo.pMultisampleState						= &multisampling;
-	pipelineInfo.pDepthStencilState						= &depthStencil;
-	pipelineInfo.pColorBlendState						= &colorBlending;
-	pipelineInfo.pDynamicState							= nullptr; // Optional
-	pipelineInfo.layout									= m_pipelineLayout;
-	pipelineInfo.renderPass								= m_renderPass;
-	pipelineInfo.subpass								= 0;
-	pipelineInfo.basePipelineHandle						= VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex						= -1; // Optional: These values are only used if the VK_PIPELINE_CREATE_DERIVATIVE_BIT flag is also specified in the flags field of VkGraphicsPipelineCreateInfo
+	// Both vertex layouts share their locations, the shaders take either
+	auto instanceAttributeDescriptions	= InstanceData::GetAttributeDescriptions();
 
-	if (vkCreateGraphicsPipelines(m_logicalDevices[0], VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) 
-	{
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
+	VulkanPipelineDesc pipelineDesc;
+	pipelineDesc.vertexShader			= vertShaderModule;
+	pipelineDesc.fragmentShader			= fragShaderModule;
+	pipelineDesc.vertexBindings			= m_isVertexCompression ? COMPRESSED_VERTEX_LAYOUT.GetBindingDescriptions() : VERTEX_LAYOUT.GetBindingDescriptions();
+	pipelineDesc.vertexAttributes		= m_isVertexCompression ? COMPRESSED_VERTEX_LAYOUT.GetAttributeDescriptions() : VERTEX_LAYOUT.GetAttributeDescriptions();
+	pipelineDesc.vertexBindings.push_back(InstanceData::GetBindingDescription());
+	pipelineDesc.vertexAttributes.insert(pipelineDesc.vertexAttributes.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+	pipelineDesc.layout					= m_pipelineLayout;
+	pipelineDesc.renderPass				= m_renderPass;
+
+	// If the driver found this pipeline in the cache it adds nothing to it, so growth means a cold compile
+	size_t cacheSizeBefore = m_pipelineCache.GetDataSize();
+	auto compileStart = std::chrono::high_resolution_clock::now();
+
+	m_graphicsPipeline = pipelineDesc.Create(m_logicalDevices[0], m_pipelineCache.GetCache());
+
+	float compileMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count();
+	std::cout << "graphics pipeline created in " << compileMs << " ms (pipeline cache " << (m_pipelineCache.GetDataSize() > cacheSizeBefore ? "miss" : "hit") << ")" << std::endl;
 
 	DestroyShaderModule(vertShaderModule);
 	DestroyShaderModule(fragShaderModule);
@@ -1028,8 +1417,8 @@ void VulkanRenderer::CreateRenderPass()
 	colorAttachment.storeOp						= VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp				= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp				= VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout				= VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout					= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.initialLayout				= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout					= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentRef	= {};
 	colorAttachmentRef.attachment				= 0;
@@ -1039,10 +1428,10 @@ void VulkanRenderer::CreateRenderPass()
 	depthAttachment.format						= FindDepthFormat();
 	depthAttachment.samples						= VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp						= VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp						= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.storeOp						= m_isOcclusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;	// The depth pyramid is built from it
 	depthAttachment.stencilLoadOp				= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp				= VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout				= VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout				= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout					= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef	= {};
@@ -1055,14 +1444,7 @@ void VulkanRenderer::CreateRenderPass()
 	subpass.pColorAttachments					= &colorAttachmentRef;
 	subpass.pDepthStencilAttachment				= &depthAttachmentRef;
 
-	VkSubpassDependency dependency				= {};
-	dependency.srcSubpass						= VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass						= 0;
-	dependency.srcStageMask						= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask					= 0;
-	dependency.dstStageMask						= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask					= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+	// Layout transitions and every dependency in and out of the pass are barriers of the render graph
 	std::array<VkAttachmentDescription, 2> attachments	= { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassInfo				= {};
 	renderPassInfo.sType								= VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -1070,29 +1452,67 @@ void VulkanRenderer::CreateRenderPass()
 	renderPassInfo.pAttachments							= attachments.data();
 	renderPassInfo.subpassCount							= 1;
 	renderPassInfo.pSubpasses							= &subpass;
-	renderPassInfo.dependencyCount						= 1;
-	renderPassInfo.pDependencies						= &dependency;
+	renderPassInfo.dependencyCount						= 0;
+	renderPassInfo.pDependencies						= nullptr;
 
 	if (vkCreateRenderPass(m_logicalDevices[0], &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) 
 	{
 		throw std::runtime_error("failed to create render pass!");
 	}
-}
 
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyRenderPass()
+	// Draws what the late cull phase found visible on top of the main pass. Only load and store ops
+	// differ, so the pass stays compatible with the framebuffers and the pipeline of m_renderPass
+	if (m_isOcclusionCulling)
+	{
+		attachments[0].loadOp	= VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].loadOp	= VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp	= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		if (vkCreateRenderPass(m_logicalDevices[0], &renderPassInfo, nullptr, &m_lateRenderPass) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to create late render pass!");
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DestroyRenderPass()
 {
 	vkDestroyRenderPass(m_logicalDevices[0], m_renderPass, nullptr);
+	vkDestroyRenderPass(m_logicalDevices[0], m_lateRenderPass, nullptr);
+	m_lateRenderPass = VK_NULL_HANDLE;
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateFrameBuffers()
 {
+	// With dynamic resolution the scene never renders into the swap chain images, one framebuffer over
+	// the scene color target serves every image. It is sized to the full extent, the scale only
+	// shrinks the render area
+	if (m_isDynamicResolution)
+	{
+		std::array<VkImageView, 2> attachments		= { m_renderGraph.GetImageView(m_sceneColorResource), m_renderGraph.GetImageView(m_depthResource) };
+
+		VkFramebufferCreateInfo framebufferInfo		= {};
+		framebufferInfo.sType						= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass					= m_renderPass;
+		framebufferInfo.attachmentCount				= attachments.size();
+		framebufferInfo.pAttachments				= attachments.data();
+		framebufferInfo.width						= m_swapChainExtent.width;
+		framebufferInfo.height						= m_swapChainExtent.height;
+		framebufferInfo.layers						= 1;
+
+		if (vkCreateFramebuffer(m_logicalDevices[0], &framebufferInfo, nullptr, &m_sceneFrameBuffer) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to create framebuffer!");
+		}
+		return;
+	}
+
 	m_swapChainFrameBuffers.resize(m_imageViews.size(), VkFramebuffer());
 
 	for (size_t i = 0; i < m_imageViews.size(); i++)
 	{
-		std::array<VkImageView, 2> attachments[]	= { m_imageViews[i], m_depthImageView };
+		std::array<VkImageView, 2> attachments[]	= { m_imageViews[i], m_renderGraph.GetImageView(m_depthResource) };
 
 		VkFramebufferCreateInfo framebufferInfo		= {};
 		framebufferInfo.sType						= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1117,135 +1537,559 @@ void VulkanRenderer::DestroyFrameBuffers()
 	{
 		vkDestroyFramebuffer(m_logicalDevices[0], frameBuffer, nullptr);
 	}
+	m_swapChainFrameBuffers.clear();
+	vkDestroyFramebuffer(m_logicalDevices[0], m_sceneFrameBuffer, nullptr);
+	m_sceneFrameBuffer = VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateUploadContext()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevices[0]);
+	m_uploadContext.Initialize(m_logicalDevices[0], m_memoryAllocator, queueFamilyIndices.graphicsFamily, m_graphicsQueue, queueFamilyIndices.transferFamily, m_transferQueue);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DestroyUploadContext()
+{
+	m_uploadContext.Uninitialize();
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateCommandPool()
+void VulkanRenderer::CreateFrameResources()
 {
 	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevices[0]);
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags = 0;
+	m_frames.resize(m_framesInFlight);
+	m_currentFrame = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType					= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// Created signaled so the very first wait on each frame slot returns immediately
+	VkFenceCreateInfo fenceInfo			= {};
+	fenceInfo.sType						= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags						= VK_FENCE_CREATE_SIGNALED_BIT;
+
+	VkCommandPoolCreateInfo poolInfo	= {};
+	poolInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex			= queueFamilyIndices.graphicsFamily;
+	poolInfo.flags						= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-	if (vkCreateCommandPool(m_logicalDevices[0], &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	for (FrameData& frame : m_frames)
 	{
-		throw std::runtime_error("failed to create command pool!");
+		if (vkCreateSemaphore(m_logicalDevices[0], &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS || vkCreateSemaphore(m_logicalDevices[0], &semaphoreInfo, nullptr, &frame.renderFinishedSemaphore) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to create semaphores!");
+		}
+
+		if (vkCreateFence(m_logicalDevices[0], &fenceInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame fence!");
+		}
+
+		if (vkCreateCommandPool(m_logicalDevices[0], &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo	= {};
+		allocInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool					= frame.commandPool;
+		allocInfo.level							= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount			= 1;
+
+		if (vkAllocateCommandBuffers(m_logicalDevices[0], &allocInfo, &frame.commandBuffer) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to allocate command buffers!");
+		}
+
+		if (m_isHeadless)
+		{
+			VkDeviceSize readbackSize = (VkDeviceSize)m_swapChainExtent.width * m_swapChainExtent.height * 4;
+			CreateBuffer(m_logicalDevices[0], readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, frame.readbackBuffer);
+			AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.readbackMemory, frame.readbackBuffer);
+		}
 	}
+
+	m_parallelRecorder.Initialize(m_logicalDevices[0], queueFamilyIndices.graphicsFamily, m_framesInFlight);
+	m_gpuProfiler.Initialize(m_logicalDevices[0], m_physicalDevices[0], queueFamilyIndices.graphicsFamily, m_framesInFlight);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyCommandPool()
+void VulkanRenderer::DestroyFrameResources()
 {
-	vkDestroyCommandPool(m_logicalDevices[0], m_commandPool, nullptr);
+	vkDeviceWaitIdle(m_logicalDevices[0]);
+	m_parallelRecorder.Uninitialize();
+	m_gpuProfiler.Uninitialize();
+	for (FrameData& frame : m_frames)
+	{
+		// Destroying the pool frees the command buffer allocated from it
+		vkDestroyCommandPool(m_logicalDevices[0], frame.commandPool, nullptr);
+		vkDestroyFence(m_logicalDevices[0], frame.inFlightFence, nullptr);
+		vkDestroySemaphore(m_logicalDevices[0], frame.imageAvailableSemaphore, nullptr);
+		vkDestroySemaphore(m_logicalDevices[0], frame.renderFinishedSemaphore, nullptr);
+		if (frame.readbackBuffer != VK_NULL_HANDLE)
+		{
+			DestroyBuffer(m_logicalDevices[0], frame.readbackBuffer);
+			FreeBufferMemory(m_logicalDevices[0], frame.readbackMemory);
+		}
+	}
+	m_frames.clear();
+	m_imagesInFlight.assign(m_imagesInFlight.size(), VK_NULL_HANDLE);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateCommandBuffers()
+void VulkanRenderer::RecordCommandBuffer(FrameData& frame, uint32_t imageIndex)
 {
-	DestroyCommandBuffers();
-	m_commandBuffers.resize(m_swapChainFrameBuffers.size());
+	PROFILE_FUNCTION();
+
+	// The frame's fence has already been waited on, so everything allocated from this pool is idle
+	vkResetCommandPool(m_logicalDevices[0], frame.commandPool, 0);
 
-	VkCommandBufferAllocateInfo allocInfo	= {};
-	allocInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool					= m_commandPool;
-	allocInfo.level							= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount			= (uint32_t)m_commandBuffers.size();
+	VkCommandBufferBeginInfo beginInfo	= {};
+	beginInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags						= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo			= nullptr; // Optional
 
-	if (vkAllocateCommandBuffers(m_logicalDevices[0], &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) 
+	vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+
+	m_gpuProfiler.ResetQueries(frame.commandBuffer);
+	m_gpuProfiler.BeginScope(frame.commandBuffer, "Frame");
+
+	// Take ownership of anything the transfer queue finished uploading since the last frame, then fill
+	// the mip chains of the textures among it, which needs the graphics queue
+	m_gpuProfiler.BeginScope(frame.commandBuffer, "Uploads");
+	m_uploadContext.RecordPendingAcquires(frame.commandBuffer);
+	m_mipGenerator.RecordPending(frame.commandBuffer);
+	if (m_isGpuCulling)
 	{
-		throw std::runtime_error("failed to allocate command buffers!");
+		m_depthPyramid.RecordPending(frame.commandBuffer);
 	}
+	m_gpuProfiler.EndScope(frame.commandBuffer);
 
-	for (size_t i = 0; i < m_commandBuffers.size(); i++) 
+	// The graph inserts every barrier between its passes and scopes each of them on the GPU profiler
+	m_recordingImageIndex = imageIndex;
+	m_renderGraph.SetImportedImage(m_backBufferResource, m_swapChainImages[imageIndex], m_imageViews[imageIndex]);
+	if (m_isHeadless)
+	{
+		m_renderGraph.SetImportedBuffer(m_readbackResource, frame.readbackBuffer);
+	}
+	if (m_isGpuCulling)
 	{
-		VkCommandBufferBeginInfo beginInfo	= {};
-		beginInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags						= VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo			= nullptr; // Optional
+		m_renderGraph.SetImportedBuffer(m_drawCommandsResource, m_gpuCuller.GetCommandBuffer());
+		m_renderGraph.SetImportedBuffer(m_drawCountResource, m_gpuCuller.GetCountBuffer());
+	}
+	if (m_isOcclusionCulling)
+	{
+		m_renderGraph.SetImportedImage(m_depthPyramidResource, m_depthPyramid.GetImage(), m_depthPyramid.GetView());
+		m_renderGraph.SetImportedBuffer(m_visibilityResource, m_gpuCuller.GetVisibilityBuffer());
+		m_renderGraph.SetImportedBuffer(m_lateDrawCommandsResource, m_gpuCuller.GetCommandBuffer(GPU_CULL_PHASE_LATE));
+		m_renderGraph.SetImportedBuffer(m_lateDrawCountResource, m_gpuCuller.GetCountBuffer(GPU_CULL_PHASE_LATE));
+	}
+	m_renderGraph.Execute(frame.commandBuffer, &m_gpuProfiler);
+	m_gpuProfiler.EndScope(frame.commandBuffer);
 
-		vkBeginCommandBuffer(m_commandBuffers[i], &beginInfo);
+	if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color					= { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil				= { 1.0f, 0 };
-		VkRenderPassBeginInfo renderPassInfo	= {};
-		renderPassInfo.sType					= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass				= m_renderPass;
-		renderPassInfo.framebuffer				= m_swapChainFrameBuffers[i];
-		renderPassInfo.renderArea.offset		= { 0, 0 };
-		renderPassInfo.renderArea.extent		= m_swapChainExtent;
-		renderPassInfo.clearValueCount			= clearValues.size();
-		renderPassInfo.pClearValues				= clearValues.data();
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::BuildRenderGraph()
+{
+	// Decided on every build, a new swap chain may come with another format
+	m_isDynamicResolution = m_isDynamicResolutionRequested && CanUpscale();
+	if (m_isDynamicResolution)
+	{
+		SetDynamicResolutionSettings(m_dynamicResolution.GetSettings());
+	}
 
-		vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Presentable images come out of acquire in no particular layout, the acquire semaphore is waited
+	// on at color output. Offscreen targets are cleared every frame and their slot's fence covers reuse
+	VulkanResourceState backBufferInitial;
+	VulkanResourceState backBufferFinal;
+	if (m_isHeadless)
+	{
+		backBufferInitial.stageMask	= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+	else
+	{
+		backBufferInitial.stageMask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		backBufferFinal				= VulkanResourceState::FromLayout(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	}
+	m_backBufferResource = m_renderGraph.ImportImage("BackBuffer", VK_IMAGE_ASPECT_COLOR_BIT, backBufferInitial, backBufferFinal);
 
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	RenderGraphImageDesc depthDesc;
+	depthDesc.format	= FindDepthFormat();
+	depthDesc.extent	= m_swapChainExtent;
+	depthDesc.aspect	= VK_IMAGE_ASPECT_DEPTH_BIT;
+	m_depthResource		= m_renderGraph.CreateImage("Depth", depthDesc);
+
+	// Shares the swap chain format, so the one render pass serves both targets
+	RenderGraphImageDesc sceneColorDesc;
+	sceneColorDesc.format	= m_swapChainImageFormat;
+	sceneColorDesc.extent	= m_swapChainExtent;
+	m_sceneColorResource	= m_isDynamicResolution ? m_renderGraph.CreateImage("SceneColor", sceneColorDesc) : m_backBufferResource;
+
+	if (m_isGpuCulling)
+	{
+		// Both buffers belong to the frame being recorded, its fence already covers their reuse
+		m_drawCommandsResource	= m_renderGraph.ImportBuffer("DrawCommands", VulkanResourceState(), VulkanResourceState());
+		m_drawCountResource		= m_renderGraph.ImportBuffer("DrawCount", VulkanResourceState(), VulkanResourceState());
 
-		VkBuffer vertexBuffers[]	= { m_vertexBuffer };
-		VkDeviceSize offsets[]		= { 0 };
-		vkCmdBindVertexBuffers(m_commandBuffers[i], 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(m_commandBuffers[i], m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(m_commandBuffers[i], m_indices.size(), 1, 0, 0, 0);
-		vkCmdBindDescriptorSets(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
-		vkCmdEndRenderPass(m_commandBuffers[i]);
+		VulkanRenderGraph::PassBuilder clearPass = m_renderGraph.AddPass("ClearDrawCount", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			UNUSED(graph);
+			m_gpuCuller.RecordClear(commandBuffer);
+		})
+			.Write(m_drawCountResource, RENDER_GRAPH_TRANSFER_DST);
 
-		if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS) 
+		// The count is bumped atomically, so the cull reads what the clear left rather than replacing it
+		VulkanRenderGraph::PassBuilder cullPass = m_renderGraph.AddPass("CullDraws", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			UNUSED(graph);
+			m_gpuCuller.RecordCull(commandBuffer, GPU_CULL_PHASE_EARLY, m_isOcclusionCulling && m_depthPyramid.HasHistory());
+		})
+			.Write(m_drawCommandsResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE)
+			.Read(m_drawCountResource, RENDER_GRAPH_STORAGE_READ_COMPUTE)
+			.Write(m_drawCountResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE);
+
+		if (m_isOcclusionCulling)
 		{
-			throw std::runtime_error("failed to record command buffer!");
+			// The pyramid outlives the frame and is sampled at its start, so it is left where it is sampled.
+			// The other buffers belong to the frame being recorded like the early ones
+			VulkanResourceState pyramidState	= VulkanResourceState::FromUsage(RENDER_GRAPH_SAMPLED_COMPUTE);
+			m_depthPyramidResource				= m_renderGraph.ImportImage("DepthPyramid", VK_IMAGE_ASPECT_COLOR_BIT, pyramidState, pyramidState);
+			m_visibilityResource				= m_renderGraph.ImportBuffer("CullVisibility", VulkanResourceState(), VulkanResourceState());
+			m_lateDrawCommandsResource			= m_renderGraph.ImportBuffer("LateDrawCommands", VulkanResourceState(), VulkanResourceState());
+			m_lateDrawCountResource				= m_renderGraph.ImportBuffer("LateDrawCount", VulkanResourceState(), VulkanResourceState());
+
+			clearPass
+				.Write(m_lateDrawCountResource, RENDER_GRAPH_TRANSFER_DST);
+			cullPass
+				.Read(m_depthPyramidResource, RENDER_GRAPH_SAMPLED_COMPUTE)
+				.Write(m_visibilityResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE);
 		}
 	}
+
+	VulkanRenderGraph::PassBuilder mainPass = m_renderGraph.AddPass("MainPass", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+	{
+		UNUSED(graph);
+		RecordMainPass(commandBuffer);
+	})
+		.Write(m_sceneColorResource, RENDER_GRAPH_COLOR_ATTACHMENT)
+		.Write(m_depthResource, RENDER_GRAPH_DEPTH_ATTACHMENT);
+	if (m_isGpuCulling)
+	{
+		mainPass
+			.Read(m_drawCommandsResource, RENDER_GRAPH_INDIRECT_BUFFER)
+			.Read(m_drawCountResource, RENDER_GRAPH_INDIRECT_BUFFER);
+	}
+
+	if (m_isOcclusionCulling)
+	{
+		// Rebuilt from the depth the early phase drew, which is conservative: whatever it hides stays
+		// hidden once the late phase adds more. Next frame's early phase tests against it as well
+		m_renderGraph.AddPass("BuildDepthPyramid", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			m_depthPyramid.RecordBuild(commandBuffer, graph.GetImageView(m_depthResource), m_renderExtent);
+		})
+			.Read(m_depthResource, RENDER_GRAPH_SAMPLED_COMPUTE)
+			.Write(m_depthPyramidResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE);
+
+		// Bumps the late count atomically like the early cull does
+		m_renderGraph.AddPass("CullLateDraws", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			UNUSED(graph);
+			m_gpuCuller.RecordCull(commandBuffer, GPU_CULL_PHASE_LATE, true);
+		})
+			.Read(m_depthPyramidResource, RENDER_GRAPH_SAMPLED_COMPUTE)
+			.Read(m_visibilityResource, RENDER_GRAPH_STORAGE_READ_COMPUTE)
+			.Write(m_lateDrawCommandsResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE)
+			.Read(m_lateDrawCountResource, RENDER_GRAPH_STORAGE_READ_COMPUTE)
+			.Write(m_lateDrawCountResource, RENDER_GRAPH_STORAGE_WRITE_COMPUTE);
+
+		m_renderGraph.AddPass("LateMainPass", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			UNUSED(graph);
+			RecordMainPass(commandBuffer, GPU_CULL_PHASE_LATE);
+		})
+			.Read(m_lateDrawCommandsResource, RENDER_GRAPH_INDIRECT_BUFFER)
+			.Read(m_lateDrawCountResource, RENDER_GRAPH_INDIRECT_BUFFER)
+			.Write(m_sceneColorResource, RENDER_GRAPH_COLOR_ATTACHMENT)
+			.Write(m_depthResource, RENDER_GRAPH_DEPTH_ATTACHMENT);
+	}
+
+	if (m_isDynamicResolution)
+	{
+		m_renderGraph.AddPass("Upscale", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			RecordUpscale(commandBuffer, graph);
+		})
+			.Read(m_sceneColorResource, RENDER_GRAPH_TRANSFER_SRC)
+			.Write(m_backBufferResource, RENDER_GRAPH_TRANSFER_DST);
+	}
+
+	if (m_isHeadless)
+	{
+		// A fence wait alone does not make device writes visible to the host, the final host read state does
+		m_readbackResource = m_renderGraph.ImportBuffer("Readback", VulkanResourceState(), VulkanResourceState::FromUsage(RENDER_GRAPH_HOST_READ));
+
+		m_renderGraph.AddPass("Readback", [this](const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+		{
+			RecordReadback(commandBuffer, graph);
+		})
+			.Read(m_backBufferResource, RENDER_GRAPH_TRANSFER_SRC)
+			.Write(m_readbackResource, RENDER_GRAPH_TRANSFER_DST);
+	}
+
+	m_renderGraph.Compile();
+	m_renderGraph.PrintStats();
+	if (m_isGpuCulling && m_renderGraph.IsPassCulled("ClearDrawCount"))
+	{
+		throw std::runtime_error("the draw count clear was culled from the render graph!");
+	}
+	if (m_isDynamicResolution)
+	{
+		const DynamicResolutionSettings& settings = m_dynamicResolution.GetSettings();
+		std::cout << "dynamic resolution: " << settings.minScale << "-" << settings.maxScale << " of " << m_swapChainExtent.width << "x" << m_swapChainExtent.height << " within " << settings.frameBudgetMilliseconds << " ms" << std::endl;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::RecordMainPass(const VkCommandBuffer& commandBuffer, GpuCullPhase phase)
+{
+	// The late pass loads both attachments, its clear values go unused
+	VkRenderPass renderPass					= phase == GPU_CULL_PHASE_EARLY ? m_renderPass : m_lateRenderPass;
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color					= { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil				= { 1.0f, 0 };
+	VkRenderPassBeginInfo renderPassInfo	= {};
+	renderPassInfo.sType					= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass				= renderPass;
+	renderPassInfo.framebuffer				= m_isDynamicResolution ? m_sceneFrameBuffer : m_swapChainFrameBuffers[m_recordingImageIndex];
+	renderPassInfo.renderArea.offset		= { 0, 0 };
+	renderPassInfo.renderArea.extent		= m_renderExtent;
+	renderPassInfo.clearValueCount			= clearValues.size();
+	renderPassInfo.pClearValues				= clearValues.data();
+
+	// The pass body is recorded into secondary command buffers, possibly on several threads. Timestamps
+	// cannot go inside such a pass, the graph measures it from the outside
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	VkCommandBufferInheritanceInfo inheritanceInfo	= {};
+	inheritanceInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass						= renderPass;
+	inheritanceInfo.subpass							= 0;
+	inheritanceInfo.framebuffer						= renderPassInfo.framebuffer;
+
+	VulkanViewState viewState	= VulkanViewState::FromExtent(m_renderExtent);
+	uint32_t uniformOffset		= m_frames[m_currentFrame].uniformOffset;
+
+	// GPU-culled draws are a single indirect call, one slice records them
+	uint32_t itemCount			= m_isGpuCulling ? std::min(1u, m_gpuCuller.GetObjectCount()) : (uint32_t)m_drawList.size();
+
+	m_parallelRecorder.Record(commandBuffer, inheritanceInfo, itemCount, [this, &viewState, uniformOffset, phase](const VkCommandBuffer& commandBuffer, uint32_t firstItem, uint32_t itemCount)
+	{
+		// Secondary command buffers inherit no state, every slice binds everything it draws with
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+		viewState.Apply(commandBuffer);
+
+		// Bindings follow VERTEX_STREAM_BINDINGS, the instance buffer sits between the two streams
+		VkBuffer vertexBuffers[]	= { m_vertexBuffer, m_instanceBuffer, m_vertexBuffer };
+		VkDeviceSize offsets[]		= { m_vertexStreamOffsets[VERTEX_STREAM_POSITION], 0, m_vertexStreamOffsets[VERTEX_STREAM_ATTRIBUTES] };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 3, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		// Bindless, this is the only descriptor bind however many materials the slice draws with
+		VkDescriptorSet descriptorSets[] = { m_descriptorSet, m_bindlessTable.GetSet() };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, m_isBindless ? 2 : 1, descriptorSets, 1, &uniformOffset);
+
+		if (m_isGpuCulling)
+		{
+			m_gpuCuller.RecordDraws(commandBuffer, phase);
+			return;
+		}
+
+		for (uint32_t i = firstItem; i < firstItem + itemCount; ++i)
+		{
+			const VkDrawIndexedIndirectCommand& draw = m_drawList[i];
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+		}
+	});
+
+	vkCmdEndRenderPass(commandBuffer);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyCommandBuffers()
+void VulkanRenderer::RecordReadback(const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
 {
-	if (m_commandBuffers.size() > 0)
+	VkBufferImageCopy region				= {};
+	region.bufferOffset						= 0;
+	region.bufferRowLength					= 0;
+	region.bufferImageHeight				= 0;
+	region.imageSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel		= 0;
+	region.imageSubresource.baseArrayLayer	= 0;
+	region.imageSubresource.layerCount		= 1;
+	region.imageOffset						= { 0, 0, 0 };
+	region.imageExtent						= { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, graph.GetImage(m_backBufferResource), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph.GetBuffer(m_readbackResource), 1, &region);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::RecordUpscale(const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph)
+{
+	VkImageBlit blit						= {};
+	blit.srcSubresource.aspectMask			= VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount			= 1;
+	blit.srcOffsets[1]						= { (int32_t)m_renderExtent.width, (int32_t)m_renderExtent.height, 1 };
+	blit.dstSubresource.aspectMask			= VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.layerCount			= 1;
+	blit.dstOffsets[1]						= { (int32_t)m_swapChainExtent.width, (int32_t)m_swapChainExtent.height, 1 };
+
+	vkCmdBlitImage(commandBuffer, graph.GetImage(m_sceneColorResource), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, graph.GetImage(m_backBufferResource), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, m_upscaleFilter);
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanRenderer::CanUpscale()
+{
+	if (!m_gpuProfiler.IsSupported())
+	{
+		std::cerr << "dynamic resolution: disabled, the graphics queue has no timestamps to measure frames with" << std::endl;
+		return false;
+	}
+	if (!(m_swapChainImageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+	{
+		std::cerr << "dynamic resolution: disabled, the swap chain images cannot be blitted to" << std::endl;
+		return false;
+	}
+
+	// The scene target and the swap chain images share a format, it has to be both ends of a blit
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevices[0], m_swapChainImageFormat, &formatProperties);
+	VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	if ((formatProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
 	{
-		vkFreeCommandBuffers(m_logicalDevices[0], m_commandPool, (uint32_t)m_commandBuffers.size(), m_commandBuffers.data());
-		m_commandBuffers.clear();
+		std::cerr << "dynamic resolution: disabled, the swap chain format cannot be blitted" << std::endl;
+		return false;
 	}
+	m_upscaleFilter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	return true;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateSemaphores()
+bool VulkanRenderer::CanCullOcclusion(const VkPhysicalDevice& physicalDevice)
 {
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType					= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	// The pyramid samples the depth target and is written as a storage image
+	VkFormatProperties depthProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, FindDepthFormat(), &depthProperties);
+	if (!(depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+	{
+		std::cerr << "occlusion culling: disabled, the depth format cannot be sampled" << std::endl;
+		return false;
+	}
 
-	if (vkCreateSemaphore(m_logicalDevices[0], &semaphoreInfo, nullptr, &m_imageAvailableSemaphore) != VK_SUCCESS || vkCreateSemaphore(m_logicalDevices[0], &semaphoreInfo, nullptr, &m_renderFinishedSemaphore) != VK_SUCCESS) 
+	VkFormatProperties pyramidProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VulkanDepthPyramid::FORMAT, &pyramidProperties);
+	VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	if ((pyramidProperties.optimalTilingFeatures & requiredFeatures) != requiredFeatures)
 	{
-		throw std::runtime_error("failed to create semaphores!");
+		std::cerr << "occlusion culling: disabled, the depth pyramid format cannot be stored to" << std::endl;
+		return false;
 	}
+	return true;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroySemaphores()
+void VulkanRenderer::UpdateRenderExtent()
 {
-	vkDeviceWaitIdle(m_logicalDevices[0]);
-	vkDestroySemaphore(m_logicalDevices[0], m_imageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(m_logicalDevices[0], m_renderFinishedSemaphore, nullptr);
+	if (!m_isDynamicResolution)
+	{
+		m_renderExtent = m_swapChainExtent;
+		return;
+	}
+
+	// The slot whose fence was just waited on has been resolved, a new result is one new frame time
+	const std::vector<GpuScopeResult>& results = m_gpuProfiler.GetLastResults();
+	if (!results.empty() && m_gpuProfiler.GetLastResultFrame() != m_dynamicResolutionFrame)
+	{
+		m_dynamicResolutionFrame = m_gpuProfiler.GetLastResultFrame();
+		for (const GpuScopeResult& result : results)
+		{
+			if (result.depth == 0 && result.name == "Frame")
+			{
+				m_dynamicResolution.AddFrameTime(result.milliseconds);
+				break;
+			}
+		}
+	}
+
+	// The scene target is full size, any scale fits without recreating it
+	m_renderExtent.width	= std::min(m_swapChainExtent.width, m_dynamicResolution.ScaleSize(m_swapChainExtent.width));
+	m_renderExtent.height	= std::min(m_swapChainExtent.height, m_dynamicResolution.ScaleSize(m_swapChainExtent.height));
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateVertexBuffer()
+void VulkanRenderer::DrawOffscreen(FrameData& frame)
 {
-	VkDeviceSize	bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
-	VkBuffer		stagingBuffer;
-	VkDeviceMemory	stagingBufferMemory;
+	// Each frame slot owns its color target, the fence waited on in Update already covers both
+	RecordCommandBuffer(frame, m_currentFrame);
 
-	CreateStagingBuffer(m_logicalDevices[0], bufferSize, stagingBuffer, stagingBufferMemory);
+	VkSubmitInfo submitInfo				= {};
+	submitInfo.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount		= 1;
+	submitInfo.pCommandBuffers			= &frame.commandBuffer;
+
+	vkResetFences(m_logicalDevices[0], 1, &frame.inFlightFence);
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) 
+	{
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
 
-	void* data;
-	vkMapMemory(m_logicalDevices[0], stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_logicalDevices[0], stagingBufferMemory);
+	// Nothing blocks on the readback here, it is picked up once this slot comes around again
+	frame.readbackPending		= true;
+	frame.readbackFrameNumber	= m_frameNumber++;
+	m_currentFrame				= (m_currentFrame + 1) % m_framesInFlight;
+}
 
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DeliverReadback(FrameData& frame)
+{
+	frame.readbackPending = false;
+	if (m_frameReadyCallback)
+	{
+		m_frameReadyCallback(static_cast<const uint8_t*>(frame.readbackMemory.mappedData), m_swapChainExtent.width, m_swapChainExtent.height, frame.readbackFrameNumber);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateVertexBuffer()
+{
+	// The streams go into one buffer back to back, bound at their offsets
+	std::vector<uint8_t> vertexData;
+	if (m_isVertexCompression)
+	{
+		// Each mesh's vertices are packed against its own bounds, BuildMeshes has found them
+		std::vector<CompressedVertex> compressedVertices(m_vertices.size());
+		for (const MeshRange& mesh : m_meshes)
+		{
+			VertexCompressor::Compress(&m_vertices[mesh.vertexOffset], mesh.vertexCount, mesh.quantization, &compressedVertices[mesh.vertexOffset]);
+		}
+		COMPRESSED_VERTEX_LAYOUT.Pack(compressedVertices.data(), (uint32_t)compressedVertices.size(), vertexData, m_vertexStreamOffsets);
+		std::cout << "vertex compression: " << m_vertices.size() << " vertices in " << vertexData.size() << " bytes instead of " << sizeof(Vertex) * m_vertices.size() << std::endl;
+	}
+	else
+	{
+		VERTEX_LAYOUT.Pack(m_vertices.data(), (uint32_t)m_vertices.size(), vertexData, m_vertexStreamOffsets);
+	}
+
+	VkDeviceSize bufferSize = vertexData.size();
 	CreateBuffer(m_logicalDevices[0], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertexBuffer);
 	AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBufferMemory, m_vertexBuffer);
-	CopyBuffer(m_logicalDevices[0], stagingBuffer, m_vertexBuffer, bufferSize);
-
-	DestroyStagingBuffer(m_logicalDevices[0], stagingBuffer, stagingBufferMemory);
+	UploadToBuffer(m_vertexBuffer, vertexData.data(), bufferSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 }
 
 
@@ -1279,99 +2123,424 @@ void VulkanRenderer::DestroyBuffer(const VkDevice& device, VkBuffer& bufferToFre
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::AllocateBufferMemory(const VkDevice& device, VkMemoryPropertyFlags properties, VkDeviceMemory& bufferMemory, VkBuffer& bufferToAllocate)
+void VulkanRenderer::AllocateBufferMemory(const VkDevice& device, VkMemoryPropertyFlags properties, VulkanAllocation& bufferMemory, VkBuffer& bufferToAllocate)
 {
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device, bufferToAllocate, &memRequirements);
+	UNUSED(device);
+	bufferMemory = m_memoryAllocator.AllocateForBuffer(bufferToAllocate, properties);
+}
 
-	VkMemoryAllocateInfo allocInfo	= {};
-	allocInfo.sType					= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize		= memRequirements.size;
-	allocInfo.memoryTypeIndex		= FindMemoryType(memRequirements.memoryTypeBits, properties);
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::FreeBufferMemory(const VkDevice& device, VulkanAllocation& bufferMemory)
+{
+	UNUSED(device);
+	m_memoryAllocator.Free(bufferMemory);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::UploadToBuffer(const VkBuffer& dstBuffer, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
+{
+	// Recorded into the current upload batch. Nothing reaches the GPU until the batch is submitted
+	m_uploadContext.UploadBuffer(dstBuffer, data, size);
+
+	VkBufferMemoryBarrier barrier	= {};
+	barrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask			= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask			= dstAccess;
+	barrier.buffer					= dstBuffer;
+	barrier.offset					= 0;
+	barrier.size					= VK_WHOLE_SIZE;
+	m_uploadContext.ReleaseToGraphics(barrier, dstStage);
+}
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateIndexBuffer()
+{
+	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+
+	CreateBuffer(m_logicalDevices[0], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer);
+	AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBufferMemory, m_indexBuffer);
+	UploadToBuffer(m_indexBuffer, m_indices.data(), bufferSize, VK_ACCESS_INDEX_READ_BIT);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::BuildMeshes()
+{
+	m_meshes.clear();
+	if (m_indices.empty())
+	{
+		return;
+	}
+
+	// Geometry arrives in source order, reorder it for the vertex cache, overdraw and vertex fetch first
+	MeshCacheStats before	= MeshOptimizer::Analyze(m_indices.data(), (uint32_t)m_indices.size(), (uint32_t)m_vertices.size());
+	MeshOptimizer::Optimize(m_vertices, m_indices);
+	MeshCacheStats after	= MeshOptimizer::Analyze(m_indices.data(), (uint32_t)m_indices.size(), (uint32_t)m_vertices.size());
+	std::cout << "mesh optimization: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+
+	// The whole index buffer is the one model there is so far
+	MeshRange mesh;
+	mesh.indexCount		= (uint32_t)m_indices.size();
+	mesh.vertexCount	= (uint32_t)m_vertices.size();
+
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	for (uint32_t index = mesh.firstIndex; index < mesh.firstIndex + mesh.indexCount; ++index)
 	{
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
+		const glm::vec3& position = m_vertices[mesh.vertexOffset + m_indices[index]].pos;
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+	}
+	glm::vec3 center	= (boundsMin + boundsMax) * 0.5f;
+	mesh.boundingSphere	= glm::vec4(center, glm::length(boundsMax - center));
+	if (m_isVertexCompression)
+	{
+		mesh.quantization = VertexCompressor::ComputeQuantization(&m_vertices[mesh.vertexOffset], mesh.vertexCount);
 	}
 
-	vkBindBufferMemory(device, bufferToAllocate, bufferMemory, 0);
+	// Levels go after every mesh in the index buffer, over the same vertices
+	if (m_isMeshLods)
+	{
+		mesh.lods = MeshSimplifier::BuildLodChain(&m_vertices[mesh.vertexOffset], mesh.vertexCount, m_indices, mesh.firstIndex, mesh.indexCount);
+		std::cout << "mesh lods:";
+		for (const MeshLod& lod : mesh.lods)
+		{
+			std::cout << " " << lod.indexCount / 3;
+		}
+		std::cout << " triangles, error " << mesh.lods.back().error << std::endl;
+	}
+	else
+	{
+		MeshLod lod;
+		lod.firstIndex	= mesh.firstIndex;
+		lod.indexCount	= mesh.indexCount;
+		mesh.lods.push_back(lod);
+	}
+	m_meshes.push_back(mesh);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::FreeBufferMemory(const VkDevice& device, VkDeviceMemory& bufferMemory)
+// Splits order[begin, end) at the median along the longest axis of the sphere centers until each part
+// is no wider than spread times its largest sphere and holds at most maxCount, appending the parts
+static void SplitInstanceCluster(std::vector<uint32_t>& order, uint32_t begin, uint32_t end, const std::vector<glm::vec4>& spheres, uint32_t maxCount, float spread, std::vector<uint32_t>& clusterEnds)
 {
-	vkFreeMemory(device, bufferMemory, nullptr);
+	glm::vec3 centersMin(std::numeric_limits<float>::max());
+	glm::vec3 centersMax(-std::numeric_limits<float>::max());
+	float maxRadius = 0.0f;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const glm::vec4& sphere	= spheres[order[i]];
+		centersMin				= glm::min(centersMin, glm::vec3(sphere));
+		centersMax				= glm::max(centersMax, glm::vec3(sphere));
+		maxRadius				= std::max(maxRadius, sphere.w);
+	}
+
+	glm::vec3 extent = centersMax - centersMin;
+	if (end - begin <= 1 || (end - begin <= maxCount && glm::length(extent) + 2.0f * maxRadius <= spread * 2.0f * maxRadius))
+	{
+		clusterEnds.push_back(end);
+		return;
+	}
+
+	int axis		= extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	uint32_t middle	= begin + (end - begin) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&spheres, axis](uint32_t a, uint32_t b)
+	{
+		return spheres[a][axis] < spheres[b][axis];
+	});
+	SplitInstanceCluster(order, begin, middle, spheres, maxCount, spread, clusterEnds);
+	SplitInstanceCluster(order, middle, end, spheres, maxCount, spread, clusterEnds);
 }
 
 //---------------------------------------------------------------------------------------------------
-uint32_t VulkanRenderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+void VulkanRenderer::BuildDrawList()
 {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(m_physicalDevices[0], &memProperties);
+	m_drawList.clear();
+	m_drawLods.clear();
+	m_isDrawListDirty = false;
+
+	// Instances of the same mesh and material end up next to each other, each run of them is one draw
+	std::vector<uint32_t> order(m_instances.size());
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+	{
+		const SceneInstance& lhs = m_instances[a];
+		const SceneInstance& rhs = m_instances[b];
+		return lhs.mesh != rhs.mesh ? lhs.mesh < rhs.mesh : lhs.data.materialIndex < rhs.data.materialIndex;
+	});
+
+	// Object space bounds of every instance. Culling and picking levels work on unpacked positions, so
+	// this comes before the dequantization
+	std::vector<glm::vec4> spheres(m_instances.size());
+	std::vector<float> scales(m_instances.size());
+	for (uint32_t i = 0; i < m_instances.size(); ++i)
+	{
+		const glm::mat4& transform	= m_instances[i].data.transform;
+		const glm::vec4& meshSphere	= m_meshes[m_instances[i].mesh].boundingSphere;
+		scales[i]					= std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		spheres[i]					= glm::vec4(glm::vec3(transform * glm::vec4(glm::vec3(meshSphere), 1.0f)), meshSphere.w * scales[i]);
+	}
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	// A run scattered over the scene would be bounded by one sphere around all of it, never culled and
+	// always at the finest level. Each run is split into compact clusters instead, each its own draw
+	std::vector<uint32_t> clusterEnds;
+	for (uint32_t runBegin = 0; runBegin < order.size();)
 	{
-		if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		const SceneInstance& first	= m_instances[order[runBegin]];
+		uint32_t runEnd				= runBegin + 1;
+		while (runEnd < order.size() && m_instances[order[runEnd]].mesh == first.mesh && m_instances[order[runEnd]].data.materialIndex == first.data.materialIndex)
 		{
-			return i;
+			++runEnd;
+		}
+		SplitInstanceCluster(order, runBegin, runEnd, spheres, MAX_DRAW_INSTANCES, DRAW_CLUSTER_SPREAD, clusterEnds);
+		runBegin = runEnd;
+	}
+
+	std::vector<InstanceData> instances;
+	std::vector<uint32_t> drawMeshes;
+	instances.reserve(order.size());
+	uint32_t cluster	= 0;
+	uint32_t clusterEnd	= 0;
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		const SceneInstance& instance = m_instances[order[i]];
+		if (i == clusterEnd)
+		{
+			clusterEnd = clusterEnds[cluster++];
+
+			const MeshRange& mesh				= m_meshes[instance.mesh];
+			VkDrawIndexedIndirectCommand draw	= {};
+			draw.indexCount						= mesh.indexCount;
+			draw.firstIndex						= mesh.firstIndex;
+			draw.vertexOffset					= mesh.vertexOffset;
+			draw.firstInstance					= i;	// Where the cluster starts in the instance buffer
+			m_drawList.push_back(draw);
+			drawMeshes.push_back(instance.mesh);
+		}
+		++m_drawList.back().instanceCount;
+		instances.push_back(instance.data);
+	}
+
+	// Each draw is bounded by a sphere around its instances' spheres
+	m_drawLods.resize(m_drawList.size());
+	for (uint32_t i = 0; i < m_drawList.size(); ++i)
+	{
+		const VkDrawIndexedIndirectCommand& draw	= m_drawList[i];
+		DrawLodState& state							= m_drawLods[i];
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		state.errorScale = 0.0f;
+		for (uint32_t instance = draw.firstInstance; instance < draw.firstInstance + draw.instanceCount; ++instance)
+		{
+			const glm::vec4& sphere	= spheres[order[instance]];
+			boundsMin				= glm::min(boundsMin, glm::vec3(sphere) - sphere.w);
+			boundsMax				= glm::max(boundsMax, glm::vec3(sphere) + sphere.w);
+			state.errorScale		= std::max(state.errorScale, scales[order[instance]]);
+		}
+
+		glm::vec3 center	= (boundsMin + boundsMax) * 0.5f;
+		float radius		= 0.0f;
+		for (uint32_t instance = draw.firstInstance; instance < draw.firstInstance + draw.instanceCount; ++instance)
+		{
+			const glm::vec4& sphere	= spheres[order[instance]];
+			radius					= std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+		}
+		state.mesh				= drawMeshes[i];
+		state.boundingSphere	= glm::vec4(center, radius);
+	}
+
+	if (m_isGpuCulling)
+	{
+		UploadGpuCullObjects();
+	}
+
+	// Packed positions are in the unit cube of their mesh's bounds, the instance transform takes them out of it
+	if (m_isVertexCompression)
+	{
+		for (uint32_t i = 0; i < m_drawList.size(); ++i)
+		{
+			glm::mat4 dequantize = m_meshes[drawMeshes[i]].quantization.GetDequantizeMatrix();
+			for (uint32_t instance = m_drawList[i].firstInstance; instance < m_drawList[i].firstInstance + m_drawList[i].instanceCount; ++instance)
+			{
+				instances[instance].transform = instances[instance].transform * dequantize;
+			}
 		}
 	}
 
-	throw std::runtime_error("failed to find suitable memory type!");
+	if (!instances.empty())
+	{
+		VkDeviceSize bufferSize = sizeof(InstanceData) * instances.size();
+		CreateBuffer(m_logicalDevices[0], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_instanceBuffer);
+		AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instanceBufferMemory, m_instanceBuffer);
+		UploadToBuffer(m_instanceBuffer, instances.data(), bufferSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	}
+	std::cout << "draw list: " << instances.size() << " instances in " << m_drawList.size() << " draws" << std::endl;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateStagingBuffer(const VkDevice& device, VkDeviceSize size, VkBuffer& bufferToCreate, VkDeviceMemory& memoryToCreate)
+void VulkanRenderer::RebuildDrawList()
 {
-	CreateBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, bufferToCreate);
-	AllocateBufferMemory(device, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memoryToCreate, bufferToCreate);
+	PROFILE_FUNCTION();
+
+	// The instance and cull object buffers may still be read by any frame in flight
+	vkDeviceWaitIdle(m_logicalDevices[0]);
+	DestroyInstanceBuffer();
+	BuildDrawList();
+	m_uploadContext.Wait(m_uploadContext.Submit());
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyStagingBuffer(const VkDevice& device, VkBuffer& bufferToDestroy, VkDeviceMemory& memoryToFree)
+void VulkanRenderer::DestroyInstanceBuffer()
 {
-	FreeBufferMemory(device, memoryToFree);
-	DestroyBuffer(device, bufferToDestroy);
+	if (m_instanceBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	FreeBufferMemory(m_logicalDevices[0], m_instanceBufferMemory);
+	DestroyBuffer(m_logicalDevices[0], m_instanceBuffer);
+	m_instanceBuffer = VK_NULL_HANDLE;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CopyBuffer(const VkDevice& device, const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize size)
+void VulkanRenderer::CreateGpuCuller(const VkDevice& device)
 {
-	VkCommandBufferAllocateInfo allocInfo	= {};
-	allocInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level							= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool					= m_commandPool;
-	allocInfo.commandBufferCount			= 1;
+	if (!m_isGpuCulling)
+	{
+		return;
+	}
 
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, m_commandPool);
+	VkShaderModule cullShaderModule;
+	CreateShaderModule(ReadFile("EngineCode/Renderer/Shaders/DrawCull.comp.spv"), cullShaderModule);
+	m_gpuCuller.Initialize(device, m_memoryAllocator, m_descriptorAllocator, m_pipelineCache.GetCache(), cullShaderModule, m_framesInFlight, m_hasDrawIndirectCount, m_maxDrawIndirectCount, m_isOcclusionCulling);
+	DestroyShaderModule(cullShaderModule);
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset	= 0; // Optional
-	copyRegion.dstOffset	= 0; // Optional
-	copyRegion.size			= size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	VkShaderModule reduceShaderModule;
+	CreateShaderModule(ReadFile("EngineCode/Renderer/Shaders/DepthReduce.comp.spv"), reduceShaderModule);
+	m_depthPyramid.Initialize(device, m_memoryAllocator, m_descriptorAllocator, m_pipelineCache.GetCache(), reduceShaderModule);
+	DestroyShaderModule(reduceShaderModule);
 
-	EndSingleTimeCommands(device, commandBuffer, m_commandPool, m_graphicsQueue);
+	ResizeDepthPyramid();
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateIndexBuffer()
+void VulkanRenderer::ResizeDepthPyramid()
 {
-	VkDeviceSize	bufferSize = sizeof(m_indices[0]) * m_indices.size();
-	VkBuffer		stagingBuffer;
-	VkDeviceMemory	stagingBufferMemory;
-	CreateStagingBuffer(m_logicalDevices[0], bufferSize, stagingBuffer, stagingBufferMemory);
+	// The cull set binds a pyramid either way, without occlusion culling a single texel that is never built
+	if (m_isOcclusionCulling)
+	{
+		m_depthPyramid.Resize(m_swapChainExtent.width, m_swapChainExtent.height);
+	}
+	else
+	{
+		m_depthPyramid.Resize(1, 1);
+	}
+	m_gpuCuller.SetDepthPyramid(m_depthPyramid.GetView(), m_depthPyramid.GetSampler(), m_depthPyramid.GetWidth(), m_depthPyramid.GetHeight(), m_depthPyramid.GetLevelCount());
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::UploadGpuCullObjects()
+{
+	// Every mesh's levels one after the other, each object points at its mesh's
+	std::vector<uint32_t> meshFirstLods(m_meshes.size());
+	std::vector<GpuMeshLod> lods;
+	for (uint32_t mesh = 0; mesh < m_meshes.size(); ++mesh)
+	{
+		meshFirstLods[mesh] = (uint32_t)lods.size();
+		for (const MeshLod& lod : m_meshes[mesh].lods)
+		{
+			GpuMeshLod gpuLod;
+			memset(&gpuLod, 0, sizeof(gpuLod));
+			gpuLod.firstIndex	= lod.firstIndex;
+			gpuLod.indexCount	= lod.indexCount;
+			gpuLod.error		= lod.error;
+			lods.push_back(gpuLod);
+		}
+	}
 
-	void* data;
-	vkMapMemory(m_logicalDevices[0], stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_logicalDevices[0], stagingBufferMemory);
+	// One object per draw
+	std::vector<GpuDrawObject> objects(m_drawList.size());
+	for (uint32_t i = 0; i < objects.size(); ++i)
+	{
+		const VkDrawIndexedIndirectCommand& draw	= m_drawList[i];
+		const DrawLodState& state					= m_drawLods[i];
 
-	CreateBuffer(m_logicalDevices[0], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer);
-	AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBufferMemory, m_indexBuffer);
-	CopyBuffer(m_logicalDevices[0], stagingBuffer, m_indexBuffer, bufferSize);
+		GpuDrawObject& object		= objects[i];
+		memset(&object, 0, sizeof(object));
+		object.boundingSphere[0]	= state.boundingSphere.x;
+		object.boundingSphere[1]	= state.boundingSphere.y;
+		object.boundingSphere[2]	= state.boundingSphere.z;
+		object.boundingSphere[3]	= state.boundingSphere.w;
+		object.indexCount			= draw.indexCount;
+		object.instanceCount		= draw.instanceCount;
+		object.firstIndex			= draw.firstIndex;
+		object.vertexOffset			= draw.vertexOffset;
+		object.firstInstance		= draw.firstInstance;
+		object.firstLod				= meshFirstLods[state.mesh];
+		object.lodCount				= (uint32_t)m_meshes[state.mesh].lods.size();
+		object.lodErrorScale		= state.errorScale;
+	}
 
-	DestroyStagingBuffer(m_logicalDevices[0], stagingBuffer, stagingBufferMemory);
+	if (lods.size() > VulkanGpuCuller::MAX_LODS)
+	{
+		throw std::runtime_error("more levels of detail than the gpu culler was created for!");
+	}
+
+	// Levels kept for the previous objects mean nothing to the new ones, every object starts at its full mesh
+	m_gpuCuller.SetObjectCount((uint32_t)objects.size());
+	if (!objects.empty())
+	{
+		std::vector<uint32_t> lodLevels(objects.size(), 0);
+		UploadToBuffer(m_gpuCuller.GetObjectBuffer(), objects.data(), sizeof(GpuDrawObject) * objects.size(), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		UploadToBuffer(m_gpuCuller.GetLodLevelBuffer(), lodLevels.data(), sizeof(uint32_t) * lodLevels.size(), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+	if (!lods.empty())
+	{
+		UploadToBuffer(m_gpuCuller.GetLodBuffer(), lods.data(), sizeof(GpuMeshLod) * lods.size(), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::SelectDrawLods(const glm::vec3& eyePosition, float errorScale)
+{
+	// Mirrors DrawCull.comp, the picked range is what RecordMainPass draws
+	for (uint32_t i = 0; i < m_drawList.size(); ++i)
+	{
+		DrawLodState& state		= m_drawLods[i];
+		const MeshRange& mesh	= m_meshes[state.mesh];
+		float distance			= std::max(glm::length(glm::vec3(state.boundingSphere) - eyePosition) - state.boundingSphere.w, 0.0f);
+
+		state.level					= SelectLod(mesh.lods, distance, errorScale * state.errorScale, state.level);
+		m_drawList[i].firstIndex	= mesh.lods[state.level].firstIndex;
+		m_drawList[i].indexCount	= mesh.lods[state.level].indexCount;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+uint32_t VulkanRenderer::SelectLod(const std::vector<MeshLod>& lods, float distance, float errorScale, uint32_t currentLevel)
+{
+	// The coarsest level within the threshold, errors only grow along the chain. Going coarser than the
+	// current level takes a margin under the threshold, staying gets as much over it
+	uint32_t level = 0;
+	for (uint32_t candidate = 1; candidate < lods.size(); ++candidate)
+	{
+		float margin = candidate > currentLevel ? 1.0f - VulkanGpuCuller::LOD_HYSTERESIS : 1.0f + VulkanGpuCuller::LOD_HYSTERESIS;
+		if (lods[candidate].error * errorScale > margin * distance)
+		{
+			break;
+		}
+		level = candidate;
+	}
+	return level;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DestroyGpuCuller()
+{
+	m_depthPyramid.Uninitialize();
+	m_gpuCuller.Uninitialize();
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -1386,7 +2555,7 @@ void VulkanRenderer::CreateDescriptorSetLayout(const VkDevice& device)
 {
 	VkDescriptorSetLayoutBinding uboLayoutBinding	= {};
 	uboLayoutBinding.binding						= 0;
-	uboLayoutBinding.descriptorType					= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType					= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount				= 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -1420,23 +2589,21 @@ void VulkanRenderer::DestroyDescriptorSetLayout(const VkDevice& device)
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateUniformBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-	CreateStagingBuffer(m_logicalDevices[0], bufferSize, m_uniformStagingBuffer, m_uniformStagingBufferMemory);
-	CreateBuffer(m_logicalDevices[0], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, m_uniformBuffer);
-	AllocateBufferMemory(m_logicalDevices[0], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_uniformBufferMemory, m_uniformBuffer);
+	// Uniforms, dynamic vertices and instance data for a frame are all sub-allocated from this buffer
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	m_frameRingBuffer.Initialize(m_logicalDevices[0], m_physicalDevices[0], m_memoryAllocator, m_framesInFlight, FRAME_RING_BUFFER_SIZE, usage);
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::DestroyUniformBuffer()
 {
-	DestroyStagingBuffer(m_logicalDevices[0], m_uniformStagingBuffer, m_uniformStagingBufferMemory);
-	FreeBufferMemory(m_logicalDevices[0], m_uniformBufferMemory);
-	DestroyBuffer(m_logicalDevices[0], m_uniformBuffer);
+	m_frameRingBuffer.Uninitialize();
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::UpdateUniformBuffer(const VkDevice& device)
 {
+	PROFILE_FUNCTION();
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1448,118 +2615,252 @@ void VulkanRenderer::UpdateUniformBuffer(const VkDevice& device)
 	ubo.proj = glm::perspective(glm::radians(45.0f), m_swapChainExtent.width / (float)m_swapChainExtent.height, 0.1f, 10.0f);
 	ubo.proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(device, m_uniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, m_uniformStagingBufferMemory);
+	// Every draw shares the model matrix, so object space bounds are culled against the frustum in object space
+	if (m_isGpuCulling)
+	{
+		glm::mat4 clipMatrix = ubo.proj * ubo.view * ubo.model;
+		m_gpuCuller.SetClipMatrix(&clipMatrix[0][0]);
+	}
 
-	CopyBuffer(device, m_uniformStagingBuffer, m_uniformBuffer, sizeof(ubo));
+	// Levels of detail are picked in the same space, by the pixels their error covers on the render target
+	glm::vec3 eyePosition	= glm::vec3(glm::inverse(ubo.view * ubo.model)[3]);
+	float lodErrorScale		= std::abs(ubo.proj[1][1]) * m_renderExtent.height * 0.5f / LOD_ERROR_PIXELS;
+	if (m_isGpuCulling)
+	{
+		m_gpuCuller.SetLodView(&eyePosition[0], lodErrorScale);
+	}
+	else
+	{
+		SelectDrawLods(eyePosition, lodErrorScale);
+	}
 
+	// Written straight into persistently mapped memory; the offset is fed to the dynamic UBO binding
+	UNUSED(device);
+	m_frames[m_currentFrame].uniformOffset = (uint32_t)m_frameRingBuffer.Push(ubo).offset;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateDescriptorPool(const VkDevice& device)
+void VulkanRenderer::CreateDescriptorAllocator(const VkDevice& device)
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = 1;
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = 1;
-	VkDescriptorPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = poolSizes.size();
-	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = 1;
+	m_descriptorAllocator.Initialize(device, m_framesInFlight, m_hasUpdateTemplates);
 
-	if (vkCreateDescriptorPool(m_logicalDevices[0], &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS) 
-	{
-		throw std::runtime_error("failed to create descriptor pool!");
-	}
+	// Where each binding of the material set sits in MaterialDescriptorData
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries(2);
+	entries[0].dstBinding		= 0;
+	entries[0].dstArrayElement	= 0;
+	entries[0].descriptorCount	= 1;
+	entries[0].descriptorType	= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	entries[0].offset			= offsetof(MaterialDescriptorData, uniforms);
+	entries[0].stride			= sizeof(VkDescriptorBufferInfo);
+	entries[1].dstBinding		= 1;
+	entries[1].dstArrayElement	= 0;
+	entries[1].descriptorCount	= 1;
+	entries[1].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	entries[1].offset			= offsetof(MaterialDescriptorData, texture);
+	entries[1].stride			= sizeof(VkDescriptorImageInfo);
+
+	m_materialTemplate = m_descriptorAllocator.CreateTemplate(m_descriptorSetLayout, entries, sizeof(MaterialDescriptorData));
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyDescriptorPool(const VkDevice& device)
+void VulkanRenderer::DestroyDescriptorAllocator()
 {
-	vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+	m_descriptorAllocator.PrintStats();
+	m_descriptorAllocator.Uninitialize();
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateDescriptorSet(const VkDevice& device)
 {
-	VkDescriptorSetLayout layouts[] = { m_descriptorSetLayout };
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = m_descriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = layouts;
-
-	VkDescriptorImageInfo imageInfo = {};
-	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = m_textureImageView;
-	imageInfo.sampler = m_textureSampler;
+	UNUSED(device);
 
-	if (vkAllocateDescriptorSets(device, &allocInfo, &m_descriptorSet) != VK_SUCCESS) 
-	{
-		throw std::runtime_error("failed to allocate descriptor set!");
-	}
+	// Padding is part of the cache key, so the struct is cleared as a whole
+	MaterialDescriptorData data;
+	memset(&data, 0, sizeof(data));
+	data.uniforms.buffer		= m_frameRingBuffer.GetBuffer();
+	data.uniforms.offset		= 0;
+	data.uniforms.range			= sizeof(UniformBufferObject);
+	data.texture.imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	data.texture.imageView		= m_textureImageView;
+	data.texture.sampler		= m_textureSampler;
 
-	VkDescriptorBufferInfo bufferInfo = {};
-	bufferInfo.buffer = m_uniformBuffer;
-	bufferInfo.offset = 0;
-	bufferInfo.range = sizeof(UniformBufferObject);
-
-	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
-
-	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = m_descriptorSet;
-	descriptorWrites[0].dstBinding = 0;
-	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	descriptorWrites[0].descriptorCount = 1;
-	descriptorWrites[0].pBufferInfo = &bufferInfo;
+	m_descriptorSet = m_descriptorAllocator.GetCached(m_materialTemplate, &data);
+}
 
-	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[1].dstSet = m_descriptorSet;
-	descriptorWrites[1].dstBinding = 1;
-	descriptorWrites[1].dstArrayElement = 0;
-	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[1].descriptorCount = 1;
-	descriptorWrites[1].pImageInfo = &imageInfo;
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateMipGenerator(const VkDevice& device)
+{
+	VkShaderModule downsampleShaderModule;
+	CreateShaderModule(ReadFile("EngineCode/Renderer/Shaders/MipDownsample.comp.spv"), downsampleShaderModule);
+	m_mipGenerator.Initialize(device, m_physicalDevices[0], m_descriptorAllocator, m_pipelineCache.GetCache(), downsampleShaderModule, m_framesInFlight);
+	DestroyShaderModule(downsampleShaderModule);
+}
 
-	vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::DestroyMipGenerator()
+{
+	m_mipGenerator.Uninitialize();
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateTextureImage(const VkDevice& device)
 {
+	const std::string texturePath = "EngineCode/Renderer/Textures/Texture.jpg";
+
+	// Block compressed when the device samples a format worth using for the content. Only the header
+	// is read to find out whether there is alpha, the baked chain may make decoding the source unnecessary
 	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load("EngineCode/Renderer/Textures/Texture.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+	bool hasAlpha					= stbi_info(texturePath.c_str(), &texWidth, &texHeight, &texChannels) && (texChannels == 2 || texChannels == 4);
+	TextureCompression compression	= ChooseTextureCompression(hasAlpha ? TEXTURE_CONTENT_COLOR_ALPHA : TEXTURE_CONTENT_COLOR);
+
+	CompressedTexture texture;
+	if (compression != TEXTURE_COMPRESSION_NONE && LoadBakedTexture(texturePath, compression, texture))
+	{
+		CreateCompressedTextureImage(device, texture);
+		return;
+	}
+
+	stbi_uc* pixels = stbi_load(texturePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	m_textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
 
 	if (!pixels) 
 	{
 		throw std::runtime_error("failed to load texture image!");
 	}
-	VkImage			stagingImage;
-	VkDeviceMemory	stagingImageMemory;
-	CreateImage(device, stagingImage, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_LINEAR, VK_IMAGE_LAYOUT_PREINITIALIZED, texWidth, texHeight);
-	AllocateImageMemory(device, stagingImageMemory, stagingImage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	BindImage(device, stagingImage, stagingImageMemory, 0);
-	MapImage(device, stagingImage, stagingImageMemory, imageSize, texWidth, texHeight, pixels);
-	UnmapImageMemory(device, stagingImageMemory);
+
+	// A full chain when the device can generate one for the format, level 0 alone otherwise
+	VkImageUsageFlags textureUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	m_textureMipLevels = 1;
+	if (m_mipGenerator.CanGenerate(VK_FORMAT_R8G8B8A8_UNORM))
+	{
+		m_textureMipLevels	= VulkanMipGenerator::GetMipLevelCount(texWidth, texHeight);
+		textureUsage		|= m_mipGenerator.GetRequiredUsage(VK_FORMAT_R8G8B8A8_UNORM);
+	}
+
+	CreateImage(device, m_textureImage, textureUsage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, texWidth, texHeight, m_textureMipLevels);
+	AllocateImageMemory(device, m_textureImageMemory, m_textureImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	BindImage(device, m_textureImage, m_textureImageMemory);
+
+	// Pixels go straight from the decoder into the staging buffer. A chain stays in TRANSFER_DST_OPTIMAL
+	// for the mip generator, which leaves it shader readable
+	ImageUploadRegion region;
+	region.data		= pixels;
+	region.size		= (VkDeviceSize)texWidth * texHeight * 4;
+	region.extent	= { (uint32_t)texWidth, (uint32_t)texHeight, 1 };
+	UploadTextureImage(m_textureImage, VK_FORMAT_R8G8B8A8_UNORM, { region }, 4, m_textureMipLevels > 1 ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	stbi_image_free(pixels);
 
-	CreateImage(device, m_textureImage, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_PREINITIALIZED, texWidth, texHeight);
+	// Once the batch is done the chain is generated in the next frame, after the image has been acquired
+	if (m_textureMipLevels > 1)
+	{
+		VkImage textureImage		= m_textureImage;
+		uint32_t textureMipLevels	= m_textureMipLevels;
+		uint32_t textureWidth		= texWidth;
+		uint32_t textureHeight		= texHeight;
+		m_uploadContext.DeferUntilComplete([this, textureImage, textureMipLevels, textureWidth, textureHeight]()
+		{
+			m_mipGenerator.Enqueue(textureImage, VK_FORMAT_R8G8B8A8_UNORM, textureWidth, textureHeight, textureMipLevels);
+		});
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::UploadTextureImage(const VkImage& image, VkFormat format, const std::vector<ImageUploadRegion>& regions, VkDeviceSize texelBlockSize, VkImageLayout releasedLayout)
+{
+	// Every level starts out undefined, the copies fill the ones there is data for
+	TransitionImageLayout(m_uploadContext.GetCommandBuffer(), image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	m_uploadContext.UploadImage(image, regions, texelBlockSize);
+
+	// The final transition doubles as the queue ownership release when uploads run on the transfer queue
+	VkPipelineStageFlags srcStage, dstStage;
+	VkImageMemoryBarrier barrier = MakeImageLayoutBarrier(image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, releasedLayout, srcStage, dstStage);
+	m_uploadContext.ReleaseToGraphics(barrier, dstStage);
+}
+
+//---------------------------------------------------------------------------------------------------
+static VkFormat GetTextureFormat(TextureCompression compression)
+{
+	switch (compression)
+	{
+	case TEXTURE_COMPRESSION_BC1:	return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case TEXTURE_COMPRESSION_BC3:	return VK_FORMAT_BC3_UNORM_BLOCK;
+	case TEXTURE_COMPRESSION_BC5:	return VK_FORMAT_BC5_UNORM_BLOCK;
+	case TEXTURE_COMPRESSION_BC7:	return VK_FORMAT_BC7_UNORM_BLOCK;
+	default:						return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+TextureCompression VulkanRenderer::ChooseTextureCompression(TextureContent content)
+{
+	if (!m_hasTextureCompressionBC)
+	{
+		return TEXTURE_COMPRESSION_NONE;
+	}
+
+	for (TextureCompression compression : TextureCompressor::GetCandidates(content))
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(m_physicalDevices[0], GetTextureFormat(compression), &properties);
+
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if ((properties.optimalTilingFeatures & required) == required)
+		{
+			return compression;
+		}
+	}
+	return TEXTURE_COMPRESSION_NONE;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanRenderer::LoadBakedTexture(const std::string& sourcePath, TextureCompression compression, CompressedTexture& texture)
+{
+	// A bake only counts for the source it was made from. Without the source, whatever was baked is all there is
+	uint64_t sourceHash		= 0;
+	uint64_t bakedHash		= 0;
+	bool hasSource			= TextureContainer::HashSource(sourcePath, sourceHash);
+	std::string bakedPath	= TextureContainer::GetBakedPath(sourcePath, compression);
+	if (TextureContainer::Read(bakedPath, texture, &bakedHash) && texture.compression == compression)
+	{
+		if (!hasSource || bakedHash == sourceHash)
+		{
+			return true;
+		}
+		std::cout << bakedPath << " was baked from another version of " << sourcePath << ", baking it again" << std::endl;
+	}
+
+	// Not baked for this format yet. Done once here and kept on disk, so later runs load the blocks directly
+	return hasSource && TextureContainer::Bake(sourcePath, compression, texture);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRenderer::CreateCompressedTextureImage(const VkDevice& device, const CompressedTexture& texture)
+{
+	const TextureLevel& baseLevel	= texture.levels[0];
+	m_textureFormat					= GetTextureFormat(texture.compression);
+	m_textureMipLevels				= (uint32_t)texture.levels.size();
+
+	CreateImage(device, m_textureImage, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_textureFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, baseLevel.width, baseLevel.height, m_textureMipLevels);
 	AllocateImageMemory(device, m_textureImageMemory, m_textureImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	BindImage(device, m_textureImage, m_textureImageMemory, 0);
+	BindImage(device, m_textureImage, m_textureImageMemory);
 
-	TransitionImageLayout(device, m_commandPool, m_graphicsQueue, stagingImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-	TransitionImageLayout(device, m_commandPool, m_graphicsQueue, m_textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyImage(device, m_commandPool, m_graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM, stagingImage, m_textureImage, texWidth, texHeight);
-	TransitionImageLayout(device, m_commandPool, m_graphicsQueue, m_textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	// The chain is baked, so every level is copied and nothing is left to generate
+	std::vector<ImageUploadRegion> regions(texture.levels.size());
+	VkDeviceSize compressedSize	= 0;
+	VkDeviceSize uncompressedSize	= 0;
+	for (uint32_t i = 0; i < texture.levels.size(); ++i)
+	{
+		const TextureLevel& level	= texture.levels[i];
+		regions[i].data				= level.data.data();
+		regions[i].size				= level.data.size();
+		regions[i].mipLevel			= i;
+		regions[i].extent			= { level.width, level.height, 1 };
+		compressedSize				+= level.data.size();
+		uncompressedSize			+= TextureCompressor::GetLevelSize(TEXTURE_COMPRESSION_NONE, level.width, level.height);
+	}
+	UploadTextureImage(m_textureImage, m_textureFormat, regions, TextureCompressor::GetBlockSize(texture.compression), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	FreeImageMemory(device, stagingImageMemory);
-	DestroyImage(device, stagingImage);
+	std::cout << "texture: " << m_textureMipLevels << " levels of " << TextureCompressor::GetName(texture.compression) << ", " << compressedSize / 1024 << " KB instead of " << uncompressedSize / 1024 << " KB as rgba8" << std::endl;
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -1570,7 +2871,7 @@ void VulkanRenderer::DestroyTextureImage(const VkDevice& device)
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateImage(const VkDevice& device, VkImage& imageToCreate, VkFlags usage, VkFormat format, VkImageTiling tiling, VkImageLayout layout, uint32_t width, uint32_t height)
+void VulkanRenderer::CreateImage(const VkDevice& device, VkImage& imageToCreate, VkFlags usage, VkFormat format, VkImageTiling tiling, VkImageLayout layout, uint32_t width, uint32_t height, uint32_t mipLevels)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1578,7 +2879,7 @@ void VulkanRenderer::CreateImage(const VkDevice& device, VkImage& imageToCreate,
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -1601,117 +2902,28 @@ void VulkanRenderer::DestroyImage(const VkDevice& device, VkImage& imageToDestro
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::AllocateImageMemory(const VkDevice& device, VkDeviceMemory& imageMemToAllocate, const VkImage& imageToAllocateMemFor, VkMemoryPropertyFlags memPropertyFlags)
+void VulkanRenderer::AllocateImageMemory(const VkDevice& device, VulkanAllocation& imageMemToAllocate, const VkImage& imageToAllocateMemFor, VkMemoryPropertyFlags memPropertyFlags, VkImageTiling tiling)
 {
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, imageToAllocateMemFor, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, memPropertyFlags);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemToAllocate) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate image memory!");
-	}
+	UNUSED(device);
+	imageMemToAllocate = m_memoryAllocator.AllocateForImage(imageToAllocateMemFor, memPropertyFlags, tiling == VK_IMAGE_TILING_OPTIMAL);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::FreeImageMemory(const VkDevice& device, VkDeviceMemory& imageMemToFree)
+void VulkanRenderer::FreeImageMemory(const VkDevice& device, VulkanAllocation& imageMemToFree)
 {
-	vkFreeMemory(device, imageMemToFree, nullptr);
+	UNUSED(device);
+	m_memoryAllocator.Free(imageMemToFree);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::BindImage(const VkDevice& device, const VkImage& imageToBind, const VkDeviceMemory& memoryToBind, uint32_t imageOffset)
+void VulkanRenderer::BindImage(const VkDevice& device, const VkImage& imageToBind, const VulkanAllocation& memoryToBind)
 {
-	vkBindImageMemory(device, imageToBind, memoryToBind, imageOffset);
+	vkBindImageMemory(device, imageToBind, memoryToBind.memory, memoryToBind.offset);
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::MapImage(const VkDevice& device, const VkImage& imageToMap, const VkDeviceMemory& memoryToMap, uint32_t imageSize, uint32_t width, uint32_t height, void* pixels)
+VkImageMemoryBarrier VulkanRenderer::MakeImageLayoutBarrier(const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout, VkPipelineStageFlags& srcStage, VkPipelineStageFlags& dstStage)
 {
-	void* data;
-	vkMapMemory(device, memoryToMap, 0, imageSize, 0, &data);
-
-	VkImageSubresource subresource = {};
-	subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresource.mipLevel = 0;
-	subresource.arrayLayer = 0;
-
-	VkSubresourceLayout stagingImageLayout;
-	vkGetImageSubresourceLayout(device, imageToMap, &subresource, &stagingImageLayout);
-
-	if (stagingImageLayout.rowPitch == width * 4)
-	{
-		memcpy(data, pixels, (size_t)imageSize);
-	}
-	else
-	{
-		uint8_t* dataBytes = reinterpret_cast<uint8_t*>(data);
-		stbi_uc* imagePixels = (stbi_uc*)pixels;
-		for (int y = 0; y < height; y++)
-		{
-			memcpy
-			(
-				&dataBytes[y * stagingImageLayout.rowPitch],
-				&imagePixels[y * width * 4],
-				width * 4
-			);
-		}
-	}
-}
-
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::UnmapImageMemory(const VkDevice& device, const VkDeviceMemory& memoryToUnmap)
-{
-	vkUnmapMemory(device, memoryToUnmap);
-}
-
-//---------------------------------------------------------------------------------------------------
-VkCommandBuffer VulkanRenderer::BeginSingleTimeCommands(const VkDevice& device, const VkCommandPool& commandPool)
-{
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::EndSingleTimeCommands(const VkDevice& device, const VkCommandBuffer& commandBuffer, const VkCommandPool& commandPool, const VkQueue& queueToSubmit)
-{
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	vkQueueSubmit(queueToSubmit, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queueToSubmit);
-
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::TransitionImageLayout(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& queueToSubmit, const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout)
-{
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-
-
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -1736,68 +2948,34 @@ void VulkanRenderer::TransitionImageLayout(const VkDevice& device, const VkComma
 	}
 
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
-	if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) 
-	{
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) 
-	{
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) 
-	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) 
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-	}
-	else 
-	{
-		throw std::invalid_argument("unsupported layout transition!");
-	}
+	// Transitions share a command buffer with the copies around them, so the stage masks have to
+	// describe the real dependency instead of relying on a queue idle between every command
+	VulkanResourceState srcState	= VulkanResourceState::FromLayout(oldLayout);
+	VulkanResourceState dstState	= VulkanResourceState::FromLayout(newLayout);
+	barrier.srcAccessMask			= srcState.accessMask;
+	barrier.dstAccessMask			= dstState.accessMask;
+	srcStage						= srcState.stageMask;
+	dstStage						= dstState.stageMask;
 
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-	EndSingleTimeCommands(device, commandBuffer, commandPool, queueToSubmit);
+	return barrier;
 }
 
 //---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CopyImage(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& queueToSubmit, const VkFormat& format, const VkImage& srcImage, VkImage& dstImage, uint32_t width, uint32_t height)
+void VulkanRenderer::TransitionImageLayout(const VkCommandBuffer& commandBuffer, const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout)
 {
-	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
-
-	VkImageSubresourceLayers subResource = {};
-	subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subResource.baseArrayLayer = 0;
-	subResource.mipLevel = 0;
-	subResource.layerCount = 1;
-
-	VkImageCopy region = {};
-	region.srcSubresource = subResource;
-	region.dstSubresource = subResource;
-	region.srcOffset = { 0, 0, 0 };
-	region.dstOffset = { 0, 0, 0 };
-	region.extent.width = width;
-	region.extent.height = height;
-	region.extent.depth = 1;
-
-	vkCmdCopyImage(commandBuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	EndSingleTimeCommands(device, commandBuffer, commandPool, queueToSubmit);
+	VkPipelineStageFlags srcStage, dstStage;
+	VkImageMemoryBarrier barrier = MakeImageLayoutBarrier(image, format, oldLayout, newLayout, srcStage, dstStage);
+	vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::CreateTextureImageView(const VkDevice& device, const VkImage& imageToCreateViewFor, VkImageView& imageViewToCreate)
 {
-	CreateImageView(device, imageViewToCreate, imageToCreateViewFor, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	CreateImageView(device, imageViewToCreate, imageToCreateViewFor, m_textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, m_textureMipLevels);
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -1816,8 +2994,8 @@ void VulkanRenderer::CreateSampler(const VkDevice& device, VkSampler& samplerToC
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16;
+	samplerInfo.anisotropyEnable = m_maxSamplerAnisotropy > 0.0f ? VK_TRUE : VK_FALSE;
+	samplerInfo.maxAnisotropy = std::max(1.0f, m_maxSamplerAnisotropy);
 	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 	samplerInfo.unnormalizedCoordinates = VK_FALSE;
 	samplerInfo.compareEnable = VK_FALSE;
@@ -1825,7 +3003,7 @@ void VulkanRenderer::CreateSampler(const VkDevice& device, VkSampler& samplerToC
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;	// Whatever chain the view covers
 
 	if (vkCreateSampler(device, &samplerInfo, nullptr, &samplerToCreate) != VK_SUCCESS)
 	{
@@ -1860,11 +3038,22 @@ void VulkanRenderer::CreateTextureResources(const VkDevice& device, bool createI
 	}
 	CreateTextureImageView(device, m_textureImage, m_textureImageView);
 	CreateTextureSampler(device);
+
+	if (m_isBindless)
+	{
+		m_textureBindlessIndex = m_bindlessTable.AddImage(m_textureImageView, m_textureSampler);
+	}
 }
 
 //---------------------------------------------------------------------------------------------------
 void VulkanRenderer::DestroyTextureResources(const VkDevice& device, bool destroyImage)
 {
+	if (m_isBindless)
+	{
+		m_bindlessTable.ReleaseImage(m_textureBindlessIndex);
+	}
+	// The material set refers to the view and sampler, their handles may come back for other resources
+	m_descriptorAllocator.FlushCache();
 	DestroyTextureSampler(device);
 	DestroyTextureImageView(device, m_textureImageView);
 	if (destroyImage)
@@ -1873,29 +3062,6 @@ void VulkanRenderer::DestroyTextureResources(const VkDevice& device, bool destro
 	}
 }
 
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::CreateDepthResources(const VkDevice& device)
-{
-	VkFormat depthFormat = FindDepthFormat();
-
-	CreateImage(device, m_depthImage, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_PREINITIALIZED, m_swapChainExtent.width, m_swapChainExtent.height);
-	AllocateImageMemory(device, m_depthImageMemory, m_depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	BindImage(device, m_depthImage, m_depthImageMemory, 0);
-	CreateImageView(device, m_depthImageView, m_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-	TransitionImageLayout(device, m_commandPool, m_graphicsQueue, m_depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-
-}
-
-//---------------------------------------------------------------------------------------------------
-void VulkanRenderer::DestroyDepthResources(const VkDevice& device)
-{
-	DestroyImageView(device, m_depthImageView);
-	FreeImageMemory(device, m_depthImageMemory);
-	DestroyImage(device, m_depthImage);
-}
-
 //---------------------------------------------------------------------------------------------------
 VkFormat VulkanRenderer::FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
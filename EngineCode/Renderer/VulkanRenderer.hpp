@@ -6,8 +6,27 @@
 //---------------------------------------------------------------------------------------------------
 #include "BaseRenderer.hpp"
 #include "vulkan\vulkan.h"
+#include <functional>
 #include <vector>
 #include "VertexData.hpp"
+#include "VertexCompressor.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "DynamicResolution.hpp"
+#include "TextureCompressor.hpp"
+#include "VulkanBindlessTable.hpp"
+#include "VulkanDepthPyramid.hpp"
+#include "VulkanDescriptorAllocator.hpp"
+#include "VulkanGpuCuller.hpp"
+#include "VulkanGpuProfiler.hpp"
+#include "VulkanMemoryAllocator.hpp"
+#include "VulkanMipGenerator.hpp"
+#include "VulkanPipelineCache.hpp"
+#include "VulkanParallelRecorder.hpp"
+#include "VulkanPipelineDesc.hpp"
+#include "VulkanRenderGraph.hpp"
+#include "VulkanRingBuffer.hpp"
+#include "VulkanUploadContext.hpp"
 
 //---------------------------------------------------------------------------------------------------
 class BaseWindow;
@@ -18,9 +37,10 @@ struct QueueFamilyIndices
 {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
-	bool IsComplete()
+	int transferFamily = -1; // Optional, -1 when the device has no dedicated transfer family
+	bool IsComplete(bool needsPresent = true)
 	{
-		return graphicsFamily > -1 && presentFamily > -1;
+		return graphicsFamily > -1 && (presentFamily > -1 || !needsPresent);
 	}
 };
 
@@ -32,6 +52,55 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR>	presentModes;
 };
 
+//---------------------------------------------------------------------------------------------------
+// Everything the CPU touches while recording a frame. One of these exists per frame in flight so the
+// CPU can record frame N+1 while the GPU is still consuming frame N.
+struct FrameData
+{
+	VkSemaphore						imageAvailableSemaphore	= VK_NULL_HANDLE;
+	VkSemaphore						renderFinishedSemaphore	= VK_NULL_HANDLE;
+	VkFence							inFlightFence			= VK_NULL_HANDLE;
+	VkCommandPool					commandPool				= VK_NULL_HANDLE;
+	VkCommandBuffer					commandBuffer			= VK_NULL_HANDLE;
+	uint32_t						uniformOffset			= 0;
+
+	// Headless only. The color target is copied in here and handed out once inFlightFence signals
+	VkBuffer						readbackBuffer			= VK_NULL_HANDLE;
+	VulkanAllocation				readbackMemory;
+	uint64_t						readbackFrameNumber		= 0;
+	bool							readbackPending			= false;
+};
+
+//---------------------------------------------------------------------------------------------------
+// A mesh is a range of the shared vertex and index buffers
+struct MeshRange
+{
+	uint32_t						firstIndex				= 0;
+	uint32_t						indexCount				= 0;
+	int32_t							vertexOffset			= 0;
+	uint32_t						vertexCount				= 0;
+	glm::vec4						boundingSphere			= glm::vec4(0.0f);	// Object space center and radius
+	VertexQuantization				quantization;			// Bounds of the packed positions, with vertex compression
+	std::vector<MeshLod>			lods;					// Level 0 is the range above, simplified ones follow with mesh LODs
+};
+
+//---------------------------------------------------------------------------------------------------
+// What picking a draw's level of detail needs, in the space the clip matrix takes from
+struct DrawLodState
+{
+	uint32_t						mesh					= 0;
+	glm::vec4						boundingSphere			= glm::vec4(0.0f);	// Around every instance of the draw, a spatial cluster
+	float							errorScale				= 1.0f;				// Largest instance scale
+	uint32_t						level					= 0;				// Picked last frame, CPU selection only
+};
+
+//---------------------------------------------------------------------------------------------------
+struct SceneInstance
+{
+	uint32_t						mesh					= 0;
+	InstanceData					data;
+};
+
 //---------------------------------------------------------------------------------------------------
 class VulkanRenderer : public BaseRenderer
 {
@@ -45,6 +114,87 @@ public:
 
 	void OnWindowResize(int width, int height) override;
 
+	// Must be called before Initialize
+	void SetFramesInFlight(uint32_t framesInFlight);
+
+	// Must be called before Initialize. Renders into offscreen images instead of a swap chain, so no
+	// window, surface or present support is needed. Initialize(nullptr) implies a WIDTH x HEIGHT target
+	void SetHeadless(uint32_t width, uint32_t height);
+	bool IsHeadless() const { return m_isHeadless; }
+
+	// Headless frames are read back asynchronously and arrive from Update, framesInFlight frames late and
+	// in submission order. Pixels are tightly packed RGBA8 and only valid for the duration of the call
+	typedef std::function<void(const uint8_t* pixels, uint32_t width, uint32_t height, uint64_t frameNumber)> FrameReadyFunction;
+	void SetFrameReadyCallback(const FrameReadyFunction& callback);
+
+	// Waits for every submitted headless frame and delivers the ones still pending
+	void FlushReadbacks();
+
+	const VulkanGpuProfiler&	GetGpuProfiler() const { return m_gpuProfiler; }
+
+	// Must be called before Initialize. Draws then index one bindless descriptor table by a per-draw
+	// material index instead of binding a set per material. On by default, falls back to the classic
+	// path when the device lacks descriptor indexing
+	void SetBindless(bool enabled);
+	bool IsBindless() const { return m_isBindless; }
+
+	// Must be called before Initialize. Draws are culled against the frustum by a compute pass and
+	// drawn from the indirect commands it writes, so recording cost no longer grows with the draw count.
+	// On by default, falls back to recording every draw when the device lacks drawIndirectFirstInstance
+	void SetGpuCulling(bool enabled);
+	bool IsGpuCulling() const { return m_isGpuCulling; }
+
+	// Must be called before Initialize. GPU-culled draws are also tested against a depth pyramid of the
+	// previous frame, and whatever that hides is tested again against this frame's before being drawn.
+	// On by default, needs gpu culling, a sampleable depth format and storable R32_SFLOAT images
+	void SetOcclusionCulling(bool enabled);
+	bool IsOcclusionCulling() const { return m_isOcclusionCulling; }
+
+	// Must be called before Initialize. Meshes are packed into CompressedVertex as they are built,
+	// positions quantized to their mesh's bounds, and the bounds folded into each instance's transform.
+	// On by default, every format involved is mandatory for vertex buffers
+	void SetVertexCompression(bool enabled);
+	bool IsVertexCompression() const { return m_isVertexCompression; }
+
+	// Must be called before Initialize. Meshes get a chain of simplified levels of detail in the shared
+	// index buffer as they are built, see MeshSimplifier, and each draw is drawn every frame with the
+	// coarsest level whose error covers at most LOD_ERROR_PIXELS on screen. Picked by the cull shader with
+	// gpu culling, on the CPU otherwise. On by default
+	void SetMeshLods(bool enabled);
+	bool IsMeshLods() const { return m_isMeshLods; }
+
+	// Must be called before Initialize. The scene renders into an offscreen target at a fraction of the
+	// output size that follows the measured GPU frame time against the settings' budget, and is blitted
+	// up into the swap chain image. Off by default, stays off when the device cannot time frames or blit
+	// the swap chain format. The settings alone may be changed at any time
+	void SetDynamicResolution(bool enabled, const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+	void SetDynamicResolutionSettings(const DynamicResolutionSettings& settings);
+	bool IsDynamicResolution() const { return m_isDynamicResolution; }
+	float GetRenderScale() const { return m_isDynamicResolution ? m_dynamicResolution.GetScale() : 1.0f; }
+
+	// Instances persist until ClearInstances. Those sharing a mesh and a material are collapsed into
+	// instanced draws when the draw list is rebuilt, at the first Update after a change, one per spatially
+	// compact cluster of them so that each draw is culled and picks its level of detail by bounds that
+	// fit. The rebuild waits for the GPU to go idle, scenes are meant to change while loading rather than
+	// every frame
+	uint32_t AddInstance(uint32_t mesh, uint32_t material, const glm::mat4& transform, const glm::vec4& parameters = glm::vec4(1.0f));
+	void ClearInstances();
+	uint32_t GetInstanceCount() const { return (uint32_t)m_instances.size(); }
+
+	// Mesh 0 is the model loaded at startup
+	uint32_t GetMeshCount() const { return (uint32_t)m_meshes.size(); }
+
+	// The texture loaded at startup, the only material there is without bindless
+	uint32_t GetDefaultMaterial() const { return m_isBindless ? m_textureBindlessIndex : 0; }
+
+public:
+	static const uint32_t					DEFAULT_FRAMES_IN_FLIGHT	= 2;
+	static const VkDeviceSize				FRAME_RING_BUFFER_SIZE		= 4 * 1024 * 1024;
+	static const VkFormat					HEADLESS_COLOR_FORMAT		= VK_FORMAT_R8G8B8A8_UNORM;
+	static constexpr float					LOD_ERROR_PIXELS			= 1.0f;
+	static const uint32_t					MAX_DRAW_INSTANCES			= 64;	// Per cluster of instances drawn together
+	static constexpr float					DRAW_CLUSTER_SPREAD			= 4.0f;	// Cluster bounds over the largest instance's, before splitting
+
 private:
 	static VKAPI_ATTR VkBool32 VKAPI_CALL	ValidationLayerCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objType, uint64_t obj, size_t location, int32_t code, const char* layerPrefix, const char* msg, void* userData);
 
@@ -62,6 +212,7 @@ private:
 	void									DestroyPhysicalDevices();
 	QueueFamilyIndices						FindQueueFamilies(const VkPhysicalDevice& device);
 	bool									CheckDeviceExtensioSupport(const VkPhysicalDevice& device);
+	bool									IsDeviceExtensionAvailable(const VkPhysicalDevice& device, const char* extensionName);
 	void									CreateLogicalDevice(const VkPhysicalDevice& physicalDevice);
 	void									DestroyLogicalDevices();
 	void									CreateSurface();
@@ -72,8 +223,10 @@ private:
 	VkExtent2D								ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 	void									CreateSwapChain();
 	void									DestroySwapChain();
+	void									CreateOffscreenImages();
+	void									DestroyOffscreenImages();
 	void									CreateImageViews();
-	void CreateImageView(const VkDevice& device, VkImageView& imageViewToCreate, const VkImage& imageToCreateViewFor, VkFormat imageFormat, VkImageAspectFlags aspectFlags);
+	void CreateImageView(const VkDevice& device, VkImageView& imageViewToCreate, const VkImage& imageToCreateViewFor, VkFormat imageFormat, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
 	void									DestroyImageViews();
 	void									DestroyImageView(const VkDevice& device, VkImageView& imageViewToDestroy);
 	void									CreateGraphicsPipeline();
@@ -85,46 +238,62 @@ private:
 	void									DestroyRenderPass();
 	void									CreateFrameBuffers();
 	void									DestroyFrameBuffers();
-	void									CreateCommandPool();
-	void									DestroyCommandPool();
-	void									CreateCommandBuffers();
-	void									DestroyCommandBuffers();
-	void									CreateSemaphores();
-	void									DestroySemaphores();
+	void									CreateUploadContext();
+	void									DestroyUploadContext();
+	void									CreateFrameResources();
+	void									DestroyFrameResources();
+	void									RecordCommandBuffer(FrameData& frame, uint32_t imageIndex);
+	void									RecordMainPass(const VkCommandBuffer& commandBuffer, GpuCullPhase phase = GPU_CULL_PHASE_EARLY);
+	void									RecordReadback(const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph);
+	void									RecordUpscale(const VkCommandBuffer& commandBuffer, const VulkanRenderGraph& graph);
+	bool									CanUpscale();
+	bool									CanCullOcclusion(const VkPhysicalDevice& physicalDevice);
+	void									UpdateRenderExtent();
+	void									DrawOffscreen(FrameData& frame);
+	void									DeliverReadback(FrameData& frame);
 	void									RecreateSwapChain();
 	void									CreateVertexBuffer();
 	void									DestroyVertexBuffer();
 	void									CreateBuffer(const VkDevice& device, const VkDeviceSize& size, VkBufferUsageFlags usage, VkBuffer& buffer);
 	void									DestroyBuffer(const VkDevice& device, VkBuffer& bufferToFree);
-	void									AllocateBufferMemory(const VkDevice& device, VkMemoryPropertyFlags properties, VkDeviceMemory& bufferMemory, VkBuffer& bufferToAllocate);
-	void									FreeBufferMemory(const VkDevice& device, VkDeviceMemory& bufferMemory);
-	uint32_t								FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-	void									CreateStagingBuffer(const VkDevice& device, VkDeviceSize size, VkBuffer& bufferToCreate, VkDeviceMemory& memoryToCreate);
-	void									DestroyStagingBuffer(const VkDevice& device, VkBuffer& bufferToDestroy, VkDeviceMemory& memoryToFree);
-	void									CopyBuffer(const VkDevice& device, const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize size);
+	void									AllocateBufferMemory(const VkDevice& device, VkMemoryPropertyFlags properties, VulkanAllocation& bufferMemory, VkBuffer& bufferToAllocate);
+	void									FreeBufferMemory(const VkDevice& device, VulkanAllocation& bufferMemory);
+	void									UploadToBuffer(const VkBuffer& dstBuffer, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 	void									CreateIndexBuffer();
+	void									BuildMeshes();
+	void									BuildDrawList();
+	void									RebuildDrawList();
+	void									DestroyInstanceBuffer();
+	void									CreateGpuCuller(const VkDevice& device);
+	void									UploadGpuCullObjects();
+	void									SelectDrawLods(const glm::vec3& eyePosition, float errorScale);
+	static uint32_t							SelectLod(const std::vector<MeshLod>& lods, float distance, float errorScale, uint32_t currentLevel);
+	void									DestroyGpuCuller();
+	void									ResizeDepthPyramid();
 	void									DestroyIndexBuffer();
 	void									CreateDescriptorSetLayout(const VkDevice& device);
 	void									DestroyDescriptorSetLayout(const VkDevice& device);
 	void									CreateUniformBuffer();
 	void									DestroyUniformBuffer();
 	void									UpdateUniformBuffer(const VkDevice& device);
-	void									CreateDescriptorPool(const VkDevice& device);
-	void									DestroyDescriptorPool(const VkDevice& device);
+	void									CreateDescriptorAllocator(const VkDevice& device);
+	void									DestroyDescriptorAllocator();
 	void									CreateDescriptorSet(const VkDevice& device);
+	void									CreateMipGenerator(const VkDevice& device);
+	void									DestroyMipGenerator();
 	void									CreateTextureImage(const VkDevice& device);
+	void									CreateCompressedTextureImage(const VkDevice& device, const CompressedTexture& texture);
+	void									UploadTextureImage(const VkImage& image, VkFormat format, const std::vector<ImageUploadRegion>& regions, VkDeviceSize texelBlockSize, VkImageLayout releasedLayout);
+	TextureCompression						ChooseTextureCompression(TextureContent content);
+	bool									LoadBakedTexture(const std::string& sourcePath, TextureCompression compression, CompressedTexture& texture);
 	void									DestroyTextureImage(const VkDevice& device);
-	void									CreateImage(const VkDevice& device, VkImage& imageToCreate, VkFlags usage, VkFormat format, VkImageTiling tiling, VkImageLayout layout, uint32_t width, uint32_t height);
+	void									CreateImage(const VkDevice& device, VkImage& imageToCreate, VkFlags usage, VkFormat format, VkImageTiling tiling, VkImageLayout layout, uint32_t width, uint32_t height, uint32_t mipLevels = 1);
 	void									DestroyImage(const VkDevice& device, VkImage& imageToDestroy);
-	void									AllocateImageMemory(const VkDevice& device, VkDeviceMemory& imageMemToAllocate, const VkImage& imageToAllocateMemFor, VkMemoryPropertyFlags memPropertyFlags);
-	void									FreeImageMemory(const VkDevice& device, VkDeviceMemory& imageMemToFree);
-	void									BindImage(const VkDevice& device, const VkImage& imageToBind, const VkDeviceMemory& memoryToBind, uint32_t imageOffset);
-	void									MapImage(const VkDevice& device, const VkImage& imageToMap, const VkDeviceMemory& memoryToMap, uint32_t imageSize, uint32_t width, uint32_t height, void* pixels);
-	void									UnmapImageMemory(const VkDevice& device, const VkDeviceMemory& memoryToBind);
-	VkCommandBuffer							BeginSingleTimeCommands(const VkDevice& device, const VkCommandPool& commandPool);
-	void									EndSingleTimeCommands(const VkDevice& device, const VkCommandBuffer& commandBuffer, const VkCommandPool& commandPool, const VkQueue& queueToSubmit);
-	void									TransitionImageLayout(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& queueToSubmit, const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout);
-	void									CopyImage(const VkDevice& device, const VkCommandPool& commandPool, const VkQueue& queueToSubmit, const VkFormat& format, const VkImage& srcImage, VkImage& dstImage, uint32_t width, uint32_t height);
+	void									AllocateImageMemory(const VkDevice& device, VulkanAllocation& imageMemToAllocate, const VkImage& imageToAllocateMemFor, VkMemoryPropertyFlags memPropertyFlags, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL);
+	void									FreeImageMemory(const VkDevice& device, VulkanAllocation& imageMemToFree);
+	void									BindImage(const VkDevice& device, const VkImage& imageToBind, const VulkanAllocation& memoryToBind);
+	VkImageMemoryBarrier					MakeImageLayoutBarrier(const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout, VkPipelineStageFlags& srcStage, VkPipelineStageFlags& dstStage);
+	void									TransitionImageLayout(const VkCommandBuffer& commandBuffer, const VkImage& image, const VkFormat& format, const VkImageLayout& oldLayout, const VkImageLayout& newLayout);
 	void									CreateTextureImageView(const VkDevice& device, const VkImage& imageToCreateViewFor, VkImageView& imageViewToCreate);
 	void									DestroyTextureImageView(const VkDevice& device, VkImageView& imageViewToDestroy);
 	void									CreateSampler(const VkDevice& device, VkSampler& samplerToCreate);
@@ -133,8 +302,7 @@ private:
 	void									DestroyTextureSampler(const VkDevice& device);
 	void									CreateTextureResources(const VkDevice& device, bool createImage = true);
 	void									DestroyTextureResources(const VkDevice& device, bool destroyImage = true);
-	void									CreateDepthResources(const VkDevice& device);
-	void									DestroyDepthResources(const VkDevice& device);
+	void									BuildRenderGraph();
 	VkFormat								FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat								FindDepthFormat();
 	bool									HasStencilComponent(VkFormat format);
@@ -149,8 +317,16 @@ private:
 	std::vector<VkDevice>					m_logicalDevices;
 	VkSurfaceKHR							m_surface;
 	BaseWindow*								m_window;
+	bool									m_isHeadless;
+	VkExtent2D								m_headlessExtent;
+	std::vector<VulkanAllocation>			m_offscreenImageMemory;
+	FrameReadyFunction						m_frameReadyCallback;
+	uint64_t								m_frameNumber;
+	VulkanMemoryAllocator					m_memoryAllocator;
+	VulkanPipelineCache						m_pipelineCache;
 	VkQueue									m_graphicsQueue;
 	VkQueue									m_presentQueue;
+	VkQueue									m_transferQueue;
 	VkSwapchainKHR							m_swapChain;
 	std::vector<VkImage>					m_swapChainImages;
 	VkFormat								m_swapChainImageFormat;
@@ -159,31 +335,79 @@ private:
 	VkDescriptorSetLayout					m_descriptorSetLayout;
 	VkPipelineLayout						m_pipelineLayout;
 	VkRenderPass							m_renderPass;
+	VkRenderPass							m_lateRenderPass;		// Compatible with m_renderPass, loads what it stored
 	VkPipeline								m_graphicsPipeline;
 	std::vector<VkFramebuffer>				m_swapChainFrameBuffers;
-	VkCommandPool							m_commandPool;
-	std::vector<VkCommandBuffer>			m_commandBuffers;
-	VkSemaphore								m_imageAvailableSemaphore;
-	VkSemaphore								m_renderFinishedSemaphore;
+	VulkanUploadContext						m_uploadContext;
+	uint32_t								m_framesInFlight;
+	uint32_t								m_currentFrame;
+	std::vector<FrameData>					m_frames;
+	std::vector<VkFence>					m_imagesInFlight;
+	VulkanParallelRecorder					m_parallelRecorder;
+	VulkanGpuProfiler						m_gpuProfiler;
+	std::vector<MeshRange>					m_meshes;
+	std::vector<SceneInstance>				m_instances;
+	bool									m_isDrawListDirty;
+	std::vector<VkDrawIndexedIndirectCommand>	m_drawList;		// One instanced draw per mesh and material
+	std::vector<DrawLodState>				m_drawLods;		// One per draw
+	VkBuffer								m_instanceBuffer;
+	VulkanAllocation						m_instanceBufferMemory;
+	bool									m_isBindlessRequested;
+	bool									m_isBindless;
+	VulkanBindlessSupport					m_bindlessSupport;
+	VulkanBindlessTable						m_bindlessTable;
+	uint32_t								m_textureBindlessIndex;
+	bool									m_isGpuCullingRequested;
+	bool									m_isGpuCulling;
+	bool									m_hasDrawIndirectCount;
+	uint32_t								m_maxDrawIndirectCount;
+	VulkanGpuCuller							m_gpuCuller;
+	bool									m_isOcclusionCullingRequested;
+	bool									m_isOcclusionCulling;
+	VulkanDepthPyramid						m_depthPyramid;
+	VulkanRenderGraph						m_renderGraph;
+	RenderGraphResource						m_backBufferResource;
+	RenderGraphResource						m_depthResource;
+	RenderGraphResource						m_readbackResource;
+	RenderGraphResource						m_drawCommandsResource;
+	RenderGraphResource						m_drawCountResource;
+	RenderGraphResource						m_depthPyramidResource;
+	RenderGraphResource						m_visibilityResource;
+	RenderGraphResource						m_lateDrawCommandsResource;
+	RenderGraphResource						m_lateDrawCountResource;
+	RenderGraphResource						m_sceneColorResource;	// The back buffer itself without dynamic resolution
+	uint32_t								m_recordingImageIndex;	// Image the graph is being executed for
+	VkImageUsageFlags						m_swapChainImageUsage;
+	bool									m_isDynamicResolutionRequested;
+	bool									m_isDynamicResolution;
+	DynamicResolution						m_dynamicResolution;
+	VkFramebuffer							m_sceneFrameBuffer;
+	VkFilter								m_upscaleFilter;
+	VkExtent2D								m_renderExtent;			// Area of the scene target drawn this frame
+	uint64_t								m_dynamicResolutionFrame;	// Last profiler frame fed to m_dynamicResolution
 	VkBuffer								m_vertexBuffer;
-	VkDeviceMemory							m_vertexBufferMemory;
+	VkDeviceSize							m_vertexStreamOffsets[VERTEX_STREAM_COUNT];	// Every stream lives in m_vertexBuffer
+	VulkanAllocation						m_vertexBufferMemory;
 	VkBuffer								m_indexBuffer;
-	VkDeviceMemory							m_indexBufferMemory;
-	VkBuffer								m_uniformBuffer;
-	VkDeviceMemory							m_uniformBufferMemory;
-	VkBuffer								m_uniformStagingBuffer;
-	VkDeviceMemory							m_uniformStagingBufferMemory;
-	VkDescriptorPool						m_descriptorPool;
+	VulkanAllocation						m_indexBufferMemory;
+	VulkanRingBuffer						m_frameRingBuffer;
+	VulkanDescriptorAllocator				m_descriptorAllocator;
+	bool									m_hasUpdateTemplates;
+	DescriptorTemplate						m_materialTemplate;
 	VkDescriptorSet							m_descriptorSet;
+	bool									m_hasTextureCompressionBC;
 	VkImage									m_textureImage;
-	VkDeviceMemory							m_textureImageMemory;
+	VkFormat								m_textureFormat;
+	VulkanAllocation						m_textureImageMemory;
 	VkImageView								m_textureImageView;
 	VkSampler								m_textureSampler;
-	VkImage									m_depthImage;
-	VkDeviceMemory							m_depthImageMemory;
-	VkImageView								m_depthImageView;
-	std::vector<Vertex>						m_vertices;
-	std::vector<uint32_t>					m_indices;
+	uint32_t								m_textureMipLevels;
+	float									m_maxSamplerAnisotropy;	// Zero when samplerAnisotropy is not supported
+	VulkanMipGenerator						m_mipGenerator;
+	std::vector<Vertex>						m_vertices;				// As imported, packed into the vertex buffer with compression
+	bool									m_isVertexCompression;
+	std::vector<uint32_t>					m_indices;				// Every mesh's levels of detail after the meshes themselves
+	bool									m_isMeshLods;
 
 };
 #endif // !_VULKAN_RENDERER_H_
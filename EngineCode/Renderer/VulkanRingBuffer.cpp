@@ -0,0 +1,103 @@
+#include "VulkanRingBuffer.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+VulkanRingBuffer::VulkanRingBuffer()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_buffer(VK_NULL_HANDLE)
+	, m_mappedData(nullptr)
+	, m_frameCount(0)
+	, m_bytesPerFrame(0)
+	, m_minAlignment(1)
+	, m_frameBegin(0)
+	, m_head(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanRingBuffer::~VulkanRingBuffer()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRingBuffer::Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VulkanMemoryAllocator& allocator, uint32_t frameCount, VkDeviceSize bytesPerFrame, VkBufferUsageFlags usage)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_frameCount = frameCount;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	// Every sub-allocation has to be usable as a dynamic uniform/storage offset, so align to the worst case
+	m_minAlignment = std::max<VkDeviceSize>(1, deviceProperties.limits.minUniformBufferOffsetAlignment);
+	m_minAlignment = std::max(m_minAlignment, deviceProperties.limits.minStorageBufferOffsetAlignment);
+	m_bytesPerFrame = (bytesPerFrame + m_minAlignment - 1) & ~(m_minAlignment - 1);
+
+	VkBufferCreateInfo bufferInfo	= {};
+	bufferInfo.sType				= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size					= m_bytesPerFrame * m_frameCount;
+	bufferInfo.usage				= usage;
+	bufferInfo.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create ring buffer!");
+	}
+
+	// Host visible memory from the allocator is mapped for its whole lifetime. It is also coherent, so
+	// writes through m_mappedData never need flushing
+	m_memory		= m_allocator->AllocateForBuffer(m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	m_mappedData	= static_cast<uint8_t*>(m_memory.mappedData);
+
+	BeginFrame(0);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRingBuffer::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkDestroyBuffer(m_device, m_buffer, nullptr);
+	m_allocator->Free(m_memory);
+
+	m_mappedData	= nullptr;
+	m_buffer		= VK_NULL_HANDLE;
+	m_allocator		= nullptr;
+	m_device		= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	m_frameBegin	= m_bytesPerFrame * (frameIndex % m_frameCount);
+	m_head			= m_frameBegin;
+}
+
+//---------------------------------------------------------------------------------------------------
+RingAllocation VulkanRingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize align	= std::max(alignment, m_minAlignment);
+	VkDeviceSize offset	= (m_head + align - 1) / align * align;
+
+	if (offset + size > m_frameBegin + m_bytesPerFrame)
+	{
+		throw std::runtime_error("ring buffer is out of space for this frame!");
+	}
+	m_head = offset + size;
+
+	RingAllocation allocation;
+	allocation.buffer	= m_buffer;
+	allocation.offset	= offset;
+	allocation.size		= size;
+	allocation.data		= m_mappedData + offset;
+	return allocation;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef _VULKAN_RING_BUFFER_H_
+#define _VULKAN_RING_BUFFER_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanMemoryAllocator.hpp"
+#include <cstring>
+
+//---------------------------------------------------------------------------------------------------
+struct RingAllocation
+{
+	VkBuffer		buffer	= VK_NULL_HANDLE;
+	VkDeviceSize	offset	= 0;
+	VkDeviceSize	size	= 0;
+	void*			data	= nullptr;
+};
+
+//---------------------------------------------------------------------------------------------------
+// Persistently mapped, host visible buffer split into one region per frame in flight. Allocations are
+// linear bumps inside the current frame's region and are handed back wholesale by BeginFrame, which
+// must only be called once the fence of the frame that last used that region has signaled.
+class VulkanRingBuffer
+{
+public:
+	VulkanRingBuffer();
+	~VulkanRingBuffer();
+
+	void					Initialize(const VkDevice& device, const VkPhysicalDevice& physicalDevice, VulkanMemoryAllocator& allocator, uint32_t frameCount, VkDeviceSize bytesPerFrame, VkBufferUsageFlags usage);
+	void					Uninitialize();
+	void					BeginFrame(uint32_t frameIndex);
+	RingAllocation			Allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+	template<typename T>
+	RingAllocation			Push(const T& value);
+
+	VkBuffer				GetBuffer() const			{ return m_buffer; }
+	VkDeviceSize			GetBytesPerFrame() const	{ return m_bytesPerFrame; }
+	VkDeviceSize			GetBytesUsed() const		{ return m_head - m_frameBegin; }
+
+private:
+	VkDevice				m_device;
+	VulkanMemoryAllocator*	m_allocator;
+	VkBuffer				m_buffer;
+	VulkanAllocation		m_memory;
+	uint8_t*				m_mappedData;
+	uint32_t				m_frameCount;
+	VkDeviceSize			m_bytesPerFrame;
+	VkDeviceSize			m_minAlignment;
+	VkDeviceSize			m_frameBegin;
+	VkDeviceSize			m_head;
+};
+
+//---------------------------------------------------------------------------------------------------
+template<typename T>
+RingAllocation VulkanRingBuffer::Push(const T& value)
+{
+	RingAllocation allocation = Allocate(sizeof(T));
+	memcpy(allocation.data, &value, sizeof(T));
+	return allocation;
+}
+#endif // !_VULKAN_RING_BUFFER_H_
@@ -0,0 +1,448 @@
+#include "VulkanUploadContext.hpp"
+#include "Main/PrecompiledDefinitions.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+//---------------------------------------------------------------------------------------------------
+VulkanUploadContext::VulkanUploadContext()
+	: m_device(VK_NULL_HANDLE)
+	, m_allocator(nullptr)
+	, m_queue(VK_NULL_HANDLE)
+	, m_queueFamily(0)
+	, m_graphicsFamily(0)
+	, m_usesTransferQueue(false)
+	, m_commandPool(VK_NULL_HANDLE)
+	, m_isRecording(false)
+	, m_nextTicket(1)
+	, m_lastCompletedTicket(0)
+{
+
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanUploadContext::~VulkanUploadContext()
+{
+	Uninitialize();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, uint32_t graphicsFamily, const VkQueue& graphicsQueue, int transferFamily, const VkQueue& transferQueue)
+{
+	m_device			= device;
+	m_allocator			= &allocator;
+	m_graphicsFamily	= graphicsFamily;
+	m_usesTransferQueue	= transferFamily >= 0 && static_cast<uint32_t>(transferFamily) != graphicsFamily;
+	m_queueFamily		= m_usesTransferQueue ? static_cast<uint32_t>(transferFamily) : graphicsFamily;
+	m_queue				= m_usesTransferQueue ? transferQueue : graphicsQueue;
+
+	VkCommandPoolCreateInfo poolInfo	= {};
+	poolInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags						= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex			= m_queueFamily;
+
+	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::Uninitialize()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	WaitIdle();
+
+	for each (VkFence fence in m_freeFences)
+	{
+		vkDestroyFence(m_device, fence, nullptr);
+	}
+	m_freeFences.clear();
+	m_freeCommandBuffers.clear();
+	m_readyBufferAcquires.clear();
+	m_readyImageAcquires.clear();
+
+	// Destroying the pool frees every command buffer allocated from it
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+	m_commandPool	= VK_NULL_HANDLE;
+	m_allocator		= nullptr;
+	m_device		= VK_NULL_HANDLE;
+}
+
+//---------------------------------------------------------------------------------------------------
+VkCommandBuffer VulkanUploadContext::GetCommandBuffer()
+{
+	if (!m_isRecording)
+	{
+		BeginBatch();
+	}
+	return m_currentBatch.commandBuffer;
+}
+
+//---------------------------------------------------------------------------------------------------
+StagingRegion VulkanUploadContext::AllocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	GetCommandBuffer();
+
+	// Staging buffers live until the batch that reads them has retired
+	StagingRegion region;
+	if (size > STAGING_BLOCK_SIZE)
+	{
+		StagingBuffer staging = CreateStagingBuffer(size);
+		m_currentBatch.stagingBuffers.push_back(staging);
+
+		region.buffer	= staging.buffer;
+		region.offset	= 0;
+		region.data		= staging.memory.mappedData;
+		return region;
+	}
+
+	VkDeviceSize offset = (m_currentBatch.stagingHead + alignment - 1) / alignment * alignment;
+	if (m_currentBatch.stagingBlock < 0 || offset + size > m_currentBatch.stagingBuffers[m_currentBatch.stagingBlock].size)
+	{
+		m_currentBatch.stagingBuffers.push_back(CreateStagingBuffer(STAGING_BLOCK_SIZE));
+		m_currentBatch.stagingBlock = (int)m_currentBatch.stagingBuffers.size() - 1;
+		offset = 0;
+	}
+	m_currentBatch.stagingHead = offset + size;
+
+	const StagingBuffer& block = m_currentBatch.stagingBuffers[m_currentBatch.stagingBlock];
+	region.buffer	= block.buffer;
+	region.offset	= offset;
+	region.data		= static_cast<uint8_t*>(block.memory.mappedData) + offset;
+	return region;
+}
+
+//---------------------------------------------------------------------------------------------------
+VulkanUploadContext::StagingBuffer VulkanUploadContext::CreateStagingBuffer(VkDeviceSize size)
+{
+	VkBufferCreateInfo bufferInfo	= {};
+	bufferInfo.sType				= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size					= size;
+	bufferInfo.usage				= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+
+	StagingBuffer staging;
+	staging.size = size;
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &staging.buffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+	staging.memory = m_allocator->AllocateForBuffer(staging.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	return staging;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::UploadBuffer(const VkBuffer& dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+	StagingRegion staging = AllocateStaging(size);
+	memcpy(staging.data, data, static_cast<size_t>(size));
+
+	CopyBuffer(staging.buffer, dstBuffer, size, staging.offset, dstOffset);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::CopyBuffer(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
+{
+	VkBufferCopy copyRegion	= {};
+	copyRegion.srcOffset	= srcOffset;
+	copyRegion.dstOffset	= dstOffset;
+	copyRegion.size			= size;
+
+	vkCmdCopyBuffer(GetCommandBuffer(), srcBuffer, dstBuffer, 1, &copyRegion);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::UploadImage(const VkImage& dstImage, const std::vector<ImageUploadRegion>& regions, VkDeviceSize texelBlockSize)
+{
+	// Buffer offsets of a copy have to be multiples of both 4 and the texel block size, powers of two here
+	VkDeviceSize alignment = std::max<VkDeviceSize>(4, texelBlockSize);
+
+	VkDeviceSize stagingSize = 0;
+	for (const ImageUploadRegion& region : regions)
+	{
+		stagingSize = (stagingSize + alignment - 1) / alignment * alignment + region.size;
+	}
+	StagingRegion staging = AllocateStaging(stagingSize, alignment);
+
+	std::vector<VkBufferImageCopy> copies(regions.size());
+	VkDeviceSize regionOffset = 0;
+	for (size_t i = 0; i < regions.size(); ++i)
+	{
+		regionOffset = (regionOffset + alignment - 1) / alignment * alignment;
+		memcpy(static_cast<uint8_t*>(staging.data) + regionOffset, regions[i].data, static_cast<size_t>(regions[i].size));
+
+		copies[i].bufferOffset						= staging.offset + regionOffset;
+		copies[i].bufferRowLength					= 0;	// Tightly packed
+		copies[i].bufferImageHeight					= 0;
+		copies[i].imageSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+		copies[i].imageSubresource.mipLevel			= regions[i].mipLevel;
+		copies[i].imageSubresource.baseArrayLayer	= regions[i].arrayLayer;
+		copies[i].imageSubresource.layerCount		= 1;
+		copies[i].imageOffset						= { 0, 0, 0 };
+		copies[i].imageExtent						= regions[i].extent;
+		regionOffset								+= regions[i].size;
+	}
+
+	vkCmdCopyBufferToImage(GetCommandBuffer(), staging.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copies.size(), copies.data());
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::ReleaseToGraphics(VkBufferMemoryBarrier barrier, VkPipelineStageFlags dstStage)
+{
+	VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+	if (!m_usesTransferQueue)
+	{
+		// Same queue as rendering, so an ordinary barrier makes the transfer visible to later submits
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		return;
+	}
+
+	barrier.srcQueueFamilyIndex = m_queueFamily;
+	barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+	VkBufferMemoryBarrier release	= barrier;
+	release.dstAccessMask			= 0;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+
+	BufferAcquire acquire;
+	acquire.barrier					= barrier;
+	acquire.barrier.srcAccessMask	= 0;
+	acquire.dstStage				= dstStage;
+	m_currentBatch.bufferAcquires.push_back(acquire);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::ReleaseToGraphics(VkImageMemoryBarrier barrier, VkPipelineStageFlags dstStage)
+{
+	VkCommandBuffer commandBuffer = GetCommandBuffer();
+
+	if (!m_usesTransferQueue)
+	{
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		return;
+	}
+
+	// The layout transition is part of the ownership transfer, so both halves carry the same layouts
+	barrier.srcQueueFamilyIndex = m_queueFamily;
+	barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+	VkImageMemoryBarrier release	= barrier;
+	release.dstAccessMask			= 0;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+
+	ImageAcquire acquire;
+	acquire.barrier					= barrier;
+	acquire.barrier.srcAccessMask	= 0;
+	acquire.dstStage				= dstStage;
+	m_currentBatch.imageAcquires.push_back(acquire);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::DeferUntilComplete(const std::function<void()>& callback)
+{
+	GetCommandBuffer();
+	m_currentBatch.callbacks.push_back(callback);
+}
+
+//---------------------------------------------------------------------------------------------------
+UploadTicket VulkanUploadContext::Submit()
+{
+	PROFILE_FUNCTION();
+	if (!m_isRecording)
+	{
+		// Nothing recorded since the last submit, so the newest ticket already covers everything
+		return m_nextTicket - 1;
+	}
+
+	if (vkEndCommandBuffer(m_currentBatch.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record upload command buffer!");
+	}
+
+	VkSubmitInfo submitInfo			= {};
+	submitInfo.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount	= 1;
+	submitInfo.pCommandBuffers		= &m_currentBatch.commandBuffer;
+
+	if (vkQueueSubmit(m_queue, 1, &submitInfo, m_currentBatch.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	UploadTicket ticket = m_currentBatch.ticket;
+	m_inFlightBatches.push_back(std::move(m_currentBatch));
+	m_currentBatch	= UploadBatch();
+	m_isRecording	= false;
+
+	return ticket;
+}
+
+//---------------------------------------------------------------------------------------------------
+bool VulkanUploadContext::IsComplete(UploadTicket ticket)
+{
+	RetireCompletedBatches();
+	return ticket <= m_lastCompletedTicket;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::Wait(UploadTicket ticket)
+{
+	PROFILE_FUNCTION();
+	if (m_isRecording && ticket >= m_currentBatch.ticket)
+	{
+		Submit();
+	}
+
+	while (!m_inFlightBatches.empty() && m_inFlightBatches.front().ticket <= ticket)
+	{
+		UploadBatch& batch = m_inFlightBatches.front();
+		vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+		RetireBatch(batch);
+		m_inFlightBatches.pop_front();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::WaitIdle()
+{
+	Wait(m_nextTicket);
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::RecordPendingAcquires(const VkCommandBuffer& graphicsCommandBuffer)
+{
+	RetireCompletedBatches();
+
+	if (m_readyBufferAcquires.empty() && m_readyImageAcquires.empty())
+	{
+		return;
+	}
+
+	VkPipelineStageFlags dstStages = 0;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+
+	for each (const BufferAcquire& acquire in m_readyBufferAcquires)
+	{
+		bufferBarriers.push_back(acquire.barrier);
+		dstStages |= acquire.dstStage;
+	}
+	for each (const ImageAcquire& acquire in m_readyImageAcquires)
+	{
+		imageBarriers.push_back(acquire.barrier);
+		dstStages |= acquire.dstStage;
+	}
+
+	// The release already waited for the transfer, the acquire only has to block the stages that consume it
+	vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0,
+		0, nullptr,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+	m_readyBufferAcquires.clear();
+	m_readyImageAcquires.clear();
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::BeginBatch()
+{
+	RetireCompletedBatches();
+
+	if (m_freeCommandBuffers.empty())
+	{
+		VkCommandBufferAllocateInfo allocInfo	= {};
+		allocInfo.sType							= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level							= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool					= m_commandPool;
+		allocInfo.commandBufferCount			= 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+		m_freeCommandBuffers.push_back(commandBuffer);
+	}
+
+	if (m_freeFences.empty())
+	{
+		VkFenceCreateInfo fenceInfo	= {};
+		fenceInfo.sType				= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence fence;
+		if (vkCreateFence(m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload fence!");
+		}
+		m_freeFences.push_back(fence);
+	}
+
+	m_currentBatch					= UploadBatch();
+	m_currentBatch.ticket			= m_nextTicket++;
+	m_currentBatch.commandBuffer	= m_freeCommandBuffers.back();
+	m_currentBatch.fence			= m_freeFences.back();
+	m_freeCommandBuffers.pop_back();
+	m_freeFences.pop_back();
+
+	VkCommandBufferBeginInfo beginInfo	= {};
+	beginInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags						= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(m_currentBatch.commandBuffer, 0);
+	vkBeginCommandBuffer(m_currentBatch.commandBuffer, &beginInfo);
+
+	m_isRecording = true;
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::RetireCompletedBatches()
+{
+	// Batches share one queue and complete in submission order, so stop at the first one still running
+	while (!m_inFlightBatches.empty())
+	{
+		UploadBatch& batch = m_inFlightBatches.front();
+		if (vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		RetireBatch(batch);
+		m_inFlightBatches.pop_front();
+	}
+}
+
+//---------------------------------------------------------------------------------------------------
+void VulkanUploadContext::RetireBatch(UploadBatch& batch)
+{
+	for each (StagingBuffer staging in batch.stagingBuffers)
+	{
+		vkDestroyBuffer(m_device, staging.buffer, nullptr);
+		m_allocator->Free(staging.memory);
+	}
+
+	for each (const std::function<void()>& callback in batch.callbacks)
+	{
+		callback();
+	}
+
+	m_readyBufferAcquires.insert(m_readyBufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+	m_readyImageAcquires.insert(m_readyImageAcquires.end(), batch.imageAcquires.begin(), batch.imageAcquires.end());
+
+	vkResetFences(m_device, 1, &batch.fence);
+	m_freeFences.push_back(batch.fence);
+	m_freeCommandBuffers.push_back(batch.commandBuffer);
+
+	m_lastCompletedTicket = batch.ticket;
+}
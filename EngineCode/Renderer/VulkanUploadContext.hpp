@@ -0,0 +1,131 @@
+#pragma once
+
+#ifndef _VULKAN_UPLOAD_CONTEXT_H_
+#define _VULKAN_UPLOAD_CONTEXT_H_
+
+//---------------------------------------------------------------------------------------------------
+#include "vulkan\vulkan.h"
+#include "VulkanMemoryAllocator.hpp"
+#include <deque>
+#include <functional>
+#include <vector>
+
+//---------------------------------------------------------------------------------------------------
+typedef uint64_t UploadTicket;
+
+//---------------------------------------------------------------------------------------------------
+struct StagingRegion
+{
+	VkBuffer		buffer	= VK_NULL_HANDLE;
+	VkDeviceSize	offset	= 0;
+	void*			data	= nullptr;
+};
+
+//---------------------------------------------------------------------------------------------------
+// One subresource of an image upload, texels tightly packed in data
+struct ImageUploadRegion
+{
+	const void*		data		= nullptr;
+	VkDeviceSize	size		= 0;
+	uint32_t		mipLevel	= 0;
+	uint32_t		arrayLayer	= 0;
+	VkExtent3D		extent		= { 1, 1, 1 };
+};
+
+//---------------------------------------------------------------------------------------------------
+// Batches copies and barriers into one command buffer per submit instead of one blocking submit per
+// operation. Work goes to a dedicated transfer queue when the device exposes one; resources released
+// from that queue are acquired on the graphics queue by RecordPendingAcquires once their batch retires.
+// Staging allocations of a batch are packed into shared blocks, so a batch of many small uploads costs
+// a handful of buffers rather than one each.
+class VulkanUploadContext
+{
+public:
+	static const VkDeviceSize	STAGING_BLOCK_SIZE	= 8 * 1024 * 1024;	// Anything larger gets a buffer of its own
+
+public:
+	VulkanUploadContext();
+	~VulkanUploadContext();
+
+	void					Initialize(const VkDevice& device, VulkanMemoryAllocator& allocator, uint32_t graphicsFamily, const VkQueue& graphicsQueue, int transferFamily, const VkQueue& transferQueue);
+	void					Uninitialize();
+
+	VkCommandBuffer			GetCommandBuffer();
+	StagingRegion			AllocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+	void					UploadBuffer(const VkBuffer& dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+	void					CopyBuffer(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0);
+
+	// Every region in one staging allocation and one vkCmdCopyBufferToImage. The image has to be in
+	// TRANSFER_DST_OPTIMAL, texelBlockSize is the bytes of a texel or compressed block of its format
+	void					UploadImage(const VkImage& dstImage, const std::vector<ImageUploadRegion>& regions, VkDeviceSize texelBlockSize);
+	void					ReleaseToGraphics(VkBufferMemoryBarrier barrier, VkPipelineStageFlags dstStage);
+	void					ReleaseToGraphics(VkImageMemoryBarrier barrier, VkPipelineStageFlags dstStage);
+	void					DeferUntilComplete(const std::function<void()>& callback);
+
+	UploadTicket			Submit();
+	bool					IsComplete(UploadTicket ticket);
+	void					Wait(UploadTicket ticket);
+	void					WaitIdle();
+	void					RecordPendingAcquires(const VkCommandBuffer& graphicsCommandBuffer);
+
+	bool					HasDedicatedTransferQueue() const	{ return m_usesTransferQueue; }
+	uint32_t				GetQueueFamily() const				{ return m_queueFamily; }
+
+private:
+	struct StagingBuffer
+	{
+		VkBuffer			buffer	= VK_NULL_HANDLE;
+		VulkanAllocation	memory;
+		VkDeviceSize		size	= 0;
+	};
+
+	struct BufferAcquire
+	{
+		VkBufferMemoryBarrier	barrier;
+		VkPipelineStageFlags	dstStage;
+	};
+
+	struct ImageAcquire
+	{
+		VkImageMemoryBarrier	barrier;
+		VkPipelineStageFlags	dstStage;
+	};
+
+	struct UploadBatch
+	{
+		UploadTicket						ticket			= 0;
+		VkCommandBuffer						commandBuffer	= VK_NULL_HANDLE;
+		VkFence								fence			= VK_NULL_HANDLE;
+		std::vector<StagingBuffer>			stagingBuffers;
+		int									stagingBlock	= -1;	// Buffer new allocations are packed into
+		VkDeviceSize						stagingHead		= 0;
+		std::vector<std::function<void()>>	callbacks;
+		std::vector<BufferAcquire>			bufferAcquires;
+		std::vector<ImageAcquire>			imageAcquires;
+	};
+
+private:
+	void					BeginBatch();
+	StagingBuffer			CreateStagingBuffer(VkDeviceSize size);
+	void					RetireCompletedBatches();
+	void					RetireBatch(UploadBatch& batch);
+
+private:
+	VkDevice					m_device;
+	VulkanMemoryAllocator*		m_allocator;
+	VkQueue						m_queue;
+	uint32_t					m_queueFamily;
+	uint32_t					m_graphicsFamily;
+	bool						m_usesTransferQueue;
+	VkCommandPool				m_commandPool;
+	bool						m_isRecording;
+	UploadBatch					m_currentBatch;
+	std::deque<UploadBatch>		m_inFlightBatches;
+	std::vector<VkCommandBuffer>	m_freeCommandBuffers;
+	std::vector<VkFence>		m_freeFences;
+	std::vector<BufferAcquire>	m_readyBufferAcquires;
+	std::vector<ImageAcquire>	m_readyImageAcquires;
+	UploadTicket				m_nextTicket;
+	UploadTicket				m_lastCompletedTicket;
+};
+#endif // !_VULKAN_UPLOAD_CONTEXT_H_
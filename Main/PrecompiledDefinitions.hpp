@@ -6,4 +6,9 @@
 #define UNUSED (void)
 #endif // !UNUSED
 
+// Define to 0 in the project settings to compile every PROFILE_* zone and the CPU profiler out entirely
+#ifndef DEEPSRI_PROFILER_ENABLED
+#define DEEPSRI_PROFILER_ENABLED 1
+#endif // !DEEPSRI_PROFILER_ENABLED
+
 #endif // !_PRECOMPILED_DEFINITIONS_H_
\ No newline at end of file
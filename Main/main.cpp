@@ -1,14 +1,181 @@
 //---------------------------------------------------------------------------------------------------
 #include "Main/PrecompiledDefinitions.hpp"
 #include "EngineCode/App/Win32VulkanApp.hpp"
+#include "EngineCode/App/HeadlessVulkanApp.hpp"
+#include "EngineCode/Profiler/CpuProfiler.hpp"
+#include "EngineCode/Renderer/Mesh.hpp"
+#include "EngineCode/Renderer/TextureContainer.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <stdexcept>
+#include <string>
+#include <vector>
 #include <iostream>
 
 
 //---------------------------------------------------------------------------------------------------
-int main()
+// --bake-texture source [bc1|bc3|bc5|bc7]...
+static bool BakeTexture(const std::vector<std::string>& args)
 {
-	BaseApp* app = new Win32VulkanApp();
+	if (args.size() < 2)
+	{
+		std::cerr << "usage: --bake-texture source [bc1|bc3|bc5|bc7]..." << std::endl;
+		return false;
+	}
+
+	std::vector<TextureCompression> compressions;
+	for (size_t i = 2; i < args.size(); ++i)
+	{
+		bool isKnown = false;
+		for (TextureCompression compression : { TEXTURE_COMPRESSION_BC1, TEXTURE_COMPRESSION_BC3, TEXTURE_COMPRESSION_BC5, TEXTURE_COMPRESSION_BC7 })
+		{
+			if (args[i] == TextureCompressor::GetName(compression))
+			{
+				compressions.push_back(compression);
+				isKnown = true;
+			}
+		}
+		if (!isKnown)
+		{
+			std::cerr << "--bake-texture: unknown format " << args[i] << std::endl;
+			return false;
+		}
+	}
+
+	// Without a format, every one a device may pick for a colour texture
+	if (compressions.empty())
+	{
+		compressions = { TEXTURE_COMPRESSION_BC7, TEXTURE_COMPRESSION_BC3, TEXTURE_COMPRESSION_BC1 };
+	}
+
+	for (TextureCompression compression : compressions)
+	{
+		CompressedTexture texture;
+		bool isWritten = false;
+		if (!TextureContainer::Bake(args[1], compression, texture, &isWritten) || !isWritten)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+static void PrintMeshStats(const char* label, const MeshCacheStats& stats)
+{
+	std::cout << label << ": " << stats.triangleCount << " triangles, " << stats.vertexCount << " vertices, ACMR " << stats.acmr << ", ATVR " << stats.atvr << ", overfetch " << stats.overfetch << std::endl;
+}
+
+//---------------------------------------------------------------------------------------------------
+// --analyze-mesh source.obj [cacheSize]
+static bool AnalyzeMesh(const std::vector<std::string>& args)
+{
+	if (args.size() < 2)
+	{
+		std::cerr << "usage: --analyze-mesh source.obj [cacheSize]" << std::endl;
+		return false;
+	}
+	uint32_t cacheSize = args.size() > 2 ? (uint32_t)std::max(3, atoi(args[2].c_str())) : MeshOptimizer::DEFAULT_CACHE_SIZE;
+
+	Mesh mesh;
+	mesh.LoadMesh(args[1]);
+	MeshCacheStats before = mesh.Analyze(cacheSize);
+	PrintMeshStats("before", before);
+	mesh.Optimize();
+	MeshCacheStats after = mesh.Analyze(cacheSize);
+	PrintMeshStats("after", after);
+
+	// The overdraw pass may give up this much of the cache order, anything worse is a regression
+	const float tolerance = MeshOptimizer::DEFAULT_OVERDRAW_THRESHOLD;
+	if (after.acmr > before.acmr * tolerance || after.atvr > before.atvr * tolerance)
+	{
+		std::cerr << "reordering made the vertex cache efficiency worse!" << std::endl;
+		return false;
+	}
+
+	mesh.BuildLods();
+	for (uint32_t level = 0; level < mesh.GetLods().size(); ++level)
+	{
+		std::cout << "lod " << level << ": " << mesh.GetLods()[level].indexCount / 3 << " triangles, error " << mesh.GetLods()[level].error << std::endl;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// DeepSri.exe [--trace trace.json] [--frame-budget ms] [--headless [frameCount] [output.ppm]]
+// DeepSri.exe --bake-texture source [bc1|bc3|bc5|bc7]...
+// DeepSri.exe --analyze-mesh source.obj [cacheSize]
+// --headless renders offscreen without creating a window, --trace captures a CPU profile of the whole
+// run and writes it as Chrome trace JSON on exit. --frame-budget scales the render resolution to keep
+// GPU frame time within ms. --bake-texture compresses a texture and its mip chain offline into a DDS
+// per format next to it, which the renderer then loads instead of the source. --analyze-mesh reports
+// the vertex cache and fetch efficiency of a mesh before and after the import-time reordering, and the
+// levels of detail it simplifies into. It fails if the reordering made ACMR or ATVR worse
+int main(int argc, char** argv)
+{
+	std::vector<std::string> args;
+	std::string tracePath;
+	float frameBudgetMilliseconds = 0.0f;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			tracePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+		{
+			frameBudgetMilliseconds = std::max(0.0f, (float)atof(argv[++i]));
+		}
+		else
+		{
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (!args.empty() && args[0] == "--bake-texture")
+	{
+		return BakeTexture(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (!args.empty() && args[0] == "--analyze-mesh")
+	{
+		try
+		{
+			return AnalyzeMesh(args) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		catch (const std::runtime_error& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool headless = !args.empty() && args[0] == "--headless";
+
+	BaseApp* app = nullptr;
+	if (headless)
+	{
+		uint32_t frameCount		= args.size() > 1 ? (uint32_t)std::max(1, atoi(args[1].c_str())) : HeadlessVulkanApp::DEFAULT_FRAME_COUNT;
+		std::string outputPath	= args.size() > 2 ? args[2] : "HeadlessFrame.ppm";
+		app = new HeadlessVulkanApp(800, 600, frameCount, outputPath, frameBudgetMilliseconds);
+	}
+	else
+	{
+		app = new Win32VulkanApp(frameBudgetMilliseconds);
+	}
+
+#if DEEPSRI_PROFILER_ENABLED
+	PROFILE_THREAD_NAME("Main");
+	if (!tracePath.empty())
+	{
+		CpuProfiler::BeginCapture();
+	}
+#else
+	if (!tracePath.empty())
+	{
+		std::cerr << "--trace ignored, the CPU profiler is compiled out" << std::endl;
+	}
+#endif // DEEPSRI_PROFILER_ENABLED
 
 	try 
 	{
@@ -20,7 +187,20 @@ int main()
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
-	std::cout << "Press enter to exit" << std::endl;
-	getchar();
+
+#if DEEPSRI_PROFILER_ENABLED
+	if (!tracePath.empty())
+	{
+		CpuProfiler::EndCapture();
+		CpuProfiler::WriteChromeTrace(tracePath);
+	}
+#endif // DEEPSRI_PROFILER_ENABLED
+
+	// Nobody is around to press enter on a headless run
+	if (!headless)
+	{
+		std::cout << "Press enter to exit" << std::endl;
+		getchar();
+	}
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -7,38 +7,100 @@
 #include "ExtLibs/GLM/glm/glm.hpp"
 #include <array>
 #include "vulkan/vulkan.h"
+#include "EngineCode/Renderer/VertexLayout.hpp"
 
 //---------------------------------------------------------------------------------------------------
+// Full precision, as meshes are imported. Normal and tangent sit at locations 9 and 10, after the
+// per-instance attributes. See VERTEX_LAYOUT for how it reaches the GPU
 struct Vertex
 {
 	glm::vec3	pos;
 	glm::vec3	color;
 	glm::vec2	texCoords;
+	glm::vec3	normal;
+	glm::vec4	tangent;	// w is the handedness of the bitangent, +1 or -1
+};
+
+//---------------------------------------------------------------------------------------------------
+// A Vertex packed into 24 bytes by VertexCompressor, at the same locations, see COMPRESSED_VERTEX_LAYOUT.
+// Every format here is one the spec requires for vertex buffers, so no device lacks it.
+//  - pos is 16-bit unorm within its mesh's bounds. The mesh's dequantize matrix maps it back and is
+//    folded into the instance transform, so shaders take it as they would a float position. w holds the
+//    tangent's handedness as 0 or 1.
+//  - normal and tangent are octahedral, two 16-bit snorm each. A shader that needs them unpacks with
+//    n = vec3(e, 1 - |e.x| - |e.y|), n.xy -= max(-n.z, 0) * sign(n.xy), normalize(n), with sign
+//    taken as +1 at zero.
+//  - color is 8-bit unorm and texCoords are half floats, so tiling coordinates stay representable.
+struct CompressedVertex
+{
+	uint16_t	pos[4];
+	int16_t		normal[2];
+	int16_t		tangent[2];
+	uint8_t		color[4];
+	uint16_t	texCoords[2];
+};
+
+//---------------------------------------------------------------------------------------------------
+// Position alone in the first stream, everything else in the second
+constexpr VertexLayout<Vertex, 5> VERTEX_LAYOUT
+({{
+	{ 0,	VK_FORMAT_R32G32B32_SFLOAT,		VERTEX_STREAM_POSITION,		offsetof(Vertex, pos) },
+	{ 1,	VK_FORMAT_R32G32B32_SFLOAT,		VERTEX_STREAM_ATTRIBUTES,	offsetof(Vertex, color) },
+	{ 2,	VK_FORMAT_R32G32_SFLOAT,		VERTEX_STREAM_ATTRIBUTES,	offsetof(Vertex, texCoords) },
+	{ 9,	VK_FORMAT_R32G32B32_SFLOAT,		VERTEX_STREAM_ATTRIBUTES,	offsetof(Vertex, normal) },
+	{ 10,	VK_FORMAT_R32G32B32A32_SFLOAT,	VERTEX_STREAM_ATTRIBUTES,	offsetof(Vertex, tangent) },
+}});
+static_assert(VERTEX_LAYOUT.IsComplete(), "VERTEX_LAYOUT has to describe every member of Vertex exactly once");
+
+//---------------------------------------------------------------------------------------------------
+// 8 bytes of position and 16 of the rest
+constexpr VertexLayout<CompressedVertex, 5> COMPRESSED_VERTEX_LAYOUT
+({{
+	{ 0,	VK_FORMAT_R16G16B16A16_UNORM,	VERTEX_STREAM_POSITION,		offsetof(CompressedVertex, pos) },
+	{ 9,	VK_FORMAT_R16G16_SNORM,			VERTEX_STREAM_ATTRIBUTES,	offsetof(CompressedVertex, normal) },
+	{ 10,	VK_FORMAT_R16G16_SNORM,			VERTEX_STREAM_ATTRIBUTES,	offsetof(CompressedVertex, tangent) },
+	{ 1,	VK_FORMAT_R8G8B8A8_UNORM,		VERTEX_STREAM_ATTRIBUTES,	offsetof(CompressedVertex, color) },
+	{ 2,	VK_FORMAT_R16G16_SFLOAT,		VERTEX_STREAM_ATTRIBUTES,	offsetof(CompressedVertex, texCoords) },
+}});
+static_assert(COMPRESSED_VERTEX_LAYOUT.IsComplete(), "COMPRESSED_VERTEX_LAYOUT has to describe every member of CompressedVertex exactly once");
+
+//---------------------------------------------------------------------------------------------------
+// Per-instance attributes, stepped once per instance from binding 1. An instanced draw's firstInstance
+// is the index of its first InstanceData in the instance buffer
+struct InstanceData
+{
+	glm::mat4	transform;
+	glm::vec4	parameters;		// Free for the shaders, the default ones tint the texture with it
+	uint32_t	materialIndex;	// Bindless image index, ignored without bindless
 
-	static VkVertexInputBindingDescription GetBindingDescription() 
+	static VkVertexInputBindingDescription GetBindingDescription()
 	{
 		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding		= 0;
-		bindingDescription.stride		= sizeof(Vertex);
-		bindingDescription.inputRate	= VK_VERTEX_INPUT_RATE_VERTEX;
+		bindingDescription.binding		= 1;
+		bindingDescription.stride		= sizeof(InstanceData);
+		bindingDescription.inputRate	= VK_VERTEX_INPUT_RATE_INSTANCE;
 		return bindingDescription;
 	}
 
-	static std::array<VkVertexInputAttributeDescription, 3> GetAttributeDescriptions()
+	// A mat4 attribute takes one location per column, locations 3 to 6
+	static std::array<VkVertexInputAttributeDescription, 6> GetAttributeDescriptions()
 	{
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-		attributeDescriptions[0].binding	= 0;
-		attributeDescriptions[0].location	= 0;
-		attributeDescriptions[0].format		= VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset		= offsetof(Vertex, pos);
-		attributeDescriptions[1].binding	= 0;
-		attributeDescriptions[1].location	= 1;
-		attributeDescriptions[1].format		= VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset		= offsetof(Vertex, color);
-		attributeDescriptions[2].binding	= 0;
-		attributeDescriptions[2].location	= 2;
-		attributeDescriptions[2].format		= VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset		= offsetof(Vertex, texCoords);
+		std::array<VkVertexInputAttributeDescription, 6> attributeDescriptions = {};
+		for (uint32_t column = 0; column < 4; ++column)
+		{
+			attributeDescriptions[column].binding	= 1;
+			attributeDescriptions[column].location	= 3 + column;
+			attributeDescriptions[column].format	= VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[column].offset	= offsetof(InstanceData, transform) + column * sizeof(glm::vec4);
+		}
+		attributeDescriptions[4].binding	= 1;
+		attributeDescriptions[4].location	= 7;
+		attributeDescriptions[4].format		= VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[4].offset		= offsetof(InstanceData, parameters);
+		attributeDescriptions[5].binding	= 1;
+		attributeDescriptions[5].location	= 8;
+		attributeDescriptions[5].format		= VK_FORMAT_R32_UINT;
+		attributeDescriptions[5].offset		= offsetof(InstanceData, materialIndex);
 
 		return attributeDescriptions;
 	}